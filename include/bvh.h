@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "opengl.h"
+#include "vao.h"
+#include "culling.h"
+
+struct Scene;
+
+
+// ---- BOUNDING VOLUME HIERARCHY ----
+// A binary tree of boxes over items that only have bounds, built with the surface area heuristic so that queries visit
+// as few nodes as they can. Picking uses two levels of them: a MeshBvh over the triangles of every mesh, built once
+// when the mesh is loaded, and a Bvh over the meshes of a model as placed in the scene, which is cheap to build and
+// refit when the scene moves. Only the meshes the ray reaches are searched for triangles.
+
+struct BvhNode
+{
+    Bounds bounds;
+    std::uint32_t first;  // Of the leaf's items in Bvh::items, or of the second child. The first child follows the node.
+    std::uint32_t count;  // Of the leaf's items, or 0 if it's not a leaf.
+};
+
+struct Bvh
+{
+    std::vector<BvhNode> nodes;        // Depth first, from the root. Empty if there are no items.
+    std::vector<std::uint32_t> items;  // Indices of the items, grouped by leaf.
+};
+
+// Builds the tree over 'count' items with the given bounds, with at most 'max_leaf_items' items per leaf.
+void Build(Bvh& bvh, const Bounds* bounds, std::size_t count, unsigned max_leaf_items = 4);
+// Recomputes the bounds of the nodes for new bounds of the same items, keeping the tree. Much faster than building it
+// again, but queries get slower the farther the items move from where they were when it was built.
+void Refit(Bvh& bvh, const Bounds* bounds);
+
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;  // Distances along the ray are in multiples of its length.
+};
+
+// The ray through a point on the screen, in normalized device coordinates, from the near plane of 'view_projection'.
+Ray RayThrough(const glm::mat4& view_projection, const glm::vec2& point);
+// The distance along the ray to where it enters the box, or INFINITY if it misses it.
+float Intersect(const Ray& ray, const Bounds& bounds);
+
+// Visits the leaves the ray passes through, nearest first, and calls 'hit' for their items. 'hit' gets the distance of
+// the closest hit so far and returns the distance of its own, or INFINITY if the ray misses the item. Leaves behind
+// the closest hit are skipped. Returns the distance of the closest hit, at most 'max_distance'.
+float Raycast(const Bvh& bvh, const Ray& ray, float max_distance, const std::function<float(std::uint32_t item, float closest)>& hit);
+
+// Appends the items whose bounds intersect the frustum, or the sphere, to 'items'. Returns how many were appended.
+std::size_t Query(const Bvh& bvh, const Bounds* bounds, const Frustum& frustum, std::vector<std::uint32_t>& items);
+std::size_t Query(const Bvh& bvh, const Bounds* bounds, const glm::vec3& center, float radius, std::vector<std::uint32_t>& items);
+// Replaces 'items' by the 'k' items whose bounds are nearest to 'point' (at distance 0 if it's inside), nearest first.
+void Nearest(const Bvh& bvh, const Bounds* bounds, const glm::vec3& point, std::size_t k, std::vector<std::uint32_t>& items);
+
+
+// The triangles of a mesh with a tree over them, in model space.
+struct MeshBvh
+{
+    Bvh bvh;
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices;  // Three per triangle, in the order of the mesh.
+};
+
+// Over the triangles in 'indices', usually the ones of LOD 0.
+std::shared_ptr<MeshBvh> BuildMeshBvh(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count);
+
+struct RayHit
+{
+    std::uint32_t mesh     = ~std::uint32_t(0);  // Of the model, if it's a hit on a model.
+    std::uint32_t triangle = ~std::uint32_t(0);  // Of the mesh's triangles, i.e. its indices from 3 * triangle on.
+    float distance = INFINITY;
+};
+
+// Whether the ray hits a triangle of the mesh closer than hit.distance, in which case the hit is replaced.
+bool Raycast(const MeshBvh& mesh, const Ray& ray, RayHit& hit);
+
+// The world bounds of the meshes of the model, as placed by the scene from 'first_node' on (see AddModel), to build
+// or refit a Bvh over them.
+void MeshBounds(const TexturedModel& model, const Scene& scene, std::uint32_t first_node, std::vector<Bounds>& bounds);
+// Whether the ray, in world space, hits a triangle of one of the meshes in 'bvh' closer than hit.distance, in which
+// case the hit is replaced. Meshes without a MeshBvh are never hit.
+bool Raycast(const Bvh& bvh, const TexturedModel& model, const Scene& scene, std::uint32_t first_node, const Ray& ray, RayHit& hit);
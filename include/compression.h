@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "errors.h"
+#include "opengl.h"
+#include "mipmaps.h"
+
+
+// ---- BLOCK COMPRESSION ----
+// CPU encoders for the BCn formats, so textures take 4-8 times less memory on the GPU than as GL_RGB(A). Every format
+// encodes blocks of 4x4 pixels:
+//     BC1  8 bytes  RGB.                          Opaque color maps (diffuse, specular).
+//     BC3 16 bytes  RGB as BC1 + alpha as BC4.    Color maps with alpha, if BC7 isn't supported.
+//     BC4  8 bytes  One channel.                  Height maps and other single channel maps.
+//     BC5 16 bytes  Two channels as two BC4.      Normal maps; z is reconstructed as sqrt(1 - x*x - y*y).
+//     BC7 16 bytes  RGBA, only mode 6 is used.    Color maps with alpha.
+//
+// Cooked textures (with their full mip chain, compressed or not) are stored as DDS files in 'texture_cache_directory',
+// named after a hash of the source file and the role of the texture.
+enum BlockFormat { UNCOMPRESSED, BC1, BC3, BC4, BC5, BC7 };
+
+struct CookedImage
+{
+    BlockFormat format = UNCOMPRESSED;
+    int components = 4;             // Of UNCOMPRESSED images; block compressed ones are always decoded as RGBA.
+    std::vector<MipLevel> levels;   // Largest first, down to 1x1.
+    std::vector<unsigned char> data;
+};
+
+// Bit mask of (1 << BlockFormat) of the formats the OpenGL context can sample. Set with DetectBlockFormats on the
+// OpenGL thread before any texture is requested. Only UNCOMPRESSED by default.
+extern unsigned supported_block_formats;
+extern std::string texture_cache_directory;
+
+// Queries the context for the supported formats. BC4 and BC5 are core since OpenGL 3.0, BC1 and BC3 need
+// EXT_texture_compression_s3tc and BC7 needs OpenGL 4.2 or ARB_texture_compression_bptc.
+unsigned DetectBlockFormats();
+
+// The format a texture used as 'type' (e.g. "texture_diffuse") should be compressed to, given the supported formats.
+// Returns UNCOMPRESSED if there is no fitting format.
+BlockFormat FormatFor(const std::string& type, const unsigned char* pixels, int width, int height, int components, unsigned supported);
+
+std::size_t BlockSize(BlockFormat format);
+std::size_t LevelSize(BlockFormat format, int components, int width, int height);
+const char* FormatName(BlockFormat format);
+GLenum GLFormat(BlockFormat format);
+
+// Generates the full mip chain of the image (see mipmaps.h) and encodes every level in 'format'. The blocks are encoded
+// in parallel. UNCOMPRESSED keeps the components of the image.
+CookedImage Cook(const unsigned char* pixels, int width, int height, int components, BlockFormat format, bool srgb);
+
+// Encodes/decodes a single level of tightly packed RGBA pixels. Decoding is used to verify the encoders.
+void EncodeBlocks(BlockFormat format, const unsigned char* rgba, int width, int height, unsigned char* blocks);
+void DecodeBlocks(BlockFormat format, const unsigned char* blocks, int width, int height, unsigned char* rgba);
+
+// Creates a texture of all levels, with glCompressedTexImage2D if they're block compressed.
+GLuint UploadCooked(const CookedImage& image);
+
+// Where a texture with content hash 'key' is cached when it's used as 'type', with the current supported formats.
+std::string CookedTexturePath(unsigned long long key, const std::string& type);
+Return<CookedImage> ReadDDS(const std::string& path);
+// Written under a temporary name and then renamed, like the mesh cache.
+Return<bool> WriteDDS(const std::string& path, const CookedImage& image);
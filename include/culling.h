@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "vao.h"
+
+
+// ---- CULLING ----
+// Objects are culled by their bounding boxes and spheres against the planes of the view frustum. For many objects at
+// once, the volumes are kept in a BoundsTable, whose structure of arrays lets CullBounds test CULL_WIDTH of them per
+// instruction: 8 with AVX, when the build enables it, 4 with SSE, or 1 on other targets.
+
+// The planes of a view frustum, as (normal, distance) with normalized normals pointing inwards: a point p is inside
+// when dot(normal, p) + distance >= 0 for all of them.
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// The frustum of a projection matrix (Gribb and Hartmann). If it's projection * view * model, the planes are in model
+// space.
+Frustum ExtractFrustum(const glm::mat4& matrix);
+bool Intersects(const Frustum& frustum, const glm::vec3& center, float radius);
+
+// The axis aligned box around the transformed box, and the sphere around the transformed sphere.
+Bounds TransformBounds(const Bounds& bounds, const glm::mat4& matrix);
+Sphere TransformSphere(const Sphere& sphere, const glm::mat4& matrix);
+
+
+#if defined(__AVX__)
+static const unsigned CULL_WIDTH = 8;
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+static const unsigned CULL_WIDTH = 4;
+#else
+static const unsigned CULL_WIDTH = 1;
+#endif
+
+// Tables with at least this many objects are culled by more than one thread.
+static const std::size_t CULL_THREADING_THRESHOLD = 32768;
+
+// An object is culled when either its box or its sphere is entirely outside one of the planes, as both contain it.
+struct BoundsTable
+{
+    std::vector<float> center_x, center_y, center_z;  // Of the box, which is also the center of the sphere.
+    std::vector<float> extent_x, extent_y, extent_z;  // Half the sides of the box.
+    std::vector<float> radius;                        // Of the sphere.
+};
+
+// Makes room for 'count' objects, whose bounds are undefined until they're Set.
+void Reset(BoundsTable& table, std::size_t count);
+// The sphere is moved to the center of the box, so it must contain the object from there.
+void Set(BoundsTable& table, std::size_t index, const Bounds& bounds, float radius);
+
+// Sets visible[i] to 1 if object i may be in the frustum and to 0 if it's not, for every object in the table. Large
+// tables are split between 'thread_count' threads (0 meaning HardwareThreads()). Returns the number of visible objects.
+std::size_t CullBounds(const BoundsTable& table, const Frustum& frustum, std::vector<std::uint8_t>& visible, unsigned thread_count = 0);
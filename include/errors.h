@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <utility>
 
 #define CreateError(message, ...) CreateErrorImplementation(__FUNCTION__, __FILE__, __LINE__, message, __VA_ARGS__)
 
@@ -25,16 +26,16 @@ struct Return
     Type value;
     const Error* error = no_error;
 
-    Return(Type value) : value(value) {}
+    Return(Type value) : value(std::move(value)) {}
     Return(const Error* error) : error(error) {}
 };
 
 // Check for errors and terminates the program if an error has occurred.
 template <typename Type>
-Type Check(const Return<Type>&& x)
+Type Check(Return<Type>&& x)
 {
     if (!x.error)
-        return x.value;
+        return std::move(x.value);
 
     Print(*x.error);
 
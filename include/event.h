@@ -30,7 +30,8 @@ struct MouseClick : public Event
 
     Button button;
     Event  event;
-    MouseClick(Button button, Event event) : button(button), event(event) { type = MOUSE_CLICK; }
+    float x, y;  // Of the cursor, in screen coordinates from the top left corner of the window.
+    MouseClick(Button button, Event event, float x = 0.0f, float y = 0.0f) : button(button), event(event), x(x), y(y) { type = MOUSE_CLICK; }
 };
 
 struct MouseMovement : public Event
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "opengl.h"
+#include "vao.h"
+
+
+// ---- GEOMETRY ARENA ----
+// All meshes share a few large vertex and index buffers instead of having their own. Every vertex format has its own
+// blocks, each a vertex buffer, an index buffer and the one vertex array object that reads them, so drawing meshes of
+// the same format and block needs no rebinding. A mesh is an allocation of a range of vertices and a range of indices
+// in a block, drawn with glDrawElementsBaseVertex (its indices stay relative to its own vertices, so 16 bit indices
+// still work). Blocks are created as they fill up and are never resized, so allocations only move when the arena is
+// defragmented, which packs the allocations of a block into new buffers.
+
+// Hands out ranges of [0, capacity). Free ranges are kept by offset, to merge neighbors when ranges are freed, and by
+// size, to find the smallest one that fits.
+struct FreeList
+{
+    std::map<std::size_t, std::size_t> by_offset;       // Offset -> size.
+    std::multimap<std::size_t, std::size_t> by_size;    // Size -> offset.
+    std::size_t capacity = 0;
+    std::size_t used     = 0;
+};
+
+void Create(FreeList& list, std::size_t capacity);
+// Returns false if there's no free range of 'size'.
+bool Allocate(FreeList& list, std::size_t size, std::size_t& offset);
+void Free(FreeList& list, std::size_t offset, std::size_t size);
+// 0 if the free space is one range, towards 1 the more it's split up.
+float Fragmentation(const FreeList& list);
+
+
+struct GeometryBlock
+{
+    GLuint vao, vbo, ebo;
+    FreeList vertices;  // In vertices of the block's format, so every offset is a valid base vertex.
+    FreeList indices;   // In bytes, always a multiple of 4.
+};
+
+struct GeometryAllocation
+{
+    VertexFormat format;
+    unsigned block;
+    std::size_t vertex_offset, vertex_count;  // In vertices.
+    std::size_t index_offset, index_bytes;    // In bytes.
+    bool live;
+};
+
+// The ranges of a mesh to draw with Draw, relative to the start of its indices.
+struct DrawList
+{
+    std::vector<GLsizei>     counts;
+    std::vector<std::size_t> offsets;  // In indices.
+
+    // Filled in by Draw. Kept here to reuse the memory between frames.
+    std::vector<const void*> pointers;
+    std::vector<GLint>       base_vertices;
+};
+
+struct GeometryArena
+{
+    std::vector<GeometryBlock> blocks[3];        // Indexed by VertexFormat.
+    std::vector<GeometryAllocation> allocations;  // Indexed by Mesh::allocation.
+    std::vector<unsigned> free_allocations;
+    GLuint bound_vao = 0;                         // By Draw, so consecutive draws from a block don't rebind it.
+
+    // Of new blocks. A mesh that doesn't fit gets a block of its own size.
+    std::size_t block_vertex_bytes = 32 * 1024 * 1024;
+    std::size_t block_index_bytes  = 16 * 1024 * 1024;
+};
+
+extern GeometryArena geometry_arena;
+
+// Copies the encoded vertices (see EncodeVertices) and the indices into the first block of 'format' with room for them,
+// creating one if there's none. Returns the allocation. Needs a current OpenGL context.
+unsigned Allocate(GeometryArena& arena, VertexFormat format, const void* vertices, std::size_t vertex_count, const void* indices, std::size_t index_bytes);
+void Free(GeometryArena& arena, unsigned allocation);
+// Frees the geometry of every mesh in the model. Its meshes must not be drawn anymore.
+void Release(GeometryArena& arena, const TexturedModel& model);
+
+// Packs the allocations of every block whose free space is more fragmented than 'threshold'. Returns the number of
+// blocks packed.
+unsigned Defragment(GeometryArena& arena, float threshold = 0.25f);
+// Deletes all the blocks. Every allocation is invalid afterwards.
+void Destroy(GeometryArena& arena);
+
+// Draws the ranges in 'list' of the mesh. Leaves its block's vertex array object bound, until Unbind.
+void Draw(GeometryArena& arena, const Mesh& mesh, DrawList& list);
+void Unbind(GeometryArena& arena);
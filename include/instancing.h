@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "opengl.h"
+#include "vao.h"
+#include "geometry.h"
+#include "culling.h"
+
+
+// ---- INSTANCING ----
+// Draws many copies of a model with a draw call per mesh and LOD instead of per copy. The copies are Instances in an
+// InstanceBuffer, which the instanced shaders (basic.instanced.vertex.glsl) read as vertex attributes that advance once
+// per instance. A copy is placed by its instance matrix on top of the model's own transforms: a mesh is drawn with
+// instance.model * model, where 'model' is the uniform of the mesh's node, as for a draw without instancing.
+//
+// Before drawing, the instances are culled and sorted by their distance to the camera into INSTANCE_BUCKETS buckets (see
+// CullInstances), so every mesh can draw the near copies at a finer LOD than the far ones, and roughly front to back.
+
+struct Instance
+{
+    glm::mat4 model;
+    glm::vec4 color;  // Multiplies the shaded color.
+};
+
+// Of the instance attributes in the instanced shaders. The matrix takes four locations, one per column.
+static const GLuint INSTANCE_MODEL_LOCATION = 5;
+static const GLuint INSTANCE_COLOR_LOCATION = 9;
+
+struct InstanceBuffer
+{
+    GLuint id = 0;
+    std::size_t capacity = 0;  // In instances.
+    std::size_t count    = 0;  // Uploaded by the last Upload.
+
+    // What the instance attributes of a vertex array object were pointed at since the last Upload, so drawing from the
+    // same block again doesn't respecify them.
+    GLuint attached_vao = 0;
+    std::size_t attached_first = 0;
+};
+
+// Needs a current OpenGL context.
+void Create(InstanceBuffer& buffer, std::size_t capacity = 4096);
+void Destroy(InstanceBuffer& buffer);
+// Replaces the instances in the buffer. Its storage is orphaned first, so draws from the previous content still in
+// flight don't stall the upload. Grows the buffer if they don't fit.
+void Upload(InstanceBuffer& buffer, const Instance* instances, std::size_t count);
+
+// Draws instances [first, first + count) of 'buffer' with the ranges in 'list' of the mesh. Like Draw, it leaves the
+// block's vertex array object bound until Unbind.
+void DrawInstanced(GeometryArena& arena, const Mesh& mesh, DrawList& list, InstanceBuffer& buffer, std::size_t first, std::size_t count);
+
+
+static const unsigned INSTANCE_BUCKETS = 32;
+
+// The instances of a model in view, sorted into buckets of growing distance to the camera. Bucket b holds
+// visible[starts[b], starts[b + 1]), which are farther than distances[b] after dividing by their scale (so a LOD can be
+// selected for all of them as if they were unscaled at that distance).
+struct InstanceBatch
+{
+    std::vector<Instance> visible;
+    std::uint32_t starts[INSTANCE_BUCKETS + 1];
+    float distances[INSTANCE_BUCKETS];
+
+    // Kept between frames to reuse the memory.
+    BoundsTable bounds;
+    std::vector<float> scales;
+    std::vector<std::uint8_t> inside;
+    std::vector<std::uint8_t> buckets;
+};
+
+// Fills the batch with the instances whose copy of the model's bounds is in the frustum of 'view_projection'. The
+// bounds are a box and a sphere of 'radius' around its center, in the space the instance matrices transform, and should
+// both contain the whole model. Returns the number of instances kept.
+std::size_t CullInstances(const Instance* instances, std::size_t count, const Bounds& bounds, float radius, const glm::mat4& view_projection, const glm::vec3& camera, InstanceBatch& batch);
+
+// The LOD of the mesh for copies at a scaled distance of at least 'distance' (see InstanceBatch), with the mesh
+// transformed by 'model' within the copy. As SelectLod, but for many copies at once.
+unsigned SelectLod(const Mesh& mesh, const glm::mat4& model, float distance, float projection_scale, float threshold);
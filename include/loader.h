@@ -2,10 +2,150 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <future>
 
 #include "vao.h"
+#include "threading.h"
+#include "streaming.h"
+#include "compression.h"
+#include "optimizer.h"
 
+struct aiMesh;
+
+// The Assimp post processing flags used by the import. Part of the mesh cache key.
+extern const unsigned IMPORT_FLAGS;
+
+
+// A texture used by a mesh, relative to the directory of the model.
+struct TextureReference
+{
+    std::string path;
+    std::string type;
+};
+
+// CPU side data of a mesh, ready to be uploaded.
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<TextureReference> textures;
+    Bounds bounds;
+    std::vector<MeshLod> lods;                  // Ranges of 'indices', finest first. If empty, all of them are the mesh.
+    std::vector<Meshlet> meshlets;              // Of LOD 0.
+    VertexCacheStatistics imported, optimized;  // Only set by ImportModel. Not in the mesh cache.
+    std::uint32_t node = 0;                     // Of the model, whose transform places the mesh.
+    std::shared_ptr<const MeshBvh> bvh;         // Only built by LoadModelAsync. Not in the mesh cache.
+};
+
+struct ModelData
+{
+    std::vector<MeshData> meshes;
+    std::vector<ModelNode> nodes;  // The imported node hierarchy, parents first (see scene.h).
+};
+
+
+// A decoded image, not yet uploaded. 'pixels' is nullptr if decoding failed.
+struct Image
+{
+    unsigned char* pixels;
+    int width, height, components;
+};
+
+// Decoding doesn't touch OpenGL, so it can be done on any thread.
+Image DecodeImage(const std::string& path);
+Image DecodeImage(const char* data, std::size_t size);
+// Creates a mipmapped texture of the image. Returns 0 if the image failed to decode.
+GLuint UploadImage(const Image& image);
+// The OpenGL format of an image with 'components' 8 bit channels.
+GLenum ImageFormat(int components);
+void Free(Image& image);
+
+// An image queued for decoding, shared by everyone who requested the same path as the same type. The pixels are freed
+// with the last reference.
+struct ImageRequest
+{
+    std::string path;
+    std::string type;                  // E.g. "texture_diffuse", or empty if it's not used as a texture.
+    Image image {};                    // Only for requests without a type.
+    CookedImage cooked;                // Only for requests with a type.
+    unsigned long long key = 0;        // Hash of the file's content and how it's cooked, or 0 if it couldn't be read.
+    std::shared_future<void> decoded;  // Ready when 'image', 'cooked' and 'key' are written.
+
+    ~ImageRequest();
+};
+
+// Keyed on the resolved path of the image (see ResolvePath) and the type it's requested as.
+using ImageRequests = std::unordered_map<std::string, std::shared_ptr<ImageRequest>>;
+
+// Queues the image at 'path' to be read, hashed and decoded on the image decoding threads (one per hardware thread, started on the first
+// request). While a request is referenced, requesting the same path again returns it instead of decoding the image
+// twice, even from another thread.
+// With a 'type', the image is cooked instead: read from the texture cache on disk with its mip chain, or decoded,
+// cooked to the format of its type (see FormatFor) and written to the cache.
+std::shared_ptr<ImageRequest> RequestImage(const std::string& path, const std::string& type = "");
+// Requests the textures that aren't already in 'requests'. Their paths are relative to 'directory'.
+void RequestImages(const std::vector<TextureReference>& textures, const std::string& directory, ImageRequests& requests);
+
+
+// Loads the model, from the mesh cache if it's been loaded before (see naxmesh.h).
 TexturedModel LoadModel(const std::string& path);
 
+// What ImportModel does with the meshes after converting them, in this order. All are on by default, and part of the
+// mesh cache key (see ImportOptions).
+extern bool split_large_meshes;  // Split meshes with more vertices than 16 bit indices can address (see SplitMesh).
+extern bool optimize_meshes;     // Optimize them with OptimizeMesh (see optimizer.h).
+extern bool generate_lods;       // Generate LODs with GenerateLods (see simplifier.h).
+extern bool build_meshlets;      // Split LOD 0 into meshlets with BuildMeshlets (see meshlets.h).
+unsigned ImportOptions();
+
+// Imports the model with Assimp without touching OpenGL. Returns false if the import failed. 'progress' (if given) is
+// called with the progress from 0 to 1 and aborts the import by returning false.
+bool ImportModel(const std::string& path, ModelData& model, const std::function<bool(float)>& progress = {});
+// Converts an imported mesh to the vertex layout of Vertex. Textures are left empty.
+MeshData ProcessMesh(const aiMesh* mesh);
+// Splits the mesh into parts of at most 'max_vertices' vertices, with the same textures, so each part can be drawn with
+// narrower indices. Triangles are kept in order and vertices shared between parts are duplicated. Returns the mesh
+// as is if it's small enough.
+std::vector<MeshData> SplitMesh(const MeshData& mesh, std::size_t max_vertices = 65536);
+// Replaces the meshes of the model that are too large for 16 bit indices with their parts, if 'split_large_meshes'.
+// Meshes must be split before their LODs are generated.
+void SplitLargeMeshes(ModelData& model);
+// Uploads the meshes and loads the textures of an imported model. 'directory' is where the textures are relative to.
+TexturedModel UploadModel(const ModelData& model, const std::string& directory);
+TexturedMesh UploadMesh(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, const std::vector<MeshLod>& lods, const Meshlet* meshlets, std::size_t meshlet_count, const std::vector<TextureReference>& textures, const std::string& directory, const ImageRequests* images = nullptr);
+
+
+// ---- ASYNCHRONOUS LOADING ----
+// A model being loaded on a worker thread. The import (or read from the mesh cache) and the decoding of its textures
+// happen on the worker, only UploadModel has to run on the thread owning the OpenGL context.
+struct ModelLoad
+{
+    enum State { QUEUED, IMPORTING, DECODING, LOADED, FAILED, CANCELLED };
+
+    std::string path;
+    std::atomic<int>   state    {QUEUED};
+    std::atomic<float> progress {0.0f};   // From 0 to 1.
+    std::atomic<bool>  cancel   {false};
+
+    // Written by the worker. Only safe to read when the state is LOADED.
+    ModelData data;
+    ImageRequests images;
+};
+
+// Queues the model at 'path' to be loaded by 'pool'. The load must be kept alive until it's Done.
+std::unique_ptr<ModelLoad> LoadModelAsync(WorkerPool& pool, const std::string& path);
+// Whether the worker is done with the load, i.e. whether it's LOADED, FAILED or CANCELLED.
+bool Done(const ModelLoad& load);
+// Requests the load to stop. It's checked between every step and during the import.
+void Cancel(ModelLoad& load);
+// Creates the OpenGL objects of a LOADED model and releases its CPU side data. With a 'streamer', the textures are
+// streamed in over the next frames instead of uploaded right away.
+TexturedModel UploadModel(ModelLoad& load, TextureStreamer* streamer = nullptr);
+
+
 std::vector<std::string> Split(std::string source, char delimiter);
-std::pair<std::vector<Vertex>, std::vector<GLuint>> Parse(std::string source);
\ No newline at end of file
+std::pair<std::vector<Vertex>, std::vector<GLuint>> Parse(std::string source);
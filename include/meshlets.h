@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "opengl.h"
+#include "vao.h"
+#include "geometry.h"
+#include "culling.h"
+
+
+// ---- MESHLETS ----
+// Meshes are split into clusters of at most MAX_MESHLET_VERTICES vertices and MAX_MESHLET_TRIANGLES triangles, so the
+// parts of a large mesh that are off screen or face away from the camera can be skipped without drawing them. The
+// triangles are reordered so every cluster is a range of the mesh's indices, and the visible ones are drawn with one
+// call (see DrawList).
+
+static const unsigned MAX_MESHLET_VERTICES  = 64;
+static const unsigned MAX_MESHLET_TRIANGLES = 124;
+
+
+// Groups the triangles in 'indices' into meshlets, grown from neighboring triangles so they're compact and their normals
+// close together. The triangles are reordered by meshlet, and within every meshlet for the vertex cache.
+std::vector<Meshlet> BuildMeshlets(const Vertex* vertices, std::size_t vertex_count, GLuint* indices, std::size_t index_count);
+
+// Replaces the ranges in 'list' by those of the mesh's meshlets that are in the frustum and don't face away from
+// 'camera' (in world space), with adjacent ones merged. Back facing clusters are only culled if 'model' scales
+// uniformly, as a non-uniform scale bends the normal cones. Returns the number of meshlets kept.
+std::size_t CullMeshlets(const Mesh& mesh, const glm::mat4& model, const glm::mat4& view_projection, const glm::vec3& camera, DrawList& list);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+// ---- MIPMAPS ----
+// Mip chains are generated on the CPU when a texture is cooked (see compression.h), so they're cached with it and
+// uploaded level by level instead of generated by glGenerateMipmap on every load. Levels are filtered from the
+// previous level in linear space and 32 bit floats; sRGB encoded channels are decoded first and encoded again when
+// the level is stored.
+enum MipFilter
+{
+    BOX,     // 2x2 average. Cheap, but aliases on fine detail.
+    KAISER,  // Kaiser windowed sinc over 8x8 pixels. Sharper, with less aliasing. Wraps around the edges.
+};
+
+struct MipLevel
+{
+    int width, height;
+    std::size_t offset, size;  // In the data of the chain.
+};
+
+struct MipChain
+{
+    int components = 0;
+    std::vector<MipLevel> levels;  // Largest first, down to 1x1.
+    std::vector<unsigned char> data;
+};
+
+// Whether textures used as 'type' (e.g. "texture_diffuse") hold sRGB encoded colors. Alpha is always linear.
+bool IsSRGB(const std::string& type);
+
+// Generates the full chain of an image of 8 bit 'components', the image itself being the first level. Levels with
+// enough rows are filtered in parallel.
+MipChain GenerateMipChain(const unsigned char* pixels, int width, int height, int components, bool srgb, MipFilter filter = KAISER);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vao.h"
+
+struct TextureCache;
+struct GeometryArena;
+
+
+// ---- MODEL MANAGER ----
+// Owns the uploaded models, which everything else refers to by handle instead of holding a copy. A handle is the index
+// of a slot and the generation of the slot when it was handed out; a slot's generation changes when its model is
+// released, so old handles to it are detected instead of reaching whatever model is put there next.
+//
+// Models are reference counted. When the last reference is released, the model is retired: it can't be reached by its
+// handles anymore, but its textures and geometry are only given back after 'frames_in_flight' more frames, once the GPU
+// is done with the frames that drew it. Otherwise the next model could be uploaded into its geometry ranges while they
+// are still being read, which stalls the upload until the GPU catches up.
+struct ModelHandle
+{
+    std::uint32_t index      = 0;
+    std::uint32_t generation = 0;  // Never that of a live slot, so a default handle is never valid.
+};
+
+struct ModelManager
+{
+    struct Slot
+    {
+        TexturedModel model;
+        std::uint32_t generation;
+        unsigned references;  // 0 if the slot is free.
+    };
+
+    struct Retired
+    {
+        TexturedModel model;
+        unsigned long long frame;  // The last frame it could have been drawn in.
+    };
+
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> free_slots;
+    std::vector<Retired> retired;
+
+    TextureCache*  textures = nullptr;
+    GeometryArena* geometry = nullptr;
+
+    unsigned long long frame = 0;
+    unsigned frames_in_flight = 2;
+};
+
+// The textures and geometry of the models are released to 'textures' and 'geometry'.
+void Create(ModelManager& manager, TextureCache& textures, GeometryArena& geometry);
+// Releases the resources of every model now, live or retired. Every handle is invalid afterwards.
+void Destroy(ModelManager& manager);
+
+// Takes over the model, with one reference.
+ModelHandle Add(ModelManager& manager, TexturedModel&& model);
+// Adds a reference. Returns false if the handle isn't valid (anymore).
+bool Acquire(ModelManager& manager, ModelHandle handle);
+// Removes a reference, and retires the model if it was the last. Does nothing if the handle isn't valid.
+void Release(ModelManager& manager, ModelHandle handle);
+
+// Returns the model, or nullptr if the handle isn't valid. The pointer is invalidated by Add.
+const TexturedModel* Get(const ModelManager& manager, ModelHandle handle);
+
+// Ends the frame: releases the resources of the models retired 'frames_in_flight' frames ago or earlier. Returns how
+// many there were, so the caller knows when it's worth defragmenting or evicting.
+unsigned EndFrame(ModelManager& manager);
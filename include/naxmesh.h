@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "errors.h"
+#include "utilities.h"
+#include "loader.h"
+
+
+// ---- NAXMESH ----
+// Binary cache of imported models. A .naxmesh file stores the vertex and index arrays of every mesh in the same layout
+// as they're uploaded, so a cached model can be memory mapped and handed to OpenGL directly. Files are named after a
+// key made from the content of the source file and the import flags, so a changed source is imported again.
+//
+// Layout (offsets are from the start of the file):
+//     NaxMeshHeader
+//     NaxMeshRecord[mesh_count]
+//     NaxTextureRecord[texture_count]
+//     NaxNodeRecord[node_count]
+//     Texture paths and types.
+//     Vertex, index and meshlet arrays, each aligned to 16 bytes.
+//
+// NOTE: Only the content of the file passed to LoadModel is part of the key. Files it refers to (like the .bin buffers
+//     of a .gltf) are not, so the cache directory must be cleared if only those change.
+
+extern const unsigned NAXMESH_VERSION;
+
+// Directory where the cached models are stored. Created on the first write.
+extern std::string mesh_cache_directory;
+
+
+// A mesh of a cached model. Points into the mapped file.
+struct MeshView
+{
+    const Vertex* vertices;
+    std::size_t   vertex_count;
+    const GLuint* indices;
+    std::size_t   index_count;
+    std::vector<MeshLod> lods;
+    const Meshlet* meshlets;
+    std::size_t    meshlet_count;
+    std::vector<TextureReference> textures;
+    Bounds bounds;
+    std::uint32_t node;
+};
+
+struct MeshCache
+{
+    MappedFile file;
+    std::vector<MeshView> meshes;
+    std::vector<ModelNode> nodes;
+};
+
+
+// 'options' are what else was done to the meshes on import (see ImportOptions).
+unsigned long long MeshCacheKey(const char* data, std::size_t size, unsigned import_flags, unsigned options = 0);
+std::string MeshCachePath(unsigned long long key);
+
+// Maps and validates the cached model at 'path'. Fails if it doesn't exist, is corrupt, was written by another version
+// or has another key. Must be closed with Close.
+Return<MeshCache> OpenMeshCache(const std::string& path, unsigned long long key);
+void Close(MeshCache& cache);
+
+// Writes the model to 'path'. The file is written under a temporary name and then renamed, so a concurrent or aborted
+// write never leaves a partial file behind.
+Return<bool> WriteMeshCache(const std::string& path, unsigned long long key, const ModelData& model);
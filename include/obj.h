@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstddef>
+
+#include "errors.h"
+#include "vao.h"
+
+
+// Open addressing (linear probing) hash table from (position, texture coordinate, normal) index triples to vertex
+// indices, used to deduplicate face corners. Keys are stored in full, so there are no limits on the number of
+// attributes. Reserve (or Clear) it before a load; the memory is kept so the table can be reused across loads.
+struct VertexTable
+{
+    struct Slot
+    {
+        unsigned key[3];
+        unsigned value;  // EMPTY if the slot is unused.
+    };
+
+    static const unsigned EMPTY = ~0u;
+
+    std::vector<Slot> slots;
+    std::size_t count = 0;
+    std::size_t mask  = 0;
+};
+
+// Clears the table and makes room for at least 'count' entries without growing.
+void Reserve(VertexTable& table, std::size_t count);
+// Removes all entries but keeps the memory.
+void Clear(VertexTable& table);
+void Grow(VertexTable& table);
+
+inline std::size_t Hash(unsigned position, unsigned texture_coordinate, unsigned normal)
+{
+    unsigned long long hash = position * 0x9E3779B97F4A7C15ull ^ texture_coordinate * 0xC2B2AE3D27D4EB4Full ^ normal * 0x165667B19E3779F9ull;
+    return static_cast<std::size_t>(hash ^ (hash >> 29));
+}
+
+// Returns the value of the key if it exists, otherwise inserts it with 'value' and returns 'value'.
+inline unsigned FindOrInsert(VertexTable& table, unsigned position, unsigned texture_coordinate, unsigned normal, unsigned value)
+{
+    // Keep the load factor at or below 1/2.
+    if ((table.count + 1) * 2 > table.slots.size())
+        Grow(table);
+
+    std::size_t i = Hash(position, texture_coordinate, normal) & table.mask;
+    while (true)
+    {
+        VertexTable::Slot& slot = table.slots[i];
+        if (slot.value == VertexTable::EMPTY)
+        {
+            slot = {{position, texture_coordinate, normal}, value};
+            ++table.count;
+            return value;
+        }
+        if (slot.key[0] == position && slot.key[1] == texture_coordinate && slot.key[2] == normal)
+            return slot.value;
+        i = (i + 1) & table.mask;
+    }
+}
+
+
+// Parses the OBJ source in [first, last) in place. No copies of the source are made and no memory is allocated per
+// token, only for the resulting arrays. Faces with more than 3 vertices are triangulated as a fan and negative
+// (relative) indices are supported.
+//
+// With a 'thread_count' other than 1 (0 meaning all hardware threads) the source is split at line boundaries and
+// parsed and deduplicated in parallel. The result is identical to parsing it serially. When parsing serially, 'table'
+// (if given) is used for the deduplication so its memory can be reused across loads.
+Return<std::pair<std::vector<Vertex>, std::vector<GLuint>>> ParseOBJ(const char* first, const char* last, unsigned thread_count = 1, VertexTable* table = nullptr);
+
+// Memory maps the file at 'path' and parses it with ParseOBJ.
+Return<std::pair<std::vector<Vertex>, std::vector<GLuint>>> LoadOBJ(const std::string& path, unsigned thread_count = 1);
+
+
+// Called for every chunk of a streamed OBJ file. The arrays are only valid during the call.
+using OBJChunkCallback = std::function<void(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)>;
+
+// Reads the OBJ file at 'path' through a fixed-size window and calls 'callback' with chunks of deduplicated vertices
+// and indices as they're completed. The memory used is bounded by roughly 'budget' bytes (at least 1 MB) no matter
+// the size of the file; vertex attributes are spilled to temporary files and read back through a cache. Faces can only
+// refer to attributes declared before them, and vertices are only deduplicated within a chunk. Returns the number of
+// chunks.
+Return<unsigned> StreamOBJ(const std::string& path, std::size_t budget, const OBJChunkCallback& callback);
+
+// Streams the OBJ file at 'path' and uploads every chunk as a separate mesh.
+Return<TexturedModel> LoadStreamedOBJ(const std::string& path, std::size_t budget);
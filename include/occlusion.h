@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "opengl.h"
+#include "vao.h"
+#include "culling.h"
+
+
+// ---- OCCLUSION CULLING ----
+// Occluders, usually a few large meshes close to the camera, are rasterized on the CPU into a low resolution depth
+// buffer. The buffer is split into tiles of OCCLUSION_TILE_SIZE pixels square: the triangles are first transformed,
+// clipped and sorted into the tiles they cover, then the tiles are rasterized independently of each other, spread over
+// the threads, CULL_WIDTH pixels at a time (see culling.h). From the depths a pyramid is built where every texel holds
+// the farthest depth of the 2x2 below it, so that an object can be tested against a few texels whatever its size: it's
+// occluded if its nearest point is behind all of them.
+//
+// Depths are those of normalized device coordinates mapped to [0, 1], 1 being the far plane, and pixels are sampled at
+// their centers, like OpenGL does.
+
+static const unsigned OCCLUSION_TILE_SIZE = 32;
+
+// A mesh to rasterize, which must stay alive until the buffer is rasterized.
+struct Occluder
+{
+    const glm::vec3* positions;
+    std::size_t vertex_count;
+    const GLuint* indices;
+    std::size_t triangle_count;
+    glm::mat4 matrix;  // From the positions to clip space, i.e. projection * view * model.
+};
+
+// A vertex of an occluder in clip space, with a bit set for every plane it must be clipped to that it's outside of.
+struct ClipVertex
+{
+    glm::vec4 position;
+    std::uint32_t outside;
+};
+
+// A triangle in pixels, set up for rasterizing: the edge functions a * x + b * y + c, which are at least 0 inside, and
+// the plane of its depths, both for the centers of the pixels at integer (x, y).
+struct ScreenTriangle
+{
+    float a[3], b[3], c[3];
+    float z, z_dx, z_dy;
+    int min_x, min_y, max_x, max_y;  // The pixels it may cover, inclusive and within the buffer.
+};
+
+// The triangles set up by one thread, and the indices of those that cover every tile.
+struct RasterChunk
+{
+    std::vector<ScreenTriangle> triangles;
+    std::vector<std::vector<std::uint32_t>> tiles;
+};
+
+struct DepthBuffer
+{
+    unsigned width  = 0;  // Of levels[0], a multiple of OCCLUSION_TILE_SIZE.
+    unsigned height = 0;
+    std::vector<std::vector<float>> levels;  // Row major, from the bottom. Each level is half the size of the last.
+    std::vector<Occluder> occluders;         // Added since the buffer was last rasterized.
+
+    // Used by Rasterize, and kept between frames to reuse their memory.
+    std::vector<ClipVertex> vertices;  // Of the occluders, one after the other.
+    std::vector<RasterChunk> chunks;
+};
+
+// Clears the buffer to the far plane, at a size of at least 'width' by 'height' pixels (rounded up to whole tiles),
+// and drops the occluders. The whole screen is mapped to the buffer whatever its size.
+void Reset(DepthBuffer& buffer, unsigned width, unsigned height);
+void AddOccluder(DepthBuffer& buffer, const Occluder& occluder);
+// Rasterizes the occluders added since the last Reset with up to 'thread_count' threads of FramePool() (0 meaning
+// HardwareThreads()) and builds the pyramid. Returns the number of triangles rasterized after clipping, which excludes
+// those out of view.
+std::size_t Rasterize(DepthBuffer& buffer, unsigned thread_count = 0);
+
+// Whether the box, in the space that 'matrix' maps to clip space, is certainly behind the rasterized occluders. Boxes
+// that cross the near plane or are out of view are never occluded.
+bool Occluded(const DepthBuffer& buffer, const Bounds& bounds, const glm::mat4& matrix);
+// Sets visible[i] to 0 for the objects in the table that are visible but occluded, with the table in world space and
+// 'view_projection' the one the occluders were rasterized with. Returns the number of objects it culled.
+std::size_t CullOccluded(const DepthBuffer& buffer, const BoundsTable& table, const glm::mat4& view_projection, std::vector<std::uint8_t>& visible);
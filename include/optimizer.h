@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "opengl.h"
+#include "vao.h"
+
+
+// ---- MESH OPTIMIZATION ----
+// Reorders the triangles and vertices of imported meshes so the GPU does less work drawing them:
+//     1. Triangles are ordered so vertices are reused while they're still in the post-transform cache (Forsyth's linear
+//        speed vertex cache optimization).
+//     2. Clusters of that order are sorted so triangles on the outside and facing outwards are drawn first, which
+//        hides more of the rest behind them (as in Sander, Nehab and Barczak's "Fast triangle reordering for vertex
+//        locality and reduced overdraw"). Clusters start where the cache starts over, so their order costs little.
+//     3. Vertices are stored in the order they're first used, so fetching them is close to linear.
+// Only triangle lists are optimized. Done once at import; the optimized meshes are what's stored in the mesh cache.
+
+// How well an index order uses a FIFO post-transform cache of 'cache_size' vertices.
+struct VertexCacheStatistics
+{
+    float acmr = 0.0f;  // Average cache miss ratio: vertices transformed per triangle. From 3 down to about 0.5.
+    float atvr = 0.0f;  // Average transform to vertex ratio: times every vertex is transformed. 1 is optimal.
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const GLuint* indices, std::size_t index_count, std::size_t vertex_count, unsigned cache_size = 16);
+
+// Writes the triangles of 'indices' to 'destination' (which must not alias it) in vertex cache order. The corners of
+// every triangle keep their order, so the winding doesn't change.
+void OptimizeVertexCache(GLuint* destination, const GLuint* indices, std::size_t index_count, std::size_t vertex_count);
+
+// Reorders the clusters of a vertex cache optimized index order to reduce overdraw, unless that would make the ACMR
+// worse than 'threshold' times what it was.
+void OptimizeOverdraw(GLuint* indices, std::size_t index_count, const Vertex* vertices, std::size_t vertex_count, float threshold = 1.05f);
+
+// Reorders the vertices in the order the indices first use them, and updates the indices. Vertices no triangle uses
+// are dropped. Returns the new vertex count.
+std::size_t OptimizeVertexFetch(Vertex* vertices, GLuint* indices, std::size_t index_count, std::size_t vertex_count);
+
+// All of the above. Meshes that aren't triangle lists are left as they are. Returns the statistics of the mesh before
+// and after.
+std::pair<VertexCacheStatistics, VertexCacheStatistics> OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
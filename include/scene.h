@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "vao.h"
+
+
+// ---- SCENE ----
+// The transform hierarchy of everything that's drawn. Every attribute of the nodes is an array of its own, indexed by
+// node, and the nodes are sorted so every node comes after its parent. A node has a local position, rotation and scale
+// relative to its parent; UpdateTransforms recomputes the world matrices of the nodes whose local transform changed
+// since the last update, and those of their descendants, in one pass from the front. By the time a node is reached, the
+// world matrix of its parent is therefore up to date, and untouched subtrees cost a flag test per node.
+struct Scene
+{
+    std::vector<std::uint32_t> parents;  // NO_PARENT for the roots.
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<std::uint8_t> dirty;     // The local transform changed since the last update.
+};
+
+// Adds a node as the last child of 'parent', which must already be in the scene. Returns the node.
+std::uint32_t AddNode(Scene& scene, std::uint32_t parent, const glm::vec3& position = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+// Adds the nodes of the model under 'parent', or a single node if it has none. Returns the first, so the node of a mesh
+// of the model is the returned one + TexturedMesh::node.
+std::uint32_t AddModel(Scene& scene, const TexturedModel& model, std::uint32_t parent);
+void Clear(Scene& scene);
+
+void SetPosition(Scene& scene, std::uint32_t node, const glm::vec3& position);
+void SetRotation(Scene& scene, std::uint32_t node, const glm::quat& rotation);
+void SetScale(Scene& scene, std::uint32_t node, const glm::vec3& scale);
+
+// The matrix of a local transform: translation * rotation * scale.
+glm::mat4 TransformMatrix(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+// Brings the world matrices of the nodes that changed, and of their descendants, up to date. Returns the number of
+// world matrices recomputed.
+std::size_t UpdateTransforms(Scene& scene);
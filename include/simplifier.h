@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "opengl.h"
+#include "vao.h"
+
+
+// ---- SIMPLIFICATION ----
+// Quadric error metric simplification (Garland and Heckbert) by collapsing edges onto existing vertices, so every level
+// of detail indexes the same vertex buffer as the full mesh. Vertices on the border of the mesh and on seams (where
+// vertices share a position but not their texture coordinates or normals) only collapse along the border or seam, so
+// the outline and the texture mapping are kept. Vertices where seams or borders meet never move.
+//
+// Errors are distances from the original surface, relative to the largest side of the mesh's bounds.
+
+// Simplifies a triangle list towards 'target_index_count' indices, stopping early rather than introducing an error
+// above 'target_error'. The triangles to collapse are ranked in parallel. Returns the new indices and sets 'error' (if
+// given) to the largest error introduced.
+std::vector<GLuint> Simplify(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, std::size_t target_index_count, float target_error, float* error = nullptr);
+
+// Appends a chain of LODs to 'indices' (the full mesh, which becomes LOD 0), each with about half the triangles of the
+// previous one and optimized for the vertex cache. Stops at MAX_LODS, when a level barely simplifies any further or when
+// its error would exceed 'max_error'. Returns the ranges of the LODs in 'indices', with their errors in model space.
+std::vector<MeshLod> GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float max_error = 0.05f);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstddef>
+
+#include "opengl.h"
+
+struct ImageRequest;
+
+
+// ---- TEXTURE STREAMING ----
+// Uploads textures through a ring of pixel buffer objects instead of glTexImage2D from client memory, so the driver can
+// copy to the texture asynchronously. Every frame, Update copies the next rows of the queued images into the next free
+// buffer of the ring and issues a glTexSubImage2D from it, until the frame's budget is spent. Large textures therefore
+// stream in over several frames.
+//
+// The images are cooked with their mip chain (see compression.h), which is uploaded from the smallest level up. Once a
+// level is in, the texture's base level is moved to it, so it's sampled at a low resolution until it's complete.
+//
+// A buffer is only reused when the fence of its previous upload has signaled, so writing to it never stalls.
+struct TextureStreamer
+{
+    struct Buffer
+    {
+        GLuint id;
+        GLsync fence;  // Of the last upload from this buffer, or nullptr.
+    };
+
+    struct Upload
+    {
+        std::shared_ptr<ImageRequest> image;
+        GLuint texture;
+        bool started;    // Whether the levels are allocated.
+        unsigned level;  // Level being uploaded.
+        unsigned row;    // Next row of the level to upload.
+    };
+
+    std::vector<Buffer> buffers;
+    std::size_t buffer_size = 0;
+    unsigned next_buffer = 0;
+
+    std::deque<Upload> uploads;
+
+    // Budget per call to Update. At least one band of rows is uploaded per call, so every texture makes progress.
+    std::size_t bytes_per_frame = 8 * 1024 * 1024;
+    float milliseconds_per_frame = 2.0f;
+
+    // Statistics of the last call to Update.
+    std::size_t bytes_last_frame = 0;
+    float milliseconds_last_frame = 0.0f;
+};
+
+// Creates 'buffer_count' pixel buffers of 'buffer_size' bytes each. Needs a current OpenGL context.
+void Create(TextureStreamer& streamer, unsigned buffer_count = 4, std::size_t buffer_size = 4 * 1024 * 1024);
+void Destroy(TextureStreamer& streamer);
+
+// Returns a new texture that will get the content of 'image' once it's cooked (uncompressed) and streamed in. Until then
+// it's incomplete, which samples as black.
+GLuint StreamTexture(TextureStreamer& streamer, std::shared_ptr<ImageRequest> image);
+
+// Stops streaming to 'texture', e.g. because it's about to be deleted.
+void Cancel(TextureStreamer& streamer, GLuint texture);
+
+// Uploads as much of the queued textures as the budget allows. Call once per frame on the OpenGL thread.
+void Update(TextureStreamer& streamer);
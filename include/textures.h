@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+
+#include "opengl.h"
+#include "vao.h"
+
+struct TextureStreamer;
+
+
+// ---- TEXTURE CACHE ----
+// The textures on the GPU, keyed on a hash of the content of their image file (see RequestImage). Identical images are
+// therefore only uploaded once, no matter their name, while different images with the same relative path in two
+// models don't alias. Every TexturedMesh using a texture holds a reference to it. Unreferenced textures are kept
+// resident, so reloading a model is cheap, until the resident bytes exceed the budget; then the least recently used
+// ones are deleted.
+struct TextureCache
+{
+    struct Entry
+    {
+        GLuint id;
+        std::size_t bytes;              // Estimated, including the mipmaps.
+        unsigned references;
+        unsigned long long last_used;   // Tick of the last Acquire.
+        std::string path;               // The file it was first loaded from.
+    };
+
+    std::unordered_map<unsigned long long, Entry> entries;
+
+    std::size_t budget   = 512 * 1024 * 1024;
+    std::size_t resident = 0;
+    unsigned long long tick = 0;
+
+    // Statistics.
+    unsigned long long hits      = 0;
+    unsigned long long misses    = 0;
+    unsigned long long evictions = 0;
+};
+
+extern TextureCache texture_cache;
+
+// Returns the texture with content 'key' and adds a reference to it, or returns 0 (and counts a miss) if it isn't
+// resident.
+GLuint Acquire(TextureCache& cache, unsigned long long key);
+// Adds a texture created from the content 'key', with one reference.
+void Insert(TextureCache& cache, unsigned long long key, GLuint id, std::size_t bytes, const std::string& path);
+void Release(TextureCache& cache, unsigned long long key);
+// Releases the textures of every mesh in the model.
+void Release(TextureCache& cache, const TexturedModel& model);
+// Deletes unreferenced textures, least recently used first, until the resident bytes are within the budget. Textures
+// that are still being streamed in by 'streamer' are removed from it.
+void Evict(TextureCache& cache, TextureStreamer* streamer = nullptr);
+
+// Size of a texture of 8 bit components, with a full mipmap chain.
+std::size_t TextureBytes(int width, int height, int components);
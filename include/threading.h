@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Number of hardware threads, or 1 if it can't be determined.
+unsigned HardwareThreads();
+
+// Calls 'function' once for every index in [0, count), spread over 'thread_count' threads (including the calling one).
+// A thread count of 0 means HardwareThreads(). Returns when all calls are done.
+void ParallelFor(unsigned count, unsigned thread_count, const std::function<void(unsigned)>& function);
+// Whether the calling thread is doing work already spread over threads, as one of a WorkerPool's or in a ParallelFor.
+// Work nested in it should ask ParallelFor for a single thread rather than start more threads than there are cores.
+bool OnWorkerThread();
+// The thread count to ask ParallelFor for to split 'size' units of work: 0 (HardwareThreads()) from 'threshold' units
+// on, as smaller work isn't worth starting threads for, and otherwise 1. Also 1 on a worker thread, as its siblings
+// already keep all of the cores busy.
+unsigned ThreadsFor(std::size_t size, std::size_t threshold);
+
+
+// Threads that run submitted jobs in the order they were submitted, for work that should happen in the background
+// (like loading) rather than be waited on. Unlike ParallelFor the threads are kept alive between jobs.
+struct WorkerPool
+{
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    ~WorkerPool();  // Stops the pool if it hasn't been.
+};
+
+// Starts 'thread_count' threads, 0 meaning HardwareThreads().
+void Start(WorkerPool& pool, unsigned thread_count);
+void Submit(WorkerPool& pool, std::function<void()> job);
+// Runs the jobs that are already submitted and joins the threads.
+void Stop(WorkerPool& pool);
+
+// ParallelFor on the threads of 'pool' rather than new ones, for work repeated every frame where starting threads
+// would cost about as much as the work. The calling thread takes part and only waits for the calls to be done, not for
+// the pool to get to its jobs, so it may be called from one of the pool's own threads.
+void ParallelFor(WorkerPool& pool, unsigned count, unsigned thread_count, const std::function<void(unsigned)>& function);
+// The pool for per frame work, started on first use with a thread less than HardwareThreads(), as callers take part.
+WorkerPool& FramePool();
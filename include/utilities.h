@@ -1,9 +1,34 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
 
 #include "errors.h"
 
 extern const char DIRECTORY_SEPERATOR;
 
-Return<std::string> Read(const std::string& path);
\ No newline at end of file
+Return<std::string> Read(const std::string& path);
+
+
+// Read-only view of a file mapped into memory. Must be released with Unmap.
+struct MappedFile
+{
+    const char* data;
+    std::size_t size;
+};
+
+Return<MappedFile> Map(const std::string& path);
+void Unmap(MappedFile file);
+
+
+// Fast, non-cryptographic 64 bit hash of a block of memory.
+unsigned long long ContentHash(const void* data, std::size_t size, unsigned long long seed = 0);
+
+// Creates the directory at 'path' if it doesn't exist (but not its parents). Returns false on failure.
+bool MakeDirectory(const std::string& path);
+// Removes the directory at 'path', which must be empty. Returns false on failure.
+bool RemoveEmptyDirectory(const std::string& path);
+
+// Absolute path with '.', '..' (and on POSIX, symbolic links) resolved, so different spellings of the same file compare
+// equal. Returns 'path' unchanged if it can't be resolved, e.g. because it doesn't exist.
+std::string ResolvePath(const std::string& path);
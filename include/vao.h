@@ -2,13 +2,21 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
 
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include "opengl.h"
 
 
+struct MeshBvh;
+
+
 struct Vertex
 {
     glm::vec3 position;
@@ -18,32 +26,140 @@ struct Vertex
     glm::vec3 bitangent;
 };
 
+// Axis aligned bounding box.
+struct Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct Sphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
 struct Texture
 {
     GLuint id;
     std::string type;
+    unsigned long long key;  // In the texture cache (see textures.h), or 0 if it isn't cached.
 };
 
-struct Mesh
+// How vertices are stored on the GPU. Vertex is always used on the CPU side (and in the mesh cache), and encoded when
+// the mesh is uploaded.
+enum VertexFormat
+{
+    FULL,       // Vertex as is: 56 bytes of floats.
+    COMPACT,    // CompactVertex:   24 bytes.
+    QUANTIZED,  // QuantizedVertex: 20 bytes.
+};
+
+// Normals and tangents are signed normalized 10_10_10_2 (GL_INT_2_10_10_10_REV), which the vertex fetch decodes. The
+// bitangent isn't stored; it's cross(normal, tangent.xyz) * tangent.w. Half float texture coordinates lose precision
+// beyond a few repeats of the texture (1/1024 of a texture at 1.0, 1/32 at 32.0).
+struct CompactVertex
+{
+    glm::vec3     position;
+    std::uint16_t texture_coordinate[2];  // Half floats.
+    std::uint32_t normal;
+    std::uint32_t tangent;                // w is the sign of the bitangent.
+};
+
+// As CompactVertex, but positions are 16 bit unsigned normalized within the bounds of the mesh, which the vertex
+// shader maps back with the mesh's 'position_scale' and 'position_offset'.
+struct QuantizedVertex
+{
+    std::uint16_t position[4];            // The last one is padding, to keep the attributes 4 byte aligned.
+    std::uint16_t texture_coordinate[2];
+    std::uint32_t normal;
+    std::uint32_t tangent;
+};
+
+// A level of detail of a mesh: a range of its indices that draws the same vertices with fewer triangles.
+struct MeshLod
 {
-    GLuint vao, ebo, count;
+    GLuint offset, count;  // In indices.
+    float error;           // How far the surface may be from the full mesh, in model space.
+};
+
+static const unsigned MAX_LODS = 8;
 
-    // TODO(ted): Should we have this? Keeping it now for debugging purposes.
-    std::vector<Vertex> vertices;
+// A small cluster of the triangles of a mesh (see meshlets.h), with what's needed to cull it on its own: a bounding
+// sphere and a cone that contains the normals of all its triangles. The cluster faces away from cameras inside the cone
+// behind its apex: those where dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff.
+struct Meshlet
+{
+    GLuint offset, count;  // In indices, of LOD 0.
+    glm::vec3 center;
+    float radius;
+    glm::vec3 cone_apex;
+    glm::vec3 cone_axis;
+    float cone_cutoff;     // Above 1 if the normals are too spread for the cluster to ever face away.
+};
+
+struct Mesh
+{
+    unsigned allocation = ~0u;  // Of its vertices and indices in the geometry arena (see geometry.h).
+    GLuint count = 0;           // The index count of the full mesh, which is also LOD 0.
+    GLenum index_type = GL_UNSIGNED_INT;  // GL_UNSIGNED_SHORT if the mesh has at most 65536 vertices.
+    VertexFormat format = FULL;
+    glm::vec3 position_scale  {1.0f};  // Only not the identity for QUANTIZED.
+    glm::vec3 position_offset {0.0f};
+    Bounds bounds {};
+    Sphere sphere {};  // Around the same center as the bounds, but often smaller than the box's own sphere.
+    MeshLod lods[MAX_LODS] {};  // Finest first. If there are none, the whole mesh is drawn.
+    unsigned lod_count = 0;
+    std::vector<Meshlet> meshlets;  // Of LOD 0, in order. If there are none, it's only culled as a whole.
+    std::shared_ptr<const MeshBvh> bvh;  // Over the triangles of LOD 0, for picking (see bvh.h). Can be empty.
 };
 
 struct TexturedMesh
 {
     Mesh mesh;
     std::vector<Texture> textures;
+    std::uint32_t node = 0;  // Of the model, whose transform places the mesh.
+};
+
+static const std::uint32_t NO_PARENT = ~std::uint32_t(0);
+
+// A node of the hierarchy of a model, as imported. Its transform is relative to its parent, which comes before it.
+struct ModelNode
+{
+    std::uint32_t parent;  // NO_PARENT for the root.
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
 };
 
 struct TexturedModel
 {
     std::vector<TexturedMesh> meshes;
+    std::vector<ModelNode> nodes;  // If there are none, all meshes are at the origin of the model.
 };
 
 
 
-Mesh IndexedModel(std::vector<Vertex> vertices, std::vector<GLuint> indices);
+// The format IndexedModel uploads in unless it's given one.
+extern VertexFormat vertex_format;
+
+std::size_t VertexSize(VertexFormat format);
+// Encodes the vertices in 'format'. For QUANTIZED, 'scale' and 'offset' are set to what maps the quantized positions
+// back; otherwise they're the identity.
+std::vector<unsigned char> EncodeVertices(const Vertex* vertices, std::size_t count, VertexFormat format, glm::vec3& scale, glm::vec3& offset);
+
+// The narrowest index type that can address 'vertex_count' vertices. GL_UNSIGNED_BYTE is never used, as some hardware
+// handles it poorly and it saves little.
+GLenum IndexType(std::size_t vertex_count);
+std::size_t IndexSize(GLenum index_type);
+
+// The LOD of the mesh whose error projects to at most 'threshold' pixels on screen, with the mesh transformed by
+// 'model' and seen from 'camera'. 'projection_scale' is the height of the viewport in pixels divided by
+// 2 * tan(vertical field of view / 2).
+unsigned SelectLod(const Mesh& mesh, const glm::mat4& model, const glm::vec3& camera, float projection_scale, float threshold);
+
+// Uploads the mesh to the geometry arena, with the indices as IndexType(vertex_count).
+Mesh IndexedModel(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+Mesh IndexedModel(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count);
+Mesh IndexedModel(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, VertexFormat format);
 Mesh Cube();
\ No newline at end of file
@@ -0,0 +1,59 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 texture_coordinate;
+layout (location = 2) in vec3 normal;
+// Bound at location 3 is the tangent, with the sign of the bitangent in w (see VertexFormat in vao.h). Nothing uses
+// them yet.
+// Per instance (see Instance in instancing.h). The matrix takes locations 5 to 8.
+layout (location = 5) in mat4 instance_model;
+layout (location = 9) in vec4 instance_color;
+
+struct SunLight
+{
+    vec4 direction;
+    vec4 color;
+};
+
+// Of the mesh within the model. Every instance places a copy of the model.
+uniform mat4 model;
+// Quantized positions are in [0, 1] within the bounds of the mesh.
+uniform vec3 position_scale;
+uniform vec3 position_offset;
+layout (std140) uniform Data
+{
+    mat4 view;
+    mat4 projection;
+
+    vec4 color;
+    SunLight sunlight;
+
+    float ambient_factor;
+    float diffuse_factor;
+    float specular_factor;
+    float shininess;
+};
+
+out Shared {
+    vec3 position;  // World space.
+    vec2 texture_coordinate;
+    vec3 normal;    // World space.
+    vec4 color;     // Of the instance.
+} vs_out;
+
+
+
+void main()
+{
+    vec3 model_position = position * position_scale + position_offset;
+    mat4 world = instance_model * model;
+
+    // Send to fragment.
+    vs_out.position = vec3(world * vec4(model_position, 1.0f));
+    vs_out.texture_coordinate = texture_coordinate;
+    vs_out.normal = vec3(normalize(world * vec4(normal, 0.0f)));
+    vs_out.color = instance_color;
+
+    // Vertex position on screen.
+    gl_Position = projection * view * world * vec4(model_position, 1.0f);
+}
@@ -3,6 +3,8 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texture_coordinate;
 layout (location = 2) in vec3 normal;
+// Bound at location 3 is the tangent, with the sign of the bitangent in w (see VertexFormat in vao.h). Nothing uses
+// them yet.
 
 struct SunLight
 {
@@ -11,6 +13,9 @@ struct SunLight
 };
 
 uniform mat4 model;
+// Quantized positions are in [0, 1] within the bounds of the mesh.
+uniform vec3 position_scale;
+uniform vec3 position_offset;
 layout (std140) uniform Data
 {
     mat4 view;
@@ -35,11 +40,13 @@ out Shared {
 
 void main()
 {
+    vec3 model_position = position * position_scale + position_offset;
+
     // Send to fragment.
-    vs_out.position = vec3(model * vec4(position, 1.0f));
+    vs_out.position = vec3(model * vec4(model_position, 1.0f));
     vs_out.texture_coordinate = texture_coordinate;
     vs_out.normal = vec3(normalize(model * vec4(normal, 0.0f)));
 
     // Vertex position on screen.
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    gl_Position = projection * view * model * vec4(model_position, 1.0f);
 }
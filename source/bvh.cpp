@@ -0,0 +1,545 @@
+#include "bvh.h"
+
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include "scene.h"
+
+
+// The centers of the items are sorted into this many bins along every axis, and the tree is split between two of them.
+static const unsigned SAH_BINS = 16;
+
+// The items are sorted by copy rather than by index while building, so every pass over them reads memory in order.
+struct BuildItem
+{
+    Bounds bounds;
+    glm::vec3 center;
+    std::uint32_t index;
+};
+
+struct BuildState
+{
+    Bvh* bvh;
+    std::vector<BuildItem> items;
+    unsigned max_leaf_items;
+};
+
+
+// Forward declaration of internal functions.
+static void Split(BuildState& state, std::uint32_t node, std::uint32_t begin, std::uint32_t end);
+static Bounds Empty();
+static void Grow(Bounds& bounds, const Bounds& other);
+static float Area(const Bounds& bounds);
+static float Intersect(const glm::vec3& origin, const glm::vec3& inverse, const Bounds& bounds, float max_distance);
+static float IntersectTriangle(const Ray& ray, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+static void AppendSubtree(const Bvh& bvh, std::uint32_t node, std::vector<std::uint32_t>& items);
+static float SquaredDistance(const Bounds& bounds, const glm::vec3& point);
+template <typename Hit>
+static float Traverse(const Bvh& bvh, const Ray& ray, float max_distance, Hit& hit);
+template <typename Classify>
+static std::size_t Query(const Bvh& bvh, const Bounds* bounds, std::vector<std::uint32_t>& items, Classify& classify);
+
+
+void Build(Bvh& bvh, const Bounds* bounds, std::size_t count, unsigned max_leaf_items)
+{
+    bvh.nodes.clear();
+    bvh.items.resize(count);
+    if (count == 0)
+        return;
+
+    BuildState state {&bvh, std::vector<BuildItem>(count), std::max(max_leaf_items, 1u)};
+    for (std::size_t i = 0; i < count; ++i)
+        state.items[i] = {bounds[i], (bounds[i].min + bounds[i].max) * 0.5f, static_cast<std::uint32_t>(i)};
+
+    // A binary tree with leaves of one item or more has fewer than twice as many nodes as items.
+    bvh.nodes.reserve(2 * count);
+    bvh.nodes.push_back({});
+    Split(state, 0, 0, static_cast<std::uint32_t>(count));
+
+    for (std::size_t i = 0; i < count; ++i)
+        bvh.items[i] = state.items[i].index;
+}
+
+void Refit(Bvh& bvh, const Bounds* bounds)
+{
+    // Children come after their parents, so they're done first backwards.
+    for (std::size_t i = bvh.nodes.size(); i-- > 0;)
+    {
+        BvhNode& node = bvh.nodes[i];
+        if (node.count > 0)
+        {
+            node.bounds = bounds[bvh.items[node.first]];
+            for (std::uint32_t j = 1; j < node.count; ++j)
+                Grow(node.bounds, bounds[bvh.items[node.first + j]]);
+        }
+        else
+        {
+            node.bounds = bvh.nodes[i + 1].bounds;
+            Grow(node.bounds, bvh.nodes[node.first].bounds);
+        }
+    }
+}
+
+
+Ray RayThrough(const glm::mat4& view_projection, const glm::vec2& point)
+{
+    const glm::mat4 inverse = glm::inverse(view_projection);
+    glm::vec4 start = inverse * glm::vec4(point, -1.0f, 1.0f);
+    glm::vec4 end   = inverse * glm::vec4(point,  1.0f, 1.0f);
+    start /= start.w;
+    end   /= end.w;
+    return {glm::vec3(start), glm::normalize(glm::vec3(end - start))};
+}
+
+float Intersect(const Ray& ray, const Bounds& bounds)
+{
+    return Intersect(ray.origin, 1.0f / ray.direction, bounds, INFINITY);
+}
+
+float Raycast(const Bvh& bvh, const Ray& ray, float max_distance, const std::function<float(std::uint32_t item, float closest)>& hit)
+{
+    return Traverse(bvh, ray, max_distance, hit);
+}
+
+
+std::size_t Query(const Bvh& bvh, const Bounds* bounds, const Frustum& frustum, std::vector<std::uint32_t>& items)
+{
+    // Outside if the box is behind any plane, inside if it's in front of all of them.
+    auto classify = [&frustum](const Bounds& box)
+    {
+        const glm::vec3 center = (box.min + box.max) * 0.5f;
+        const glm::vec3 extent = (box.max - box.min) * 0.5f;
+        int result = 1;
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            const float radius   = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (distance < -radius)
+                return -1;
+            if (distance < radius)
+                result = 0;
+        }
+        return result;
+    };
+    return Query(bvh, bounds, items, classify);
+}
+
+std::size_t Query(const Bvh& bvh, const Bounds* bounds, const glm::vec3& center, float radius, std::vector<std::uint32_t>& items)
+{
+    // Inside if the farthest corner of the box is in the sphere.
+    auto classify = [&center, radius](const Bounds& box)
+    {
+        if (SquaredDistance(box, center) > radius * radius)
+            return -1;
+        const glm::vec3 farthest = glm::max(glm::abs(box.min - center), glm::abs(box.max - center));
+        return glm::dot(farthest, farthest) <= radius * radius ? 1 : 0;
+    };
+    return Query(bvh, bounds, items, classify);
+}
+
+void Nearest(const Bvh& bvh, const Bounds* bounds, const glm::vec3& point, std::size_t k, std::vector<std::uint32_t>& items)
+{
+    items.clear();
+    if (bvh.nodes.empty() || k == 0)
+        return;
+
+    // Nodes are visited nearest first, until the nearest node left is farther than the k-th nearest item found. The
+    // items are kept in a heap with the farthest on top.
+    using Entry = std::pair<float, std::uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> nodes;
+    std::priority_queue<Entry> nearest;
+    nodes.push({SquaredDistance(bvh.nodes[0].bounds, point), 0});
+    while (!nodes.empty())
+    {
+        const Entry entry = nodes.top();
+        nodes.pop();
+        if (nearest.size() == k && entry.first > nearest.top().first)
+            break;
+
+        const BvhNode& node = bvh.nodes[entry.second];
+        if (node.count > 0)
+        {
+            for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                const std::uint32_t item = bvh.items[i];
+                const float distance = SquaredDistance(bounds[item], point);
+                if (nearest.size() < k)
+                {
+                    nearest.push({distance, item});
+                }
+                else if (distance < nearest.top().first)
+                {
+                    nearest.pop();
+                    nearest.push({distance, item});
+                }
+            }
+        }
+        else
+        {
+            nodes.push({SquaredDistance(bvh.nodes[entry.second + 1].bounds, point), entry.second + 1});
+            nodes.push({SquaredDistance(bvh.nodes[node.first].bounds, point), node.first});
+        }
+    }
+
+    items.resize(nearest.size());
+    for (std::size_t i = items.size(); i-- > 0;)
+    {
+        items[i] = nearest.top().second;
+        nearest.pop();
+    }
+}
+
+
+std::shared_ptr<MeshBvh> BuildMeshBvh(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count)
+{
+    std::shared_ptr<MeshBvh> mesh = std::make_shared<MeshBvh>();
+    mesh->positions.resize(vertex_count);
+    for (std::size_t i = 0; i < vertex_count; ++i)
+        mesh->positions[i] = vertices[i].position;
+    mesh->indices.assign(indices, indices + index_count - index_count % 3);
+
+    const std::size_t triangle_count = index_count / 3;
+    std::vector<Bounds> bounds(triangle_count);
+    for (std::size_t i = 0; i < triangle_count; ++i)
+    {
+        const glm::vec3& a = vertices[indices[3 * i + 0]].position;
+        const glm::vec3& b = vertices[indices[3 * i + 1]].position;
+        const glm::vec3& c = vertices[indices[3 * i + 2]].position;
+        bounds[i] = {glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))};
+    }
+    Build(mesh->bvh, bounds.data(), triangle_count);
+    return mesh;
+}
+
+bool Raycast(const MeshBvh& mesh, const Ray& ray, RayHit& hit)
+{
+    bool found = false;
+    auto triangle = [&](std::uint32_t item, float closest)
+    {
+        const GLuint* corners = &mesh.indices[3 * item];
+        const float distance = IntersectTriangle(ray, mesh.positions[corners[0]], mesh.positions[corners[1]], mesh.positions[corners[2]]);
+        if (distance >= closest)
+            return INFINITY;
+
+        hit.triangle = item;
+        hit.distance = distance;
+        found = true;
+        return distance;
+    };
+    Traverse(mesh.bvh, ray, hit.distance, triangle);
+    return found;
+}
+
+
+void MeshBounds(const TexturedModel& model, const Scene& scene, std::uint32_t first_node, std::vector<Bounds>& bounds)
+{
+    bounds.resize(model.meshes.size());
+    for (std::size_t i = 0; i < model.meshes.size(); ++i)
+        bounds[i] = TransformBounds(model.meshes[i].mesh.bounds, scene.worlds[first_node + model.meshes[i].node]);
+}
+
+bool Raycast(const Bvh& bvh, const TexturedModel& model, const Scene& scene, std::uint32_t first_node, const Ray& ray, RayHit& hit)
+{
+    // Every mesh is searched in model space. The direction isn't normalized after the transform, so the distances along
+    // the ray stay the same.
+    bool found = false;
+    auto mesh = [&](std::uint32_t item, float closest)
+    {
+        const TexturedMesh& textured = model.meshes[item];
+        if (!textured.mesh.bvh)
+            return INFINITY;
+
+        const glm::mat4 inverse = glm::inverse(scene.worlds[first_node + textured.node]);
+        const Ray local {glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f))};
+        RayHit local_hit;
+        local_hit.distance = closest;
+        if (!Raycast(*textured.mesh.bvh, local, local_hit))
+            return INFINITY;
+
+        hit = local_hit;
+        hit.mesh = item;
+        found = true;
+        return local_hit.distance;
+    };
+    Traverse(bvh, ray, hit.distance, mesh);
+    return found;
+}
+
+
+// Makes 'node' the root of a tree over the items in [begin, end) of state.items.
+static void Split(BuildState& state, std::uint32_t node, std::uint32_t begin, std::uint32_t end)
+{
+    Bvh& bvh = *state.bvh;
+    BuildItem* items = state.items.data();
+
+    Bounds bounds = Empty(), centers = Empty();
+    for (std::uint32_t i = begin; i < end; ++i)
+    {
+        Grow(bounds, items[i].bounds);
+        centers.min = glm::min(centers.min, items[i].center);
+        centers.max = glm::max(centers.max, items[i].center);
+    }
+    bvh.nodes[node].bounds = bounds;
+
+    const std::uint32_t count = end - begin;
+    if (count <= state.max_leaf_items)
+    {
+        bvh.nodes[node].first = begin;
+        bvh.nodes[node].count = count;
+        return;
+    }
+
+    // The split between bins with the lowest cost, which is the area of each side times the items in it (the chance of
+    // a ray hitting the side times the work to test its items).
+    struct Bin
+    {
+        Bounds bounds;
+        std::uint32_t count;
+    };
+
+    // All three axes are binned in one pass over the items. An axis along which the centers don't spread isn't split.
+    Bin bins[3][SAH_BINS];
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (Bin& bin : bins[axis])
+            bin = {Empty(), 0};
+        const float extent = centers.max[axis] - centers.min[axis];
+        scale[axis] = extent > 0.0f ? SAH_BINS / extent : 0.0f;
+    }
+    for (std::uint32_t i = begin; i < end; ++i)
+    {
+        const glm::vec3 offset = (items[i].center - centers.min) * scale;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            Bin& bin = bins[axis][std::min(static_cast<unsigned>(offset[axis]), SAH_BINS - 1)];
+            Grow(bin.bounds, items[i].bounds);
+            ++bin.count;
+        }
+    }
+
+    float best_cost = INFINITY;
+    int best_axis = -1;
+    unsigned best_split = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (scale[axis] == 0.0f)
+            continue;
+
+        // The cost of the right sides from the right, then of the left sides from the left.
+        float right_costs[SAH_BINS];
+        Bounds side = Empty();
+        std::uint32_t side_count = 0;
+        for (unsigned b = SAH_BINS - 1; b > 0; --b)
+        {
+            Grow(side, bins[axis][b].bounds);
+            side_count += bins[axis][b].count;
+            right_costs[b] = side_count > 0 ? Area(side) * side_count : 0.0f;
+        }
+        side = Empty();
+        side_count = 0;
+        for (unsigned b = 1; b < SAH_BINS; ++b)
+        {
+            Grow(side, bins[axis][b - 1].bounds);
+            side_count += bins[axis][b - 1].count;
+            const float cost = (side_count > 0 ? Area(side) * side_count : 0.0f) + right_costs[b];
+            if (side_count > 0 && side_count < count && cost < best_cost)
+            {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    std::uint32_t middle = begin + count / 2;
+    if (best_axis >= 0)
+    {
+        const float min = centers.min[best_axis], axis_scale = scale[best_axis];
+        middle = static_cast<std::uint32_t>(std::partition(items + begin, items + end, [&](const BuildItem& item)
+        {
+            return std::min(static_cast<unsigned>((item.center[best_axis] - min) * axis_scale), SAH_BINS - 1) < best_split;
+        }) - items);
+    }
+    // All the centers are in one place, so any split is as good.
+    if (middle == begin || middle == end)
+        middle = begin + count / 2;
+
+    const std::uint32_t left = static_cast<std::uint32_t>(bvh.nodes.size());
+    bvh.nodes.push_back({});
+    Split(state, left, begin, middle);
+
+    const std::uint32_t right = static_cast<std::uint32_t>(bvh.nodes.size());
+    bvh.nodes.push_back({});
+    Split(state, right, middle, end);
+
+    bvh.nodes[node].first = right;
+    bvh.nodes[node].count = 0;
+}
+
+static Bounds Empty()
+{
+    return {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+}
+
+static void Grow(Bounds& bounds, const Bounds& other)
+{
+    bounds.min = glm::min(bounds.min, other.min);
+    bounds.max = glm::max(bounds.max, other.max);
+}
+
+// Half the surface area, which is all the heuristic needs.
+static float Area(const Bounds& bounds)
+{
+    const glm::vec3 size = bounds.max - bounds.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// The slab test, with the inverse of the ray's direction. Returns the distance where the ray enters the box (0 if it
+// starts in it), or INFINITY if it misses it or enters it beyond 'max_distance'.
+static float Intersect(const glm::vec3& origin, const glm::vec3& inverse, const Bounds& bounds, float max_distance)
+{
+    const glm::vec3 to_min = (bounds.min - origin) * inverse;
+    const glm::vec3 to_max = (bounds.max - origin) * inverse;
+    const glm::vec3 entry = glm::min(to_min, to_max), exit = glm::max(to_min, to_max);
+    const float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.0f));
+    const float leave = std::min(std::min(exit.x, exit.y), std::min(exit.z, max_distance));
+    return enter <= leave ? enter : INFINITY;
+}
+
+// Moeller and Trumbore, hitting both sides. Returns the distance along the ray, or INFINITY if it misses.
+static float IntersectTriangle(const Ray& ray, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    const glm::vec3 ab = b - a, ac = c - a;
+    const glm::vec3 p = glm::cross(ray.direction, ac);
+    const float determinant = glm::dot(ab, p);
+    if (std::abs(determinant) < 1e-12f)
+        return INFINITY;
+
+    const float inverse = 1.0f / determinant;
+    const glm::vec3 t = ray.origin - a;
+    const float u = glm::dot(t, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return INFINITY;
+
+    const glm::vec3 q = glm::cross(t, ab);
+    const float v = glm::dot(ray.direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return INFINITY;
+
+    const float distance = glm::dot(ac, q) * inverse;
+    return distance >= 0.0f ? distance : INFINITY;
+}
+
+// The items under a node are the ones from its leftmost leaf up to the end of its rightmost one.
+static void AppendSubtree(const Bvh& bvh, std::uint32_t node, std::vector<std::uint32_t>& items)
+{
+    std::uint32_t leftmost = node, rightmost = node;
+    while (bvh.nodes[leftmost].count == 0)
+        leftmost = leftmost + 1;
+    while (bvh.nodes[rightmost].count == 0)
+        rightmost = bvh.nodes[rightmost].first;
+    items.insert(items.end(), bvh.items.begin() + bvh.nodes[leftmost].first, bvh.items.begin() + bvh.nodes[rightmost].first + bvh.nodes[rightmost].count);
+}
+
+static float SquaredDistance(const Bounds& bounds, const glm::vec3& point)
+{
+    const glm::vec3 outside = glm::max(glm::max(bounds.min - point, point - bounds.max), glm::vec3(0.0f));
+    return glm::dot(outside, outside);
+}
+
+// Raycast, for any function of the items.
+template <typename Hit>
+static float Traverse(const Bvh& bvh, const Ray& ray, float max_distance, Hit& hit)
+{
+    if (bvh.nodes.empty())
+        return max_distance;
+
+    const glm::vec3 inverse = 1.0f / ray.direction;
+    float closest = max_distance;
+
+    // The nodes to visit with where the ray enters them, the nearer child on top.
+    std::vector<std::pair<std::uint32_t, float>> stack;
+    stack.reserve(64);
+    const float root = Intersect(ray.origin, inverse, bvh.nodes[0].bounds, closest);
+    if (root != INFINITY)
+        stack.push_back({0, root});
+
+    while (!stack.empty())
+    {
+        const std::pair<std::uint32_t, float> entry = stack.back();
+        stack.pop_back();
+        if (entry.second > closest)
+            continue;
+
+        const BvhNode& node = bvh.nodes[entry.first];
+        if (node.count > 0)
+        {
+            for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                closest = std::min(closest, hit(bvh.items[i], closest));
+            continue;
+        }
+
+        std::uint32_t nearer = entry.first + 1, farther = node.first;
+        float nearer_distance  = Intersect(ray.origin, inverse, bvh.nodes[nearer].bounds, closest);
+        float farther_distance = Intersect(ray.origin, inverse, bvh.nodes[farther].bounds, closest);
+        if (farther_distance < nearer_distance)
+        {
+            std::swap(nearer, farther);
+            std::swap(nearer_distance, farther_distance);
+        }
+        if (farther_distance != INFINITY)
+            stack.push_back({farther, farther_distance});
+        if (nearer_distance != INFINITY)
+            stack.push_back({nearer, nearer_distance});
+    }
+    return closest;
+}
+
+// The frustum and sphere queries. 'classify' returns -1 for a box outside the volume, 1 for one inside it and 0 for
+// one that intersects its border.
+template <typename Classify>
+static std::size_t Query(const Bvh& bvh, const Bounds* bounds, std::vector<std::uint32_t>& items, Classify& classify)
+{
+    const std::size_t before = items.size();
+    if (bvh.nodes.empty())
+        return 0;
+
+    std::vector<std::uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const std::uint32_t index = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = bvh.nodes[index];
+        const int inside = classify(node.bounds);
+        if (inside < 0)
+            continue;
+        if (inside > 0)
+        {
+            AppendSubtree(bvh, index, items);
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                if (classify(bounds[bvh.items[i]]) >= 0)
+                    items.push_back(bvh.items[i]);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(index + 1);
+        }
+    }
+    return items.size() - before;
+}
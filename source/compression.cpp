@@ -0,0 +1,899 @@
+#include "compression.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NAX_SSE2 1
+#endif
+
+#include "errors.h"
+#include "utilities.h"
+#include "threading.h"
+#include "loader.h"
+
+// Not in the core profile glad was generated for.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+const unsigned COOKED_TEXTURE_VERSION = 2;
+
+unsigned supported_block_formats = 1u << UNCOMPRESSED;
+std::string texture_cache_directory = ".naxcache";
+
+
+// Forward declaration of internal functions.
+static void LoadBlock(const unsigned char* rgba, int width, int height, int x, int y, float block[16][4]);
+static void FitLine(const float block[16][4], int channels, float start[4], float end[4]);
+static void Project(const float block[16][4], const float start[4], const float end[4], int steps, int indices[16]);
+static void EncodeBC1(const float block[16][4], unsigned char* out);
+static void EncodeBC4(const float block[16][4], int channel, unsigned char* out);
+static void EncodeBC7(const float block[16][4], unsigned char* out);
+static void DecodeBC1(const unsigned char* in, unsigned char block[16][4]);
+static void DecodeBC4(const unsigned char* in, int channel, unsigned char block[16][4]);
+static void DecodeBC7(const unsigned char* in, unsigned char block[16][4]);
+static std::vector<unsigned char> ToRGBA(const unsigned char* pixels, int width, int height, int components);
+
+
+unsigned DetectBlockFormats()
+{
+    unsigned formats = (1u << UNCOMPRESSED) | (1u << BC4) | (1u << BC5);
+
+    GLint major = 0, minor = 0, count = 0;
+    GLCALL(glGetIntegerv(GL_MAJOR_VERSION, &major));
+    GLCALL(glGetIntegerv(GL_MINOR_VERSION, &minor));
+    GLCALL(glGetIntegerv(GL_NUM_EXTENSIONS, &count));
+
+    if (major > 4 || (major == 4 && minor >= 2))
+        formats |= 1u << BC7;
+
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (!extension)
+            continue;
+        if (std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            formats |= (1u << BC1) | (1u << BC3);
+        else if (std::strcmp(extension, "GL_ARB_texture_compression_bptc") == 0)
+            formats |= 1u << BC7;
+    }
+
+    return formats;
+}
+
+
+BlockFormat FormatFor(const std::string& type, const unsigned char* pixels, int width, int height, int components, unsigned supported)
+{
+    auto is_supported = [&](BlockFormat format) { return (supported & (1u << format)) != 0; };
+
+    if (type == "texture_normal")
+        return is_supported(BC5) ? BC5 : UNCOMPRESSED;
+    if (type == "texture_height" || components == 1)
+        return is_supported(BC4) ? BC4 : UNCOMPRESSED;
+
+    if (type == "texture_diffuse" || type == "texture_specular")
+    {
+        bool has_alpha = false;
+        if (components == 2 || components == 4)
+        {
+            const std::size_t count = std::size_t(width) * std::size_t(height);
+            for (std::size_t i = 0; i < count && !has_alpha; ++i)
+                has_alpha = pixels[i * components + components - 1] != 255;
+        }
+
+        if (!has_alpha)
+            return is_supported(BC1) ? BC1 : UNCOMPRESSED;
+        if (is_supported(BC7))
+            return BC7;
+        return is_supported(BC3) ? BC3 : UNCOMPRESSED;
+    }
+
+    return UNCOMPRESSED;
+}
+
+
+std::size_t BlockSize(BlockFormat format)
+{
+    switch (format)
+    {
+        case BC1: case BC4:           return 8;
+        case BC3: case BC5: case BC7: return 16;
+        default:                      return 0;
+    }
+}
+
+std::size_t LevelSize(BlockFormat format, int components, int width, int height)
+{
+    if (format == UNCOMPRESSED)
+        return std::size_t(width) * std::size_t(height) * components;
+    return std::size_t((width + 3) / 4) * std::size_t((height + 3) / 4) * BlockSize(format);
+}
+
+const char* FormatName(BlockFormat format)
+{
+    switch (format)
+    {
+        case BC1: return "bc1";
+        case BC3: return "bc3";
+        case BC4: return "bc4";
+        case BC5: return "bc5";
+        case BC7: return "bc7";
+        default:  return "rgba";
+    }
+}
+
+GLenum GLFormat(BlockFormat format)
+{
+    switch (format)
+    {
+        case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:  return GL_RGBA;
+    }
+}
+
+
+CookedImage Cook(const unsigned char* pixels, int width, int height, int components, BlockFormat format, bool srgb)
+{
+    CookedImage image;
+    image.format = format;
+    if (width <= 0 || height <= 0)
+        return image;
+
+    if (format == UNCOMPRESSED)
+    {
+        MipChain chain = GenerateMipChain(pixels, width, height, components, srgb);
+        image.components = chain.components;
+        image.levels = std::move(chain.levels);
+        image.data = std::move(chain.data);
+        return image;
+    }
+
+    // The encoders take RGBA.
+    std::vector<unsigned char> rgba = ToRGBA(pixels, width, height, components);
+    const MipChain chain = GenerateMipChain(rgba.data(), width, height, 4, srgb);
+
+    for (const MipLevel& level : chain.levels)
+    {
+        const std::size_t offset = image.levels.empty() ? 0 : image.levels.back().offset + image.levels.back().size;
+        image.levels.push_back({level.width, level.height, offset, LevelSize(format, 4, level.width, level.height)});
+    }
+    image.data.resize(image.levels.back().offset + image.levels.back().size);
+
+    for (std::size_t i = 0; i < image.levels.size(); ++i)
+    {
+        const MipLevel& level = image.levels[i];
+        EncodeBlocks(format, chain.data.data() + chain.levels[i].offset, level.width, level.height, image.data.data() + level.offset);
+    }
+
+    return image;
+}
+
+
+void EncodeBlocks(BlockFormat format, const unsigned char* rgba, int width, int height, unsigned char* blocks)
+{
+    const int blocks_x = (width  + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const std::size_t block_size = BlockSize(format);
+
+    ParallelFor(static_cast<unsigned>(blocks_y), ThreadsFor(std::size_t(blocks_x) * blocks_y, 1024), [&](unsigned row)
+    {
+        for (int column = 0; column < blocks_x; ++column)
+        {
+            float block[16][4];
+            LoadBlock(rgba, width, height, column * 4, static_cast<int>(row) * 4, block);
+
+            unsigned char* out = blocks + (std::size_t(row) * blocks_x + column) * block_size;
+            switch (format)
+            {
+                case BC1: EncodeBC1(block, out); break;
+                case BC3: EncodeBC4(block, 3, out); EncodeBC1(block, out + 8); break;
+                case BC4: EncodeBC4(block, 0, out); break;
+                case BC5: EncodeBC4(block, 0, out); EncodeBC4(block, 1, out + 8); break;
+                case BC7: EncodeBC7(block, out); break;
+                default:  break;
+            }
+        }
+    });
+}
+
+void DecodeBlocks(BlockFormat format, const unsigned char* blocks, int width, int height, unsigned char* rgba)
+{
+    const int blocks_x = (width  + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const std::size_t block_size = BlockSize(format);
+
+    for (int row = 0; row < blocks_y; ++row)
+    {
+        for (int column = 0; column < blocks_x; ++column)
+        {
+            const unsigned char* in = blocks + (std::size_t(row) * blocks_x + column) * block_size;
+
+            unsigned char block[16][4];
+            for (int i = 0; i < 16; ++i)
+                block[i][0] = block[i][1] = block[i][2] = 0, block[i][3] = 255;
+
+            switch (format)
+            {
+                case BC1: DecodeBC1(in, block); break;
+                case BC3: DecodeBC1(in + 8, block); DecodeBC4(in, 3, block); break;
+                case BC4: DecodeBC4(in, 0, block); break;
+                case BC5: DecodeBC4(in, 0, block); DecodeBC4(in + 8, 1, block); break;
+                case BC7: DecodeBC7(in, block); break;
+                default:  break;
+            }
+
+            for (int y = 0; y < 4; ++y)
+                for (int x = 0; x < 4; ++x)
+                    if (column * 4 + x < width && row * 4 + y < height)
+                        std::memcpy(rgba + (std::size_t(row * 4 + y) * width + column * 4 + x) * 4, block[y * 4 + x], 4);
+        }
+    }
+}
+
+
+GLuint UploadCooked(const CookedImage& image)
+{
+    if (image.levels.empty())
+        return 0;
+
+    GLuint id;
+    GLCALL(glGenTextures(1, &id));
+    GLCALL(glBindTexture(GL_TEXTURE_2D, id));
+    GLCALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));  // Rows of the levels are tightly packed.
+
+    for (std::size_t i = 0; i < image.levels.size(); ++i)
+    {
+        const MipLevel& level = image.levels[i];
+        const unsigned char* data = image.data.data() + level.offset;
+        if (image.format == UNCOMPRESSED)
+        {
+            const GLenum format = ImageFormat(image.components);
+            GLCALL(glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, data));
+        }
+        else
+        {
+            GLCALL(glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GLFormat(image.format), level.width, level.height, 0,
+                                          static_cast<GLsizei>(level.size), data));
+        }
+    }
+
+    GLCALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size() - 1)));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+
+    return id;
+}
+
+
+// ---- DDS ----
+// Only what's needed for the formats above, and uncompressed images with 8 bit channels in RGBA order (gray ones as
+// luminance). BC7 needs the DX10 extension of the header.
+struct DDSPixelFormat
+{
+    std::uint32_t size, flags, four_cc, rgb_bit_count, masks[4];
+};
+
+struct DDSHeader
+{
+    std::uint32_t size, flags, height, width, linear_size, depth, mip_map_count, reserved[11];
+    DDSPixelFormat pixel_format;
+    std::uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    std::uint32_t dxgi_format, resource_dimension, misc_flag, array_size, misc_flags2;
+};
+
+static const std::uint32_t DDS_MAGIC          = 0x20534444;  // "DDS "
+static const std::uint32_t DDSD_REQUIRED      = 0x1 | 0x2 | 0x4 | 0x1000;  // Caps, height, width and pixel format.
+static const std::uint32_t DDSD_MIPMAPCOUNT   = 0x20000;
+static const std::uint32_t DDSD_PITCH         = 0x8;
+static const std::uint32_t DDSD_LINEARSIZE    = 0x80000;
+static const std::uint32_t DDPF_ALPHAPIXELS   = 0x1;
+static const std::uint32_t DDPF_FOURCC        = 0x4;
+static const std::uint32_t DDPF_RGB           = 0x40;
+static const std::uint32_t DDPF_LUMINANCE     = 0x20000;
+static const std::uint32_t DDSCAPS_TEXTURE    = 0x1000;
+static const std::uint32_t DDSCAPS_MIPMAP     = 0x400000;
+static const std::uint32_t DDSCAPS_COMPLEX    = 0x8;
+static const std::uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+static const std::uint32_t DIMENSION_TEXTURE2D   = 3;
+
+// The pixel format of an uncompressed image with 'components' 8 bit channels.
+static DDSPixelFormat PixelFormat(int components)
+{
+    DDSPixelFormat format {};
+    format.size          = sizeof(DDSPixelFormat);
+    format.flags         = (components <= 2 ? DDPF_LUMINANCE : DDPF_RGB) | (components % 2 == 0 ? DDPF_ALPHAPIXELS : 0);
+    format.rgb_bit_count = 8 * components;
+    switch (components)
+    {
+        case 1: format.masks[0] = 0xFF; break;
+        case 2: format.masks[0] = 0xFF; format.masks[3] = 0xFF00; break;
+        case 3: format.masks[0] = 0xFF; format.masks[1] = 0xFF00; format.masks[2] = 0xFF0000; break;
+        case 4: format.masks[0] = 0xFF; format.masks[1] = 0xFF00; format.masks[2] = 0xFF0000; format.masks[3] = 0xFF000000; break;
+    }
+    return format;
+}
+
+static std::uint32_t FourCC(const char code[5])
+{
+    return std::uint32_t(code[0]) | (std::uint32_t(code[1]) << 8) | (std::uint32_t(code[2]) << 16) | (std::uint32_t(code[3]) << 24);
+}
+
+static std::uint32_t FourCC(BlockFormat format)
+{
+    switch (format)
+    {
+        case BC1: return FourCC("DXT1");
+        case BC3: return FourCC("DXT5");
+        case BC4: return FourCC("ATI1");
+        case BC5: return FourCC("ATI2");
+        default:  return FourCC("DX10");
+    }
+}
+
+
+std::string CookedTexturePath(unsigned long long key, const std::string& type)
+{
+    // The format depends on what the context supports, so another GPU gets its own cache.
+    const unsigned long long seed = ContentHash(&supported_block_formats, sizeof(supported_block_formats), key + COOKED_TEXTURE_VERSION);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.dds", ContentHash(type.data(), type.size(), seed));
+    return texture_cache_directory + DIRECTORY_SEPERATOR + name;
+}
+
+Return<CookedImage> ReadDDS(const std::string& path)
+{
+    Return<MappedFile> mapped = Map(path);
+    if (mapped.error)
+        return mapped.error;
+
+    MappedFile file = mapped.value;
+    auto fail = [&](const char* reason) -> const Error*
+    {
+        Unmap(file);
+        return CreateError("Texture cache '%s' is invalid: %s", path.c_str(), reason);
+    };
+
+    std::uint32_t magic;
+    DDSHeader header;
+    std::size_t offset = sizeof(magic) + sizeof(header);
+    if (file.size < offset)
+        return fail("it's too small.");
+    std::memcpy(&magic, file.data, sizeof(magic));
+    std::memcpy(&header, file.data + sizeof(magic), sizeof(header));
+    if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.pixel_format.size != sizeof(DDSPixelFormat))
+        return fail("it's not a DDS file.");
+
+    CookedImage image;
+    const std::uint32_t four_cc = header.pixel_format.four_cc;
+    bool known = false;
+    if (!(header.pixel_format.flags & DDPF_FOURCC))
+    {
+        image.components = static_cast<int>(header.pixel_format.rgb_bit_count / 8);
+        const DDSPixelFormat expected = PixelFormat(image.components);
+        known = image.components >= 1 && image.components <= 4 && std::memcmp(&header.pixel_format, &expected, sizeof(expected)) == 0;
+    }
+    for (BlockFormat format : {BC1, BC3, BC4, BC5})
+    {
+        if ((header.pixel_format.flags & DDPF_FOURCC) && four_cc == FourCC(format))
+            image.format = format, known = true;
+    }
+    if ((header.pixel_format.flags & DDPF_FOURCC) && four_cc == FourCC("DX10"))
+    {
+        DDSHeaderDX10 extension;
+        if (file.size < offset + sizeof(extension))
+            return fail("it's too small.");
+        std::memcpy(&extension, file.data + offset, sizeof(extension));
+        offset += sizeof(extension);
+        if (extension.dxgi_format == DXGI_FORMAT_BC7_UNORM)
+            image.format = BC7, known = true;
+    }
+    if (!known)
+        return fail("the format isn't supported.");
+    if (header.width == 0 || header.height == 0 || header.width > 1u << 16 || header.height > 1u << 16)
+        return fail("the size is out of range.");
+
+    const std::uint32_t level_count = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mip_map_count, 1u) : 1;
+    int width = static_cast<int>(header.width), height = static_cast<int>(header.height);
+    std::size_t size = 0;
+    for (std::uint32_t i = 0; i < level_count; ++i)
+    {
+        const std::size_t level_size = LevelSize(image.format, image.components, width, height);
+        image.levels.push_back({width, height, size, level_size});
+        size += level_size;
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(1, width / 2), height = std::max(1, height / 2);
+    }
+    if (file.size - offset < size)
+        return fail("it's truncated.");
+
+    image.data.assign(file.data + offset, file.data + offset + size);
+    Unmap(file);
+
+    return image;
+}
+
+Return<bool> WriteDDS(const std::string& path, const CookedImage& image)
+{
+    if (image.levels.empty())
+        return CreateError("Can't write '%s', the image is empty.", path.c_str());
+    if (!MakeDirectory(texture_cache_directory))
+        return CreateError("Couldn't create the texture cache directory '%s'.", texture_cache_directory.c_str());
+
+    const std::uint32_t magic = DDS_MAGIC;
+    DDSHeader header {};
+    header.size          = sizeof(DDSHeader);
+    header.flags         = DDSD_REQUIRED | DDSD_MIPMAPCOUNT | (image.format == UNCOMPRESSED ? DDSD_PITCH : DDSD_LINEARSIZE);
+    header.width         = static_cast<std::uint32_t>(image.levels[0].width);
+    header.height        = static_cast<std::uint32_t>(image.levels[0].height);
+    header.linear_size   = static_cast<std::uint32_t>(image.format == UNCOMPRESSED ? image.levels[0].size / image.levels[0].height : image.levels[0].size);
+    header.mip_map_count = static_cast<std::uint32_t>(image.levels.size());
+    if (image.format == UNCOMPRESSED)
+    {
+        header.pixel_format = PixelFormat(image.components);
+    }
+    else
+    {
+        header.pixel_format.size    = sizeof(DDSPixelFormat);
+        header.pixel_format.flags   = DDPF_FOURCC;
+        header.pixel_format.four_cc = FourCC(image.format);
+    }
+    header.caps = DDSCAPS_TEXTURE | (image.levels.size() > 1 ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0);
+
+    DDSHeaderDX10 extension {};
+    extension.dxgi_format        = DXGI_FORMAT_BC7_UNORM;
+    extension.resource_dimension = DIMENSION_TEXTURE2D;
+    extension.array_size         = 1;
+
+    // Unique, as the same texture may be cooked by several requests at once.
+    static std::atomic<unsigned> writes {0};
+    const std::string temporary = path + "." + std::to_string(writes++) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return CreateError("Couldn't open '%s' for writing.", temporary.c_str());
+
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (image.format == BC7)
+        file.write(reinterpret_cast<const char*>(&extension), sizeof(extension));
+    file.write(reinterpret_cast<const char*>(image.data.data()), static_cast<std::streamsize>(image.data.size()));
+
+    file.close();
+    if (!file)
+    {
+        std::remove(temporary.c_str());
+        return CreateError("Couldn't write '%s'.", temporary.c_str());
+    }
+
+    std::remove(path.c_str());  // Renaming onto an existing file fails on Windows.
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return CreateError("Couldn't rename '%s' to '%s'.", temporary.c_str(), path.c_str());
+    }
+
+    return true;
+}
+
+
+// ---- ENCODING ----
+// All encoders fit a line through the colors of the block, use its extremes as endpoints and pick the closest
+// interpolated color for every pixel by projecting it onto the quantized endpoints.
+
+// Loads the 4x4 block at (x, y), repeating the last row/column for blocks on the edge.
+static void LoadBlock(const unsigned char* rgba, int width, int height, int x, int y, float block[16][4])
+{
+    for (int j = 0; j < 4; ++j)
+    {
+        const int row = std::min(y + j, height - 1);
+        for (int i = 0; i < 4; ++i)
+        {
+            const unsigned char* pixel = rgba + (std::size_t(row) * width + std::min(x + i, width - 1)) * 4;
+            for (int c = 0; c < 4; ++c)
+                block[j * 4 + i][c] = pixel[c];
+        }
+    }
+}
+
+// Fits a line through the first 'channels' channels of the block (the principal axis, by power iteration) and
+// returns the extremes of the block on it.
+static void FitLine(const float block[16][4], int channels, float start[4], float end[4])
+{
+    float mean[4] = {}, low[4], high[4];
+    for (int c = 0; c < 4; ++c)
+        low[c] = high[c] = block[0][c];
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < channels; ++c)
+        {
+            mean[c] += block[i][c] / 16.0f;
+            low[c]  = std::min(low[c],  block[i][c]);
+            high[c] = std::max(high[c], block[i][c]);
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+    float axis[4] = {};
+    for (int c = 0; c < channels; ++c)
+        axis[c] = high[c] - low[c];
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {}, length = 0.0f;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length == 0.0f)
+            break;
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    float length_squared = 0.0f;
+    for (int c = 0; c < channels; ++c)
+        length_squared += axis[c] * axis[c];
+
+    for (int c = 0; c < 4; ++c)
+        start[c] = end[c] = (c < channels) ? mean[c] : block[0][c];
+    if (length_squared == 0.0f)
+        return;
+
+    float minimum = 0.0f, maximum = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (block[i][c] - mean[c]) * axis[c];
+        minimum = std::min(minimum, t);
+        maximum = std::max(maximum, t);
+    }
+    for (int c = 0; c < channels; ++c)
+    {
+        start[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minimum / length_squared));
+        end[c]   = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maximum / length_squared));
+    }
+}
+
+// For every pixel, the step from 0 (start) to 'steps' (end) closest to its projection on the line.
+static void Project(const float block[16][4], const float start[4], const float end[4], int steps, int indices[16])
+{
+    float axis[4], length_squared = 0.0f;
+    for (int c = 0; c < 4; ++c)
+    {
+        axis[c] = end[c] - start[c];
+        length_squared += axis[c] * axis[c];
+    }
+    if (length_squared == 0.0f)
+    {
+        std::fill(indices, indices + 16, 0);
+        return;
+    }
+    const float scale = steps / length_squared;
+
+#if NAX_SSE2
+    // Four pixels at a time, one channel per register.
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maximum = _mm_set1_ps(static_cast<float>(steps));
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 t = zero;
+        for (int c = 0; c < 4; ++c)
+        {
+            const __m128 channel = _mm_set_ps(block[i + 3][c], block[i + 2][c], block[i + 1][c], block[i][c]);
+            t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(channel, _mm_set1_ps(start[c])), _mm_set1_ps(axis[c] * scale)));
+        }
+        t = _mm_min_ps(_mm_max_ps(t, zero), maximum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), _mm_cvtps_epi32(t));  // Rounds to nearest.
+    }
+#else
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < 4; ++c)
+            t += (block[i][c] - start[c]) * axis[c];
+        indices[i] = static_cast<int>(std::lround(std::min(float(steps), std::max(0.0f, t * scale))));
+    }
+#endif
+}
+
+static std::uint16_t To565(const float color[3])
+{
+    const unsigned r = static_cast<unsigned>(std::lround(color[0] * 31.0f / 255.0f));
+    const unsigned g = static_cast<unsigned>(std::lround(color[1] * 63.0f / 255.0f));
+    const unsigned b = static_cast<unsigned>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void From565(std::uint16_t color, float out[4])
+{
+    const unsigned r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    out[0] = float((r << 3) | (r >> 2));
+    out[1] = float((g << 2) | (g >> 4));
+    out[2] = float((b << 3) | (b >> 2));
+    out[3] = 0.0f;
+}
+
+static void EncodeBC1(const float block[16][4], unsigned char* out)
+{
+    float start[4], end[4];
+    FitLine(block, 3, start, end);
+
+    std::uint16_t color0 = To565(start), color1 = To565(end);
+    // color0 > color1 selects the four color mode, which is the only mode used.
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    std::uint32_t bits = 0;
+    if (color0 != color1)
+    {
+        float decoded0[4], decoded1[4];
+        From565(color0, decoded0);
+        From565(color1, decoded1);
+
+        float rgb[16][4];
+        for (int i = 0; i < 16; ++i)
+            rgb[i][0] = block[i][0], rgb[i][1] = block[i][1], rgb[i][2] = block[i][2], rgb[i][3] = 0.0f;
+
+        // The palette is color0, color1, 2/3 color0 + 1/3 color1 and 1/3 color0 + 2/3 color1.
+        static const std::uint32_t ORDER[4] = {0, 2, 3, 1};
+        int indices[16];
+        Project(rgb, decoded0, decoded1, 3, indices);
+        for (int i = 0; i < 16; ++i)
+            bits |= ORDER[indices[i]] << (2 * i);
+    }
+
+    out[0] = color0 & 0xFF, out[1] = color0 >> 8;
+    out[2] = color1 & 0xFF, out[3] = color1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+static void EncodeBC4(const float block[16][4], int channel, unsigned char* out)
+{
+    float minimum = 255.0f, maximum = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        minimum = std::min(minimum, block[i][channel]);
+        maximum = std::max(maximum, block[i][channel]);
+    }
+
+    // value0 > value1 selects the mode with six interpolated values. The palette is value0, value1 and then
+    // (6 value0 + value1) / 7 to (value0 + 6 value1) / 7.
+    const unsigned value0 = static_cast<unsigned>(std::lround(maximum));
+    const unsigned value1 = static_cast<unsigned>(std::lround(minimum));
+
+    std::uint64_t bits = 0;
+    if (value0 != value1)
+    {
+        float line[16][4] = {};
+        for (int i = 0; i < 16; ++i)
+            line[i][0] = block[i][channel];
+        const float start[4] = {float(value0)}, end[4] = {float(value1)};
+
+        static const std::uint64_t ORDER[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+        int indices[16];
+        Project(line, start, end, 7, indices);
+        for (int i = 0; i < 16; ++i)
+            bits |= ORDER[indices[i]] << (3 * i);
+    }
+
+    out[0] = static_cast<unsigned char>(value0);
+    out[1] = static_cast<unsigned char>(value1);
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+struct BitWriter
+{
+    unsigned char* out;
+    unsigned position;
+
+    void Write(unsigned value, unsigned count)
+    {
+        for (unsigned i = 0; i < count; ++i, ++position)
+            if ((value >> i) & 1)
+                out[position / 8] |= static_cast<unsigned char>(1u << (position % 8));
+    }
+};
+
+struct BitReader
+{
+    const unsigned char* in;
+    unsigned position;
+
+    unsigned Read(unsigned count)
+    {
+        unsigned value = 0;
+        for (unsigned i = 0; i < count; ++i, ++position)
+            value |= ((in[position / 8] >> (position % 8)) & 1u) << i;
+        return value;
+    }
+};
+
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Mode 6: one subset of RGBA endpoints with 7 bits per channel plus a shared lowest bit per endpoint, and 4 bit indices.
+static void EncodeBC7(const float block[16][4], unsigned char* out)
+{
+    float line[2][4];
+    FitLine(block, 4, line[0], line[1]);
+
+    unsigned endpoints[2][4], p[2];
+    float decoded[2][4];
+    for (int e = 0; e < 2; ++e)
+    {
+        float best = -1.0f;
+        for (unsigned bit = 0; bit < 2; ++bit)
+        {
+            unsigned quantized[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                const long value = std::lround((line[e][c] - float(bit)) / 2.0f);
+                quantized[c] = static_cast<unsigned>(std::min(127L, std::max(0L, value)));
+                const float difference = float(quantized[c] * 2 + bit) - line[e][c];
+                error += difference * difference;
+            }
+            if (best < 0.0f || error < best)
+            {
+                best = error;
+                p[e] = bit;
+                for (int c = 0; c < 4; ++c)
+                {
+                    endpoints[e][c] = quantized[c];
+                    decoded[e][c] = float(quantized[c] * 2 + bit);
+                }
+            }
+        }
+    }
+
+    // The weights are close enough to i * 64 / 15 for the projection to find the closest one.
+    int indices[16];
+    Project(block, decoded[0], decoded[1], 15, indices);
+
+    // The highest bit of the first index is implicitly 0.
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; ++c)
+            std::swap(endpoints[0][c], endpoints[1][c]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer {out, 0};
+    writer.Write(1u << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.Write(endpoints[0][c], 7);
+        writer.Write(endpoints[1][c], 7);
+    }
+    writer.Write(p[0], 1);
+    writer.Write(p[1], 1);
+    writer.Write(static_cast<unsigned>(indices[0]), 3);
+    for (int i = 1; i < 16; ++i)
+        writer.Write(static_cast<unsigned>(indices[i]), 4);
+}
+
+
+// ---- DECODING ----
+static void DecodeBC1(const unsigned char* in, unsigned char block[16][4])
+{
+    const std::uint16_t color0 = static_cast<std::uint16_t>(in[0] | (in[1] << 8));
+    const std::uint16_t color1 = static_cast<std::uint16_t>(in[2] | (in[3] << 8));
+
+    float palette[4][4];
+    From565(color0, palette[0]);
+    From565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    const std::uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | (std::uint32_t(in[7]) << 24);
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            block[i][c] = static_cast<unsigned char>(std::lround(palette[(bits >> (2 * i)) & 3][c]));
+}
+
+static void DecodeBC4(const unsigned char* in, int channel, unsigned char block[16][4])
+{
+    float palette[8];
+    palette[0] = in[0];
+    palette[1] = in[1];
+    for (int i = 2; i < 8; ++i)
+    {
+        if (in[0] > in[1])
+            palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7.0f;
+        else
+            palette[i] = (i < 6) ? ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5.0f : (i == 6 ? 0.0f : 255.0f);
+    }
+
+    std::uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= std::uint64_t(in[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        block[i][channel] = static_cast<unsigned char>(std::lround(palette[(bits >> (3 * i)) & 7]));
+}
+
+// Only mode 6, the one written by EncodeBC7. Other modes decode to black.
+static void DecodeBC7(const unsigned char* in, unsigned char block[16][4])
+{
+    BitReader reader {in, 0};
+    if (reader.Read(7) != (1u << 6))
+    {
+        for (int i = 0; i < 16; ++i)
+            block[i][0] = block[i][1] = block[i][2] = block[i][3] = 0;
+        return;
+    }
+
+    unsigned endpoints[2][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = reader.Read(7) << 1;
+        endpoints[1][c] = reader.Read(7) << 1;
+    }
+    const unsigned p0 = reader.Read(1), p1 = reader.Read(1);
+    for (int c = 0; c < 4; ++c)
+        endpoints[0][c] |= p0, endpoints[1][c] |= p1;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const int weight = BC7_WEIGHTS[reader.Read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c)
+            block[i][c] = static_cast<unsigned char>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+    }
+}
+
+
+// ---- CONVERSION ----
+static std::vector<unsigned char> ToRGBA(const unsigned char* pixels, int width, int height, int components)
+{
+    const std::size_t count = std::size_t(width) * std::size_t(height);
+    std::vector<unsigned char> rgba(count * 4);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const unsigned char* in = pixels + i * components;
+        unsigned char* out = rgba.data() + i * 4;
+        switch (components)
+        {
+            case 1:  out[0] = out[1] = out[2] = in[0]; out[3] = 255;   break;
+            case 2:  out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+            case 3:  out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+            default: std::memcpy(out, in, 4); break;
+        }
+    }
+    return rgba;
+}
@@ -0,0 +1,210 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/geometric.hpp>
+
+#include "threading.h"
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+#endif
+
+
+// The visible flags of four objects for every 4 bit mask of the SIMD comparisons, as they're laid out in memory, and
+// how many of them are set.
+static const std::uint8_t MASK_BYTES[16][4] = {
+    {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0}, {1, 1, 0, 0}, {0, 0, 1, 0}, {1, 0, 1, 0}, {0, 1, 1, 0}, {1, 1, 1, 0},
+    {0, 0, 0, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {1, 1, 0, 1}, {0, 0, 1, 1}, {1, 0, 1, 1}, {0, 1, 1, 1}, {1, 1, 1, 1},
+};
+static const unsigned MASK_COUNTS[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+
+// Forward declaration of internal functions.
+static std::size_t CullRange(const BoundsTable& table, const Frustum& frustum, std::uint8_t* visible, std::size_t begin, std::size_t end);
+
+
+Frustum ExtractFrustum(const glm::mat4& matrix)
+{
+    // The rows of the matrix. glm is column major.
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // Left.
+    frustum.planes[1] = rows[3] - rows[0];  // Right.
+    frustum.planes[2] = rows[3] + rows[1];  // Bottom.
+    frustum.planes[3] = rows[3] - rows[1];  // Top.
+    frustum.planes[4] = rows[3] + rows[2];  // Near.
+    frustum.planes[5] = rows[3] - rows[2];  // Far.
+    for (glm::vec4& plane : frustum.planes)
+    {
+        const float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f)
+            plane /= length;
+    }
+    return frustum;
+}
+
+bool Intersects(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+    for (const glm::vec4& plane : frustum.planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    return true;
+}
+
+
+Bounds TransformBounds(const Bounds& bounds, const glm::mat4& matrix)
+{
+    // The extents along every world axis are the absolute columns of the matrix weighted by the extents of the box.
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    const glm::vec3 world  = glm::vec3(matrix * glm::vec4(center, 1.0f));
+    const glm::vec3 world_extent = glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y + glm::abs(glm::vec3(matrix[2])) * extent.z;
+    return {world - world_extent, world + world_extent};
+}
+
+Sphere TransformSphere(const Sphere& sphere, const glm::mat4& matrix)
+{
+    const float scale = std::sqrt(std::max(glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])), std::max(glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1])), glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2])))));
+    return {glm::vec3(matrix * glm::vec4(sphere.center, 1.0f)), sphere.radius * scale};
+}
+
+
+void Reset(BoundsTable& table, std::size_t count)
+{
+    table.center_x.resize(count);
+    table.center_y.resize(count);
+    table.center_z.resize(count);
+    table.extent_x.resize(count);
+    table.extent_y.resize(count);
+    table.extent_z.resize(count);
+    table.radius.resize(count);
+}
+
+void Set(BoundsTable& table, std::size_t index, const Bounds& bounds, float radius)
+{
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    table.center_x[index] = center.x;
+    table.center_y[index] = center.y;
+    table.center_z[index] = center.z;
+    table.extent_x[index] = extent.x;
+    table.extent_y[index] = extent.y;
+    table.extent_z[index] = extent.z;
+    table.radius[index]   = radius;
+}
+
+std::size_t CullBounds(const BoundsTable& table, const Frustum& frustum, std::vector<std::uint8_t>& visible, unsigned thread_count)
+{
+    const std::size_t count = table.radius.size();
+    visible.resize(count);
+    if (count < CULL_THREADING_THRESHOLD)
+        return CullRange(table, frustum, visible.data(), 0, count);
+
+    // A chunk per thread, each a multiple of the SIMD width so only the last one has a scalar tail.
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+    const unsigned chunks = static_cast<unsigned>(std::min<std::size_t>(thread_count, count / (CULL_THREADING_THRESHOLD / 2)));
+    const std::size_t chunk_size = ((count + chunks - 1) / chunks + CULL_WIDTH - 1) / CULL_WIDTH * CULL_WIDTH;
+
+    std::vector<std::size_t> kept(chunks, 0);
+    ParallelFor(FramePool(), chunks, chunks, [&](unsigned chunk)
+    {
+        const std::size_t begin = std::min(count, chunk * chunk_size);
+        const std::size_t end   = std::min(count, begin + chunk_size);
+        kept[chunk] = CullRange(table, frustum, visible.data(), begin, end);
+    });
+
+    std::size_t total = 0;
+    for (std::size_t k : kept)
+        total += k;
+    return total;
+}
+
+
+// CullBounds for the objects in [begin, end), where 'begin' is a multiple of CULL_WIDTH.
+static std::size_t CullRange(const BoundsTable& table, const Frustum& frustum, std::uint8_t* visible, std::size_t begin, std::size_t end)
+{
+    const float* center_x = table.center_x.data();
+    const float* center_y = table.center_y.data();
+    const float* center_z = table.center_z.data();
+    const float* extent_x = table.extent_x.data();
+    const float* extent_y = table.extent_y.data();
+    const float* extent_z = table.extent_z.data();
+    const float* radius   = table.radius.data();
+
+    // An object is outside a plane when the distance of its center is below minus the smaller of its radius and the
+    // projection of its box onto the plane's normal.
+    glm::vec4 normals[6];
+    for (int p = 0; p < 6; ++p)
+        normals[p] = glm::vec4(glm::abs(glm::vec3(frustum.planes[p])), 0.0f);
+
+    std::size_t kept = 0;
+    std::size_t i = begin;
+
+#if defined(__AVX__)
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(center_x + i), cy = _mm256_loadu_ps(center_y + i), cz = _mm256_loadu_ps(center_z + i);
+        const __m256 ex = _mm256_loadu_ps(extent_x + i), ey = _mm256_loadu_ps(extent_y + i), ez = _mm256_loadu_ps(extent_z + i);
+        const __m256 r  = _mm256_loadu_ps(radius + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))), _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+            const __m256 box = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(normals[p].x)), _mm256_mul_ps(ey, _mm256_set1_ps(normals[p].y))), _mm256_mul_ps(ez, _mm256_set1_ps(normals[p].z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(r, box)), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        const int mask = _mm256_movemask_ps(inside);
+        std::memcpy(visible + i,     &MASK_BYTES[mask & 15], 4);
+        std::memcpy(visible + i + 4, &MASK_BYTES[mask >> 4], 4);
+        kept += MASK_COUNTS[mask & 15] + MASK_COUNTS[mask >> 4];
+    }
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(center_x + i), cy = _mm_loadu_ps(center_y + i), cz = _mm_loadu_ps(center_z + i);
+        const __m128 ex = _mm_loadu_ps(extent_x + i), ey = _mm_loadu_ps(extent_y + i), ez = _mm_loadu_ps(extent_z + i);
+        const __m128 r  = _mm_loadu_ps(radius + i);
+
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+        for (int p = 0; p < 6; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))), _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            const __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(normals[p].x)), _mm_mul_ps(ey, _mm_set1_ps(normals[p].y))), _mm_mul_ps(ez, _mm_set1_ps(normals[p].z)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(r, box)), _mm_setzero_ps()));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        std::memcpy(visible + i, &MASK_BYTES[mask], 4);
+        kept += MASK_COUNTS[mask];
+    }
+#endif
+
+    // What's left over, the same way.
+    for (; i < end; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            const float distance = center_x[i] * plane.x + center_y[i] * plane.y + center_z[i] * plane.z + plane.w;
+            const float box = extent_x[i] * normals[p].x + extent_y[i] * normals[p].y + extent_z[i] * normals[p].z;
+            inside = distance + std::min(radius[i], box) >= 0.0f;
+        }
+        visible[i] = inside ? 1 : 0;
+        kept += inside;
+    }
+    return kept;
+}
@@ -0,0 +1,387 @@
+#include "geometry.h"
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+#include "opengl.h"
+
+
+GeometryArena geometry_arena;
+
+
+// Forward declaration of internal functions.
+static unsigned CreateBlock(GeometryArena& arena, VertexFormat format, std::size_t vertex_capacity, std::size_t index_capacity);
+static void SetAttributes(VertexFormat format);
+static void Remove(FreeList& list, std::map<std::size_t, std::size_t>::iterator range);
+static void Insert(FreeList& list, std::size_t offset, std::size_t size);
+static std::size_t AlignIndices(std::size_t bytes);
+
+
+void Create(FreeList& list, std::size_t capacity)
+{
+    list = {};
+    list.capacity = capacity;
+    if (capacity > 0)
+        Insert(list, 0, capacity);
+}
+
+bool Allocate(FreeList& list, std::size_t size, std::size_t& offset)
+{
+    offset = 0;
+    if (size == 0)
+        return true;
+
+    // The smallest range that fits, allocated from its start.
+    const auto best = list.by_size.lower_bound(size);
+    if (best == list.by_size.end())
+        return false;
+
+    const std::size_t range_offset = best->second, range_size = best->first;
+    Remove(list, list.by_offset.find(range_offset));
+    if (range_size > size)
+        Insert(list, range_offset + size, range_size - size);
+
+    offset = range_offset;
+    list.used += size;
+    return true;
+}
+
+void Free(FreeList& list, std::size_t offset, std::size_t size)
+{
+    if (size == 0)
+        return;
+    list.used -= size;
+
+    // Merged with the free ranges right before and after it.
+    auto next = list.by_offset.lower_bound(offset);
+    if (next != list.by_offset.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size  += previous->second;
+            Remove(list, previous);
+        }
+    }
+    if (next != list.by_offset.end() && offset + size == next->first)
+    {
+        size += next->second;
+        Remove(list, next);
+    }
+    Insert(list, offset, size);
+}
+
+float Fragmentation(const FreeList& list)
+{
+    const std::size_t free = list.capacity - list.used;
+    if (free == 0 || list.by_size.empty())
+        return 0.0f;
+    return 1.0f - static_cast<float>(list.by_size.rbegin()->first) / static_cast<float>(free);
+}
+
+
+unsigned Allocate(GeometryArena& arena, VertexFormat format, const void* vertices, std::size_t vertex_count, const void* indices, std::size_t index_bytes)
+{
+    const std::size_t vertex_size = VertexSize(format);
+    const std::size_t index_space = AlignIndices(index_bytes);
+
+    GeometryAllocation allocation {format, 0, 0, vertex_count, 0, index_bytes, true};
+    std::vector<GeometryBlock>& blocks = arena.blocks[format];
+    bool found = false;
+    for (unsigned b = 0; b < blocks.size() && !found; ++b)
+    {
+        if (!Allocate(blocks[b].vertices, vertex_count, allocation.vertex_offset))
+            continue;
+        if (!Allocate(blocks[b].indices, index_space, allocation.index_offset))
+        {
+            Free(blocks[b].vertices, allocation.vertex_offset, vertex_count);
+            continue;
+        }
+        allocation.block = b;
+        found = true;
+    }
+    if (!found)
+    {
+        const std::size_t vertex_capacity = std::max(arena.block_vertex_bytes / vertex_size, vertex_count);
+        const std::size_t index_capacity  = std::max(AlignIndices(arena.block_index_bytes), index_space);
+        allocation.block = CreateBlock(arena, format, vertex_capacity, index_capacity);
+        Allocate(blocks[allocation.block].vertices, vertex_count, allocation.vertex_offset);
+        Allocate(blocks[allocation.block].indices, index_space, allocation.index_offset);
+    }
+
+    const GeometryBlock& block = blocks[allocation.block];
+    if (vertex_count > 0)
+    {
+        GLCALL(glBindBuffer(GL_ARRAY_BUFFER, block.vbo));
+        GLCALL(glBufferSubData(GL_ARRAY_BUFFER, allocation.vertex_offset * vertex_size, vertex_count * vertex_size, vertices));
+    }
+    if (index_bytes > 0)
+    {
+        // Through the copy target, as binding GL_ELEMENT_ARRAY_BUFFER would change whatever vertex array is bound.
+        GLCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, block.ebo));
+        GLCALL(glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.index_offset, index_bytes, indices));
+    }
+
+    unsigned id;
+    if (!arena.free_allocations.empty())
+    {
+        id = arena.free_allocations.back();
+        arena.free_allocations.pop_back();
+        arena.allocations[id] = allocation;
+    }
+    else
+    {
+        id = static_cast<unsigned>(arena.allocations.size());
+        arena.allocations.push_back(allocation);
+    }
+    return id;
+}
+
+void Free(GeometryArena& arena, unsigned id)
+{
+    if (id >= arena.allocations.size() || !arena.allocations[id].live)
+        return;
+
+    GeometryAllocation& allocation = arena.allocations[id];
+    GeometryBlock& block = arena.blocks[allocation.format][allocation.block];
+    Free(block.vertices, allocation.vertex_offset, allocation.vertex_count);
+    Free(block.indices, allocation.index_offset, AlignIndices(allocation.index_bytes));
+    allocation.live = false;
+    arena.free_allocations.push_back(id);
+}
+
+void Release(GeometryArena& arena, const TexturedModel& model)
+{
+    for (const TexturedMesh& mesh : model.meshes)
+        Free(arena, mesh.mesh.allocation);
+}
+
+
+unsigned Defragment(GeometryArena& arena, float threshold)
+{
+    unsigned packed = 0;
+    for (int format = 0; format < 3; ++format)
+    {
+        const std::size_t vertex_size = VertexSize(static_cast<VertexFormat>(format));
+        for (unsigned b = 0; b < arena.blocks[format].size(); ++b)
+        {
+            GeometryBlock& block = arena.blocks[format][b];
+            if (Fragmentation(block.vertices) <= threshold && Fragmentation(block.indices) <= threshold)
+                continue;
+
+            // The allocations are copied to the start of new buffers, in the order they're in now.
+            std::vector<GeometryAllocation*> allocations;
+            for (GeometryAllocation& allocation : arena.allocations)
+                if (allocation.live && allocation.format == format && allocation.block == b)
+                    allocations.push_back(&allocation);
+            std::sort(allocations.begin(), allocations.end(), [](const GeometryAllocation* a, const GeometryAllocation* c) { return a->vertex_offset < c->vertex_offset; });
+
+            GLuint buffers[2];
+            GLCALL(glGenBuffers(2, buffers));
+            GLCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]));
+            GLCALL(glBufferData(GL_COPY_WRITE_BUFFER, block.vertices.capacity * vertex_size, nullptr, GL_STATIC_DRAW));
+            GLCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]));
+            GLCALL(glBufferData(GL_COPY_WRITE_BUFFER, block.indices.capacity, nullptr, GL_STATIC_DRAW));
+
+            Create(block.vertices, block.vertices.capacity);
+            Create(block.indices,  block.indices.capacity);
+            for (GeometryAllocation* allocation : allocations)
+            {
+                std::size_t vertex_offset, index_offset;
+                Allocate(block.vertices, allocation->vertex_count, vertex_offset);
+                Allocate(block.indices, AlignIndices(allocation->index_bytes), index_offset);
+
+                if (allocation->vertex_count > 0)
+                {
+                    GLCALL(glBindBuffer(GL_COPY_READ_BUFFER,  block.vbo));
+                    GLCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]));
+                    GLCALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->vertex_offset * vertex_size, vertex_offset * vertex_size, allocation->vertex_count * vertex_size));
+                }
+                if (allocation->index_bytes > 0)
+                {
+                    GLCALL(glBindBuffer(GL_COPY_READ_BUFFER,  block.ebo));
+                    GLCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]));
+                    GLCALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->index_offset, index_offset, allocation->index_bytes));
+                }
+                allocation->vertex_offset = vertex_offset;
+                allocation->index_offset  = index_offset;
+            }
+
+            // The vertex array object stays the same, reading from the new buffers.
+            GLCALL(glDeleteBuffers(1, &block.vbo));
+            GLCALL(glDeleteBuffers(1, &block.ebo));
+            block.vbo = buffers[0];
+            block.ebo = buffers[1];
+            GLCALL(glBindVertexArray(block.vao));
+            GLCALL(glBindBuffer(GL_ARRAY_BUFFER, block.vbo));
+            SetAttributes(static_cast<VertexFormat>(format));
+            GLCALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.ebo));
+            GLCALL(glBindVertexArray(0));
+            arena.bound_vao = 0;
+            ++packed;
+        }
+    }
+    return packed;
+}
+
+void Destroy(GeometryArena& arena)
+{
+    for (std::vector<GeometryBlock>& blocks : arena.blocks)
+    {
+        for (GeometryBlock& block : blocks)
+        {
+            GLCALL(glDeleteVertexArrays(1, &block.vao));
+            GLCALL(glDeleteBuffers(1, &block.vbo));
+            GLCALL(glDeleteBuffers(1, &block.ebo));
+        }
+        blocks.clear();
+    }
+    arena.allocations.clear();
+    arena.free_allocations.clear();
+    arena.bound_vao = 0;
+}
+
+
+void Draw(GeometryArena& arena, const Mesh& mesh, DrawList& list)
+{
+    if (list.counts.empty() || mesh.allocation >= arena.allocations.size())
+        return;
+
+    const GeometryAllocation& allocation = arena.allocations[mesh.allocation];
+    const GeometryBlock& block = arena.blocks[allocation.format][allocation.block];
+    const std::size_t index_size = IndexSize(mesh.index_type);
+
+    list.pointers.resize(list.counts.size());
+    for (std::size_t i = 0; i < list.counts.size(); ++i)
+        list.pointers[i] = reinterpret_cast<const void*>(allocation.index_offset + list.offsets[i] * index_size);
+    list.base_vertices.assign(list.counts.size(), static_cast<GLint>(allocation.vertex_offset));
+
+    if (arena.bound_vao != block.vao)
+    {
+        GLCALL(glBindVertexArray(block.vao));
+        arena.bound_vao = block.vao;
+    }
+    if (list.counts.size() == 1)
+    {
+        GLCALL(glDrawElementsBaseVertex(GL_TRIANGLES, list.counts[0], mesh.index_type, list.pointers[0], list.base_vertices[0]));
+    }
+    else
+    {
+        GLCALL(glMultiDrawElementsBaseVertex(GL_TRIANGLES, list.counts.data(), mesh.index_type, list.pointers.data(), static_cast<GLsizei>(list.counts.size()), list.base_vertices.data()));
+    }
+}
+
+void Unbind(GeometryArena& arena)
+{
+    GLCALL(glBindVertexArray(0));
+    arena.bound_vao = 0;
+}
+
+
+static unsigned CreateBlock(GeometryArena& arena, VertexFormat format, std::size_t vertex_capacity, std::size_t index_capacity)
+{
+    GeometryBlock block;
+    Create(block.vertices, vertex_capacity);
+    Create(block.indices,  index_capacity);
+
+    GLCALL(glGenVertexArrays(1, &block.vao));
+    GLCALL(glGenBuffers(1, &block.vbo));
+    GLCALL(glGenBuffers(1, &block.ebo));
+
+    GLCALL(glBindVertexArray(block.vao));
+    GLCALL(glBindBuffer(GL_ARRAY_BUFFER, block.vbo));
+    GLCALL(glBufferData(GL_ARRAY_BUFFER, vertex_capacity * VertexSize(format), nullptr, GL_STATIC_DRAW));
+    GLCALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.ebo));
+    GLCALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity, nullptr, GL_STATIC_DRAW));
+    SetAttributes(format);
+    GLCALL(glBindVertexArray(0));
+    arena.bound_vao = 0;
+
+    arena.blocks[format].push_back(block);
+    return static_cast<unsigned>(arena.blocks[format].size() - 1);
+}
+
+// Sets the vertex attribute pointers of the bound vertex array object for the buffer bound to GL_ARRAY_BUFFER.
+static void SetAttributes(VertexFormat format)
+{
+    const GLsizei stride = static_cast<GLsizei>(VertexSize(format));
+    if (format == FULL)
+    {
+        // Positions
+        GLCALL(glEnableVertexAttribArray(0));
+        GLCALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0));
+
+        // Texture coordinates
+        GLCALL(glEnableVertexAttribArray(1));
+        GLCALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, texture_coordinate)));
+
+        // Normals
+        GLCALL(glEnableVertexAttribArray(2));
+        GLCALL(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, normal)));
+
+        // Tangents and bitangents
+        GLCALL(glEnableVertexAttribArray(3));
+        GLCALL(glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, tangent)));
+        GLCALL(glEnableVertexAttribArray(4));
+        GLCALL(glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, bitangent)));
+    }
+    else
+    {
+        // CompactVertex and QuantizedVertex only differ in their positions.
+        const bool compact = format == COMPACT;
+        const std::size_t texture_coordinate = compact ? offsetof(CompactVertex, texture_coordinate) : offsetof(QuantizedVertex, texture_coordinate);
+        const std::size_t normal  = compact ? offsetof(CompactVertex, normal)  : offsetof(QuantizedVertex, normal);
+        const std::size_t tangent = compact ? offsetof(CompactVertex, tangent) : offsetof(QuantizedVertex, tangent);
+
+        // Positions
+        GLCALL(glEnableVertexAttribArray(0));
+        if (compact)
+        {
+            GLCALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0));
+        }
+        else
+        {
+            GLCALL(glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0));
+        }
+
+        // Texture coordinates
+        GLCALL(glEnableVertexAttribArray(1));
+        GLCALL(glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)texture_coordinate));
+
+        // Normals
+        GLCALL(glEnableVertexAttribArray(2));
+        GLCALL(glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)normal));
+
+        // Tangents, with the sign of the bitangent in w.
+        GLCALL(glEnableVertexAttribArray(3));
+        GLCALL(glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)tangent));
+    }
+}
+
+static void Remove(FreeList& list, std::map<std::size_t, std::size_t>::iterator range)
+{
+    auto sizes = list.by_size.equal_range(range->second);
+    for (auto it = sizes.first; it != sizes.second; ++it)
+    {
+        if (it->second == range->first)
+        {
+            list.by_size.erase(it);
+            break;
+        }
+    }
+    list.by_offset.erase(range);
+}
+
+static void Insert(FreeList& list, std::size_t offset, std::size_t size)
+{
+    list.by_offset.emplace(offset, size);
+    list.by_size.emplace(size, offset);
+}
+
+// Index ranges are kept 4 byte aligned, whatever their type.
+static std::size_t AlignIndices(std::size_t bytes)
+{
+    return (bytes + 3) / 4 * 4;
+}
@@ -0,0 +1,178 @@
+#include "instancing.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+
+static const std::uint8_t CULLED = 0xFF;
+
+static float MaxScale(const glm::mat4& matrix);
+
+
+void Create(InstanceBuffer& buffer, std::size_t capacity)
+{
+    buffer = {};
+    buffer.capacity = std::max<std::size_t>(capacity, 1);
+    GLCALL(glGenBuffers(1, &buffer.id));
+    GLCALL(glBindBuffer(GL_ARRAY_BUFFER, buffer.id));
+    GLCALL(glBufferData(GL_ARRAY_BUFFER, buffer.capacity * sizeof(Instance), nullptr, GL_STREAM_DRAW));
+}
+
+void Destroy(InstanceBuffer& buffer)
+{
+    GLCALL(glDeleteBuffers(1, &buffer.id));
+    buffer = {};
+}
+
+void Upload(InstanceBuffer& buffer, const Instance* instances, std::size_t count)
+{
+    while (buffer.capacity < count)
+        buffer.capacity *= 2;
+
+    // Orphaned by allocating new storage, which the driver can do without waiting for the draws using the old one.
+    GLCALL(glBindBuffer(GL_ARRAY_BUFFER, buffer.id));
+    GLCALL(glBufferData(GL_ARRAY_BUFFER, buffer.capacity * sizeof(Instance), nullptr, GL_STREAM_DRAW));
+    if (count > 0)
+    {
+        GLCALL(glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Instance), instances));
+    }
+    buffer.count = count;
+    buffer.attached_vao = 0;
+}
+
+
+void DrawInstanced(GeometryArena& arena, const Mesh& mesh, DrawList& list, InstanceBuffer& buffer, std::size_t first, std::size_t count)
+{
+    if (list.counts.empty() || count == 0 || mesh.allocation >= arena.allocations.size())
+        return;
+
+    const GeometryAllocation& allocation = arena.allocations[mesh.allocation];
+    const GeometryBlock& block = arena.blocks[allocation.format][allocation.block];
+    const std::size_t index_size = IndexSize(mesh.index_type);
+
+    if (arena.bound_vao != block.vao)
+    {
+        GLCALL(glBindVertexArray(block.vao));
+        arena.bound_vao = block.vao;
+    }
+
+    // There's no base instance before OpenGL 4.2, so the first instance is chosen by where the attributes point.
+    if (buffer.attached_vao != block.vao || buffer.attached_first != first)
+    {
+        const GLsizei stride = sizeof(Instance);
+        const std::size_t offset = first * sizeof(Instance);
+        GLCALL(glBindBuffer(GL_ARRAY_BUFFER, buffer.id));
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            GLCALL(glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column));
+            GLCALL(glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(Instance, model) + column * sizeof(glm::vec4))));
+            GLCALL(glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1));
+        }
+        GLCALL(glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION));
+        GLCALL(glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(Instance, color))));
+        GLCALL(glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1));
+        buffer.attached_vao   = block.vao;
+        buffer.attached_first = first;
+    }
+
+    // There's no instanced multi draw either, so every range is a call of its own.
+    for (std::size_t i = 0; i < list.counts.size(); ++i)
+    {
+        const void* pointer = reinterpret_cast<const void*>(allocation.index_offset + list.offsets[i] * index_size);
+        GLCALL(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, list.counts[i], mesh.index_type, pointer, static_cast<GLsizei>(count), static_cast<GLint>(allocation.vertex_offset)));
+    }
+}
+
+
+std::size_t CullInstances(const Instance* instances, std::size_t count, const Bounds& bounds, float radius, const glm::mat4& view_projection, const glm::vec3& camera, InstanceBatch& batch)
+{
+    batch.buckets.resize(count);
+    std::fill(batch.starts, batch.starts + INSTANCE_BUCKETS + 1, 0);
+    std::fill(batch.distances, batch.distances + INSTANCE_BUCKETS, INFINITY);
+
+    // The copies of the bounds go into the table to be culled all at once.
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    BoundsTable& table = batch.bounds;
+    Reset(table, count);
+    batch.scales.resize(count);
+    float* center_x = table.center_x.data();
+    float* center_y = table.center_y.data();
+    float* center_z = table.center_z.data();
+    float* extent_x = table.extent_x.data();
+    float* extent_y = table.extent_y.data();
+    float* extent_z = table.extent_z.data();
+    float* radii    = table.radius.data();
+    float* scales   = batch.scales.data();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4& model = instances[i].model;
+        const glm::vec3 world = glm::vec3(model[0]) * center.x + glm::vec3(model[1]) * center.y + glm::vec3(model[2]) * center.z + glm::vec3(model[3]);
+        const glm::vec3 world_extent = glm::abs(glm::vec3(model[0])) * extent.x + glm::abs(glm::vec3(model[1])) * extent.y + glm::abs(glm::vec3(model[2])) * extent.z;
+        center_x[i] = world.x;
+        center_y[i] = world.y;
+        center_z[i] = world.z;
+        extent_x[i] = world_extent.x;
+        extent_y[i] = world_extent.y;
+        extent_z[i] = world_extent.z;
+        scales[i] = MaxScale(model);
+        radii[i]  = radius * scales[i];
+    }
+    CullBounds(table, ExtractFrustum(view_projection), batch.inside);
+
+    // Sorted by counting the instances of every bucket first. The buckets are half an octave of distance each, from
+    // 1/16 up, so the LODs of a bucket are at most about 40% finer than they need to be.
+    std::uint32_t sizes[INSTANCE_BUCKETS] = {};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (!batch.inside[i])
+        {
+            batch.buckets[i] = CULLED;
+            continue;
+        }
+
+        const glm::vec3 world(center_x[i], center_y[i], center_z[i]);
+        const float distance = std::max(glm::length(world - camera) - radii[i], 1e-3f) / std::max(scales[i], 1e-6f);
+        const int bucket = std::min(std::max(static_cast<int>(std::floor(std::log2(distance) * 2.0f)) + 8, 0), static_cast<int>(INSTANCE_BUCKETS) - 1);
+        batch.buckets[i] = static_cast<std::uint8_t>(bucket);
+        batch.distances[bucket] = std::min(batch.distances[bucket], distance);
+        ++sizes[bucket];
+    }
+
+    for (unsigned b = 0; b < INSTANCE_BUCKETS; ++b)
+        batch.starts[b + 1] = batch.starts[b] + sizes[b];
+    const std::size_t kept = batch.starts[INSTANCE_BUCKETS];
+
+    batch.visible.resize(kept);
+    std::uint32_t next[INSTANCE_BUCKETS];
+    std::copy(batch.starts, batch.starts + INSTANCE_BUCKETS, next);
+    for (std::size_t i = 0; i < count; ++i)
+        if (batch.buckets[i] != CULLED)
+            batch.visible[next[batch.buckets[i]]++] = instances[i];
+
+    return kept;
+}
+
+unsigned SelectLod(const Mesh& mesh, const glm::mat4& model, float distance, float projection_scale, float threshold)
+{
+    if (mesh.lod_count <= 1)
+        return 0;
+
+    const float scale = MaxScale(model);
+    distance = std::max(distance, 1e-3f);
+
+    unsigned lod = 0;
+    for (unsigned i = 1; i < mesh.lod_count; ++i)
+        if (mesh.lods[i].error * scale / distance * projection_scale <= threshold)
+            lod = i;
+    return lod;
+}
+
+
+// The largest scale along the axes of the matrix.
+static float MaxScale(const glm::mat4& matrix)
+{
+    return std::sqrt(std::max(glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])), std::max(glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1])), glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2])))));
+}
@@ -8,6 +8,14 @@
 #include <unordered_map>
 #include <vector>
 #include <deque>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -20,137 +28,680 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/ProgressHandler.hpp>
 
 #include "debug.h"
 #include "utilities.h"
+#include "obj.h"
+#include "naxmesh.h"
+#include "threading.h"
+#include "textures.h"
+#include "simplifier.h"
+#include "meshlets.h"
+#include "bvh.h"
 
-std::unordered_map<std::string, Texture> loaded_textures {};
+
+// The requests that are still referenced, and the threads decoding them. See RequestImage. The pool is declared last so
+// it's stopped before the rest is destroyed.
+std::mutex image_requests_mutex;
+std::unordered_map<std::string, std::weak_ptr<ImageRequest>> image_requests;
+std::once_flag image_pool_started;
+WorkerPool image_pool;
+
+const unsigned IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices;
+bool split_large_meshes = true;
+bool optimize_meshes = true;
+bool generate_lods = true;
+bool build_meshlets = true;
 
 
 TexturedModel LoadModel(const std::string& path);
-TexturedModel ProcessNode(const aiScene* scene, const std::string& directory);
-Mesh ProcessMesh(aiMesh* mesh);
-std::vector<Texture> ProcessMaterials(aiMaterial* material, const std::string& directory);
-std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string type_name, const std::string& directory);
-unsigned int TextureFromFile(std::string path, bool gamma = false);
+bool OpenCachedModel(const std::string& path, MeshCache& cache, std::string& cache_path, unsigned long long& key);
+void WriteCachedModel(const std::string& cache_path, unsigned long long key, const ModelData& model);
+ModelData ProcessNode(const aiScene* scene);
+std::vector<TextureReference> ProcessMaterials(aiMaterial* material);
+std::vector<TextureReference> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string type_name);
+std::vector<Texture> LoadTextures(const std::vector<TextureReference>& references, const std::string& directory, const ImageRequests* images = nullptr, TextureStreamer* streamer = nullptr);
+std::string RequestKey(const std::string& path, const std::string& type);
+void CookImage(ImageRequest& request, const MappedFile& file);
+Mesh UploadIndexed(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, const std::vector<MeshLod>& lods, const Meshlet* meshlets, std::size_t meshlet_count);
 
 
 TexturedModel LoadModel(const std::string& path)
+{
+	std::string directory = path.substr(0, path.find_last_of(DIRECTORY_SEPERATOR));
+
+    // Look for a cooked version of the file, keyed on its content and the import flags.
+    std::string cache_path;
+    unsigned long long key = 0;
+    MeshCache cache;
+    if (OpenCachedModel(path, cache, cache_path, key))
+    {
+        // Queue all textures first so they're decoded in parallel while the meshes are uploaded.
+        ImageRequests images;
+        for (const MeshView& mesh : cache.meshes)
+            RequestImages(mesh.textures, directory, images);
+
+        TexturedModel model;
+        for (const MeshView& mesh : cache.meshes)
+        {
+            model.meshes.push_back(UploadMesh(mesh.vertices, mesh.vertex_count, mesh.indices, mesh.index_count, mesh.lods, mesh.meshlets, mesh.meshlet_count, mesh.textures, directory, &images));
+            model.meshes.back().node = mesh.node;
+        }
+        model.nodes = cache.nodes;
+        Close(cache);
+        return model;
+    }
+
+    ModelData data;
+    if (!ImportModel(path, data))
+        return {};
+
+    WriteCachedModel(cache_path, key, data);
+    return UploadModel(data, directory);
+}
+
+
+// Opens the cached version of the model at 'path'. If there is none, 'cache_path' and 'key' are set to where it should
+// be written (or 'cache_path' is left empty if the source couldn't be read).
+bool OpenCachedModel(const std::string& path, MeshCache& cache, std::string& cache_path, unsigned long long& key)
+{
+    Return<MappedFile> source = Map(path);
+    if (source.error)
+        return false;
+
+    key = MeshCacheKey(source.value.data, source.value.size, IMPORT_FLAGS, ImportOptions());
+    Unmap(source.value);
+
+    cache_path = MeshCachePath(key);
+    Return<MeshCache> result = OpenMeshCache(cache_path, key);
+    if (result.error)
+        return false;
+
+    cache = std::move(result.value);
+    return true;
+}
+
+void WriteCachedModel(const std::string& cache_path, unsigned long long key, const ModelData& model)
+{
+    if (cache_path.empty())
+        return;
+
+    Return<bool> written = WriteMeshCache(cache_path, key, model);
+    if (written.error)
+        Print(*written.error);
+}
+
+
+// Forwards the progress of an Assimp import. Returning false from the callback aborts the import.
+struct ImportProgress : public Assimp::ProgressHandler
+{
+    std::function<bool(float)> callback;
+    bool aborted = false;
+
+    explicit ImportProgress(std::function<bool(float)> callback) : callback(std::move(callback)) {}
+
+    bool Update(float percentage) override
+    {
+        if (!aborted && !callback(percentage))
+            aborted = true;
+        return !aborted;
+    }
+};
+
+bool ImportModel(const std::string& path, ModelData& model, const std::function<bool(float)>& progress)
 {
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+
+    ImportProgress* handler = nullptr;
+    if (progress)
+    {
+        handler = new ImportProgress(progress);
+        importer.SetProgressHandler(handler);  // The importer takes ownership.
+    }
+
+    const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
-        std::cerr << "[Assimp Error]: " << importer.GetErrorString();
-        return {};
+        if (!handler || !handler->aborted)
+            std::cerr << "[Assimp Error]: " << importer.GetErrorString();
+        return false;
     }
 
-	std::string directory = path.substr(0, path.find_last_of(DIRECTORY_SEPERATOR));
+    model = ProcessNode(scene);
 
-    return ProcessNode(scene, directory);
+    // Split first, so the parts are optimized and simplified on their own. Every mesh is processed on its own thread,
+    // unless this already runs on a loader thread.
+    SplitLargeMeshes(model);
+    ParallelFor(static_cast<unsigned>(model.meshes.size()), OnWorkerThread() ? 1 : 0, [&](unsigned i)
+    {
+        MeshData& mesh = model.meshes[i];
+        if (optimize_meshes)
+            std::tie(mesh.imported, mesh.optimized) = OptimizeMesh(mesh.vertices, mesh.indices);
+        if (generate_lods)
+            mesh.lods = GenerateLods(mesh.vertices, mesh.indices);
+        if (build_meshlets)
+        {
+            // Reorders the triangles of LOD 0 by meshlet.
+            const std::size_t count = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].count;
+            mesh.meshlets = BuildMeshlets(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), count);
+            if (optimize_meshes)
+                mesh.optimized = AnalyzeVertexCache(mesh.indices.data(), count, mesh.vertices.size());
+        }
+    });
+
+    if (optimize_meshes)
+    {
+        // Weighted by the triangles and vertices of the meshes, as they would be for the model as a whole.
+        double triangles = 0.0, vertices = 0.0;
+        VertexCacheStatistics imported, optimized;
+        for (const MeshData& mesh : model.meshes)
+        {
+            const double mesh_triangles = (mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].count) / 3, mesh_vertices = mesh.vertices.size();
+            imported.acmr  += static_cast<float>(mesh.imported.acmr  * mesh_triangles);
+            optimized.acmr += static_cast<float>(mesh.optimized.acmr * mesh_triangles);
+            imported.atvr  += static_cast<float>(mesh.imported.atvr  * mesh_vertices);
+            optimized.atvr += static_cast<float>(mesh.optimized.atvr * mesh_vertices);
+            triangles += mesh_triangles;
+            vertices  += mesh_vertices;
+        }
+        if (triangles > 0.0)
+        {
+            std::cout << "Optimized '" << path << "': ACMR " << imported.acmr / triangles << " -> " << optimized.acmr / triangles
+                      << ", ATVR " << imported.atvr / vertices << " -> " << optimized.atvr / vertices << std::endl;
+        }
+    }
+
+    return true;
 }
 
 
-TexturedModel ProcessNode(const aiScene* scene, const std::string& directory)
+std::vector<MeshData> SplitMesh(const MeshData& mesh, std::size_t max_vertices)
 {
-    std::vector<TexturedMesh> meshes;
-    std::deque<aiNode*> queue {scene->mRootNode};
+    std::vector<MeshData> parts;
+    if (mesh.vertices.size() <= max_vertices || max_vertices < 3)
+    {
+        parts.push_back(mesh);
+        return parts;
+    }
 
-    while (!queue.empty())
+    // Where each vertex of the mesh is in the current part, and which vertices of the mesh the part uses.
+    static const GLuint UNUSED = ~GLuint(0);
+    std::vector<GLuint> remap(mesh.vertices.size(), UNUSED);
+    std::vector<GLuint> used;
+
+    MeshData part;
+    auto finish = [&]()
     {
-        aiNode* node = queue.front();
-        queue.pop_front();
+        if (part.indices.empty())
+            return;
 
-        for (unsigned int j = 0; j < node->mNumMeshes; j++)
+        glm::vec3 min = part.vertices[0].position, max = min;
+        for (const Vertex& vertex : part.vertices)
+        {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
+        part.bounds   = {min, max};
+        part.textures = mesh.textures;
+        part.node     = mesh.node;
+        parts.push_back(std::move(part));
+        part = {};
+
+        for (GLuint index : used)
+            remap[index] = UNUSED;
+        used.clear();
+    };
+
+    for (std::size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        const std::size_t corners = std::min<std::size_t>(3, mesh.indices.size() - i);
+
+        std::size_t added = 0;
+        for (std::size_t c = 0; c < corners; ++c)
+            added += remap[mesh.indices[i + c]] == UNUSED;
+        if (part.vertices.size() + added > max_vertices)
+            finish();
+
+        for (std::size_t c = 0; c < corners; ++c)
         {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[j]];
-            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            const GLuint index = mesh.indices[i + c];
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = static_cast<GLuint>(part.vertices.size());
+                part.vertices.push_back(mesh.vertices[index]);
+                used.push_back(index);
+            }
+            part.indices.push_back(remap[index]);
+        }
+    }
+    finish();
 
-            Mesh x = ProcessMesh(mesh);
-            std::vector<Texture> y = ProcessMaterials(material, directory);
+    return parts;
+}
 
-            meshes.push_back({x, y});
+unsigned ImportOptions()
+{
+    return (optimize_meshes ? 1u : 0u) | (split_large_meshes ? 2u : 0u) | (generate_lods ? 4u : 0u) | (build_meshlets ? 8u : 0u);
+}
+
+void SplitLargeMeshes(ModelData& model)
+{
+    if (!split_large_meshes)
+        return;
+
+    std::vector<MeshData> meshes;
+    for (MeshData& mesh : model.meshes)
+    {
+        if (IndexType(mesh.vertices.size()) == GL_UNSIGNED_SHORT)
+        {
+            meshes.push_back(std::move(mesh));
+            continue;
         }
+        for (MeshData& part : SplitMesh(mesh))
+            meshes.push_back(std::move(part));
+    }
+    model.meshes = std::move(meshes);
+}
 
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
-            queue.push_back(node->mChildren[i]);
+
+TexturedModel UploadModel(const ModelData& model, const std::string& directory)
+{
+    ImageRequests images;
+    for (const MeshData& mesh : model.meshes)
+        RequestImages(mesh.textures, directory, images);
+
+    TexturedModel result;
+    for (const MeshData& mesh : model.meshes)
+    {
+        result.meshes.push_back(UploadMesh(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.lods, mesh.meshlets.data(), mesh.meshlets.size(), mesh.textures, directory, &images));
+        result.meshes.back().node = mesh.node;
     }
+    result.nodes = model.nodes;
+    return result;
+}
 
-    return {meshes};
+
+TexturedMesh UploadMesh(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, const std::vector<MeshLod>& lods, const Meshlet* meshlets, std::size_t meshlet_count, const std::vector<TextureReference>& textures, const std::string& directory, const ImageRequests* images)
+{
+    return {UploadIndexed(vertices, vertex_count, indices, index_count, lods, meshlets, meshlet_count), LoadTextures(textures, directory, images)};
+}
+
+// Uploads all the indices, with LOD 0 as the mesh itself.
+Mesh UploadIndexed(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, const std::vector<MeshLod>& lods, const Meshlet* meshlets, std::size_t meshlet_count)
+{
+    Mesh mesh = IndexedModel(vertices, vertex_count, indices, index_count);
+    mesh.meshlets.assign(meshlets, meshlets + meshlet_count);
+    if (lods.empty())
+        return mesh;
+
+    mesh.lod_count = static_cast<unsigned>(std::min<std::size_t>(lods.size(), MAX_LODS));
+    std::copy(lods.begin(), lods.begin() + mesh.lod_count, mesh.lods);
+    mesh.count = lods[0].count;
+    return mesh;
 }
 
-Mesh ProcessMesh(aiMesh* mesh)
+
+std::unique_ptr<ModelLoad> LoadModelAsync(WorkerPool& pool, const std::string& path)
 {
-    // data to fill
-    std::vector<Vertex>   vertices;
-    std::vector<unsigned> indices;
+    std::unique_ptr<ModelLoad> result(new ModelLoad);
+    result->path = path;
 
-    // Walk through each of the mesh's vertices
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    ModelLoad* load = result.get();
+    Submit(pool, [load, &pool]()
     {
-        Vertex vertex {};
+        if (load->cancel)
+        {
+            load->state = ModelLoad::CANCELLED;
+            return;
+        }
 
-        // positions
-        vertex.position.x = mesh->mVertices[i].x;
-        vertex.position.y = mesh->mVertices[i].y;
-        vertex.position.z = mesh->mVertices[i].z;
+        // ---- IMPORT ----
+        // The import is the first half of the progress and decoding the textures the second.
+        load->state = ModelLoad::IMPORTING;
 
-        // normals
-        if (mesh->mNormals)
+        std::string cache_path;
+        unsigned long long key = 0;
+        MeshCache cache;
+        if (OpenCachedModel(load->path, cache, cache_path, key))
         {
-            vertex.normal.x = mesh->mNormals[i].x;
-            vertex.normal.y = mesh->mNormals[i].y;
-            vertex.normal.z = mesh->mNormals[i].z;
+            for (const MeshView& view : cache.meshes)
+            {
+                MeshData mesh;
+                mesh.vertices.assign(view.vertices, view.vertices + view.vertex_count);
+                mesh.indices.assign(view.indices, view.indices + view.index_count);
+                mesh.lods     = view.lods;
+                mesh.meshlets.assign(view.meshlets, view.meshlets + view.meshlet_count);
+                mesh.textures = view.textures;
+                mesh.bounds   = view.bounds;
+                mesh.node     = view.node;
+                load->data.meshes.push_back(std::move(mesh));
+            }
+            load->data.nodes = cache.nodes;
+            Close(cache);
         }
+        else
+        {
+            auto progress = [load](float percentage)
+            {
+                if (percentage >= 0.0f)
+                    load->progress = percentage * 0.5f;
+                return !load->cancel;
+            };
+            if (!ImportModel(load->path, load->data, progress))
+            {
+                load->state = load->cancel ? ModelLoad::CANCELLED : ModelLoad::FAILED;
+                return;
+            }
+            WriteCachedModel(cache_path, key, load->data);
+        }
+        load->progress = 0.5f;
+
+        // ---- DECODE ----
+        // The images are decoded on the image decoding threads. This one only waits for them to report progress.
+        load->state = ModelLoad::DECODING;
+
+        std::string directory = load->path.substr(0, load->path.find_last_of(DIRECTORY_SEPERATOR));
+        for (const MeshData& mesh : load->data.meshes)
+            RequestImages(mesh.textures, directory, load->images);
+
+        // The trees for picking are built while the images decode. The meshes are shared with the loader threads that
+        // are free, rather than new ones, as the others load other models.
+        std::vector<MeshData>& meshes = load->data.meshes;
+        ParallelFor(pool, static_cast<unsigned>(meshes.size()), 0, [&meshes](unsigned i)
+        {
+            MeshData& mesh = meshes[i];
+            const std::size_t offset = mesh.lods.empty() ? 0 : mesh.lods[0].offset;
+            const std::size_t count  = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].count;
+            mesh.bvh = BuildMeshBvh(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data() + offset, count);
+        });
+
+        std::size_t decoded = 0;
+        for (const auto& image : load->images)
+        {
+            while (image.second->decoded.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+            {
+                if (load->cancel)
+                {
+                    load->images.clear();
+                    load->state = ModelLoad::CANCELLED;
+                    return;
+                }
+            }
+            load->progress = 0.5f + 0.5f * ++decoded / load->images.size();
+        }
+
+        load->progress = 1.0f;
+        load->state = ModelLoad::LOADED;
+    });
+
+    return result;
+}
+
+bool Done(const ModelLoad& load)
+{
+    int state = load.state;
+    return state == ModelLoad::LOADED || state == ModelLoad::FAILED || state == ModelLoad::CANCELLED;
+}
+
+void Cancel(ModelLoad& load)
+{
+    load.cancel = true;
+}
+
+TexturedModel UploadModel(ModelLoad& load, TextureStreamer* streamer)
+{
+    Assert(load.state == ModelLoad::LOADED, "Model '%s' isn't loaded.", load.path.c_str());
+
+    std::string directory = load.path.substr(0, load.path.find_last_of(DIRECTORY_SEPERATOR));
+
+    TexturedModel result;
+    for (const MeshData& mesh : load.data.meshes)
+    {
+        Mesh uploaded = UploadIndexed(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.lods, mesh.meshlets.data(), mesh.meshlets.size());
+        uploaded.bvh = mesh.bvh;
+        result.meshes.push_back({uploaded, LoadTextures(mesh.textures, directory, &load.images, streamer), mesh.node});
+    }
+    result.nodes = load.data.nodes;
+
+    // Nothing more is needed from the CPU side copies.
+    load.images.clear();
+    load.data = {};
+
+    return result;
+}
+
+
+std::shared_ptr<ImageRequest> RequestImage(const std::string& path, const std::string& type)
+{
+    std::call_once(image_pool_started, []() { Start(image_pool, 0); });
 
-        // texture coordinates
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+    const std::string resolved = ResolvePath(path);
+
+    // The future is set before the request is shared, as others may wait on it as soon as they find it.
+    std::shared_ptr<ImageRequest> request;
+    auto promise = std::make_shared<std::promise<void>>();
+    {
+        std::lock_guard<std::mutex> lock(image_requests_mutex);
+
+        std::weak_ptr<ImageRequest>& entry = image_requests[RequestKey(resolved, type)];
+        request = entry.lock();
+        if (request)
+            return request;
+
+        request = std::make_shared<ImageRequest>();
+        request->path = resolved;
+        request->type = type;
+        request->decoded = promise->get_future().share();
+        entry = request;
+    }
+
+    // The job keeps the request alive until it's decoded, even if everyone else lets go of it.
+    Submit(image_pool, [request, promise]()
+    {
+        // The file is hashed for the texture cache from the same mapping it's decoded from.
+        Return<MappedFile> file = Map(request->path);
+        if (file.error)
+        {
+            Print(*file.error);
+        }
+        else
         {
-            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-            vertex.texture_coordinate.x = mesh->mTextureCoords[0][i].x;
-            vertex.texture_coordinate.y = mesh->mTextureCoords[0][i].y;
+            request->key = ContentHash(file.value.data, file.value.size);
+            CookImage(*request, file.value);
+            Unmap(file.value);
         }
+        promise->set_value();
+    });
+
+    return request;
+}
+
+void RequestImages(const std::vector<TextureReference>& textures, const std::string& directory, ImageRequests& requests)
+{
+    for (const TextureReference& texture : textures)
+    {
+        std::string path = ResolvePath(directory + DIRECTORY_SEPERATOR + texture.path);
+        std::string key  = RequestKey(path, texture.type);
+        if (!requests.count(key))
+            requests.emplace(key, RequestImage(path, texture.type));
+    }
+}
+
+std::string RequestKey(const std::string& path, const std::string& type)
+{
+    return path + '\n' + type;
+}
+
+// Fills in the cooked image from the texture cache on disk, or decodes the file, cooks it and writes it to the cache.
+// Requests without a type are only decoded.
+void CookImage(ImageRequest& request, const MappedFile& file)
+{
+    if (request.type.empty())
+    {
+        request.image = DecodeImage(file.data, file.size);
+        if (!request.image.pixels)
+            std::cerr << "[stb-image Error]: Texture failed to load at path: " << request.path << std::endl;
+        return;
+    }
 
-        // tangent
-        if (mesh->mTangents)
+    const std::string cooked_path = CookedTexturePath(request.key, request.type);
+    Return<CookedImage> cached = ReadDDS(cooked_path);
+    if (!cached.error && (supported_block_formats & (1u << cached.value.format)))
+    {
+        request.cooked = std::move(cached.value);
+    }
+    else
+    {
+        Image image = DecodeImage(file.data, file.size);
+        if (!image.pixels)
         {
-            vertex.tangent.x = mesh->mTangents[i].x;
-            vertex.tangent.y = mesh->mTangents[i].y;
-            vertex.tangent.z = mesh->mTangents[i].z;
+            std::cerr << "[stb-image Error]: Texture failed to load at path: " << request.path << std::endl;
+            return;
         }
 
-        // bitangent
-        if (mesh->mBitangents)
+        BlockFormat format = FormatFor(request.type, image.pixels, image.width, image.height, image.components, supported_block_formats);
+        request.cooked = Cook(image.pixels, image.width, image.height, image.components, format, IsSRGB(request.type));
+        Free(image);
+
+        Return<bool> written = WriteDDS(cooked_path, request.cooked);
+        if (written.error)
+            Print(*written.error);
+    }
+
+    // The same file is a different texture in another format, or with its mips filtered in another color space (see
+    // IsSRGB), like a diffuse and a specular map that are both BC1.
+    const BlockFormat format = request.cooked.format;
+    const bool srgb = IsSRGB(request.type);
+    request.key = ContentHash(&format, sizeof(format), request.key);
+    request.key = ContentHash(&srgb, sizeof(srgb), request.key);
+}
+
+ImageRequest::~ImageRequest()
+{
+    Free(image);
+
+    // Forget this request, unless it was already replaced by a newer one for the same image.
+    std::lock_guard<std::mutex> lock(image_requests_mutex);
+    auto it = image_requests.find(RequestKey(path, type));
+    if (it != image_requests.end() && it->second.expired())
+        image_requests.erase(it);
+}
+
+
+ModelData ProcessNode(const aiScene* scene)
+{
+    // Collect the meshes in the order of the nodes first, so they can be converted in parallel. The nodes are visited
+    // breadth first, so every node is added after its parent.
+    ModelData model;
+    std::vector<const aiMesh*> meshes;
+    std::vector<std::uint32_t> mesh_nodes;
+    std::deque<std::pair<const aiNode*, std::uint32_t>> queue {{scene->mRootNode, NO_PARENT}};
+
+    while (!queue.empty())
+    {
+        const aiNode* node = queue.front().first;
+        const std::uint32_t index = static_cast<std::uint32_t>(model.nodes.size());
+
+        aiVector3D scale, position;
+        aiQuaternion rotation;
+        node->mTransformation.Decompose(scale, rotation, position);
+        model.nodes.push_back({
+            queue.front().second, glm::vec3(position.x, position.y, position.z),
+            glm::quat(rotation.w, rotation.x, rotation.y, rotation.z), glm::vec3(scale.x, scale.y, scale.z)
+        });
+        queue.pop_front();
+
+        // the node object only contains indices to index the actual objects in the scene.
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        for (unsigned int j = 0; j < node->mNumMeshes; j++)
         {
-            vertex.bitangent.x = mesh->mBitangents[i].x;
-            vertex.bitangent.y = mesh->mBitangents[i].y;
-            vertex.bitangent.z = mesh->mBitangents[i].z;
+            meshes.push_back(scene->mMeshes[node->mMeshes[j]]);
+            mesh_nodes.push_back(index);
         }
 
-        vertices.push_back(vertex);
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            queue.push_back({node->mChildren[i], index});
     }
 
-    // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    // Every mesh writes to its own slot, so nothing has to be synchronized. Reading the scene is thread safe. Imports
+    // on a loader thread keep to it, as the other loader threads import other models.
+    model.meshes.resize(meshes.size());
+    ParallelFor(static_cast<unsigned>(meshes.size()), OnWorkerThread() ? 1 : 0, [&](unsigned i)
     {
-        aiFace face = mesh->mFaces[i];
+        model.meshes[i] = ProcessMesh(meshes[i]);
+        model.meshes[i].textures = ProcessMaterials(scene->mMaterials[meshes[i]->mMaterialIndex]);
+        model.meshes[i].node = mesh_nodes[i];
+    });
+
+    return model;
+}
 
-        // retrieve all indices of the face and store them in the indices vector
-        for (unsigned int j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
+MeshData ProcessMesh(const aiMesh* mesh)
+{
+    const unsigned count = mesh->mNumVertices;
+
+    // Missing attributes read a zero vector without advancing, so the loop below has no branches.
+    static const aiVector3D ZERO {0.0f, 0.0f, 0.0f};
+    const aiVector3D* positions  = mesh->mVertices;
+    const aiVector3D* normals    = mesh->mNormals    ? mesh->mNormals    : &ZERO;
+    const aiVector3D* texcoords  = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0] : &ZERO;  // Only the first set is used.
+    const aiVector3D* tangents   = mesh->mTangents   ? mesh->mTangents   : &ZERO;
+    const aiVector3D* bitangents = mesh->mBitangents ? mesh->mBitangents : &ZERO;
+    const std::size_t normal_step    = mesh->mNormals          ? 1 : 0;
+    const std::size_t texcoord_step  = mesh->mTextureCoords[0] ? 1 : 0;
+    const std::size_t tangent_step   = mesh->mTangents         ? 1 : 0;
+    const std::size_t bitangent_step = mesh->mBitangents       ? 1 : 0;
+
+    MeshData result;
+    result.vertices.resize(count);
+    Vertex* vertices = result.vertices.data();
+
+    glm::vec3 min = count ? glm::vec3(positions[0].x, positions[0].y, positions[0].z) : glm::vec3(0);
+    glm::vec3 max = min;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const aiVector3D& position  = positions[i];
+        const aiVector3D& texcoord  = texcoords[i * texcoord_step];
+        const aiVector3D& normal    = normals[i * normal_step];
+        const aiVector3D& tangent   = tangents[i * tangent_step];
+        const aiVector3D& bitangent = bitangents[i * bitangent_step];
+
+        Vertex& vertex = vertices[i];
+        vertex.position           = {position.x, position.y, position.z};
+        vertex.texture_coordinate = {texcoord.x, texcoord.y};
+        vertex.normal             = {normal.x, normal.y, normal.z};
+        vertex.tangent            = {tangent.x, tangent.y, tangent.z};
+        vertex.bitangent          = {bitangent.x, bitangent.y, bitangent.z};
+
+        min = glm::min(min, vertex.position);
+        max = glm::max(max, vertex.position);
     }
+    result.bounds = {min, max};
+
+    // Faces are triangles after aiProcess_Triangulate, except for points and lines.
+    std::size_t index_count = 0;
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+        index_count += mesh->mFaces[i].mNumIndices;
 
-    return IndexedModel(vertices, indices);
+    result.indices.resize(index_count);
+    GLuint* indices = result.indices.data();
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        std::memcpy(indices, face.mIndices, face.mNumIndices * sizeof(GLuint));
+        indices += face.mNumIndices;
+    }
+
+    return result;
 }
 
 
-std::vector<Texture> ProcessMaterials(aiMaterial* material, const std::string& directory)
+std::vector<TextureReference> ProcessMaterials(aiMaterial* material)
 {
-    std::vector<Texture> textures;
+    std::vector<TextureReference> textures;
 
     // process materials
     // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -161,97 +712,143 @@ std::vector<Texture> ProcessMaterials(aiMaterial* material, const std::string& d
     // normal: texture_normalN
 
     // 1. diffuse maps
-    std::vector<Texture> diffuse_maps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", directory);
+    std::vector<TextureReference> diffuse_maps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
     textures.insert(textures.end(), diffuse_maps.begin(), diffuse_maps.end());
     // 2. specular maps
-    std::vector<Texture> specular_maps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", directory);
+    std::vector<TextureReference> specular_maps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
     textures.insert(textures.end(), specular_maps.begin(), specular_maps.end());
     // 3. normal maps
-    std::vector<Texture> normal_maps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", directory);
+    std::vector<TextureReference> normal_maps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
     textures.insert(textures.end(), normal_maps.begin(), normal_maps.end());
     // 4. height maps
-    std::vector<Texture> height_maps = LoadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", directory);
+    std::vector<TextureReference> height_maps = LoadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
     textures.insert(textures.end(), height_maps.begin(), height_maps.end());
 
     return textures;
 }
 
 
-// checks all material textures of a given type and loads the textures if they're not loaded yet.
-// the required info is returned as a Texture struct.
-std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string type_name, const std::string& directory)
+// collects all material textures of a given type. They're loaded when the mesh is uploaded.
+std::vector<TextureReference> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string type_name)
 {
-    std::vector<Texture> textures;
+    std::vector<TextureReference> textures;
 
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString ai_path;
         mat->GetTexture(type, i, &ai_path);
-        std::string path = ai_path.C_Str();
-
-        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        auto it = loaded_textures.find(path);
-        if (it == loaded_textures.end())
-        {   // if texture hasn't been loaded already, load it
-            Texture texture;
-            texture.id = TextureFromFile(directory + DIRECTORY_SEPERATOR + path);
-            texture.type = type_name;
-            textures.push_back(texture);
-
-            // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            loaded_textures[path] = texture;
-        }
-        else
-        {
-            textures.push_back(it->second);
-        }
+        textures.push_back({ai_path.C_Str(), type_name});
     }
 
     return textures;
 }
 
 
-unsigned int TextureFromFile(std::string path, bool gamma)
+// loads the referenced textures, or takes them from the texture cache if an image with the same content is resident.
+std::vector<Texture> LoadTextures(const std::vector<TextureReference>& references, const std::string& directory, const ImageRequests* images, TextureStreamer* streamer)
 {
-    GLuint textureID;
-    GLCALL(glGenTextures(1, &textureID));
-
-    int width, height, components;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 0);
+    std::vector<Texture> textures;
 
-    if (data)
+    for (const TextureReference& reference : references)
     {
-        GLenum format = 0;
-        if (components == 1)
-            format = GL_RED;
-        else if (components == 3)
-            format = GL_RGB;
-        else if (components == 4)
-            format = GL_RGBA;
-        else
-            std::cerr << "[stb-image Error]: Unknown number of components " << components << "." << std::endl;
+        std::string path = ResolvePath(directory + DIRECTORY_SEPERATOR + reference.path);
 
-        GLCALL(glBindTexture(GL_TEXTURE_2D, textureID));
-        GLCALL(glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data));
-        GLCALL(glGenerateMipmap(GL_TEXTURE_2D));
+        // The content has to be known to look it up, so the request is made even if the texture turns out to be cached.
+        std::string key = RequestKey(path, reference.type);
+        std::shared_ptr<ImageRequest> request;
+        if (images && images->count(key))
+            request = images->at(key);
+        else
+            request = RequestImage(path, reference.type);
+        request->decoded.wait();
 
-        GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-        GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-        GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
-        GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        Texture texture {0, reference.type, request->key};
+        texture.id = Acquire(texture_cache, texture.key);
+        if (texture.id == 0 && !request->cooked.levels.empty())
+        {
+            // Block compressed textures are small enough to upload right away.
+            const CookedImage& image = request->cooked;
+            texture.id = (streamer && image.format == UNCOMPRESSED) ? StreamTexture(*streamer, request) : UploadCooked(image);
+            Insert(texture_cache, texture.key, texture.id, image.data.size(), path);
+        }
+        else if (texture.id == 0 && request->image.pixels)
+        {
+            const Image& image = request->image;
+            texture.id = UploadImage(image);
+            Insert(texture_cache, texture.key, texture.id, TextureBytes(image.width, image.height, image.components), path);
+        }
+        else if (texture.id == 0)
+        {
+            texture.key = 0;  // Failed to load; nothing to cache.
+        }
 
-        stbi_image_free(data);
+        textures.push_back(texture);
     }
-    else
-    {
+
+    Evict(texture_cache, streamer);
+
+    return textures;
+}
+
+
+Image DecodeImage(const std::string& path)
+{
+    Image image {};
+    image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+    if (!image.pixels)
         std::cerr << "[stb-image Error]: Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+    return image;
+}
+
+Image DecodeImage(const char* data, std::size_t size)
+{
+    Image image {};
+    image.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(data), static_cast<int>(size), &image.width, &image.height, &image.components, 0);
+    return image;
+}
+
+GLuint UploadImage(const Image& image)
+{
+    if (!image.pixels)
         return 0;
-    }
+
+    GLenum format = ImageFormat(image.components);
+
+    GLuint textureID;
+    GLCALL(glGenTextures(1, &textureID));
+    GLCALL(glBindTexture(GL_TEXTURE_2D, textureID));
+    GLCALL(glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels));
+    GLCALL(glGenerateMipmap(GL_TEXTURE_2D));
+
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
 
     return textureID;
 }
 
+GLenum ImageFormat(int components)
+{
+    if (components == 1)
+        return GL_RED;
+    else if (components == 2)
+        return GL_RG;
+    else if (components == 3)
+        return GL_RGB;
+    else if (components == 4)
+        return GL_RGBA;
+
+    std::cerr << "[stb-image Error]: Unknown number of components " << components << "." << std::endl;
+    return 0;
+}
+
+void Free(Image& image)
+{
+    stbi_image_free(image.pixels);
+    image.pixels = nullptr;
+}
+
 
 
 
@@ -285,8 +882,7 @@ std::pair<std::vector<Vertex>, std::vector<GLuint>> Parse(std::string source)
     std::vector<glm::vec2> texture_coordinates;
     std::vector<glm::vec3> normals;
 
-    // TODO(ted): Currently assuming we'll never have more than roughly 2^16 vertices.
-    std::unordered_map<unsigned long long, unsigned> vertex;
+    VertexTable vertex;
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
 
@@ -362,6 +958,8 @@ std::pair<std::vector<Vertex>, std::vector<GLuint>> Parse(std::string source)
     if (normals.empty())
         normals.push_back(glm::vec3(0));
 
+    Reserve(vertex, positions.size());
+
     // Parse faces
     do
     {
@@ -369,30 +967,28 @@ std::pair<std::vector<Vertex>, std::vector<GLuint>> Parse(std::string source)
         {
             std::vector<std::string> faces = Split(line, ' ');
 
-            unsigned long long index[3];
+            unsigned index[3];
             for (unsigned i = 1; i < 4; ++i)  // Skipping first entry (the 'f').
             {
                 std::vector<std::string> values = Split(faces[i], '/');
 
                 for (unsigned j = 0; j < 3; ++j)
-                    if (!values[j].empty())
-                        index[j] = static_cast<unsigned long long>(std::stoi(values[j]) - 1);  // OBJ-files are 1-indexed.
+                    if (j < values.size() && !values[j].empty())
+                        index[j] = static_cast<unsigned>(std::stoi(values[j]) - 1);  // OBJ-files are 1-indexed.
                     else
                         index[j] = 0;
 
-                unsigned long long mapping = (index[0] << 32) + (index[1] << 16) + index[2];
-                const auto& duplicate = vertex.find(mapping);
-                if (duplicate != vertex.end())
-                {
-                    indices.emplace_back(duplicate->second);
-                }
-                else
+                unsigned next  = static_cast<unsigned>(vertices.size());
+                unsigned found = FindOrInsert(vertex, index[0], index[1], index[2], next);
+                if (found == next)
                 {
-                    Vertex v{positions[index[0]], texture_coordinates[index[1]], normals[index[2]]};
+                    Vertex v = {};
+                    v.position           = positions[index[0]];
+                    v.texture_coordinate = texture_coordinates[index[1]];
+                    v.normal             = normals[index[2]];
                     vertices.push_back(v);
-                    indices.emplace_back(vertices.size() - 1);
-                    vertex.emplace(mapping, indices.back());
                 }
+                indices.emplace_back(found);
             }
         }
 
@@ -1,6 +1,11 @@
 #include <utility>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include <glad/glad.h>
@@ -25,16 +30,31 @@
 #include "event.h"
 #include "debug.h"
 #include "window.h"
+#include "threading.h"
+#include "textures.h"
+#include "compression.h"
+#include "meshlets.h"
+#include "geometry.h"
+#include "models.h"
+#include "scene.h"
+#include "instancing.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
 
 
 #if _WIN32 || _WIN64
     const char PATH_TO_VERTEX[]   = __FILE__ "\\..\\..\\resources\\shaders\\basic.vertex.glsl";
     const char PATH_TO_FRAGMENT[] = __FILE__ "\\..\\..\\resources\\shaders\\texture.fragment.glsl";
+    const char PATH_TO_INSTANCED_VERTEX[]   = __FILE__ "\\..\\..\\resources\\shaders\\basic.instanced.vertex.glsl";
+    const char PATH_TO_INSTANCED_FRAGMENT[] = __FILE__ "\\..\\..\\resources\\shaders\\texture.instanced.fragment.glsl";
     const char PATH_TO_BUNNY[]    = __FILE__ "\\..\\..\\resources\\models\\bunny.obj";
     const char PATH_TO_NANOSUIT[] = __FILE__ "\\..\\..\\resources\\models\\crysis_nano_suit_2\\scene.gltf";
 #else
     const char PATH_TO_VERTEX[]   = __FILE__ "/../../resources/shaders/basic.vertex.glsl";
     const char PATH_TO_FRAGMENT[] = __FILE__ "/../../resources/shaders/texture.fragment.glsl";
+    const char PATH_TO_INSTANCED_VERTEX[]   = __FILE__ "/../../resources/shaders/basic.instanced.vertex.glsl";
+    const char PATH_TO_INSTANCED_FRAGMENT[] = __FILE__ "/../../resources/shaders/texture.instanced.fragment.glsl";
     const char PATH_TO_BUNNY[]    = __FILE__ "/../../resources/models/bunny.obj";
     const char PATH_TO_NANOSUIT[] = __FILE__ "/../../resources/models/crysis_nano_suit_2/scene.gltf";
 #endif
@@ -48,20 +68,14 @@ struct Transform
 };
 
 
-glm::mat4 ModelMatrix(Transform transform)
+// The rotation of the transform's angles, around x, then y, then z of the rotated frame.
+glm::quat Rotation(Transform transform)
 {
     const glm::vec3 x_axis = {1.0f, 0.0f, 0.0f};
 	const glm::vec3 y_axis = {0.0f, 1.0f, 0.0f};
 	const glm::vec3 z_axis = {0.0f, 0.0f, 1.0f};
 
-    glm::mat4 model_matrix = {};
-    model_matrix = glm::translate(model_matrix, transform.position);
-    model_matrix = glm::rotate(model_matrix, transform.rotation.x, x_axis);
-    model_matrix = glm::rotate(model_matrix, transform.rotation.y, y_axis);
-    model_matrix = glm::rotate(model_matrix, transform.rotation.z, z_axis);
-    model_matrix = glm::scale(model_matrix, transform.scale);
-
-    return model_matrix;
+    return glm::angleAxis(transform.rotation.x, x_axis) * glm::angleAxis(transform.rotation.y, y_axis) * glm::angleAxis(transform.rotation.z, z_axis);
 }
 
 
@@ -97,7 +111,7 @@ void InitializeImGui(GLFWwindow* window)
 }
 
 
-ShaderProgram LoadShaders(std::string vertex_path, std::string fragment_path)
+ShaderProgram LoadShaders(std::string vertex_path, std::string fragment_path, std::string name = "basic")
 {
     auto vertex_source   = Check(Read(vertex_path));
     auto fragment_source = Check(Read(fragment_path));
@@ -106,9 +120,9 @@ ShaderProgram LoadShaders(std::string vertex_path, std::string fragment_path)
     // std::cout << vertex_source   << std::endl;
     // std::cout << fragment_source << std::endl;
 
-    Shader vertex       = CreateShader(vertex_source,   ShaderType::VERTEX,   "basicv");
-    Shader fragment     = CreateShader(fragment_source, ShaderType::FRAGMENT, "basicf");
-    ShaderProgram basic = CreateShaderProgram({vertex, fragment}, {"position", "texture_coordinate", "normal"}, "basic");
+    Shader vertex       = CreateShader(vertex_source,   ShaderType::VERTEX,   name + "v");
+    Shader fragment     = CreateShader(fragment_source, ShaderType::FRAGMENT, name + "f");
+    ShaderProgram basic = CreateShaderProgram({vertex, fragment}, {"position", "texture_coordinate", "normal"}, name);
 
     // TODO(ted): Remove.
     auto info = GetShaderProgramInfo(basic);
@@ -138,46 +152,265 @@ struct Data
 };
 
 
-void Draw(ShaderProgram program, TexturedModel model)
+// What the camera sees, for culling and LOD selection.
+struct View
 {
-    for (const TexturedMesh& mesh : model.meshes)
+    glm::vec3 position;
+    glm::mat4 view_projection;
+    float projection_scale;  // Pixels per unit of size at a distance of 1 (see SelectLod).
+};
+
+// Binds the textures of the mesh and sets the uniforms that map its vertices back to model space.
+void BindMesh(ShaderProgram program, const TexturedMesh& mesh)
+{
+    // bind appropriate textures
+    unsigned int diffuseNr  = 1;
+    unsigned int specularNr = 1;
+    unsigned int normalNr   = 1;
+    unsigned int heightNr   = 1;
+
+    for (unsigned int i = 0; i < mesh.textures.size(); i++)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        GLCALL(glActiveTexture(GL_TEXTURE0 + i)); // active proper texture unit before binding
+        // retrieve texture number (the N in diffuse_textureN)
+        std::string number;
+        std::string name = mesh.textures[i].type;
+        if (name == "texture_diffuse")
+            number = std::to_string(diffuseNr++);
+        else if (name == "texture_specular")
+            number = std::to_string(specularNr++); // transfer unsigned int to stream
+        else if (name == "texture_normal")
+            number = std::to_string(normalNr++); // transfer unsigned int to stream
+        else if (name == "texture_height")
+            number = std::to_string(heightNr++); // transfer unsigned int to stream
+
+        // now set the sampler to the correct texture unit
+        GLCALL(glUniform1i(glGetUniformLocation(program.id, (name + number).c_str()), i));
+        // and finally bind the texture
+        GLCALL(glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id));
+    }
+
+    // maps quantized positions back to model space (identity for the other vertex formats)
+    GLCALL(glUniform3fv(glGetUniformLocation(program.id, "position_scale"),  1, &mesh.mesh.position_scale.x));
+    GLCALL(glUniform3fv(glGetUniformLocation(program.id, "position_offset"), 1, &mesh.mesh.position_offset.x));
+}
+
+// CPU occlusion culling of the meshes of the displayed model (see occlusion.h). The occluders are picked among the
+// meshes in view, by how large they appear, and by default only among those that were visible last frame, as those are
+// the ones most likely to be in front.
+struct Occlusion
+{
+    bool enabled = true;
+    bool reuse_visible = true;
+    int triangle_budget = 100000;  // Of the occluders.
+    unsigned width = 256;          // Of the depth buffer, whose height follows the window's aspect ratio.
+    DepthBuffer buffer;
+    std::vector<std::uint8_t> last_visible;  // Of the meshes, after occlusion culling.
+    std::vector<std::pair<float, std::uint32_t>> candidates;
+
+    // Of the last frame.
+    std::size_t occluders = 0;
+    std::size_t occluder_triangles = 0;
+    std::size_t tested = 0;
+    std::size_t occluded = 0;
+    float milliseconds = 0.0f;
+};
+
+// Rasterizes the occluders and clears visible[i] for the meshes in 'table' they hide. Only meshes with a MeshBvh have
+// their triangles on the CPU, so the others can't occlude.
+void CullOccludedMeshes(Occlusion& occlusion, const TexturedModel& model, const Scene& scene, std::uint32_t first_node, const View& view, const BoundsTable& table, std::vector<std::uint8_t>& visible, float aspect)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const bool reuse = occlusion.reuse_visible && occlusion.last_visible.size() == visible.size();
 
-        for (unsigned int i = 0; i < mesh.textures.size(); i++)
+    // The largest first, by the radius of their spheres over their distance.
+    occlusion.candidates.clear();
+    occlusion.tested = 0;
+    for (std::uint32_t i = 0; i < visible.size(); ++i)
+    {
+        if (!visible[i])
+            continue;
+        ++occlusion.tested;
+        if (!model.meshes[i].mesh.bvh || (reuse && !occlusion.last_visible[i]))
+            continue;
+
+        const glm::vec3 center(table.center_x[i], table.center_y[i], table.center_z[i]);
+        occlusion.candidates.push_back({table.radius[i] / std::max(glm::length(center - view.position), 1e-3f), i});
+    }
+    std::sort(occlusion.candidates.begin(), occlusion.candidates.end(), std::greater<std::pair<float, std::uint32_t>>());
+
+    Reset(occlusion.buffer, occlusion.width, static_cast<unsigned>(occlusion.width / aspect));
+    occlusion.occluders = 0;
+    std::size_t triangles = 0;
+    for (const auto& candidate : occlusion.candidates)
+    {
+        const TexturedMesh& mesh = model.meshes[candidate.second];
+        const std::size_t count = mesh.mesh.bvh->indices.size() / 3;
+        if (triangles + count > static_cast<std::size_t>(occlusion.triangle_budget))
+            continue;
+
+        const glm::mat4 matrix = view.view_projection * scene.worlds[first_node + mesh.node];
+        AddOccluder(occlusion.buffer, {mesh.mesh.bvh->positions.data(), mesh.mesh.bvh->positions.size(), mesh.mesh.bvh->indices.data(), count, matrix});
+        triangles += count;
+        ++occlusion.occluders;
+    }
+    occlusion.occluder_triangles = Rasterize(occlusion.buffer);
+    occlusion.occluded = CullOccluded(occlusion.buffer, table, view.view_projection, visible);
+    occlusion.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Draws every mesh in view at the coarsest LOD whose error projects to at most 'lod_threshold' pixels. At LOD 0 only the
+// meshlets in view that face the camera are drawn, if 'cull_meshlets'. The meshes are placed by the world matrices of
+// the model's nodes, which start at 'first_node' in the scene (see AddModel), and culled by their bounds in 'table',
+// and by occlusion if it's enabled. Returns the number of triangles drawn, which is 0 if the handle isn't valid.
+std::size_t Draw(ShaderProgram program, UniformLocation model_location, const ModelManager& models, ModelHandle handle, const Scene& scene, std::uint32_t first_node, const View& view, float lod_threshold, bool cull_meshlets, BoundsTable& table, std::vector<std::uint8_t>& visible, Occlusion& occlusion, float aspect, DrawList& list)
+{
+    const TexturedModel* model = Get(models, handle);
+    if (!model)
+        return 0;
+
+    // All meshes are culled at once before any is drawn.
+    Reset(table, model->meshes.size());
+    for (std::size_t i = 0; i < model->meshes.size(); ++i)
+    {
+        const TexturedMesh& mesh = model->meshes[i];
+        const glm::mat4& model_matrix = scene.worlds[first_node + mesh.node];
+        Set(table, i, TransformBounds(mesh.mesh.bounds, model_matrix), TransformSphere(mesh.mesh.sphere, model_matrix).radius);
+    }
+    CullBounds(table, ExtractFrustum(view.view_projection), visible);
+    if (occlusion.enabled)
+        CullOccludedMeshes(occlusion, *model, scene, first_node, view, table, visible, aspect);
+    occlusion.last_visible = visible;
+
+    std::size_t triangles = 0;
+    for (std::size_t i = 0; i < model->meshes.size(); ++i)
+    {
+        if (!visible[i])
+            continue;
+
+        const TexturedMesh& mesh = model->meshes[i];
+        const glm::mat4& model_matrix = scene.worlds[first_node + mesh.node];
+
+        // the selected LOD, a range of the mesh's indices, or the visible meshlets of LOD 0
+        const unsigned lod = mesh.mesh.lod_count > 0 ? SelectLod(mesh.mesh, model_matrix, view.position, view.projection_scale, lod_threshold) : 0;
+        if (lod == 0 && cull_meshlets && !mesh.mesh.meshlets.empty())
+        {
+            CullMeshlets(mesh.mesh, model_matrix, view.view_projection, view.position, list);
+        }
+        else
         {
-            GLCALL(glActiveTexture(GL_TEXTURE0 + i)); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            std::string number;
-            std::string name = mesh.textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            GLCALL(glUniform1i(glGetUniformLocation(program.id, (name + number).c_str()), i));
-            // and finally bind the texture
-            GLCALL(glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id));
+            const GLuint offset = mesh.mesh.lod_count > 0 ? mesh.mesh.lods[lod].offset : 0;
+            const GLuint count  = mesh.mesh.lod_count > 0 ? mesh.mesh.lods[lod].count  : mesh.mesh.count;
+            list.counts.assign(1, static_cast<GLsizei>(count));
+            list.offsets.assign(1, offset);
         }
+        if (list.counts.empty())
+            continue;
 
-        // draw mesh
-        GLCALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.mesh.ebo));
-        GLCALL(glBindVertexArray(mesh.mesh.vao));
-        GLCALL(glDrawElements(GL_TRIANGLES, mesh.mesh.count, GL_UNSIGNED_INT, 0));
-        GLCALL(glBindVertexArray(0));
+        SetUniform(model_location, model_matrix);
+        BindMesh(program, mesh);
+
+        // draw mesh, from the geometry arena
+        Draw(geometry_arena, mesh.mesh, list);
+        for (GLsizei count : list.counts)
+            triangles += count / 3;
 
         // always good practice to set everything back to defaults once configured.
         GLCALL(glActiveTexture(GL_TEXTURE0));
     }
+    Unbind(geometry_arena);
+    return triangles;
+}
+
+// The box around the meshes of the model, as placed by the scene, and the radius of a sphere around its center that
+// contains them too.
+void ModelBounds(const TexturedModel& model, const Scene& scene, std::uint32_t first_node, Bounds& bounds, float& radius)
+{
+    bounds = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+    for (const TexturedMesh& mesh : model.meshes)
+    {
+        const Bounds world = TransformBounds(mesh.mesh.bounds, scene.worlds[first_node + mesh.node]);
+        bounds.min = glm::min(bounds.min, world.min);
+        bounds.max = glm::max(bounds.max, world.max);
+    }
+    if (model.meshes.empty())
+        bounds = {glm::vec3(0.0f), glm::vec3(0.0f)};
+
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    radius = 0.0f;
+    for (const TexturedMesh& mesh : model.meshes)
+    {
+        const Sphere world = TransformSphere(mesh.mesh.sphere, scene.worlds[first_node + mesh.node]);
+        radius = std::max(radius, glm::length(world.center - center) + world.radius);
+    }
+}
+
+// Draws a copy of the model for every instance in the batch (see CullInstances), with one draw call per mesh and LOD.
+// Every mesh is drawn at the coarsest LOD whose error projects to at most 'lod_threshold' pixels for the nearest copy
+// of each distance bucket, and buckets that end up at the same LOD are drawn together. Returns the number of triangles
+// drawn.
+std::size_t DrawInstanced(ShaderProgram program, UniformLocation model_location, const ModelManager& models, ModelHandle handle, const Scene& scene, std::uint32_t first_node, const InstanceBatch& batch, InstanceBuffer& buffer, const View& view, float lod_threshold, DrawList& list)
+{
+    const TexturedModel* model = Get(models, handle);
+    if (!model || batch.visible.empty())
+        return 0;
+
+    Upload(buffer, batch.visible.data(), batch.visible.size());
+
+    std::size_t triangles = 0;
+    for (const TexturedMesh& mesh : model->meshes)
+    {
+        const glm::mat4& model_matrix = scene.worlds[first_node + mesh.node];
+        SetUniform(model_location, model_matrix);
+        BindMesh(program, mesh);
+
+        unsigned lods[INSTANCE_BUCKETS];
+        for (unsigned b = 0; b < INSTANCE_BUCKETS; ++b)
+            lods[b] = batch.starts[b] < batch.starts[b + 1] ? SelectLod(mesh.mesh, model_matrix, batch.distances[b], view.projection_scale, lod_threshold) : ~0u;
+
+        for (unsigned b = 0; b < INSTANCE_BUCKETS;)
+        {
+            if (lods[b] == ~0u)
+            {
+                ++b;
+                continue;
+            }
+
+            // Empty buckets in between don't split a run.
+            unsigned end = b + 1;
+            while (end < INSTANCE_BUCKETS && (lods[end] == lods[b] || lods[end] == ~0u))
+                ++end;
+
+            const unsigned lod = lods[b];
+            const GLuint offset = mesh.mesh.lod_count > 0 ? mesh.mesh.lods[lod].offset : 0;
+            const GLuint count  = mesh.mesh.lod_count > 0 ? mesh.mesh.lods[lod].count  : mesh.mesh.count;
+            const std::size_t instances = batch.starts[end] - batch.starts[b];
+            list.counts.assign(1, static_cast<GLsizei>(count));
+            list.offsets.assign(1, offset);
+            DrawInstanced(geometry_arena, mesh.mesh, list, buffer, batch.starts[b], instances);
+            triangles += count / 3 * instances;
+            b = end;
+        }
+
+        GLCALL(glActiveTexture(GL_TEXTURE0));
+    }
+    Unbind(geometry_arena);
+    return triangles;
+}
+
+// Copies of the model on a square grid around the origin, 'spacing' apart, in varying shades.
+std::vector<Instance> InstanceGrid(unsigned count, float spacing)
+{
+    std::vector<Instance> instances(count);
+    const unsigned side = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<float>(count))));
+    for (unsigned i = 0; i < count; ++i)
+    {
+        const float x = (static_cast<float>(i % side) - (side - 1) * 0.5f) * spacing;
+        const float z = (static_cast<float>(i / side) - (side - 1) * 0.5f) * spacing;
+        const float shade = 0.6f + 0.4f * static_cast<float>((i * 2654435761u) >> 24) / 255.0f;
+        instances[i] = {glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)), glm::vec4(shade, shade, shade, 1.0f)};
+    }
+    return instances;
 }
 
 
@@ -189,6 +422,9 @@ int main()
     // ---- INITIALIZE GLAD ----
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
 
+    // Before any texture is requested, as the decoding threads compress to these.
+    supported_block_formats = DetectBlockFormats();
+
 
     // ---- IMGUI SETUP ----
     InitializeImGui(window.handle);
@@ -199,17 +435,36 @@ int main()
 
     // ---- SHADER SETUP ----
     ShaderProgram basic = LoadShaders(PATH_TO_VERTEX, PATH_TO_FRAGMENT);
+    ShaderProgram instanced = LoadShaders(PATH_TO_INSTANCED_VERTEX, PATH_TO_INSTANCED_FRAGMENT, "instanced");
 
 
     // ---- MODEL SETUP ----
     // auto  source = Check(Read(PATH_TO_BUNNY));
     // auto  data   = Parse(source);
     // Mesh model  = IndexedModel(data.first, data.second);
-    TexturedModel model = LoadModel(PATH_TO_NANOSUIT);
+
+    // Models are loaded in the background and replace the displayed one when they're done.
+    WorkerPool loader_pool;
+    Start(loader_pool, std::max(1u, HardwareThreads() - 1));
+    std::vector<std::unique_ptr<ModelLoad>> loads;  // In the order they were requested.
+
+    // The displayed model. Replaced ones are released once the GPU is done drawing them.
+    ModelManager models;
+    Create(models, texture_cache, geometry_arena);
+    ModelHandle model;
+    loads.push_back(LoadModelAsync(loader_pool, PATH_TO_NANOSUIT));
+
+    // Textures of loaded models are streamed in over several frames.
+    TextureStreamer texture_streamer;
+    Create(texture_streamer);
 
 
     // ---- DATA SETUP ----
+    // The model's nodes hang below a root node, which places the model as a whole.
     Transform model_transform {};
+    Scene scene;
+    std::uint32_t model_root  = AddNode(scene, NO_PARENT);
+    std::uint32_t model_nodes = AddModel(scene, TexturedModel {}, model_root);
 
     glm::vec3 view_position  (0.0f, 10.0f,  20.0f);
     glm::vec3 view_front     (0.0f, 0.0f,  -1.0f);
@@ -217,6 +472,30 @@ int main()
     glm::vec3 view_velocity  (0.0f, 0.0f,   0.0f);
     float view_angle = 0.0f;
 
+    // With more than one instance, copies of the model are drawn on a grid with instancing.
+    int instance_count = 1;
+    float instance_spacing = 3.0f;
+    std::vector<Instance> instances;
+    InstanceBatch instance_batch;
+    InstanceBuffer instance_buffer;
+    Create(instance_buffer);
+
+    float lod_threshold = 1.0f;  // In pixels.
+    bool cull_meshlets = true;
+    DrawList draw_list;
+    BoundsTable mesh_bounds;  // Of the meshes of the model, culled every frame.
+    std::vector<std::uint8_t> mesh_visible;
+    Occlusion occlusion;
+    std::size_t triangles_drawn = 0;
+
+    // Clicking picks the triangle under the cursor through a tree over the model's meshes, refit when the scene moves
+    // and built again when the model is replaced.
+    Bvh model_bvh;
+    std::vector<Bounds> model_mesh_bounds;
+    bool rebuild_model_bvh = true;
+    RayHit picked;
+    float pick_microseconds = 0.0f;
+
 
     glm::mat4 view_matrix = glm::lookAt(view_position, view_position + view_front, view_up);
     glm::mat4 projection_matrix = glm::perspective(glm::radians(70.0f), static_cast<float>(window.width)/static_cast<float>(window.height), 0.1f, 100.0f);
@@ -245,6 +524,7 @@ int main()
     uniform_buffer.data.specular_factor = material.specular_factor;
     uniform_buffer.data.shininess = material.shininess;
     AddUniformBuffer(basic, "Data", uniform_buffer.id);
+    AddUniformBuffer(instanced, "Data", uniform_buffer.id);
 
     for (auto& x : GetShaderProgramInfo(basic).uniforms)
         std::cout << x.name << std::endl;
@@ -255,6 +535,9 @@ int main()
 
     //
     auto model_location      = CacheUniform(basic, "model");
+    Enable(instanced);
+    auto instanced_model_location = CacheUniform(instanced, "model");
+    Enable(basic);
     // auto view_location       = CacheUniform(basic, "view");
     // auto projection_location = CacheUniform(basic, "projection");
     // auto color_location      = CacheUniform(basic, "color");
@@ -276,9 +559,8 @@ int main()
             if (event->type == Event::FILE_DROP)
             {
                 // This cast should always be safe.
-                // TODO(ted): This should probably be loaded in a different thread.
                 auto file_drop = reinterpret_cast<FileDrop*>(event);
-                model = LoadModel(file_drop->path);
+                loads.push_back(LoadModelAsync(loader_pool, file_drop->path));
             }
             else if (event->type == Event::RESIZE)
             {
@@ -288,9 +570,60 @@ int main()
                 window.height = resize_event->height;
                 should_resize = true;
             }
+            else if (event->type == Event::MOUSE_CLICK)
+            {
+                // This cast should always be safe.
+                auto click = reinterpret_cast<MouseClick*>(event);
+                const TexturedModel* displayed = Get(models, model);
+                if (click->button == MouseClick::Button::LEFT && click->event == MouseClick::Event::CLICKED && !io.WantCaptureMouse && displayed)
+                {
+                    // The window's size is in screen coordinates like the cursor, which may differ from its pixels.
+                    int width = 0, height = 0;
+                    glfwGetWindowSize(window.handle, &width, &height);
+                    if (width > 0 && height > 0)
+                    {
+                        const glm::vec2 point(2.0f * click->x / width - 1.0f, 1.0f - 2.0f * click->y / height);
+                        const auto start = std::chrono::steady_clock::now();
+                        picked = RayHit {};
+                        Raycast(model_bvh, *displayed, scene, model_nodes, RayThrough(projection_matrix * view_matrix, point), picked);
+                        pick_microseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+                    }
+                }
+            }
         }
         Clear(event_queue);
 
+        // ---- LOADING ----
+        // Only the upload happens here. The newest finished model is displayed and older unfinished ones are cancelled,
+        // as they would be replaced anyway.
+        for (std::size_t i = loads.size(); i-- > 0;)
+        {
+            if (loads[i]->state == ModelLoad::LOADED && !loads[i]->cancel)
+            {
+                // Uploaded before the old model is released, so the textures they share stay resident.
+                const ModelHandle previous = model;
+                model = Add(models, UploadModel(*loads[i], &texture_streamer));
+                Release(models, previous);
+
+                Clear(scene);
+                model_root  = AddNode(scene, NO_PARENT, model_transform.position, Rotation(model_transform), model_transform.scale);
+                model_nodes = AddModel(scene, *Get(models, model), model_root);
+                rebuild_model_bvh = true;
+                picked = RayHit {};
+                for (std::size_t j = 0; j <= i; ++j)
+                    Cancel(*loads[j]);  // Including this one, as it's been handled.
+                break;
+            }
+        }
+        loads.erase(
+            std::remove_if(loads.begin(), loads.end(), [](const std::unique_ptr<ModelLoad>& load)
+            {
+                return Done(*load) && (load->state != ModelLoad::LOADED || load->cancel);
+            }),
+            loads.end()
+        );
+        Update(texture_streamer);
+
         if (!io.WantCaptureKeyboard)
         {
             glm::vec3 right = glm::normalize(glm::cross(view_front, view_up));
@@ -356,14 +689,105 @@ int main()
                 ImGui::NextColumn();
 
                 ImGui::Text("Transform");
-                ImGui::SliderFloat3("Position", &model_transform.position.x, -3.0f,  3.0f);
-                ImGui::SliderFloat3("Rotation", &model_transform.rotation.x, -3.14f, 3.14f);
-                ImGui::SliderFloat3("Scale",    &model_transform.scale.x,     0.0f,  2.0f);
+                bool transform_changed = false;
+                transform_changed |= ImGui::SliderFloat3("Position", &model_transform.position.x, -3.0f,  3.0f);
+                transform_changed |= ImGui::SliderFloat3("Rotation", &model_transform.rotation.x, -3.14f, 3.14f);
+                transform_changed |= ImGui::SliderFloat3("Scale",    &model_transform.scale.x,     0.0f,  2.0f);
                 if (ImGui::Button("Reset"))
                 {
                     model_transform.position = glm::vec3(0.0f, 0.0f, -2.0f);
                     model_transform.rotation = glm::vec3(0.0f, 0.0f,  0.0f);
                     model_transform.scale    = glm::vec3(1.0f, 1.0f,  1.0f);
+                    transform_changed = true;
+                }
+                if (transform_changed)
+                {
+                    SetPosition(scene, model_root, model_transform.position);
+                    SetRotation(scene, model_root, Rotation(model_transform));
+                    SetScale(scene, model_root, model_transform.scale);
+                }
+
+                float megabytes_per_frame = texture_streamer.bytes_per_frame / (1024.0f * 1024.0f);
+                if (ImGui::SliderFloat("Texture MB/frame", &megabytes_per_frame, 0.25f, 64.0f))
+                    texture_streamer.bytes_per_frame = static_cast<std::size_t>(megabytes_per_frame * 1024.0f * 1024.0f);
+                ImGui::SliderFloat("Texture ms/frame", &texture_streamer.milliseconds_per_frame, 0.1f, 16.0f);
+                ImGui::Text(
+                    "Streaming %u textures, %.2f MB in %.2f ms last frame", static_cast<unsigned>(texture_streamer.uploads.size()),
+                    texture_streamer.bytes_last_frame / (1024.0f * 1024.0f), texture_streamer.milliseconds_last_frame
+                );
+
+                float texture_budget = texture_cache.budget / (1024.0f * 1024.0f);
+                if (ImGui::SliderFloat("Texture budget (MB)", &texture_budget, 16.0f, 4096.0f))
+                {
+                    texture_cache.budget = static_cast<std::size_t>(texture_budget * 1024.0f * 1024.0f);
+                    Evict(texture_cache, &texture_streamer);
+                }
+                ImGui::Text(
+                    "Textures: %u resident, %.1f MB, %llu hits, %llu misses, %llu evictions",
+                    static_cast<unsigned>(texture_cache.entries.size()), texture_cache.resident / (1024.0f * 1024.0f),
+                    texture_cache.hits, texture_cache.misses, texture_cache.evictions
+                );
+
+                // Used for models uploaded from now on.
+                static const char* VERTEX_FORMATS[] = {"Full (56 bytes)", "Compact (24 bytes)", "Quantized (20 bytes)"};
+                int format = vertex_format;
+                if (ImGui::Combo("Vertex format", &format, VERTEX_FORMATS, 3))
+                    vertex_format = static_cast<VertexFormat>(format);
+                ImGui::Checkbox("Split meshes for 16 bit indices", &split_large_meshes);
+                ImGui::Checkbox("Optimize meshes on import", &optimize_meshes);
+                ImGui::Checkbox("Generate LODs on import", &generate_lods);
+                ImGui::Checkbox("Build meshlets on import", &build_meshlets);
+                ImGui::Checkbox("Cull meshlets", &cull_meshlets);
+                ImGui::SliderFloat("LOD threshold (px)", &lod_threshold, 0.25f, 16.0f);
+                ImGui::Text("Triangles drawn: %u", static_cast<unsigned>(triangles_drawn));
+                if (ImGui::SliderInt("Instances", &instance_count, 1, 100000) | ImGui::SliderFloat("Instance spacing", &instance_spacing, 0.5f, 20.0f))
+                    instances = InstanceGrid(static_cast<unsigned>(instance_count), instance_spacing);
+                if (instance_count > 1)
+                    ImGui::Text("Instances drawn: %u of %u", static_cast<unsigned>(instance_batch.visible.size()), static_cast<unsigned>(instances.size()));
+                ImGui::Checkbox("Occlusion culling", &occlusion.enabled);
+                ImGui::Checkbox("Occluders from last frame's visible meshes", &occlusion.reuse_visible);
+                ImGui::SliderInt("Occluder triangles", &occlusion.triangle_budget, 1000, 1000000);
+                if (occlusion.enabled && instance_count <= 1)
+                {
+                    ImGui::Text(
+                        "Occlusion: %u of %u meshes hidden by %u occluders (%u triangles, %ux%u) in %.2f ms",
+                        static_cast<unsigned>(occlusion.occluded), static_cast<unsigned>(occlusion.tested), static_cast<unsigned>(occlusion.occluders),
+                        static_cast<unsigned>(occlusion.occluder_triangles), occlusion.buffer.width, occlusion.buffer.height, occlusion.milliseconds
+                    );
+                }
+                if (picked.mesh != RayHit {}.mesh)
+                    ImGui::Text("Picked mesh %u, triangle %u at %.2f (%.1f us)", picked.mesh, picked.triangle, picked.distance, pick_microseconds);
+                else
+                    ImGui::Text("Picked nothing (%.1f us)", pick_microseconds);
+
+                std::size_t geometry_blocks = 0, geometry_used = 0, geometry_capacity = 0;
+                for (int format = 0; format < 3; ++format)
+                {
+                    for (const GeometryBlock& block : geometry_arena.blocks[format])
+                    {
+                        const std::size_t vertex_size = VertexSize(static_cast<VertexFormat>(format));
+                        geometry_used     += block.vertices.used * vertex_size + block.indices.used;
+                        geometry_capacity += block.vertices.capacity * vertex_size + block.indices.capacity;
+                        ++geometry_blocks;
+                    }
+                }
+                ImGui::Text(
+                    "Geometry: %u blocks, %.1f of %.1f MB used", static_cast<unsigned>(geometry_blocks),
+                    geometry_used / (1024.0f * 1024.0f), geometry_capacity / (1024.0f * 1024.0f)
+                );
+
+                for (const std::unique_ptr<ModelLoad>& load : loads)
+                {
+                    static const char* STATES[] = {"Queued", "Importing", "Decoding", "Loaded", "Failed", "Cancelled"};
+
+                    ImGui::PushID(load.get());
+                    std::string name = load->path.substr(load->path.find_last_of("/\\") + 1);
+                    ImGui::Text("%s (%s)", name.c_str(), STATES[load->state]);
+                    ImGui::ProgressBar(load->progress, ImVec2(-80.0f, 0.0f));
+                    ImGui::SameLine();
+                    if (ImGui::Button("Cancel"))
+                        Cancel(*load);
+                    ImGui::PopID();
                 }
 
             }
@@ -379,8 +803,21 @@ int main()
         view_matrix = glm::lookAt(view_position, view_position + view_front, view_up);
         projection_matrix = glm::perspective(glm::radians(45.0f), static_cast<float>(window.width) / static_cast<float>(window.height), 0.1f, 100.0f);
 
+        // Only the nodes that moved since the last frame are recomputed, and the picking tree only follows when some did.
+        if (UpdateTransforms(scene) > 0 || rebuild_model_bvh)
+        {
+            if (const TexturedModel* displayed = Get(models, model))
+            {
+                MeshBounds(*displayed, scene, model_nodes, model_mesh_bounds);
+                if (rebuild_model_bvh)
+                    Build(model_bvh, model_mesh_bounds.data(), model_mesh_bounds.size());
+                else
+                    Refit(model_bvh, model_mesh_bounds.data());
+                rebuild_model_bvh = false;
+            }
+        }
+
         Enable(basic);
-        SetUniform(model_location,      ModelMatrix(model_transform));
         // SetUniform(view_location,       view_matrix);
         // SetUniform(projection_location, projection_matrix);
         // SetUniform(color_location,      material.color);
@@ -415,7 +852,23 @@ int main()
 
         Enable(basic);
 
-        Draw(basic, model);
+        // The projection scale is for the 45 degree vertical field of view above.
+        const View view {view_position, projection_matrix * view_matrix, window.height * 0.5f * projection_matrix[1][1]};
+        if (instance_count > 1)
+        {
+            Bounds bounds {};
+            float radius = 0.0f;
+            if (const TexturedModel* displayed = Get(models, model))
+                ModelBounds(*displayed, scene, model_nodes, bounds, radius);
+            CullInstances(instances.data(), instances.size(), bounds, radius, view.view_projection, view.position, instance_batch);
+
+            Enable(instanced);
+            triangles_drawn = DrawInstanced(instanced, instanced_model_location, models, model, scene, model_nodes, instance_batch, instance_buffer, view, lod_threshold, draw_list);
+        }
+        else
+        {
+            triangles_drawn = Draw(basic, model_location, models, model, scene, model_nodes, view, lod_threshold, cull_meshlets, mesh_bounds, mesh_visible, occlusion, static_cast<float>(window.width) / static_cast<float>(window.height), draw_list);
+        }
         // GLCALL(glBindVertexArray(model.vao));
         // GLCALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.ebo));
         // GLCALL(glDrawElements(GL_TRIANGLES, model.count, GL_UNSIGNED_INT, nullptr));
@@ -429,9 +882,24 @@ int main()
 
         /* Poll for and process events */
         glfwPollEvents();
+
+        // Once the models released frames ago are gone, their space in the geometry blocks and texture budget is free.
+        if (EndFrame(models) > 0)
+        {
+            Defragment(geometry_arena);
+            Evict(texture_cache, &texture_streamer);
+        }
     }
 
     // Cleanup
+    for (const std::unique_ptr<ModelLoad>& load : loads)
+        Cancel(*load);
+    Stop(loader_pool);
+    Destroy(texture_streamer);
+    Destroy(instance_buffer);
+    Destroy(models);
+    Destroy(geometry_arena);
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,271 @@
+#include "meshlets.h"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <numeric>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include "optimizer.h"
+
+
+// Forward declaration of internal functions.
+static Meshlet Bound(const Vertex* vertices, const GLuint* indices, GLuint offset, GLuint count);
+static bool UniformScale(const glm::mat4& model);
+
+
+std::vector<Meshlet> BuildMeshlets(const Vertex* vertices, std::size_t vertex_count, GLuint* indices, std::size_t index_count)
+{
+    std::vector<Meshlet> meshlets;
+    if (index_count % 3 != 0 || index_count == 0)
+        return meshlets;
+    const std::size_t triangle_count = index_count / 3;
+
+    // The triangles around every vertex.
+    std::vector<unsigned> offsets(vertex_count + 1, 0), adjacent(index_count);
+    for (std::size_t i = 0; i < index_count; ++i)
+        ++offsets[indices[i] + 1];
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    {
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < index_count; ++i)
+            adjacent[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+    }
+
+    std::vector<glm::vec3> centroids(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        centroids[t] = (vertices[indices[t * 3]].position + vertices[indices[t * 3 + 1]].position + vertices[indices[t * 3 + 2]].position) / 3.0f;
+
+    // Which meshlet last used every vertex, plus one, so it doesn't have to be cleared between meshlets.
+    std::vector<unsigned> used(vertex_count, 0);
+    std::vector<unsigned char> emitted(triangle_count, 0);
+    std::vector<unsigned> live(offsets.size() - 1);  // Triangles of every vertex that aren't emitted yet.
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        live[v] = offsets[v + 1] - offsets[v];
+    std::vector<unsigned> order, candidates;
+    order.reserve(triangle_count);
+    std::size_t next = 0;  // The first triangle that may not be emitted yet, where the next meshlet starts.
+
+    auto new_vertices = [&](unsigned t, unsigned current)
+    {
+        return unsigned(used[indices[t * 3]] != current) + unsigned(used[indices[t * 3 + 1]] != current) + unsigned(used[indices[t * 3 + 2]] != current);
+    };
+    auto live_score = [&](unsigned t) { return live[indices[t * 3]] + live[indices[t * 3 + 1]] + live[indices[t * 3 + 2]]; };
+
+    for (unsigned current = 1; order.size() < triangle_count; ++current)
+    {
+        // The next meshlet starts next to the last one, at the triangle with the fewest live neighbors, so no
+        // stragglers are left behind. If there's none, at the first triangle left.
+        unsigned seed = ~0u;
+        for (unsigned t : candidates)
+            if (!emitted[t] && (seed == ~0u || live_score(t) < live_score(seed)))
+                seed = t;
+        if (seed == ~0u)
+        {
+            while (emitted[next])
+                ++next;
+            seed = static_cast<unsigned>(next);
+        }
+
+        // Grows the meshlet by the neighboring triangle that adds the fewest vertices, and then the one closest to its
+        // center, which keeps it compact and its normals close together.
+        const std::size_t begin = order.size();
+        unsigned meshlet_vertices = 0;
+        glm::vec3 sum(0.0f);
+        candidates.assign(1, seed);
+        while (true)
+        {
+            const glm::vec3 center = order.size() > begin ? sum / float(order.size() - begin) : glm::vec3(0.0f);
+            unsigned best = ~0u, best_added = 4, best_score = 0;
+            float best_distance = 0.0f;
+            for (std::size_t i = 0; i < candidates.size(); )
+            {
+                const unsigned t = candidates[i];
+                if (emitted[t])
+                {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                const unsigned added = new_vertices(t, current);
+                const unsigned score = live_score(t);
+                const float distance = glm::dot(centroids[t] - center, centroids[t] - center);
+                if (added < best_added || (added == best_added && (score < best_score || (score == best_score && distance < best_distance))))
+                {
+                    best = t;
+                    best_added = added;
+                    best_score = score;
+                    best_distance = distance;
+                }
+                ++i;
+            }
+            if (best == ~0u || meshlet_vertices + best_added > MAX_MESHLET_VERTICES || order.size() - begin == MAX_MESHLET_TRIANGLES)
+                break;
+
+            emitted[best] = 1;
+            order.push_back(best);
+            for (int c = 0; c < 3; ++c)
+                --live[indices[best * 3 + c]];
+            sum += centroids[best];
+            meshlet_vertices += best_added;
+            for (int c = 0; c < 3; ++c)
+            {
+                const GLuint v = indices[best * 3 + c];
+                if (used[v] == current)
+                    continue;
+                used[v] = current;
+                for (unsigned a = offsets[v]; a < offsets[v + 1]; ++a)
+                    if (!emitted[adjacent[a]])
+                        candidates.push_back(adjacent[a]);
+            }
+        }
+        Meshlet meshlet = {};
+        meshlet.offset = static_cast<GLuint>(begin * 3);
+        meshlet.count  = static_cast<GLuint>((order.size() - begin) * 3);
+        meshlets.push_back(meshlet);
+    }
+
+    // The triangles in meshlet order, each meshlet optimized for the vertex cache on its own. Its vertices are numbered
+    // locally for that, so the optimization doesn't scale with the whole mesh.
+    std::vector<GLuint> reordered(index_count), local, optimized, global;
+    for (std::size_t i = 0; i < triangle_count; ++i)
+        for (int c = 0; c < 3; ++c)
+            reordered[i * 3 + c] = indices[order[i] * 3 + c];
+    std::vector<GLuint> local_index(vertex_count, ~GLuint(0));
+    for (Meshlet& meshlet : meshlets)
+    {
+        local.resize(meshlet.count);
+        global.clear();
+        for (GLuint i = 0; i < meshlet.count; ++i)
+        {
+            const GLuint v = reordered[meshlet.offset + i];
+            if (local_index[v] == ~GLuint(0))
+            {
+                local_index[v] = static_cast<GLuint>(global.size());
+                global.push_back(v);
+            }
+            local[i] = local_index[v];
+        }
+
+        optimized.resize(meshlet.count);
+        OptimizeVertexCache(optimized.data(), local.data(), meshlet.count, global.size());
+        for (GLuint i = 0; i < meshlet.count; ++i)
+            indices[meshlet.offset + i] = global[optimized[i]];
+        for (GLuint v : global)
+            local_index[v] = ~GLuint(0);
+
+        meshlet = Bound(vertices, indices, meshlet.offset, meshlet.count);
+    }
+
+    return meshlets;
+}
+
+
+std::size_t CullMeshlets(const Mesh& mesh, const glm::mat4& model, const glm::mat4& view_projection, const glm::vec3& camera, DrawList& list)
+{
+    list.counts.clear();
+    list.offsets.clear();
+
+    // Everything is tested in model space.
+    const Frustum frustum = ExtractFrustum(view_projection * model);
+    const glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(camera, 1.0f));
+    const bool cone_culling = UniformScale(model);
+
+    std::size_t kept = 0;
+    GLuint end = ~GLuint(0);  // Of the last range.
+    for (const Meshlet& meshlet : mesh.meshlets)
+    {
+        if (!Intersects(frustum, meshlet.center, meshlet.radius))
+            continue;
+        if (cone_culling && meshlet.cone_cutoff <= 1.0f)
+        {
+            const glm::vec3 direction = meshlet.cone_apex - eye;
+            const float distance = glm::length(direction);
+            if (distance > 0.0f && glm::dot(direction, meshlet.cone_axis) >= meshlet.cone_cutoff * distance)
+                continue;
+        }
+
+        ++kept;
+        if (meshlet.offset == end)
+        {
+            list.counts.back() += static_cast<GLsizei>(meshlet.count);
+        }
+        else
+        {
+            list.counts.push_back(static_cast<GLsizei>(meshlet.count));
+            list.offsets.push_back(meshlet.offset);
+        }
+        end = meshlet.offset + meshlet.count;
+    }
+    return kept;
+}
+
+
+// The bounding sphere and normal cone of the triangles in [offset, offset + count) of 'indices'.
+static Meshlet Bound(const Vertex* vertices, const GLuint* indices, GLuint offset, GLuint count)
+{
+    Meshlet meshlet {};
+    meshlet.offset = offset;
+    meshlet.count  = count;
+
+    // The sphere around the center of the bounding box, which is close enough for clusters this small.
+    glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+    for (GLuint i = offset; i < offset + count; ++i)
+    {
+        min = glm::min(min, vertices[indices[i]].position);
+        max = glm::max(max, vertices[indices[i]].position);
+    }
+    meshlet.center = (min + max) * 0.5f;
+    for (GLuint i = offset; i < offset + count; ++i)
+        meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+
+    // The cone axis is the average of the triangle normals, and its cutoff the sine of the widest angle between them.
+    std::vector<std::pair<glm::vec3, glm::vec3>> planes;  // A corner and the unit normal of every triangle.
+    planes.reserve(count / 3);
+    glm::vec3 axis(0.0f);
+    for (GLuint i = offset; i < offset + count; i += 3)
+    {
+        const glm::vec3& p0 = vertices[indices[i]].position;
+        const glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - p0, vertices[indices[i + 2]].position - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            planes.push_back({p0, normal / length});
+            axis += normal / length;
+        }
+    }
+
+    meshlet.cone_apex   = meshlet.center;
+    meshlet.cone_cutoff = 2.0f;
+    const float axis_length = glm::length(axis);
+    if (planes.empty() || axis_length <= 0.0f)
+        return meshlet;
+    meshlet.cone_axis = axis / axis_length;
+
+    float min_cosine = 1.0f;
+    for (const auto& plane : planes)
+        min_cosine = std::min(min_cosine, glm::dot(plane.second, meshlet.cone_axis));
+    if (min_cosine <= 0.1f)
+        return meshlet;  // Wider than about 85 degrees: nearly no camera would be inside the cone.
+
+    // The apex is where the cone axis passes behind every triangle's plane, so any camera in the cone behind it sees
+    // only their backs.
+    float apex = std::numeric_limits<float>::max();
+    for (const auto& plane : planes)
+        apex = std::min(apex, glm::dot(plane.first - meshlet.center, plane.second) / glm::dot(meshlet.cone_axis, plane.second));
+    meshlet.cone_apex   = meshlet.center + meshlet.cone_axis * apex;
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_cosine * min_cosine);
+    return meshlet;
+}
+
+// Whether the columns of the upper 3x3 have the same length, within a percent.
+static bool UniformScale(const glm::mat4& model)
+{
+    const float x = glm::length(glm::vec3(model[0])), y = glm::length(glm::vec3(model[1])), z = glm::length(glm::vec3(model[2]));
+    const float largest = std::max(x, std::max(y, z)), smallest = std::min(x, std::min(y, z));
+    return smallest > 0.0f && largest <= smallest * 1.01f;
+}
@@ -0,0 +1,314 @@
+#include "mipmaps.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NAX_SSE2 1
+#endif
+
+#include "threading.h"
+
+
+// Every pixel is filtered as 4 floats, whatever the number of components, so one pixel is one SSE register.
+#if NAX_SSE2
+using Pixel = __m128;
+
+static inline Pixel Zero()                { return _mm_setzero_ps(); }
+static inline Pixel Load(const float* in) { return _mm_loadu_ps(in); }
+static inline void  Store(float* out, Pixel pixel) { _mm_storeu_ps(out, pixel); }
+static inline Pixel MultiplyAdd(Pixel sum, Pixel pixel, float weight) { return _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_set1_ps(weight))); }
+static inline Pixel Saturate(Pixel pixel) { return _mm_min_ps(_mm_max_ps(pixel, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+#else
+struct Pixel { float channels[4]; };
+
+static inline Pixel Zero()                { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+static inline Pixel Load(const float* in) { return {{in[0], in[1], in[2], in[3]}}; }
+static inline void  Store(float* out, Pixel pixel) { std::memcpy(out, pixel.channels, sizeof(pixel.channels)); }
+static inline Pixel MultiplyAdd(Pixel sum, Pixel pixel, float weight)
+{
+    for (int c = 0; c < 4; ++c)
+        sum.channels[c] += pixel.channels[c] * weight;
+    return sum;
+}
+static inline Pixel Saturate(Pixel pixel)
+{
+    for (int c = 0; c < 4; ++c)
+        pixel.channels[c] = std::min(1.0f, std::max(0.0f, pixel.channels[c]));
+    return pixel;
+}
+#endif
+
+
+// The source pixels and weights of every destination pixel along one axis. Every destination pixel has 'count' taps,
+// padded with zero weights.
+struct Taps
+{
+    int count;
+    std::vector<int>   indices;
+    std::vector<float> weights;
+};
+
+// Returns row 'y' of a level as 4 floats per pixel, either from the level itself or converted into 'scratch'.
+using RowLoader = std::function<const float*(unsigned y, std::vector<float>& scratch)>;
+
+static const float KAISER_RADIUS = 2.0f;  // In destination pixels.
+static const float KAISER_ALPHA  = 4.0f;
+static const int   LINEAR_TO_SRGB_SIZE = 16384;
+
+
+// Forward declaration of internal functions.
+static Taps ComputeTaps(int size, int next_size, MipFilter filter);
+static void Downsample(const RowLoader& source, int width, int height, float* destination, int next_width, int next_height, MipFilter filter, std::vector<float>& horizontal);
+static bool IsSRGBChannel(int channel, int components, bool srgb);
+static const float* SRGBToLinear();
+static const unsigned char* LinearToSRGB();
+
+
+bool IsSRGB(const std::string& type)
+{
+    return type == "texture_diffuse";
+}
+
+
+MipChain GenerateMipChain(const unsigned char* pixels, int width, int height, int components, bool srgb, MipFilter filter)
+{
+    MipChain chain;
+    chain.components = components;
+    if (width <= 0 || height <= 0 || components < 1 || components > 4)
+        return chain;
+
+    for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        const std::size_t offset = chain.levels.empty() ? 0 : chain.levels.back().offset + chain.levels.back().size;
+        chain.levels.push_back({w, h, offset, std::size_t(w) * std::size_t(h) * components});
+        if (w == 1 && h == 1)
+            break;
+    }
+    chain.data.resize(chain.levels.back().offset + chain.levels.back().size);
+    std::memcpy(chain.data.data(), pixels, chain.levels[0].size);
+
+    const float* to_linear = SRGBToLinear();
+    const unsigned char* to_srgb = LinearToSRGB();
+    bool srgb_channel[4];
+    for (int c = 0; c < 4; ++c)
+        srgb_channel[c] = IsSRGBChannel(c, components, srgb);
+
+    // The base level is converted a row at a time as it's filtered, rather than kept as floats.
+    auto base = [&](unsigned y, std::vector<float>& scratch) -> const float*
+    {
+        scratch.assign(std::size_t(width) * 4, 0.0f);
+        const unsigned char* in = pixels + std::size_t(y) * width * components;
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < components; ++c)
+                scratch[std::size_t(x) * 4 + c] = srgb_channel[c] ? to_linear[in[x * components + c]] : in[x * components + c] / 255.0f;
+        return scratch.data();
+    };
+
+    std::vector<float> level, next, horizontal;
+    for (std::size_t l = 1; l < chain.levels.size(); ++l)
+    {
+        const MipLevel& previous = chain.levels[l - 1];
+        const MipLevel& current  = chain.levels[l];
+
+        auto filtered = [&](unsigned y, std::vector<float>&) -> const float* { return level.data() + std::size_t(y) * previous.width * 4; };
+        next.resize(std::size_t(current.width) * current.height * 4);
+        Downsample(l == 1 ? RowLoader(base) : RowLoader(filtered), previous.width, previous.height, next.data(), current.width, current.height, filter, horizontal);
+        level.swap(next);
+
+        unsigned char* out = chain.data.data() + current.offset;
+        for (std::size_t i = 0; i < std::size_t(current.width) * current.height; ++i)
+        {
+            for (int c = 0; c < components; ++c)
+            {
+                const float value = level[i * 4 + c];
+                out[i * components + c] = srgb_channel[c] ?
+                    to_srgb[static_cast<int>(value * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)] :
+                    static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    return chain;
+}
+
+
+static float Sinc(float x)
+{
+    if (std::abs(x) < 1e-6f)
+        return 1.0f;
+    const float pi_x = 3.14159265358979f * x;
+    return std::sin(pi_x) / pi_x;
+}
+
+// Modified Bessel function of the first kind, of order 0.
+static float BesselI0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 32 && term > 1e-8f * sum; ++k)
+    {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static float Kaiser(float x)
+{
+    const float t = x / KAISER_RADIUS;
+    if (t <= -1.0f || t >= 1.0f)
+        return 0.0f;
+    return Sinc(x) * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+}
+
+static Taps ComputeTaps(int size, int next_size, MipFilter filter)
+{
+    const float scale = float(size) / float(next_size);
+    std::vector<std::vector<std::pair<int, float>>> taps(next_size);
+
+    for (int i = 0; i < next_size; ++i)
+    {
+        const float begin = i * scale, end = (i + 1) * scale, center = (i + 0.5f) * scale;
+        if (filter == BOX)
+        {
+            // The source pixels the destination pixel covers, weighted by how much.
+            for (int j = static_cast<int>(std::floor(begin)); j < end; ++j)
+            {
+                const float coverage = std::min(end, float(j + 1)) - std::max(begin, float(j));
+                if (coverage > 0.0f)
+                    taps[i].push_back({j, coverage / scale});
+            }
+        }
+        else
+        {
+            const int first = static_cast<int>(std::floor(center - KAISER_RADIUS * scale));
+            const int last  = static_cast<int>(std::ceil(center + KAISER_RADIUS * scale));
+            float sum = 0.0f;
+            for (int j = first; j <= last; ++j)
+            {
+                const float weight = Kaiser((j + 0.5f - center) / scale);
+                if (weight == 0.0f)
+                    continue;
+                taps[i].push_back({((j % size) + size) % size, weight});  // Wrapped, as the textures repeat.
+                sum += weight;
+            }
+            for (std::pair<int, float>& tap : taps[i])
+                tap.second /= sum;
+        }
+    }
+
+    Taps result;
+    result.count = 0;
+    for (const auto& pixel : taps)
+        result.count = std::max(result.count, static_cast<int>(pixel.size()));
+    result.indices.assign(std::size_t(next_size) * result.count, 0);
+    result.weights.assign(std::size_t(next_size) * result.count, 0.0f);
+    for (int i = 0; i < next_size; ++i)
+    {
+        for (std::size_t t = 0; t < taps[i].size(); ++t)
+        {
+            result.indices[std::size_t(i) * result.count + t] = taps[i][t].first;
+            result.weights[std::size_t(i) * result.count + t] = taps[i][t].second;
+        }
+    }
+    return result;
+}
+
+// Separable: filters the rows into 'horizontal', an image of the new width, then its columns into 'destination'.
+static void Downsample(const RowLoader& source, int width, int height, float* destination, int next_width, int next_height, MipFilter filter, std::vector<float>& horizontal)
+{
+    const Taps columns = ComputeTaps(width,  next_width,  filter);
+    const Taps rows    = ComputeTaps(height, next_height, filter);
+    horizontal.resize(std::size_t(next_width) * height * 4);
+
+    const unsigned thread_count = ThreadsFor(std::size_t(width) * height, 256 * 256);
+
+    ParallelFor(static_cast<unsigned>(height), thread_count, [&](unsigned y)
+    {
+        std::vector<float> scratch;
+        const float* in = source(y, scratch);
+        float* out = horizontal.data() + std::size_t(y) * next_width * 4;
+        for (int x = 0; x < next_width; ++x)
+        {
+            Pixel sum = Zero();
+            for (int t = 0; t < columns.count; ++t)
+            {
+                const std::size_t tap = std::size_t(x) * columns.count + t;
+                sum = MultiplyAdd(sum, Load(in + std::size_t(columns.indices[tap]) * 4), columns.weights[tap]);
+            }
+            Store(out + std::size_t(x) * 4, sum);
+        }
+    });
+
+    ParallelFor(static_cast<unsigned>(next_height), thread_count, [&](unsigned y)
+    {
+        float* out = destination + std::size_t(y) * next_width * 4;
+        for (int x = 0; x < next_width; ++x)
+            Store(out + std::size_t(x) * 4, Zero());
+
+        for (int t = 0; t < rows.count; ++t)
+        {
+            const std::size_t tap = std::size_t(y) * rows.count + t;
+            const float* in = horizontal.data() + std::size_t(rows.indices[tap]) * next_width * 4;
+            const float weight = rows.weights[tap];
+            if (weight == 0.0f)
+                continue;
+            for (int x = 0; x < next_width; ++x)
+                Store(out + std::size_t(x) * 4, MultiplyAdd(Load(out + std::size_t(x) * 4), Load(in + std::size_t(x) * 4), weight));
+        }
+
+        // The negative lobes of the Kaiser filter can overshoot.
+        for (int x = 0; x < next_width; ++x)
+            Store(out + std::size_t(x) * 4, Saturate(Load(out + std::size_t(x) * 4)));
+    });
+}
+
+
+// Gray (and gray with alpha) images have a single color channel.
+static bool IsSRGBChannel(int channel, int components, bool srgb)
+{
+    return srgb && (components <= 2 ? channel == 0 : channel < 3);
+}
+
+static const float* SRGBToLinear()
+{
+    struct Table
+    {
+        float values[256];
+        Table()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                const float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+    static const Table table;
+    return table.values;
+}
+
+// Indexed by the linear value scaled to [0, LINEAR_TO_SRGB_SIZE - 1], which is fine enough to round correctly.
+static const unsigned char* LinearToSRGB()
+{
+    struct Table
+    {
+        unsigned char values[LINEAR_TO_SRGB_SIZE];
+        Table()
+        {
+            for (int i = 0; i < LINEAR_TO_SRGB_SIZE; ++i)
+            {
+                const float l = float(i) / (LINEAR_TO_SRGB_SIZE - 1);
+                const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                values[i] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+            }
+        }
+    };
+    static const Table table;
+    return table.values;
+}
@@ -0,0 +1,115 @@
+#include "models.h"
+
+#include <utility>
+#include <cstddef>
+
+#include "textures.h"
+#include "geometry.h"
+
+
+static bool Valid(const ModelManager& manager, ModelHandle handle)
+{
+    return handle.index < manager.slots.size() && manager.slots[handle.index].references > 0 &&
+           manager.slots[handle.index].generation == handle.generation;
+}
+
+static void ReleaseResources(ModelManager& manager, const TexturedModel& model)
+{
+    Release(*manager.textures, model);
+    Release(*manager.geometry, model);
+}
+
+
+void Create(ModelManager& manager, TextureCache& textures, GeometryArena& geometry)
+{
+    manager.textures = &textures;
+    manager.geometry = &geometry;
+}
+
+void Destroy(ModelManager& manager)
+{
+    for (ModelManager::Slot& slot : manager.slots)
+        if (slot.references > 0)
+            ReleaseResources(manager, slot.model);
+    for (const ModelManager::Retired& retired : manager.retired)
+        ReleaseResources(manager, retired.model);
+
+    manager.slots.clear();
+    manager.free_slots.clear();
+    manager.retired.clear();
+}
+
+
+ModelHandle Add(ModelManager& manager, TexturedModel&& model)
+{
+    std::uint32_t index;
+    if (!manager.free_slots.empty())
+    {
+        index = manager.free_slots.back();
+        manager.free_slots.pop_back();
+    }
+    else
+    {
+        index = static_cast<std::uint32_t>(manager.slots.size());
+        manager.slots.push_back({{}, 1, 0});  // Not 0, the generation of a default handle.
+    }
+
+    ModelManager::Slot& slot = manager.slots[index];
+    slot.model = std::move(model);
+    slot.references = 1;
+    return {index, slot.generation};
+}
+
+bool Acquire(ModelManager& manager, ModelHandle handle)
+{
+    if (!Valid(manager, handle))
+        return false;
+    ++manager.slots[handle.index].references;
+    return true;
+}
+
+void Release(ModelManager& manager, ModelHandle handle)
+{
+    if (!Valid(manager, handle))
+        return;
+
+    ModelManager::Slot& slot = manager.slots[handle.index];
+    if (--slot.references > 0)
+        return;
+
+    // It may be in the frame being recorded, so it's retired as of this one.
+    manager.retired.push_back({std::move(slot.model), manager.frame});
+    slot.model = {};
+    slot.generation += 1;
+    if (slot.generation == 0)
+        slot.generation = 1;
+    manager.free_slots.push_back(handle.index);
+}
+
+const TexturedModel* Get(const ModelManager& manager, ModelHandle handle)
+{
+    return Valid(manager, handle) ? &manager.slots[handle.index].model : nullptr;
+}
+
+
+unsigned EndFrame(ModelManager& manager)
+{
+    ++manager.frame;
+
+    unsigned released = 0;
+    for (std::size_t i = 0; i < manager.retired.size();)
+    {
+        if (manager.retired[i].frame + manager.frames_in_flight <= manager.frame)
+        {
+            ReleaseResources(manager, manager.retired[i].model);
+            manager.retired[i] = std::move(manager.retired.back());
+            manager.retired.pop_back();
+            ++released;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return released;
+}
@@ -0,0 +1,374 @@
+#include "naxmesh.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#include "errors.h"
+#include "utilities.h"
+#include "loader.h"
+
+const unsigned NAXMESH_VERSION = 5;
+
+std::string mesh_cache_directory = ".naxcache";
+
+
+struct NaxMeshHeader
+{
+    char          magic[4];     // "NAXM"
+    std::uint32_t version;
+    std::uint64_t key;
+    std::uint64_t size;         // Of the whole file, to catch truncated files.
+    std::uint32_t vertex_size;  // sizeof(Vertex), to catch layout changes.
+    std::uint32_t meshlet_size; // sizeof(Meshlet), likewise.
+    std::uint32_t mesh_count;
+    std::uint32_t texture_count;
+    std::uint32_t node_count;
+    std::uint32_t reserved;
+};
+
+struct NaxMeshRecord
+{
+    std::uint64_t vertex_offset;
+    std::uint64_t index_offset;
+    std::uint64_t meshlet_offset;
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    std::uint32_t meshlet_count;
+    std::uint32_t node;
+    std::uint32_t first_texture;
+    std::uint32_t texture_count;
+    float         bounds_min[3];
+    float         bounds_max[3];
+    std::uint32_t lod_count;
+    std::uint32_t lod_offsets[MAX_LODS];  // In indices.
+    std::uint32_t lod_counts[MAX_LODS];
+    float         lod_errors[MAX_LODS];
+};
+
+struct NaxTextureRecord
+{
+    std::uint64_t path_offset;
+    std::uint64_t type_offset;
+    std::uint32_t path_size;
+    std::uint32_t type_size;
+};
+
+struct NaxNodeRecord
+{
+    std::uint32_t parent;
+    float         position[3];
+    float         rotation[4];  // x, y, z, w.
+    float         scale[3];
+};
+
+static const char NAXMESH_MAGIC[4] = {'N', 'A', 'X', 'M'};
+static const std::uint64_t ALIGNMENT = 16;
+
+
+// Forward declaration of internal functions.
+static std::uint64_t Align(std::uint64_t offset);
+static bool InFile(std::uint64_t offset, std::uint64_t size, std::uint64_t file_size);
+
+
+unsigned long long MeshCacheKey(const char* data, std::size_t size, unsigned import_flags, unsigned options)
+{
+    return ContentHash(data, size, ContentHash(&options, sizeof(options), (static_cast<unsigned long long>(NAXMESH_VERSION) << 32) | import_flags));
+}
+
+std::string MeshCachePath(unsigned long long key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.naxmesh", key);
+    return mesh_cache_directory + DIRECTORY_SEPERATOR + name;
+}
+
+
+Return<MeshCache> OpenMeshCache(const std::string& path, unsigned long long key)
+{
+    Return<MappedFile> mapped = Map(path);
+    if (mapped.error)
+        return mapped.error;
+
+    MappedFile file = mapped.value;
+    auto fail = [&](const char* reason) -> const Error*
+    {
+        Unmap(file);
+        return CreateError("Mesh cache '%s' is invalid: %s", path.c_str(), reason);
+    };
+
+    NaxMeshHeader header;
+    if (file.size < sizeof(header))
+        return fail("it's too small.");
+    std::memcpy(&header, file.data, sizeof(header));
+
+    if (std::memcmp(header.magic, NAXMESH_MAGIC, sizeof(NAXMESH_MAGIC)) != 0)
+        return fail("it's not a naxmesh file.");
+    if (header.version != NAXMESH_VERSION || header.vertex_size != sizeof(Vertex) || header.meshlet_size != sizeof(Meshlet))
+        return fail("it was written by another version.");
+    if (header.key != key)
+        return fail("the key doesn't match.");
+    if (header.size != file.size)
+        return fail("it's truncated.");
+
+    const std::uint64_t mesh_offset    = sizeof(NaxMeshHeader);
+    const std::uint64_t texture_offset = mesh_offset + std::uint64_t(header.mesh_count) * sizeof(NaxMeshRecord);
+    const std::uint64_t node_offset    = texture_offset + std::uint64_t(header.texture_count) * sizeof(NaxTextureRecord);
+    if (!InFile(mesh_offset, std::uint64_t(header.mesh_count) * sizeof(NaxMeshRecord), file.size) ||
+        !InFile(texture_offset, std::uint64_t(header.texture_count) * sizeof(NaxTextureRecord), file.size) ||
+        !InFile(node_offset, std::uint64_t(header.node_count) * sizeof(NaxNodeRecord), file.size))
+        return fail("the tables are out of range.");
+
+    MeshCache cache {file, {}, {}};
+    cache.meshes.reserve(header.mesh_count);
+
+    cache.nodes.reserve(header.node_count);
+    for (std::uint32_t i = 0; i < header.node_count; ++i)
+    {
+        NaxNodeRecord record;
+        std::memcpy(&record, file.data + node_offset + i * sizeof(NaxNodeRecord), sizeof(record));
+
+        // Parents must come first, which also rules out cycles.
+        if (record.parent != NO_PARENT && record.parent >= i)
+            return fail("a node is out of order.");
+
+        cache.nodes.push_back({
+            record.parent, glm::vec3(record.position[0], record.position[1], record.position[2]),
+            glm::quat(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]),
+            glm::vec3(record.scale[0], record.scale[1], record.scale[2])
+        });
+    }
+
+    for (std::uint32_t i = 0; i < header.mesh_count; ++i)
+    {
+        NaxMeshRecord record;
+        std::memcpy(&record, file.data + mesh_offset + i * sizeof(NaxMeshRecord), sizeof(record));
+
+        if (!InFile(record.vertex_offset, std::uint64_t(record.vertex_count) * sizeof(Vertex), file.size) ||
+            !InFile(record.index_offset,  std::uint64_t(record.index_count)  * sizeof(GLuint), file.size) ||
+            !InFile(record.meshlet_offset, std::uint64_t(record.meshlet_count) * sizeof(Meshlet), file.size) ||
+            record.vertex_offset % ALIGNMENT != 0 || record.index_offset % ALIGNMENT != 0 || record.meshlet_offset % ALIGNMENT != 0 ||
+            std::uint64_t(record.first_texture) + record.texture_count > header.texture_count || record.lod_count > MAX_LODS ||
+            (record.node != 0 && record.node >= header.node_count))
+            return fail("a mesh is out of range.");
+
+        MeshView mesh;
+        mesh.vertices     = reinterpret_cast<const Vertex*>(file.data + record.vertex_offset);
+        mesh.vertex_count = record.vertex_count;
+        mesh.indices      = reinterpret_cast<const GLuint*>(file.data + record.index_offset);
+        mesh.index_count  = record.index_count;
+        mesh.meshlets      = reinterpret_cast<const Meshlet*>(file.data + record.meshlet_offset);
+        mesh.meshlet_count = record.meshlet_count;
+        mesh.bounds       = {{record.bounds_min[0], record.bounds_min[1], record.bounds_min[2]},
+                             {record.bounds_max[0], record.bounds_max[1], record.bounds_max[2]}};
+        mesh.node         = record.node;
+
+        for (std::uint32_t j = 0; j < record.lod_count; ++j)
+        {
+            if (std::uint64_t(record.lod_offsets[j]) + record.lod_counts[j] > record.index_count)
+                return fail("a LOD is out of range.");
+            mesh.lods.push_back({record.lod_offsets[j], record.lod_counts[j], record.lod_errors[j]});
+        }
+
+        for (std::size_t j = 0; j < mesh.meshlet_count; ++j)
+            if (std::uint64_t(mesh.meshlets[j].offset) + mesh.meshlets[j].count > record.index_count)
+                return fail("a meshlet is out of range.");
+
+        // Indices are handed straight to OpenGL, so make sure they're in range.
+        for (std::size_t j = 0; j < mesh.index_count; ++j)
+            if (mesh.indices[j] >= mesh.vertex_count)
+                return fail("an index is out of range.");
+
+        for (std::uint32_t j = record.first_texture; j < record.first_texture + record.texture_count; ++j)
+        {
+            NaxTextureRecord texture;
+            std::memcpy(&texture, file.data + texture_offset + j * sizeof(NaxTextureRecord), sizeof(texture));
+
+            if (!InFile(texture.path_offset, texture.path_size, file.size) || !InFile(texture.type_offset, texture.type_size, file.size))
+                return fail("a texture is out of range.");
+
+            mesh.textures.push_back({
+                std::string(file.data + texture.path_offset, texture.path_size),
+                std::string(file.data + texture.type_offset, texture.type_size)
+            });
+        }
+
+        cache.meshes.push_back(std::move(mesh));
+    }
+
+    return cache;
+}
+
+void Close(MeshCache& cache)
+{
+    Unmap(cache.file);
+    cache.file = {nullptr, 0};
+    cache.meshes.clear();
+}
+
+
+Return<bool> WriteMeshCache(const std::string& path, unsigned long long key, const ModelData& model)
+{
+    if (!MakeDirectory(mesh_cache_directory))
+        return CreateError("Couldn't create the mesh cache directory '%s'.", mesh_cache_directory.c_str());
+
+    // ---- LAYOUT ----
+    NaxMeshHeader header {};
+    std::memcpy(header.magic, NAXMESH_MAGIC, sizeof(NAXMESH_MAGIC));
+    header.version     = NAXMESH_VERSION;
+    header.key         = key;
+    header.vertex_size = sizeof(Vertex);
+    header.meshlet_size = sizeof(Meshlet);
+    header.mesh_count  = static_cast<std::uint32_t>(model.meshes.size());
+    header.node_count  = static_cast<std::uint32_t>(model.nodes.size());
+    for (const MeshData& mesh : model.meshes)
+        header.texture_count += static_cast<std::uint32_t>(mesh.textures.size());
+
+    std::uint64_t offset = sizeof(NaxMeshHeader) + header.mesh_count * sizeof(NaxMeshRecord) + header.texture_count * sizeof(NaxTextureRecord) +
+                           header.node_count * sizeof(NaxNodeRecord);
+
+    std::vector<NaxTextureRecord> textures;
+    textures.reserve(header.texture_count);
+    for (const MeshData& mesh : model.meshes)
+    {
+        for (const TextureReference& texture : mesh.textures)
+        {
+            NaxTextureRecord record {};
+            record.path_offset = offset;
+            record.path_size   = static_cast<std::uint32_t>(texture.path.size());
+            offset += texture.path.size();
+            record.type_offset = offset;
+            record.type_size   = static_cast<std::uint32_t>(texture.type.size());
+            offset += texture.type.size();
+            textures.push_back(record);
+        }
+    }
+
+    std::vector<NaxMeshRecord> meshes;
+    meshes.reserve(header.mesh_count);
+    std::uint32_t first_texture = 0;
+    for (const MeshData& mesh : model.meshes)
+    {
+        NaxMeshRecord record {};
+        record.vertex_offset = offset = Align(offset);
+        record.vertex_count  = static_cast<std::uint32_t>(mesh.vertices.size());
+        offset += mesh.vertices.size() * sizeof(Vertex);
+        record.index_offset  = offset = Align(offset);
+        record.index_count   = static_cast<std::uint32_t>(mesh.indices.size());
+        offset += mesh.indices.size() * sizeof(GLuint);
+        record.meshlet_offset = offset = Align(offset);
+        record.meshlet_count  = static_cast<std::uint32_t>(mesh.meshlets.size());
+        offset += mesh.meshlets.size() * sizeof(Meshlet);
+        record.node          = mesh.node;
+        record.first_texture = first_texture;
+        record.texture_count = static_cast<std::uint32_t>(mesh.textures.size());
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            record.bounds_min[i] = mesh.bounds.min[i];
+            record.bounds_max[i] = mesh.bounds.max[i];
+        }
+        record.lod_count = static_cast<std::uint32_t>(std::min<std::size_t>(mesh.lods.size(), MAX_LODS));
+        for (std::uint32_t i = 0; i < record.lod_count; ++i)
+        {
+            record.lod_offsets[i] = mesh.lods[i].offset;
+            record.lod_counts[i]  = mesh.lods[i].count;
+            record.lod_errors[i]  = mesh.lods[i].error;
+        }
+        first_texture += record.texture_count;
+        meshes.push_back(record);
+    }
+    header.size = offset;
+
+    std::vector<NaxNodeRecord> nodes;
+    nodes.reserve(header.node_count);
+    for (const ModelNode& node : model.nodes)
+    {
+        NaxNodeRecord record {};
+        record.parent = node.parent;
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            record.position[i] = node.position[i];
+            record.scale[i]    = node.scale[i];
+        }
+        record.rotation[0] = node.rotation.x;
+        record.rotation[1] = node.rotation.y;
+        record.rotation[2] = node.rotation.z;
+        record.rotation[3] = node.rotation.w;
+        nodes.push_back(record);
+    }
+
+
+    // ---- WRITE ----
+    // Unique, as the same model may be written by several loads at once.
+    static std::atomic<unsigned> writes {0};
+    const std::string temporary = path + "." + std::to_string(writes++) + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return CreateError("Couldn't open '%s' for writing.", temporary.c_str());
+
+    std::uint64_t written = 0;
+    auto write = [&](const void* data, std::uint64_t size)
+    {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        written += size;
+    };
+    auto pad = [&](std::uint64_t to)
+    {
+        static const char zeros[ALIGNMENT] = {};
+        write(zeros, to - written);
+    };
+
+    write(&header, sizeof(header));
+    write(meshes.data(), meshes.size() * sizeof(NaxMeshRecord));
+    write(textures.data(), textures.size() * sizeof(NaxTextureRecord));
+    write(nodes.data(), nodes.size() * sizeof(NaxNodeRecord));
+    for (const MeshData& mesh : model.meshes)
+    {
+        for (const TextureReference& texture : mesh.textures)
+        {
+            write(texture.path.data(), texture.path.size());
+            write(texture.type.data(), texture.type.size());
+        }
+    }
+    for (std::size_t i = 0; i < model.meshes.size(); ++i)
+    {
+        pad(meshes[i].vertex_offset);
+        write(model.meshes[i].vertices.data(), model.meshes[i].vertices.size() * sizeof(Vertex));
+        pad(meshes[i].index_offset);
+        write(model.meshes[i].indices.data(), model.meshes[i].indices.size() * sizeof(GLuint));
+        pad(meshes[i].meshlet_offset);
+        write(model.meshes[i].meshlets.data(), model.meshes[i].meshlets.size() * sizeof(Meshlet));
+    }
+
+    file.close();
+    if (!file || written != header.size)
+    {
+        std::remove(temporary.c_str());
+        return CreateError("Couldn't write '%s'.", temporary.c_str());
+    }
+
+    std::remove(path.c_str());  // Renaming onto an existing file fails on Windows.
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return CreateError("Couldn't rename '%s' to '%s'.", temporary.c_str(), path.c_str());
+    }
+
+    return true;
+}
+
+
+static std::uint64_t Align(std::uint64_t offset)
+{
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+static bool InFile(std::uint64_t offset, std::uint64_t size, std::uint64_t file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
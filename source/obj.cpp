@@ -0,0 +1,932 @@
+#include "obj.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "utilities.h"
+#include "threading.h"
+
+
+// A face corner, i.e. the zero-indexed (position, texture coordinate, normal) indices of a vertex.
+struct Corner
+{
+    unsigned position;
+    unsigned texture_coordinate;
+    unsigned normal;
+};
+
+// A negative OBJ index, which is relative to the number of attributes read so far. When parsing in parallel the
+// number of attributes in the preceding chunks isn't known yet, so these are resolved after all chunks are parsed.
+struct RelativeIndex
+{
+    std::size_t corner;
+    unsigned    attribute;  // 0 = position, 1 = texture coordinate, 2 = normal.
+    long long   index;      // Relative to the start of the chunk.
+};
+
+// The result of parsing a range of lines.
+struct Chunk
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texture_coordinates;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner>    corners;  // Three per triangle.
+    std::vector<RelativeIndex> relative_indices;
+
+    // Deduplication (parallel mode only).
+    std::vector<Corner>   unique;         // Unique corners in order of first occurrence.
+    std::vector<GLuint>   local_indices;  // Indices into 'unique'.
+    std::vector<unsigned long long> owner;  // (chunk << 32 | unique) of the first occurrence in the whole file.
+    std::vector<GLuint>   global;         // Final vertex index of each unique corner.
+    std::vector<std::vector<unsigned>> shards;  // Indices into 'unique' partitioned by shard.
+};
+
+// A face corner as it's being parsed.
+struct FaceCorner
+{
+    unsigned  indices[3];
+    long long relative[3];
+    bool      is_relative[3];
+};
+
+static const unsigned INVALID_INDEX = ~0u;
+
+// Chunks smaller than this aren't worth a thread.
+static const std::size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+
+// Forward declaration of internal functions.
+static void ParseChunk(const char* first, const char* last, Chunk& chunk);
+static void EmitCorner(const FaceCorner& corner, Chunk& chunk);
+static bool ResolveRelativeIndices(Chunk& chunk, const std::size_t offsets[3]);
+static std::size_t FindInvalidCorner(const std::vector<Corner>& corners, const std::size_t counts[3]);
+static unsigned Shard(const Corner& corner, unsigned shard_count);
+static Vertex MakeVertex(const Corner& corner, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& texture_coordinates, const std::vector<glm::vec3>& normals);
+static bool IsDigit(char c);
+static bool IsSeparator(char c);
+static const char* SkipSeparators(const char* first, const char* last);
+static const char* SkipLine(const char* first, const char* last);
+static const char* ScanFloat(const char* first, const char* last, float& value);
+static const char* ScanFloats(const char* first, const char* last, float* values, unsigned count);
+static const char* ScanInt(const char* first, const char* last, long long& value);
+
+
+void Reserve(VertexTable& table, std::size_t count)
+{
+    std::size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+
+    if (table.slots.size() < capacity)
+        table.slots.resize(capacity);
+
+    Clear(table);
+}
+
+void Clear(VertexTable& table)
+{
+    VertexTable::Slot empty {{0, 0, 0}, VertexTable::EMPTY};
+    std::fill(table.slots.begin(), table.slots.end(), empty);
+    table.count = 0;
+    table.mask  = table.slots.empty() ? 0 : table.slots.size() - 1;
+}
+
+void Grow(VertexTable& table)
+{
+    std::vector<VertexTable::Slot> slots;
+    slots.swap(table.slots);
+
+    Reserve(table, std::max<std::size_t>(8, slots.size()));
+    for (const VertexTable::Slot& slot : slots)
+        if (slot.value != VertexTable::EMPTY)
+            FindOrInsert(table, slot.key[0], slot.key[1], slot.key[2], slot.value);
+}
+
+
+Return<std::pair<std::vector<Vertex>, std::vector<GLuint>>> ParseOBJ(const char* first, const char* last, unsigned thread_count, VertexTable* table)
+{
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+
+    std::size_t size = static_cast<std::size_t>(last - first);
+    unsigned chunk_count = static_cast<unsigned>(std::min<std::size_t>(thread_count, std::max<std::size_t>(1, size / MIN_CHUNK_SIZE)));
+
+    if (chunk_count <= 1)
+    {
+        Chunk chunk;
+        ParseChunk(first, last, chunk);
+
+        const std::size_t offsets[3] = {0, 0, 0};
+        if (!ResolveRelativeIndices(chunk, offsets))
+            return CreateError("Face %u references a vertex attribute that doesn't exist.", static_cast<unsigned>(chunk.relative_indices.front().corner / 3));
+
+        // Missing attributes default to zero (and missing indices refer to the first entry).
+        if (chunk.positions.empty())
+            chunk.positions.push_back(glm::vec3(0));
+        if (chunk.texture_coordinates.empty())
+            chunk.texture_coordinates.push_back(glm::vec2(0));
+        if (chunk.normals.empty())
+            chunk.normals.push_back(glm::vec3(0));
+
+        const std::size_t counts[3] = {chunk.positions.size(), chunk.texture_coordinates.size(), chunk.normals.size()};
+        std::size_t invalid = FindInvalidCorner(chunk.corners, counts);
+        if (invalid != chunk.corners.size())
+            return CreateError("Face %u references a vertex attribute that doesn't exist.", static_cast<unsigned>(invalid / 3));
+
+        VertexTable local_table;
+        VertexTable& vertex = table ? *table : local_table;
+        Reserve(vertex, chunk.corners.size() / 3);  // Roughly the number of faces.
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        indices.reserve(chunk.corners.size());
+
+        for (const Corner& corner : chunk.corners)
+        {
+            unsigned next  = static_cast<unsigned>(vertices.size());
+            unsigned index = FindOrInsert(vertex, corner.position, corner.texture_coordinate, corner.normal, next);
+            if (index == next)
+                vertices.push_back(MakeVertex(corner, chunk.positions, chunk.texture_coordinates, chunk.normals));
+            indices.push_back(index);
+        }
+
+        return std::make_pair(std::move(vertices), std::move(indices));
+    }
+
+
+    // ---- 1. SPLIT AND PARSE ----
+    // Chunks are split at line boundaries and parsed independently.
+    std::vector<const char*> boundaries(chunk_count + 1);
+    boundaries[0] = first;
+    boundaries[chunk_count] = last;
+    for (unsigned i = 1; i < chunk_count; ++i)
+    {
+        const char* split = std::max(first + size * i / chunk_count, boundaries[i - 1]);
+        boundaries[i] = SkipLine(split, last);
+    }
+
+    std::vector<Chunk> chunks(chunk_count);
+    ParallelFor(chunk_count, thread_count, [&](unsigned i) { ParseChunk(boundaries[i], boundaries[i + 1], chunks[i]); });
+
+
+    // ---- 2. CONCATENATE ATTRIBUTES ----
+    std::vector<std::array<std::size_t, 3>> attribute_offsets(chunk_count + 1);
+    std::vector<std::size_t> corner_offsets(chunk_count + 1);
+    attribute_offsets[0] = {0, 0, 0};
+    corner_offsets[0] = 0;
+    for (unsigned i = 0; i < chunk_count; ++i)
+    {
+        attribute_offsets[i + 1][0] = attribute_offsets[i][0] + chunks[i].positions.size();
+        attribute_offsets[i + 1][1] = attribute_offsets[i][1] + chunks[i].texture_coordinates.size();
+        attribute_offsets[i + 1][2] = attribute_offsets[i][2] + chunks[i].normals.size();
+        corner_offsets[i + 1] = corner_offsets[i] + chunks[i].corners.size();
+    }
+
+    // Missing attributes default to zero (and missing indices refer to the first entry).
+    const std::array<std::size_t, 3>& totals = attribute_offsets[chunk_count];
+    std::vector<glm::vec3> positions(std::max<std::size_t>(1, totals[0]), glm::vec3(0));
+    std::vector<glm::vec2> texture_coordinates(std::max<std::size_t>(1, totals[1]), glm::vec2(0));
+    std::vector<glm::vec3> normals(std::max<std::size_t>(1, totals[2]), glm::vec3(0));
+    const std::size_t counts[3] = {positions.size(), texture_coordinates.size(), normals.size()};
+
+    // Also resolves and validates the face indices of the chunk. Errors are reported for the first invalid face in
+    // the file, just as when parsing serially.
+    std::vector<std::size_t> invalid(chunk_count);
+    ParallelFor(chunk_count, thread_count, [&](unsigned i)
+    {
+        Chunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + attribute_offsets[i][0]);
+        std::copy(chunk.texture_coordinates.begin(), chunk.texture_coordinates.end(), texture_coordinates.begin() + attribute_offsets[i][1]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + attribute_offsets[i][2]);
+        std::vector<glm::vec3>().swap(chunk.positions);
+        std::vector<glm::vec2>().swap(chunk.texture_coordinates);
+        std::vector<glm::vec3>().swap(chunk.normals);
+
+        if (ResolveRelativeIndices(chunk, attribute_offsets[i].data()))
+            invalid[i] = FindInvalidCorner(chunk.corners, counts);
+        else
+            invalid[i] = chunk.relative_indices.front().corner;
+    });
+
+    for (unsigned i = 0; i < chunk_count; ++i)
+        if (invalid[i] != chunks[i].corners.size())
+            return CreateError("Face %u references a vertex attribute that doesn't exist.", static_cast<unsigned>((corner_offsets[i] + invalid[i]) / 3));
+
+
+    // ---- 3. LOCAL DEDUPLICATION ----
+    // Each chunk deduplicates its own corners and partitions the unique ones into shards by key.
+    const unsigned shard_count = thread_count;
+    ParallelFor(chunk_count, thread_count, [&](unsigned i)
+    {
+        Chunk& chunk = chunks[i];
+        VertexTable vertex;
+        Reserve(vertex, chunk.corners.size() / 3);
+        chunk.local_indices.reserve(chunk.corners.size());
+
+        for (const Corner& corner : chunk.corners)
+        {
+            unsigned next  = static_cast<unsigned>(chunk.unique.size());
+            unsigned index = FindOrInsert(vertex, corner.position, corner.texture_coordinate, corner.normal, next);
+            if (index == next)
+                chunk.unique.push_back(corner);
+            chunk.local_indices.push_back(index);
+        }
+        std::vector<Corner>().swap(chunk.corners);
+
+        chunk.shards.resize(shard_count);
+        for (unsigned j = 0; j < chunk.unique.size(); ++j)
+            chunk.shards[Shard(chunk.unique[j], shard_count)].push_back(j);
+
+        chunk.owner.resize(chunk.unique.size());
+        chunk.global.resize(chunk.unique.size());
+    });
+
+
+    // ---- 4. SHARDED GLOBAL DEDUPLICATION ----
+    // Each shard owns a disjoint set of keys and visits the chunks in file order, so the first chunk to insert a key
+    // holds its first occurrence in the whole file.
+    ParallelFor(shard_count, thread_count, [&](unsigned shard)
+    {
+        std::size_t shard_size = 0;
+        for (unsigned i = 0; i < chunk_count; ++i)
+            shard_size += chunks[i].shards[shard].size();
+
+        VertexTable first_occurrence;  // Key -> index into 'owners'.
+        Reserve(first_occurrence, shard_size / 2);
+        std::vector<unsigned long long> owners;
+
+        for (unsigned i = 0; i < chunk_count; ++i)
+        {
+            Chunk& chunk = chunks[i];
+            for (unsigned j : chunk.shards[shard])
+            {
+                const Corner& corner = chunk.unique[j];
+                unsigned next  = static_cast<unsigned>(owners.size());
+                unsigned index = FindOrInsert(first_occurrence, corner.position, corner.texture_coordinate, corner.normal, next);
+                if (index == next)
+                    owners.push_back((static_cast<unsigned long long>(i) << 32) | j);
+                chunk.owner[j] = owners[index];
+            }
+        }
+    });
+
+
+    // ---- 5. NUMBERING AND REMAPPING ----
+    // Vertices are numbered by first occurrence, chunk by chunk, which is the same order as the serial path.
+    std::vector<std::size_t> vertex_offsets(chunk_count + 1);
+    vertex_offsets[0] = 0;
+    for (unsigned i = 0; i < chunk_count; ++i)
+    {
+        std::size_t owned = 0;
+        for (unsigned j = 0; j < chunks[i].unique.size(); ++j)
+            owned += chunks[i].owner[j] == ((static_cast<unsigned long long>(i) << 32) | j);
+        vertex_offsets[i + 1] = vertex_offsets[i] + owned;
+    }
+
+    std::vector<Vertex> vertices(vertex_offsets[chunk_count]);
+    std::vector<GLuint> indices(corner_offsets[chunk_count]);
+
+    ParallelFor(chunk_count, thread_count, [&](unsigned i)
+    {
+        Chunk& chunk = chunks[i];
+        GLuint next = static_cast<GLuint>(vertex_offsets[i]);
+        for (unsigned j = 0; j < chunk.unique.size(); ++j)
+        {
+            if (chunk.owner[j] == ((static_cast<unsigned long long>(i) << 32) | j))
+            {
+                vertices[next] = MakeVertex(chunk.unique[j], positions, texture_coordinates, normals);
+                chunk.global[j] = next++;
+            }
+        }
+    });
+
+    ParallelFor(chunk_count, thread_count, [&](unsigned i)
+    {
+        Chunk& chunk = chunks[i];
+        for (unsigned j = 0; j < chunk.unique.size(); ++j)
+        {
+            unsigned long long owner = chunk.owner[j];
+            unsigned owner_chunk  = static_cast<unsigned>(owner >> 32);
+            unsigned owner_unique = static_cast<unsigned>(owner & 0xFFFFFFFFull);
+            if (owner_chunk != i)
+                chunk.global[j] = chunks[owner_chunk].global[owner_unique];
+        }
+
+        GLuint* output = indices.data() + corner_offsets[i];
+        for (std::size_t j = 0; j < chunk.local_indices.size(); ++j)
+            output[j] = chunk.global[chunk.local_indices[j]];
+    });
+
+    return std::make_pair(std::move(vertices), std::move(indices));
+}
+
+
+Return<std::pair<std::vector<Vertex>, std::vector<GLuint>>> LoadOBJ(const std::string& path, unsigned thread_count)
+{
+    Return<MappedFile> file = Map(path);
+    if (file.error)
+        return file.error;
+
+    auto result = ParseOBJ(file.value.data, file.value.data + file.value.size, thread_count);
+    Unmap(file.value);
+
+    return result;
+}
+
+
+
+// ---- STREAMING ----
+
+// Attributes of a streamed file are spilled to a temporary file and read back through a small direct-mapped cache of
+// blocks, so memory doesn't grow with the number of attributes. Faces usually refer to attributes close to each other,
+// so few blocks are needed.
+struct AttributeFile
+{
+    std::FILE*  file       = nullptr;
+    unsigned    components = 0;      // Floats per attribute.
+    std::size_t count      = 0;      // Attributes written.
+    std::size_t block_size = 0;      // Attributes per cached block.
+    bool        dirty      = false;  // Written since the last read.
+    std::vector<float>       blocks;
+    std::vector<std::size_t> tags;   // Block cached in each slot.
+};
+
+// Memory used by the different parts of the streaming reader.
+struct StreamSizes
+{
+    std::size_t window;          // Bytes of the file read at a time.
+    std::size_t block_size;      // Attributes per cached block.
+    std::size_t cached_blocks;   // Cached blocks per attribute.
+    std::size_t chunk_vertices;  // Maximum vertices per chunk.
+    std::size_t chunk_indices;   // Maximum indices per chunk.
+};
+
+static const std::size_t NO_BLOCK = ~static_cast<std::size_t>(0);
+
+
+// Forward declaration of internal functions.
+static StreamSizes SplitBudget(std::size_t budget);
+static bool Seek(std::FILE* file, unsigned long long offset);
+static bool AppendAttributes(AttributeFile& attributes, const float* data, std::size_t count);
+static const float* FetchAttribute(AttributeFile& attributes, std::size_t index);
+
+
+Return<unsigned> StreamOBJ(const std::string& path, std::size_t budget, const OBJChunkCallback& callback)
+{
+    const StreamSizes sizes = SplitBudget(budget);
+
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return CreateError("Couldn't open file '%s'.", path.c_str());
+
+    AttributeFile attributes[3];
+    const unsigned components[3] = {3, 2, 3};
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        attributes[i].components = components[i];
+        attributes[i].block_size = sizes.block_size;
+        attributes[i].blocks.resize(sizes.cached_blocks * sizes.block_size * components[i]);
+        attributes[i].tags.assign(sizes.cached_blocks, NO_BLOCK);
+    }
+
+    auto close = [&]()
+    {
+        std::fclose(file);
+        for (AttributeFile& attribute : attributes)
+            if (attribute.file)
+                std::fclose(attribute.file);
+    };
+
+    for (AttributeFile& attribute : attributes)
+    {
+        attribute.file = std::tmpfile();
+        if (!attribute.file)
+        {
+            close();
+            return CreateError("Couldn't create a temporary file for streaming '%s'.", path.c_str());
+        }
+    }
+
+    std::vector<char>   window(sizes.window);
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    VertexTable table;
+    Chunk block;
+    vertices.reserve(sizes.chunk_vertices);
+    indices.reserve(sizes.chunk_indices);
+    Reserve(table, sizes.chunk_vertices);
+
+    unsigned chunk_count = 0;
+    std::size_t triangle_count = 0;
+    std::size_t used = 0;
+
+    auto flush = [&]()
+    {
+        if (indices.empty())
+            return;
+        callback(vertices, indices);
+        ++chunk_count;
+        vertices.clear();
+        indices.clear();
+        Clear(table);
+    };
+
+    while (true)
+    {
+        used += std::fread(window.data() + used, 1, window.size() - used, file);
+        bool end_of_file = used < window.size();
+
+        // Only complete lines are parsed; the rest is moved to the front of the window for the next read.
+        std::size_t end = used;
+        if (!end_of_file)
+        {
+            while (end > 0 && window[end - 1] != '\n')
+                --end;
+            if (end == 0)
+            {
+                close();
+                return CreateError("A line in '%s' is longer than the streaming window (%u bytes).", path.c_str(), static_cast<unsigned>(window.size()));
+            }
+        }
+
+        block.positions.clear();
+        block.texture_coordinates.clear();
+        block.normals.clear();
+        block.corners.clear();
+        block.relative_indices.clear();
+        ParseChunk(window.data(), window.data() + end, block);
+
+        const std::size_t offsets[3] = {attributes[0].count, attributes[1].count, attributes[2].count};
+        bool valid = ResolveRelativeIndices(block, offsets);
+
+        valid = valid &&
+            AppendAttributes(attributes[0], reinterpret_cast<const float*>(block.positions.data()),           block.positions.size()) &&
+            AppendAttributes(attributes[1], reinterpret_cast<const float*>(block.texture_coordinates.data()), block.texture_coordinates.size()) &&
+            AppendAttributes(attributes[2], reinterpret_cast<const float*>(block.normals.data()),             block.normals.size());
+
+        for (std::size_t i = 0; valid && i < block.corners.size(); i += 3, ++triangle_count)
+        {
+            if (vertices.size() + 3 > sizes.chunk_vertices || indices.size() + 3 > sizes.chunk_indices)
+                flush();
+
+            for (std::size_t j = i; j < i + 3; ++j)
+            {
+                const Corner& corner = block.corners[j];
+                const unsigned index[3] = {corner.position, corner.texture_coordinate, corner.normal};
+
+                // Missing attributes default to zero (and missing indices refer to the first entry).
+                const float* data[3];
+                for (unsigned k = 0; k < 3 && valid; ++k)
+                {
+                    static const float zero[3] = {0.0f, 0.0f, 0.0f};
+                    if (attributes[k].count == 0 && index[k] == 0)
+                        data[k] = zero;
+                    else if (index[k] < attributes[k].count)
+                        valid = (data[k] = FetchAttribute(attributes[k], index[k])) != nullptr;
+                    else
+                        valid = false;
+                }
+                if (!valid)
+                    break;
+
+                unsigned next  = static_cast<unsigned>(vertices.size());
+                unsigned found = FindOrInsert(table, corner.position, corner.texture_coordinate, corner.normal, next);
+                if (found == next)
+                {
+                    Vertex vertex {};
+                    vertex.position           = {data[0][0], data[0][1], data[0][2]};
+                    vertex.texture_coordinate = {data[1][0], data[1][1]};
+                    vertex.normal             = {data[2][0], data[2][1], data[2][2]};
+                    vertices.push_back(vertex);
+                }
+                indices.push_back(found);
+            }
+        }
+
+        if (!valid)
+        {
+            close();
+            return CreateError("Face %u references a vertex attribute that doesn't exist.", static_cast<unsigned>(triangle_count));
+        }
+
+        std::copy(window.begin() + end, window.begin() + used, window.begin());
+        used -= end;
+
+        if (end_of_file)
+            break;
+    }
+
+    flush();
+    close();
+
+    return chunk_count;
+}
+
+
+Return<TexturedModel> LoadStreamedOBJ(const std::string& path, std::size_t budget)
+{
+    TexturedModel model;
+    Return<unsigned> result = StreamOBJ(path, budget, [&](const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+    {
+        model.meshes.push_back({IndexedModel(vertices, indices), {}});
+    });
+
+    if (result.error)
+        return result.error;
+
+    return model;
+}
+
+
+static StreamSizes SplitBudget(std::size_t budget)
+{
+    budget = std::max<std::size_t>(budget, 1 << 20);
+
+    StreamSizes sizes {};
+
+    // A face line of a few bytes can become several corners, so the parsed window takes a multiple of its size.
+    sizes.window = budget / 32;
+
+    // A quarter goes to the attribute cache.
+    sizes.block_size    = 1024;
+    sizes.cached_blocks = std::max<std::size_t>(4, budget / 4 / (sizes.block_size * sizeof(float) * 8));
+
+    // A quarter goes to the chunk being built: its vertices, indices (roughly 6 per vertex) and deduplication table
+    // (two slots per vertex).
+    std::size_t per_vertex = sizeof(Vertex) + 6 * sizeof(GLuint) + 2 * sizeof(VertexTable::Slot);
+    sizes.chunk_vertices = std::max<std::size_t>(3, budget / 4 / per_vertex);
+    sizes.chunk_indices  = std::max<std::size_t>(3, sizes.chunk_vertices * 6);
+
+    return sizes;
+}
+
+static bool Seek(std::FILE* file, unsigned long long offset)
+{
+#if _WIN32 || _WIN64
+    return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+static bool AppendAttributes(AttributeFile& attributes, const float* data, std::size_t count)
+{
+    if (count == 0)
+        return true;
+
+    // The block at the end might be cached while only partially written.
+    std::size_t last_block = attributes.count / attributes.block_size;
+    std::size_t slot = last_block % attributes.tags.size();
+    if (attributes.tags[slot] == last_block)
+        attributes.tags[slot] = NO_BLOCK;
+
+    const std::size_t stride = attributes.components * sizeof(float);
+    if (!Seek(attributes.file, static_cast<unsigned long long>(attributes.count) * stride))
+        return false;
+    if (std::fwrite(data, stride, count, attributes.file) != count)
+        return false;
+
+    attributes.count += count;
+    attributes.dirty  = true;
+    return true;
+}
+
+static const float* FetchAttribute(AttributeFile& attributes, std::size_t index)
+{
+    const std::size_t block = index / attributes.block_size;
+    const std::size_t slot  = block % attributes.tags.size();
+    float* data = attributes.blocks.data() + slot * attributes.block_size * attributes.components;
+
+    if (attributes.tags[slot] != block)
+    {
+        if (attributes.dirty)
+        {
+            std::fflush(attributes.file);
+            attributes.dirty = false;
+        }
+
+        const std::size_t stride = attributes.components * sizeof(float);
+        const std::size_t first  = block * attributes.block_size;
+        const std::size_t count  = std::min(attributes.block_size, attributes.count - first);
+        if (!Seek(attributes.file, static_cast<unsigned long long>(first) * stride))
+            return nullptr;
+        if (std::fread(data, stride, count, attributes.file) != count)
+            return nullptr;
+
+        attributes.tags[slot] = block;
+    }
+
+    return data + (index % attributes.block_size) * attributes.components;
+}
+
+
+
+
+static void ParseChunk(const char* first, const char* last, Chunk& chunk)
+{
+    const char* p = first;
+    while (p != last)
+    {
+        p = SkipSeparators(p, last);
+        if (p == last)
+            break;
+
+        if (*p == 'v' && last - p > 1)
+        {
+            char kind = p[1];
+            if (kind == ' ' || kind == '\t')
+            {
+                glm::vec3 position(0);
+                p = ScanFloats(p + 1, last, &position[0], 3);
+                chunk.positions.push_back(position);
+            }
+            else if (kind == 't' && last - p > 2 && (p[2] == ' ' || p[2] == '\t'))
+            {
+                glm::vec2 texture_coordinate(0);
+                p = ScanFloats(p + 2, last, &texture_coordinate[0], 2);
+                chunk.texture_coordinates.push_back(texture_coordinate);
+            }
+            else if (kind == 'n' && last - p > 2 && (p[2] == ' ' || p[2] == '\t'))
+            {
+                glm::vec3 normal(0);
+                p = ScanFloats(p + 2, last, &normal[0], 3);
+                chunk.normals.push_back(normal);
+            }
+        }
+        else if (*p == 'f' && last - p > 1 && (p[1] == ' ' || p[1] == '\t'))
+        {
+            const std::size_t counts[3] = {chunk.positions.size(), chunk.texture_coordinates.size(), chunk.normals.size()};
+
+            // Polygons are triangulated as a fan around the first corner.
+            FaceCorner first_corner    {};
+            FaceCorner previous_corner {};
+            unsigned corner_count = 0;
+
+            ++p;
+            while (true)
+            {
+                p = SkipSeparators(p, last);
+                if (p == last || !(IsDigit(*p) || *p == '-' || *p == '+'))
+                    break;
+
+                FaceCorner current {};  // Missing indices refer to the first entry.
+                for (unsigned i = 0; i < 3; ++i)
+                {
+                    if (i > 0)
+                    {
+                        if (p == last || *p != '/')
+                            break;
+                        ++p;
+                    }
+
+                    long long index = 0;
+                    const char* next = ScanInt(p, last, index);
+                    if (next == p)
+                        continue;
+                    p = next;
+
+                    if (index > 0 && index <= INVALID_INDEX)
+                        current.indices[i] = static_cast<unsigned>(index - 1);
+                    else if (index < 0)
+                    {
+                        current.relative[i]    = static_cast<long long>(counts[i]) + index;
+                        current.is_relative[i] = true;
+                    }
+                    else
+                        current.indices[i] = INVALID_INDEX;
+                }
+
+                if (corner_count == 0)
+                {
+                    first_corner = current;
+                }
+                else if (corner_count >= 2)
+                {
+                    EmitCorner(first_corner,    chunk);
+                    EmitCorner(previous_corner, chunk);
+                    EmitCorner(current,         chunk);
+                }
+
+                previous_corner = current;
+                ++corner_count;
+            }
+        }
+
+        p = SkipLine(p, last);
+    }
+}
+
+
+static void EmitCorner(const FaceCorner& corner, Chunk& chunk)
+{
+    chunk.corners.push_back({corner.indices[0], corner.indices[1], corner.indices[2]});
+    for (unsigned i = 0; i < 3; ++i)
+        if (corner.is_relative[i])
+            chunk.relative_indices.push_back({chunk.corners.size() - 1, i, corner.relative[i]});
+}
+
+// Resolves the relative indices of a chunk given the number of attributes in the preceding chunks. Returns false if
+// any of them is out of range, in which case the offending one is moved to the front of 'relative_indices'.
+static bool ResolveRelativeIndices(Chunk& chunk, const std::size_t offsets[3])
+{
+    for (const RelativeIndex& relative : chunk.relative_indices)
+    {
+        long long index = static_cast<long long>(offsets[relative.attribute]) + relative.index;
+        if (index < 0)
+        {
+            chunk.relative_indices.front() = relative;
+            return false;
+        }
+
+        Corner& corner = chunk.corners[relative.corner];
+        unsigned* indices[3] = {&corner.position, &corner.texture_coordinate, &corner.normal};
+        *indices[relative.attribute] = static_cast<unsigned>(index);
+    }
+    return true;
+}
+
+// Returns the index of the first corner referring to an attribute that doesn't exist, or corners.size() if there are none.
+static std::size_t FindInvalidCorner(const std::vector<Corner>& corners, const std::size_t counts[3])
+{
+    for (std::size_t i = 0; i < corners.size(); ++i)
+        if (corners[i].position >= counts[0] || corners[i].texture_coordinate >= counts[1] || corners[i].normal >= counts[2])
+            return i;
+    return corners.size();
+}
+
+// Uses the high bits of the hash, as the low ones select the slots of the table in each shard.
+static unsigned Shard(const Corner& corner, unsigned shard_count)
+{
+    unsigned long long hash = Hash(corner.position, corner.texture_coordinate, corner.normal);
+    return static_cast<unsigned>((hash >> 40) % shard_count);
+}
+
+static Vertex MakeVertex(const Corner& corner, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& texture_coordinates, const std::vector<glm::vec3>& normals)
+{
+    Vertex vertex = {};
+    vertex.position           = positions[corner.position];
+    vertex.texture_coordinate = texture_coordinates[corner.texture_coordinate];
+    vertex.normal             = normals[corner.normal];
+    return vertex;
+}
+
+
+static bool IsDigit(char c)
+{
+    return static_cast<unsigned>(c - '0') < 10;
+}
+
+// Values are separated by whitespace, but we also accept commas (i.e. "v 0.5, 0.5, 0.0").
+static bool IsSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static const char* SkipSeparators(const char* first, const char* last)
+{
+    while (first != last && IsSeparator(*first))
+        ++first;
+    return first;
+}
+
+// Returns a pointer to the first character of the next line.
+static const char* SkipLine(const char* first, const char* last)
+{
+    while (first != last && *first != '\n')
+        ++first;
+    return first == last ? last : first + 1;
+}
+
+
+// Scans a decimal floating point number of the form [+-]digits[.digits][(e|E)[+-]digits]. Returns 'first' if no number
+// could be read, otherwise a pointer past the last character read.
+static const char* ScanFloat(const char* first, const char* last, float& value)
+{
+    // Every power of ten up to 1e22 is exactly representable as a double.
+    static const double powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    constexpr unsigned MAX_DIGITS = 19;  // Fits in 64 bits.
+
+    const char* p = first;
+
+    bool negative = false;
+    if (p != last && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    std::uint64_t mantissa = 0;
+    unsigned digits   = 0;  // Significant digits stored in the mantissa.
+    int      exponent = 0;
+    bool     any      = false;
+
+    for (; p != last && IsDigit(*p); ++p, any = true)
+    {
+        if (digits < MAX_DIGITS)
+        {
+            mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+            digits  += mantissa != 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+    }
+
+    if (p != last && *p == '.')
+    {
+        for (++p; p != last && IsDigit(*p); ++p, any = true)
+        {
+            if (digits < MAX_DIGITS)
+            {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+                digits  += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+
+    if (!any)
+        return first;
+
+    if (p != last && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+
+        bool negative_exponent = false;
+        if (q != last && (*q == '-' || *q == '+'))
+            negative_exponent = *q++ == '-';
+
+        if (q != last && IsDigit(*q))
+        {
+            int e = 0;
+            for (; q != last && IsDigit(*q); ++q)
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa != 0)
+    {
+        for (; exponent > 22; exponent -= 22)
+            result *= powers_of_ten[22];
+        for (; exponent < -22; exponent += 22)
+            result /= powers_of_ten[22];
+
+        if (exponent >= 0)
+            result *= powers_of_ten[exponent];
+        else
+            result /= powers_of_ten[-exponent];
+    }
+
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+// Scans up to 'count' floats on the current line. Values that are missing are left untouched.
+static const char* ScanFloats(const char* first, const char* last, float* values, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        first = SkipSeparators(first, last);
+        const char* next = ScanFloat(first, last, values[i]);
+        if (next == first)
+            break;
+        first = next;
+    }
+    return first;
+}
+
+// Scans a decimal integer of the form [+-]digits. Returns 'first' if no number could be read.
+static const char* ScanInt(const char* first, const char* last, long long& value)
+{
+    const char* p = first;
+
+    bool negative = false;
+    if (p != last && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    if (p == last || !IsDigit(*p))
+        return first;
+
+    long long result = 0;
+    for (; p != last && IsDigit(*p); ++p)
+        if (result < (1ll << 40))
+            result = result * 10 + (*p - '0');
+
+    value = negative ? -result : result;
+    return p;
+}
@@ -0,0 +1,403 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "threading.h"
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+#endif
+
+
+// Vertices and triangles are transformed and set up by more than one thread only if each gets at least this many.
+static const std::size_t SETUP_CHUNK_SIZE = 1024;
+
+// Triangles are clipped to this many times the screen in x and y, which keeps their edge functions precise, besides
+// the near plane. Those that only reach past the screen within it are rasterized as they are.
+static const float GUARD_BAND = 4.0f;
+
+// The planes triangles are clipped to, in clip space. Points are inside them where their dot product is at least 0.
+static const glm::vec4 CLIP_PLANES[5] = {
+    {0.0f, 0.0f, 1.0f, 1.0f},
+    {-1.0f, 0.0f, 0.0f, GUARD_BAND}, {1.0f, 0.0f, 0.0f, GUARD_BAND},
+    {0.0f, -1.0f, 0.0f, GUARD_BAND}, {0.0f, 1.0f, 0.0f, GUARD_BAND},
+};
+
+
+// Forward declaration of internal functions.
+static unsigned Chunks(std::size_t count, unsigned thread_count);
+static void SetupTriangle(const DepthBuffer& buffer, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, RasterChunk& chunk);
+static glm::vec3 ToScreen(const DepthBuffer& buffer, const glm::vec4& clip);
+static void AddTriangle(const DepthBuffer& buffer, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, RasterChunk& chunk);
+static void RasterizeTile(DepthBuffer& buffer, unsigned tile);
+static void RasterizeRows(const ScreenTriangle& triangle, float* depth, unsigned width, int x_begin, int x_end, int y_begin, int y_end);
+static void BuildPyramid(DepthBuffer& buffer);
+
+
+void Reset(DepthBuffer& buffer, unsigned width, unsigned height)
+{
+    buffer.width  = std::max(1u, (width  + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE) * OCCLUSION_TILE_SIZE;
+    buffer.height = std::max(1u, (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE) * OCCLUSION_TILE_SIZE;
+
+    unsigned levels = 1;
+    for (unsigned size = std::max(buffer.width, buffer.height); size > 1; size = (size + 1) / 2)
+        ++levels;
+    buffer.levels.resize(levels);
+    buffer.levels[0].assign(buffer.width * buffer.height, 1.0f);
+    buffer.occluders.clear();
+}
+
+void AddOccluder(DepthBuffer& buffer, const Occluder& occluder)
+{
+    buffer.occluders.push_back(occluder);
+}
+
+std::size_t Rasterize(DepthBuffer& buffer, unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+
+    // The vertices and triangles of all occluders are numbered one after the other, and split evenly between chunks.
+    const std::size_t occluders = buffer.occluders.size();
+    std::vector<std::size_t> first_vertices(occluders + 1, 0), first_triangles(occluders + 1, 0);
+    for (std::size_t i = 0; i < occluders; ++i)
+    {
+        first_vertices[i + 1]  = first_vertices[i]  + buffer.occluders[i].vertex_count;
+        first_triangles[i + 1] = first_triangles[i] + buffer.occluders[i].triangle_count;
+    }
+
+    // Every vertex is transformed once, with the planes it's outside of, for all the triangles that share it.
+    const std::size_t vertices = first_vertices.back();
+    buffer.vertices.resize(vertices);
+    const unsigned vertex_chunks = Chunks(vertices, thread_count);
+    ParallelFor(FramePool(), vertex_chunks, vertex_chunks, [&](unsigned c)
+    {
+        const std::size_t begin = vertices * c / vertex_chunks, end = vertices * (c + 1) / vertex_chunks;
+        std::size_t o = std::upper_bound(first_vertices.begin(), first_vertices.end(), begin) - first_vertices.begin() - 1;
+        for (std::size_t v = begin; v < end; ++v)
+        {
+            while (v >= first_vertices[o + 1])
+                ++o;
+            ClipVertex& vertex = buffer.vertices[v];
+            vertex.position = buffer.occluders[o].matrix * glm::vec4(buffer.occluders[o].positions[v - first_vertices[o]], 1.0f);
+            vertex.outside = 0;
+            for (unsigned p = 0; p < 5; ++p)
+                vertex.outside |= (glm::dot(CLIP_PLANES[p], vertex.position) < 0.0f) << p;
+        }
+    });
+
+    const std::size_t triangles = first_triangles.back();
+    const unsigned tiles  = (buffer.width / OCCLUSION_TILE_SIZE) * (buffer.height / OCCLUSION_TILE_SIZE);
+    const unsigned chunks = Chunks(triangles, thread_count);
+    buffer.chunks.resize(chunks);
+    ParallelFor(FramePool(), chunks, chunks, [&](unsigned c)
+    {
+        RasterChunk& chunk = buffer.chunks[c];
+        chunk.triangles.clear();
+        chunk.tiles.resize(tiles);
+        for (std::vector<std::uint32_t>& tile : chunk.tiles)
+            tile.clear();
+
+        const std::size_t begin = triangles * c / chunks, end = triangles * (c + 1) / chunks;
+        std::size_t o = std::upper_bound(first_triangles.begin(), first_triangles.end(), begin) - first_triangles.begin() - 1;
+        for (std::size_t t = begin; t < end; ++t)
+        {
+            while (t >= first_triangles[o + 1])
+                ++o;
+            const GLuint* corners = buffer.occluders[o].indices + 3 * (t - first_triangles[o]);
+            const ClipVertex* occluder_vertices = buffer.vertices.data() + first_vertices[o];
+            SetupTriangle(buffer, occluder_vertices[corners[0]], occluder_vertices[corners[1]], occluder_vertices[corners[2]], chunk);
+        }
+    });
+
+    // Every tile is written by one thread only, so they need no synchronization. Too few triangles to share out aren't
+    // worth waking the pool for either.
+    ParallelFor(FramePool(), tiles, chunks > 1 ? thread_count : 1, [&buffer](unsigned tile)
+    {
+        RasterizeTile(buffer, tile);
+    });
+    BuildPyramid(buffer);
+
+    buffer.occluders.clear();
+    std::size_t rasterized = 0;
+    for (const RasterChunk& chunk : buffer.chunks)
+        rasterized += chunk.triangles.size();
+    return rasterized;
+}
+
+
+bool Occluded(const DepthBuffer& buffer, const Bounds& bounds, const glm::mat4& matrix)
+{
+    if (buffer.levels.empty())
+        return false;
+
+    // The corners are the transformed center plus or minus the transformed half sides.
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    const glm::vec4 clip_center = matrix * glm::vec4(center, 1.0f);
+    const glm::vec4 axes[3] = {matrix[0] * extent.x, matrix[1] * extent.y, matrix[2] * extent.z};
+
+    glm::vec2 min(INFINITY), max(-INFINITY);
+    float nearest = INFINITY;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        const glm::vec4 clip = clip_center + ((corner & 1) ? axes[0] : -axes[0]) + ((corner & 2) ? axes[1] : -axes[1]) + ((corner & 4) ? axes[2] : -axes[2]);
+        if (clip.w <= 0.0f || clip.z < -clip.w)
+            return false;
+
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        min = glm::min(min, glm::vec2(ndc));
+        max = glm::max(max, glm::vec2(ndc));
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    // The pixels the box may cover.
+    const float width = static_cast<float>(buffer.width), height = static_cast<float>(buffer.height);
+    const float x_min = (min.x * 0.5f + 0.5f) * width,  x_max = (max.x * 0.5f + 0.5f) * width;
+    const float y_min = (min.y * 0.5f + 0.5f) * height, y_max = (max.y * 0.5f + 0.5f) * height;
+    if (x_max < 0.0f || y_max < 0.0f || x_min >= width || y_min >= height)
+        return false;
+    const int x_begin = static_cast<int>(std::max(0.0f, x_min)), x_end = static_cast<int>(std::min(width  - 1.0f, x_max));
+    const int y_begin = static_cast<int>(std::max(0.0f, y_min)), y_end = static_cast<int>(std::min(height - 1.0f, y_max));
+
+    // The first level where they're at most 4 texels across.
+    unsigned level = 0, level_width = buffer.width;
+    while (level + 1 < buffer.levels.size() && ((x_end >> level) - (x_begin >> level) > 3 || (y_end >> level) - (y_begin >> level) > 3))
+    {
+        ++level;
+        level_width = std::max(1u, (level_width + 1) / 2);
+    }
+
+    const std::vector<float>& depths = buffer.levels[level];
+    for (int y = y_begin >> level; y <= y_end >> level; ++y)
+        for (int x = x_begin >> level; x <= x_end >> level; ++x)
+            if (nearest <= depths[y * level_width + x])
+                return false;
+    return true;
+}
+
+std::size_t CullOccluded(const DepthBuffer& buffer, const BoundsTable& table, const glm::mat4& view_projection, std::vector<std::uint8_t>& visible)
+{
+    std::size_t culled = 0;
+    for (std::size_t i = 0; i < table.radius.size(); ++i)
+    {
+        if (!visible[i])
+            continue;
+
+        const glm::vec3 center(table.center_x[i], table.center_y[i], table.center_z[i]);
+        const glm::vec3 extent(table.extent_x[i], table.extent_y[i], table.extent_z[i]);
+        if (Occluded(buffer, {center - extent, center + extent}, view_projection))
+        {
+            visible[i] = 0;
+            ++culled;
+        }
+    }
+    return culled;
+}
+
+
+// The number of chunks to split 'count' vertices or triangles into.
+static unsigned Chunks(std::size_t count, unsigned thread_count)
+{
+    return static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(thread_count, count / SETUP_CHUNK_SIZE)));
+}
+
+// Clips the triangle to the near plane and the guard band, if it crosses them, and adds what's left to the chunk.
+static void SetupTriangle(const DepthBuffer& buffer, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, RasterChunk& chunk)
+{
+    if (a.outside & b.outside & c.outside)
+        return;
+    const unsigned outside = a.outside | b.outside | c.outside;
+    if (!outside)
+    {
+        AddTriangle(buffer, ToScreen(buffer, a.position), ToScreen(buffer, b.position), ToScreen(buffer, c.position), chunk);
+        return;
+    }
+
+    // Clipped one plane at a time, into a polygon of at most 3 + 5 corners (Sutherland and Hodgman).
+    glm::vec4 polygon[8] = {a.position, b.position, c.position}, clipped[8];
+    unsigned count = 3;
+    for (unsigned p = 0; p < 5; ++p)
+    {
+        if (!(outside & (1u << p)))
+            continue;
+
+        const glm::vec4& plane = CLIP_PLANES[p];
+        unsigned clipped_count = 0;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            const glm::vec4& current = polygon[i], & next = polygon[(i + 1) % count];
+            const float d_current = glm::dot(plane, current), d_next = glm::dot(plane, next);
+            if (d_current >= 0.0f)
+                clipped[clipped_count++] = current;
+            if ((d_current >= 0.0f) != (d_next >= 0.0f))
+                clipped[clipped_count++] = current + (next - current) * (d_current / (d_current - d_next));
+        }
+        count = clipped_count;
+        std::copy(clipped, clipped + count, polygon);
+        if (count < 3)
+            return;
+    }
+
+    // A fan of triangles over the polygon, in pixels.
+    glm::vec3 screen[8];
+    for (unsigned i = 0; i < count; ++i)
+        screen[i] = ToScreen(buffer, polygon[i]);
+    for (unsigned i = 2; i < count; ++i)
+        AddTriangle(buffer, screen[0], screen[i - 1], screen[i], chunk);
+}
+
+// From clip space to pixels, with the depth in [0, 1].
+static glm::vec3 ToScreen(const DepthBuffer& buffer, const glm::vec4& clip)
+{
+    const float inverse_w = 1.0f / clip.w;
+    return {(clip.x * inverse_w * 0.5f + 0.5f) * buffer.width, (clip.y * inverse_w * 0.5f + 0.5f) * buffer.height, clip.z * inverse_w * 0.5f + 0.5f};
+}
+
+// Sets the triangle up, facing either way, and adds it to the tiles it covers.
+static void AddTriangle(const DepthBuffer& buffer, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, RasterChunk& chunk)
+{
+    // The pixels whose centers are in its bounds.
+    ScreenTriangle triangle;
+    triangle.min_x = std::max(0, static_cast<int>(std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f)));
+    triangle.min_y = std::max(0, static_cast<int>(std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f)));
+    triangle.max_x = std::min(static_cast<int>(buffer.width)  - 1, static_cast<int>(std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f)));
+    triangle.max_y = std::min(static_cast<int>(buffer.height) - 1, static_cast<int>(std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f)));
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        return;
+
+    const float determinant = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    if (std::abs(determinant) < 1e-8f)
+        return;
+
+    // Counterclockwise, so the edge functions are positive inside.
+    const glm::vec3 corners[3] = {a, determinant > 0.0f ? b : c, determinant > 0.0f ? c : b};
+    for (int e = 0; e < 3; ++e)
+    {
+        const glm::vec3& from = corners[e], & to = corners[(e + 1) % 3];
+        triangle.a[e] = from.y - to.y;
+        triangle.b[e] = to.x - from.x;
+        triangle.c[e] = -(triangle.a[e] * from.x + triangle.b[e] * from.y) + 0.5f * (triangle.a[e] + triangle.b[e]);
+    }
+
+    triangle.z_dx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / determinant;
+    triangle.z_dy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / determinant;
+    triangle.z    = a.z - triangle.z_dx * (a.x - 0.5f) - triangle.z_dy * (a.y - 0.5f);
+
+    const std::uint32_t index = static_cast<std::uint32_t>(chunk.triangles.size());
+    chunk.triangles.push_back(triangle);
+    const int tiles_x = static_cast<int>(buffer.width / OCCLUSION_TILE_SIZE), tile_size = static_cast<int>(OCCLUSION_TILE_SIZE);
+    for (int y = triangle.min_y / tile_size; y <= triangle.max_y / tile_size; ++y)
+        for (int x = triangle.min_x / tile_size; x <= triangle.max_x / tile_size; ++x)
+            chunk.tiles[y * tiles_x + x].push_back(index);
+}
+
+static void RasterizeTile(DepthBuffer& buffer, unsigned tile)
+{
+    const unsigned tiles_x = buffer.width / OCCLUSION_TILE_SIZE;
+    const int tile_x = static_cast<int>(tile % tiles_x * OCCLUSION_TILE_SIZE);
+    const int tile_y = static_cast<int>(tile / tiles_x * OCCLUSION_TILE_SIZE);
+    const int tile_size = static_cast<int>(OCCLUSION_TILE_SIZE);
+
+    float* depth = buffer.levels[0].data();
+    for (const RasterChunk& chunk : buffer.chunks)
+    {
+        for (std::uint32_t index : chunk.tiles[tile])
+        {
+            // Whole groups of CULL_WIDTH pixels, which stay in the tile as its size is a multiple of it. The edge
+            // functions reject the pixels of the groups that aren't covered.
+            const ScreenTriangle& triangle = chunk.triangles[index];
+            const int x_begin = std::max(triangle.min_x, tile_x) / static_cast<int>(CULL_WIDTH) * static_cast<int>(CULL_WIDTH);
+            const int x_end   = std::min(triangle.max_x, tile_x + tile_size - 1);
+            const int y_begin = std::max(triangle.min_y, tile_y);
+            const int y_end   = std::min(triangle.max_y, tile_y + tile_size - 1);
+            RasterizeRows(triangle, depth, buffer.width, x_begin, x_end, y_begin, y_end);
+        }
+    }
+}
+
+// Keeps the nearer depth of the triangle in the pixels it covers, of the rows in [y_begin, y_end] from x_begin on,
+// which is a multiple of CULL_WIDTH, to past x_end.
+static void RasterizeRows(const ScreenTriangle& triangle, float* depth, unsigned width, int x_begin, int x_end, int y_begin, int y_end)
+{
+    for (int y = y_begin; y <= y_end; ++y)
+    {
+        float* row = depth + static_cast<std::size_t>(y) * width;
+        const float fy = static_cast<float>(y);
+        const float row_0 = triangle.b[0] * fy + triangle.c[0];
+        const float row_1 = triangle.b[1] * fy + triangle.c[1];
+        const float row_2 = triangle.b[2] * fy + triangle.c[2];
+        const float row_z = triangle.z_dy * fy + triangle.z;
+        int x = x_begin;
+
+#if defined(__AVX__)
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        for (; x <= x_end; x += 8)
+        {
+            const __m256 fx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+            const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(fx, _mm256_set1_ps(triangle.a[0])), _mm256_set1_ps(row_0));
+            const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(fx, _mm256_set1_ps(triangle.a[1])), _mm256_set1_ps(row_1));
+            const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(fx, _mm256_set1_ps(triangle.a[2])), _mm256_set1_ps(row_2));
+            const __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_cmp_ps(e1, _mm256_setzero_ps(), _CMP_GE_OQ)), _mm256_cmp_ps(e2, _mm256_setzero_ps(), _CMP_GE_OQ));
+            const __m256 z = _mm256_add_ps(_mm256_mul_ps(fx, _mm256_set1_ps(triangle.z_dx)), _mm256_set1_ps(row_z));
+            const __m256 old = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+        }
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        for (; x <= x_end; x += 4)
+        {
+            const __m128 fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+            const __m128 e0 = _mm_add_ps(_mm_mul_ps(fx, _mm_set1_ps(triangle.a[0])), _mm_set1_ps(row_0));
+            const __m128 e1 = _mm_add_ps(_mm_mul_ps(fx, _mm_set1_ps(triangle.a[1])), _mm_set1_ps(row_1));
+            const __m128 e2 = _mm_add_ps(_mm_mul_ps(fx, _mm_set1_ps(triangle.a[2])), _mm_set1_ps(row_2));
+            const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, _mm_setzero_ps()), _mm_cmpge_ps(e1, _mm_setzero_ps())), _mm_cmpge_ps(e2, _mm_setzero_ps()));
+            const __m128 z = _mm_add_ps(_mm_mul_ps(fx, _mm_set1_ps(triangle.z_dx)), _mm_set1_ps(row_z));
+            const __m128 old = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+        }
+#endif
+
+        // Without SIMD, the same one pixel at a time.
+        for (; x <= x_end; ++x)
+        {
+            const float fx = static_cast<float>(x);
+            if (triangle.a[0] * fx + row_0 >= 0.0f && triangle.a[1] * fx + row_1 >= 0.0f && triangle.a[2] * fx + row_2 >= 0.0f)
+                row[x] = std::min(row[x], triangle.z_dx * fx + row_z);
+        }
+    }
+}
+
+// Every texel of a level is the farthest of the 2x2 texels below it, or of those there are at the odd edges.
+static void BuildPyramid(DepthBuffer& buffer)
+{
+    unsigned width = buffer.width, height = buffer.height;
+    for (std::size_t level = 1; level < buffer.levels.size(); ++level)
+    {
+        const std::vector<float>& below = buffer.levels[level - 1];
+        const unsigned below_width = width, below_height = height;
+        width  = std::max(1u, (width  + 1) / 2);
+        height = std::max(1u, (height + 1) / 2);
+
+        std::vector<float>& depths = buffer.levels[level];
+        depths.resize(width * height);
+        for (unsigned y = 0; y < height; ++y)
+        {
+            const float* row_0 = below.data() + 2 * y * below_width;
+            const float* row_1 = below.data() + std::min(2 * y + 1, below_height - 1) * below_width;
+            for (unsigned x = 0; x < width; ++x)
+            {
+                const unsigned x_0 = 2 * x, x_1 = std::min(2 * x + 1, below_width - 1);
+                depths[y * width + x] = std::max(std::max(row_0[x_0], row_0[x_1]), std::max(row_1[x_0], row_1[x_1]));
+            }
+        }
+    }
+}
@@ -0,0 +1,334 @@
+#include "optimizer.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+
+// Forsyth's scoring. The simulated cache is LRU, larger than most real ones so the order degrades gracefully on them.
+static const int   FORSYTH_CACHE_SIZE  = 32;
+static const float CACHE_DECAY_POWER   = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+static const int   VALENCE_TABLE_SIZE  = 32;
+
+// The cache the statistics and overdraw clusters are computed with.
+static const unsigned FIFO_CACHE_SIZE = 16;
+
+
+// Forward declaration of internal functions.
+static float VertexScore(int cache_position, unsigned remaining);
+static unsigned CacheMisses(const GLuint* triangle, std::vector<unsigned>& timestamps, unsigned& time);
+
+
+VertexCacheStatistics AnalyzeVertexCache(const GLuint* indices, std::size_t index_count, std::size_t vertex_count, unsigned cache_size)
+{
+    VertexCacheStatistics statistics;
+    if (index_count < 3 || vertex_count == 0)
+        return statistics;
+
+    // A vertex is in the FIFO if fewer than 'cache_size' vertices were added after it.
+    std::vector<unsigned> timestamps(vertex_count, 0);
+    unsigned time = cache_size + 1;
+    std::size_t misses = 0;
+    for (std::size_t i = 0; i < index_count; ++i)
+    {
+        if (time - timestamps[indices[i]] > cache_size)
+        {
+            timestamps[indices[i]] = time++;
+            ++misses;
+        }
+    }
+
+    statistics.acmr = float(misses) / float(index_count / 3);
+    statistics.atvr = float(misses) / float(vertex_count);
+    return statistics;
+}
+
+
+void OptimizeVertexCache(GLuint* destination, const GLuint* indices, std::size_t index_count, std::size_t vertex_count)
+{
+    const std::size_t triangle_count = index_count / 3;
+
+    // The triangles of every vertex that aren't emitted yet are adjacency[offsets[v] .. offsets[v] + remaining[v]].
+    std::vector<unsigned> remaining(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(triangle_count * 3);
+    for (std::size_t i = 0; i < triangle_count * 3; ++i)
+        ++remaining[indices[i]];
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < triangle_count * 3; ++i)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+
+    std::vector<float> vertex_score(vertex_count);
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<char>  emitted(triangle_count, 0);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        vertex_score[v] = VertexScore(-1, remaining[v]);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+    std::vector<GLuint> cache, next_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    next_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    std::size_t cursor = 0;  // Triangles before it are all emitted.
+    long long best = -1;
+    for (std::size_t out = 0; out < triangle_count; ++out)
+    {
+        // Nothing in the cache has triangles left, so start over at the first triangle that isn't emitted.
+        if (best < 0)
+        {
+            while (emitted[cursor])
+                ++cursor;
+            best = static_cast<long long>(cursor);
+        }
+
+        const std::size_t triangle = static_cast<std::size_t>(best);
+        const GLuint* corners = indices + triangle * 3;
+        emitted[triangle] = 1;
+        std::copy(corners, corners + 3, destination + out * 3);
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const GLuint v = corners[c];
+            unsigned* begin = adjacency.data() + offsets[v];
+            unsigned* end   = begin + remaining[v];
+            unsigned* found = std::find(begin, end, static_cast<unsigned>(triangle));
+            if (found != end)
+            {
+                std::swap(*found, *(end - 1));
+                --remaining[v];
+            }
+        }
+
+        // The corners move to the front of the cache, and the rest keep their order behind them.
+        next_cache.clear();
+        for (int c = 0; c < 3; ++c)
+            if (std::find(next_cache.begin(), next_cache.end(), corners[c]) == next_cache.end())
+                next_cache.push_back(corners[c]);
+        for (GLuint v : cache)
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                next_cache.push_back(v);
+
+        // Evicted vertices lose their cache score, which changes the score of their triangles too.
+        for (std::size_t i = FORSYTH_CACHE_SIZE; i < next_cache.size(); ++i)
+        {
+            const GLuint v = next_cache[i];
+            vertex_score[v] = VertexScore(-1, remaining[v]);
+            for (unsigned a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+            {
+                const GLuint* other = indices + std::size_t(adjacency[a]) * 3;
+                triangle_score[adjacency[a]] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+            }
+        }
+        if (next_cache.size() > FORSYTH_CACHE_SIZE)
+            next_cache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(next_cache);
+
+        for (std::size_t i = 0; i < cache.size(); ++i)
+            vertex_score[cache[i]] = VertexScore(static_cast<int>(i), remaining[cache[i]]);
+
+        // Only triangles of cached vertices are candidates for the next one.
+        best = -1;
+        float best_score = -1.0f;
+        for (GLuint v : cache)
+        {
+            for (unsigned a = offsets[v]; a < offsets[v] + remaining[v]; ++a)
+            {
+                const unsigned t = adjacency[a];
+                const GLuint* other = indices + std::size_t(t) * 3;
+                triangle_score[t] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+}
+
+
+void OptimizeOverdraw(GLuint* indices, std::size_t index_count, const Vertex* vertices, std::size_t vertex_count, float threshold)
+{
+    const std::size_t triangle_count = index_count / 3;
+    if (triangle_count < 2)
+        return;
+
+    const float original_acmr = AnalyzeVertexCache(indices, index_count, vertex_count, FIFO_CACHE_SIZE).acmr;
+
+    // Every simulation shares the timestamps; moving the time past the cache size empties the cache.
+    std::vector<unsigned> timestamps(vertex_count, 0);
+    unsigned time = FIFO_CACHE_SIZE + 1;
+
+    // Hard boundaries: triangles that miss the cache with every corner start a new region of the mesh, so whatever is
+    // drawn before them doesn't matter to the cache.
+    std::vector<std::size_t> hard;
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        if (CacheMisses(indices + t * 3, timestamps, time) == 3 || t == 0)
+            hard.push_back(t);
+    hard.push_back(triangle_count);
+
+    // Soft boundaries: regions are split further where drawing them from a cold cache has already gotten within the
+    // threshold of the region's own ACMR.
+    std::vector<std::size_t> clusters;
+    for (std::size_t h = 0; h + 1 < hard.size(); ++h)
+    {
+        const std::size_t begin = hard[h], end = hard[h + 1];
+
+        time += FIFO_CACHE_SIZE + 1;
+        std::size_t misses = 0;
+        for (std::size_t t = begin; t < end; ++t)
+            misses += CacheMisses(indices + t * 3, timestamps, time);
+        const float target = float(misses) / float(end - begin) * threshold;
+
+        time += FIFO_CACHE_SIZE + 1;
+        std::size_t start = begin;
+        misses = 0;
+        clusters.push_back(begin);
+        for (std::size_t t = begin; t < end; ++t)
+        {
+            misses += CacheMisses(indices + t * 3, timestamps, time);
+            if (t + 1 < end && float(misses) / float(t + 1 - start) <= target)
+            {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                time += FIFO_CACHE_SIZE + 1;
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    glm::vec3 mesh_centroid(0.0f);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        mesh_centroid += vertices[v].position;
+    mesh_centroid /= float(vertex_count);
+
+    // Clusters far out along their own normal are drawn first; they're the most likely to cover the rest.
+    struct Cluster
+    {
+        std::size_t begin, end;
+        float sort_key;
+    };
+    std::vector<Cluster> sorted;
+    for (std::size_t c = 0; c + 1 < clusters.size(); ++c)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (std::size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+        {
+            const glm::vec3& a = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+            const glm::vec3 cross = glm::cross(b - a, d - a);
+            const float triangle_area = glm::length(cross);
+            centroid += (a + b + d) * (triangle_area / 3.0f);
+            normal   += cross;
+            area     += triangle_area;
+        }
+        const float normal_length = glm::length(normal);
+        const float key = (area > 0.0f && normal_length > 0.0f) ? glm::dot(centroid / area - mesh_centroid, normal / normal_length) : 0.0f;
+        sorted.push_back({clusters[c], clusters[c + 1], key});
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sort_key > b.sort_key; });
+
+    std::vector<GLuint> reordered;
+    reordered.reserve(triangle_count * 3);
+    for (const Cluster& cluster : sorted)
+        reordered.insert(reordered.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+
+    // Less overdraw isn't worth many more transformed vertices.
+    if (AnalyzeVertexCache(reordered.data(), reordered.size(), vertex_count, FIFO_CACHE_SIZE).acmr <= original_acmr * threshold)
+        std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+
+std::size_t OptimizeVertexFetch(Vertex* vertices, GLuint* indices, std::size_t index_count, std::size_t vertex_count)
+{
+    static const GLuint UNUSED = ~GLuint(0);
+    std::vector<GLuint> remap(vertex_count, UNUSED);
+    GLuint next = 0;
+    for (std::size_t i = 0; i < index_count; ++i)
+    {
+        if (remap[indices[i]] == UNUSED)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+
+    std::vector<Vertex> reordered(next);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        if (remap[v] != UNUSED)
+            reordered[remap[v]] = vertices[v];
+    std::copy(reordered.begin(), reordered.end(), vertices);
+
+    return next;
+}
+
+
+std::pair<VertexCacheStatistics, VertexCacheStatistics> OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    std::pair<VertexCacheStatistics, VertexCacheStatistics> statistics;
+    statistics.first  = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), FIFO_CACHE_SIZE);
+    statistics.second = statistics.first;
+    if (indices.empty() || indices.size() % 3 != 0)
+        return statistics;
+
+    std::vector<GLuint> optimized(indices.size());
+    OptimizeVertexCache(optimized.data(), indices.data(), indices.size(), vertices.size());
+    OptimizeOverdraw(optimized.data(), optimized.size(), vertices.data(), vertices.size());
+    vertices.resize(OptimizeVertexFetch(vertices.data(), optimized.data(), optimized.size(), vertices.size()));
+    indices.swap(optimized);
+
+    statistics.second = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), FIFO_CACHE_SIZE);
+    return statistics;
+}
+
+
+static float VertexScore(int cache_position, unsigned remaining)
+{
+    // Vertices without triangles left are never the reason to pick a triangle.
+    if (remaining == 0)
+        return -1.0f;
+
+    struct Tables
+    {
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[VALENCE_TABLE_SIZE];
+        Tables()
+        {
+            // The last triangle's corners get a fixed score, so the next triangle doesn't just reuse them.
+            for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+                cache[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - float(i - 3) / float(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            // Vertices with few triangles left are boosted, so they're finished instead of left behind.
+            for (int i = 1; i < VALENCE_TABLE_SIZE; ++i)
+                valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+        }
+    };
+    static const Tables tables;
+
+    const float cache_score = cache_position >= 0 ? tables.cache[cache_position] : 0.0f;
+    const float valence_score = remaining < unsigned(VALENCE_TABLE_SIZE) ? tables.valence[remaining] : VALENCE_BOOST_SCALE * std::pow(float(remaining), -VALENCE_BOOST_POWER);
+    return cache_score + valence_score;
+}
+
+// Simulates drawing a triangle with a FIFO cache (see AnalyzeVertexCache). Returns how many corners missed.
+static unsigned CacheMisses(const GLuint* triangle, std::vector<unsigned>& timestamps, unsigned& time)
+{
+    unsigned misses = 0;
+    for (int c = 0; c < 3; ++c)
+    {
+        if (time - timestamps[triangle[c]] > FIFO_CACHE_SIZE)
+        {
+            timestamps[triangle[c]] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
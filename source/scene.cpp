@@ -0,0 +1,117 @@
+#include "scene.h"
+
+#include <algorithm>
+
+#include "debug.h"
+
+
+std::uint32_t AddNode(Scene& scene, std::uint32_t parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    const std::uint32_t node = static_cast<std::uint32_t>(scene.parents.size());
+    Assert(parent == NO_PARENT || parent < node, "Node %u has a parent that's not in the scene.", node);
+
+    scene.parents.push_back(parent);
+    scene.positions.push_back(position);
+    scene.rotations.push_back(rotation);
+    scene.scales.push_back(scale);
+    scene.worlds.push_back(glm::mat4(1.0f));
+    scene.dirty.push_back(1);
+    return node;
+}
+
+std::uint32_t AddModel(Scene& scene, const TexturedModel& model, std::uint32_t parent)
+{
+    const std::uint32_t first = static_cast<std::uint32_t>(scene.parents.size());
+    if (model.nodes.empty())
+        return AddNode(scene, parent);
+
+    // The model's nodes are sorted the same way, so they only have to be offset.
+    for (const ModelNode& node : model.nodes)
+        AddNode(scene, node.parent == NO_PARENT ? parent : first + node.parent, node.position, node.rotation, node.scale);
+    return first;
+}
+
+void Clear(Scene& scene)
+{
+    scene.parents.clear();
+    scene.positions.clear();
+    scene.rotations.clear();
+    scene.scales.clear();
+    scene.worlds.clear();
+    scene.dirty.clear();
+}
+
+
+void SetPosition(Scene& scene, std::uint32_t node, const glm::vec3& position)
+{
+    scene.positions[node] = position;
+    scene.dirty[node] = 1;
+}
+
+void SetRotation(Scene& scene, std::uint32_t node, const glm::quat& rotation)
+{
+    scene.rotations[node] = rotation;
+    scene.dirty[node] = 1;
+}
+
+void SetScale(Scene& scene, std::uint32_t node, const glm::vec3& scale)
+{
+    scene.scales[node] = scale;
+    scene.dirty[node] = 1;
+}
+
+
+glm::mat4 TransformMatrix(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    // The rotation matrix of the quaternion with its columns scaled, written out so there are no branches.
+    const float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+    const float xx = x * x, yy = y * y, zz = z * z;
+    const float xy = x * y, xz = x * z, yz = y * z;
+    const float wx = w * x, wy = w * y, wz = w * z;
+
+    return glm::mat4(
+        glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * scale.x,
+        glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * scale.y,
+        glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * scale.z,
+        glm::vec4(position, 1.0f)
+    );
+}
+
+std::size_t UpdateTransforms(Scene& scene)
+{
+    const std::size_t count = scene.parents.size();
+    const std::uint32_t* parents = scene.parents.data();
+    std::uint8_t* dirty = scene.dirty.data();
+
+    // A node is dirty if it or any of its ancestors is. Parents come first, so their flag is final when it's read.
+    for (std::size_t i = 0; i < count; ++i)
+        if (parents[i] != NO_PARENT)
+            dirty[i] |= dirty[parents[i]];
+
+    std::size_t updated = 0;
+    glm::mat4* worlds = scene.worlds.data();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (!dirty[i])
+            continue;
+
+        const glm::mat4 local = TransformMatrix(scene.positions[i], scene.rotations[i], scene.scales[i]);
+        if (parents[i] == NO_PARENT)
+        {
+            worlds[i] = local;
+        }
+        else
+        {
+            // Both are affine, so the bottom row of 'local' is (0, 0, 0, 1).
+            const glm::mat4& parent = worlds[parents[i]];
+            worlds[i][0] = parent[0] * local[0].x + parent[1] * local[0].y + parent[2] * local[0].z;
+            worlds[i][1] = parent[0] * local[1].x + parent[1] * local[1].y + parent[2] * local[1].z;
+            worlds[i][2] = parent[0] * local[2].x + parent[1] * local[2].y + parent[2] * local[2].z;
+            worlds[i][3] = parent[0] * local[3].x + parent[1] * local[3].y + parent[2] * local[3].z + parent[3];
+        }
+        ++updated;
+    }
+
+    std::fill(scene.dirty.begin(), scene.dirty.end(), 0);
+    return updated;
+}
@@ -0,0 +1,476 @@
+#include "simplifier.h"
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include "optimizer.h"
+#include "threading.h"
+
+
+// How a vertex may move. Manifold vertices can collapse onto any neighbor; border and seam vertices only onto the next
+// vertex along their border or seam; locked vertices never.
+enum VertexKind { MANIFOLD, BORDER, SEAM, LOCKED };
+
+// Sum of weighted squared distances to a set of planes: p'Ap + 2b'p + c, where A is symmetric.
+struct Quadric
+{
+    float a00, a11, a22, a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float weight;
+};
+
+// Collapses 'source' onto 'target' and, for seams, 'sibling_source' (the other wedge) onto 'sibling_target'.
+struct Collapse
+{
+    GLuint source, target;
+    GLuint sibling_source, sibling_target;
+    float cost;
+};
+
+static const GLuint   NONE        = ~GLuint(0);
+static const float    EDGE_WEIGHT = 10.0f;   // Of the planes that keep borders and seams in place, relative to the surface.
+static const float    MIN_FLIP_COSINE = 0.25f;  // Collapses turning a triangle more than about 75 degrees are rejected.
+static const unsigned MAX_PASSES  = 100;
+static const unsigned CHUNK_SIZE  = 4096;    // Positions ranked per call of ParallelFor.
+static const std::size_t MIN_LOD_INDICES = 32 * 3;
+
+
+// Forward declaration of internal functions.
+static Quadric PlaneQuadric(const glm::vec3& normal, float distance, float weight);
+static void Add(Quadric& quadric, const Quadric& other);
+static float Error(const Quadric& quadric, const glm::vec3& point);
+static float Extent(const Vertex* vertices, std::size_t vertex_count, glm::vec3& min);
+
+
+std::vector<GLuint> Simplify(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, std::size_t target_index_count, float target_error, float* error)
+{
+    std::vector<GLuint> result(indices, indices + index_count);
+    if (error)
+        *error = 0.0f;
+    if (index_count % 3 != 0 || index_count <= target_index_count || vertex_count == 0)
+        return result;
+
+    // Positions are scaled to the unit cube, so the errors are relative.
+    glm::vec3 min;
+    const float extent = Extent(vertices, vertex_count, min);
+    const float scale  = extent > 0.0f ? 1.0f / extent : 1.0f;
+    std::vector<glm::vec3> positions(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        positions[v] = (vertices[v].position - min) * scale;
+
+    // ---- WEDGES ----
+    // Identical vertices are merged into one 'canonical' vertex. Different vertices at the same position (the wedges of
+    // the position) are linked in a ring by 'wedge', and represented by the first of them.
+    auto same_position = [&](GLuint a, GLuint b) { return vertices[a].position == vertices[b].position; };
+    std::vector<GLuint> order(vertex_count);
+    std::iota(order.begin(), order.end(), GLuint(0));
+    std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b)
+    {
+        const glm::vec3& pa = vertices[a].position;
+        const glm::vec3& pb = vertices[b].position;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return std::memcmp(&vertices[a], &vertices[b], sizeof(Vertex)) < 0;
+    });
+
+    std::vector<GLuint> canonical(vertex_count), representative(vertex_count), wedge(vertex_count);
+    std::vector<unsigned char> wedge_count(vertex_count, 0);
+    for (std::size_t begin = 0, end; begin < vertex_count; begin = end)
+    {
+        end = begin + 1;
+        while (end < vertex_count && same_position(order[end], order[begin]))
+            ++end;
+
+        const GLuint first = order[begin];
+        GLuint last = first;
+        unsigned count = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const GLuint v = order[i];
+            representative[v] = first;
+            if (i > begin && std::memcmp(&vertices[v], &vertices[order[i - 1]], sizeof(Vertex)) == 0)
+            {
+                canonical[v] = canonical[order[i - 1]];
+                continue;
+            }
+            canonical[v] = v;
+            wedge[last] = v;
+            last = v;
+            ++count;
+        }
+        wedge[last] = first;
+        wedge_count[first] = static_cast<unsigned char>(std::min(count, 255u));
+    }
+    for (GLuint& index : result)
+        index = canonical[index];
+
+    // ---- CLASSIFICATION ----
+    // Half edges without a twin are open: on a border if no wedge of either end has the twin either, else on a seam.
+    std::vector<unsigned> edge_offsets(vertex_count + 1, 0);
+    std::vector<GLuint>   edge_targets(index_count);
+    for (std::size_t i = 0; i < index_count; ++i)
+        ++edge_offsets[result[i] + 1];
+    std::partial_sum(edge_offsets.begin(), edge_offsets.end(), edge_offsets.begin());
+    {
+        std::vector<unsigned> fill(edge_offsets.begin(), edge_offsets.end() - 1);
+        for (std::size_t i = 0; i < index_count; ++i)
+            edge_targets[fill[result[i]]++] = result[i - i % 3 + (i + 1) % 3];
+    }
+    auto has_edge = [&](GLuint a, GLuint b)
+    {
+        for (unsigned e = edge_offsets[a]; e < edge_offsets[a + 1]; ++e)
+            if (edge_targets[e] == b)
+                return true;
+        return false;
+    };
+    auto has_position_edge = [&](GLuint a, GLuint b)
+    {
+        GLuint wa = a;
+        do
+        {
+            GLuint wb = b;
+            do
+            {
+                if (has_edge(wa, wb))
+                    return true;
+                wb = wedge[wb];
+            } while (wb != b);
+            wa = wedge[wa];
+        } while (wa != a);
+        return false;
+    };
+
+    std::vector<GLuint> open_out(vertex_count, NONE), open_in(vertex_count, NONE);
+    std::vector<unsigned char> open_out_count(vertex_count, 0), open_in_count(vertex_count, 0), border_edges(vertex_count, 0);
+    std::vector<Quadric> quadrics(vertex_count, Quadric {});  // Of the positions, indexed by their representative.
+    for (std::size_t t = 0; t < index_count; t += 3)
+    {
+        const GLuint corners[3] = {result[t], result[t + 1], result[t + 2]};
+        const glm::vec3& p0 = positions[corners[0]];
+        glm::vec3 normal = glm::cross(positions[corners[1]] - p0, positions[corners[2]] - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f)
+        {
+            normal /= length;
+            const Quadric plane = PlaneQuadric(normal, -glm::dot(normal, p0), length * 0.5f);
+            for (GLuint corner : corners)
+                Add(quadrics[representative[corner]], plane);
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const GLuint a = corners[c], b = corners[(c + 1) % 3];
+            if (has_edge(b, a))
+                continue;
+
+            open_out[a] = b;
+            open_in[b]  = a;
+            open_out_count[a] = static_cast<unsigned char>(std::min(open_out_count[a] + 1, 255));
+            open_in_count[b]  = static_cast<unsigned char>(std::min(open_in_count[b] + 1, 255));
+            if (!has_position_edge(representative[b], representative[a]))
+            {
+                border_edges[a] = static_cast<unsigned char>(std::min(border_edges[a] + 1, 255));
+                border_edges[b] = static_cast<unsigned char>(std::min(border_edges[b] + 1, 255));
+            }
+
+            // A plane through the edge, perpendicular to the triangle, keeps the edge from moving sideways.
+            if (length > 0.0f)
+            {
+                const glm::vec3 edge = positions[b] - positions[a];
+                const glm::vec3 perpendicular = glm::cross(edge, normal);
+                const float edge_length = glm::length(perpendicular);
+                if (edge_length > 0.0f)
+                {
+                    const glm::vec3 n = perpendicular / edge_length;
+                    const Quadric plane = PlaneQuadric(n, -glm::dot(n, positions[a]), edge_length * edge_length * EDGE_WEIGHT);
+                    Add(quadrics[representative[a]], plane);
+                    Add(quadrics[representative[b]], plane);
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> kinds(vertex_count, LOCKED);  // Of the positions, indexed by their representative.
+    for (std::size_t v = 0; v < vertex_count; ++v)
+    {
+        if (representative[v] != v)
+            continue;
+
+        const auto is_open_once = [&](GLuint w) { return open_out_count[w] == 1 && open_in_count[w] == 1; };
+        if (wedge_count[v] == 1)
+        {
+            if (open_out_count[v] == 0 && open_in_count[v] == 0)
+                kinds[v] = MANIFOLD;
+            else if (is_open_once(v) && border_edges[v] == 2)
+                kinds[v] = BORDER;
+        }
+        else if (wedge_count[v] == 2)
+        {
+            // Both wedges continue the seam in the same two directions.
+            const GLuint other = wedge[v];
+            if (is_open_once(v) && is_open_once(other) && border_edges[v] == 0 && border_edges[other] == 0 &&
+                representative[open_out[v]] == representative[open_in[other]] &&
+                representative[open_in[v]]  == representative[open_out[other]])
+                kinds[v] = SEAM;
+        }
+    }
+
+    // ---- COLLAPSES ----
+    std::vector<unsigned> triangle_offsets(vertex_count + 1);
+    std::vector<unsigned> triangles;
+    std::vector<Collapse> best(vertex_count);
+    std::vector<GLuint>   collapse_remap(vertex_count);
+    std::vector<unsigned char> locked(vertex_count);
+    std::vector<GLuint>   sources, next_out(vertex_count), next_in(vertex_count);
+    float result_error = 0.0f;  // Squared.
+    const float error_limit = target_error * target_error;
+
+    // Whether moving the position of 'source' to 'target' turns any of its triangles over (or nearly).
+    auto flips = [&](GLuint source, GLuint target)
+    {
+        const GLuint target_representative = representative[target];
+        for (unsigned i = triangle_offsets[source]; i < triangle_offsets[source + 1]; ++i)
+        {
+            const GLuint* corners = &result[std::size_t(triangles[i]) * 3];
+            glm::vec3 before[3], after[3];
+            bool collapses = false;
+            for (int c = 0; c < 3; ++c)
+            {
+                const GLuint r = representative[corners[c]];
+                collapses |= r == target_representative;
+                before[c] = positions[corners[c]];
+                after[c]  = r == source ? positions[target] : before[c];
+            }
+            if (collapses)
+                continue;
+
+            const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(n0, n1) < MIN_FLIP_COSINE * glm::length(n0) * glm::length(n1))
+                return true;
+        }
+        return false;
+    };
+
+    auto rank = [&](GLuint r)
+    {
+        Collapse collapse {NONE, NONE, NONE, NONE, std::numeric_limits<float>::infinity()};
+        auto consider = [&](GLuint source, GLuint target, GLuint sibling_source, GLuint sibling_target)
+        {
+            const float cost = Error(quadrics[r], positions[target]);
+            if (cost < collapse.cost && !flips(r, target))
+                collapse = {source, target, sibling_source, sibling_target, cost};
+        };
+
+        if (kinds[r] == MANIFOLD)
+        {
+            for (unsigned i = triangle_offsets[r]; i < triangle_offsets[r + 1]; ++i)
+                for (int c = 0; c < 3; ++c)
+                {
+                    const GLuint v = result[std::size_t(triangles[i]) * 3 + c];
+                    if (representative[v] != r)
+                        consider(r, v, NONE, NONE);
+                }
+        }
+        else if (kinds[r] == BORDER)
+        {
+            for (GLuint target : {open_out[r], open_in[r]})
+                if (target != NONE && kinds[representative[target]] == BORDER)
+                    consider(r, target, NONE, NONE);
+        }
+        else if (kinds[r] == SEAM)
+        {
+            // Along the seam on one side is against it on the other.
+            const GLuint other = wedge[r];
+            const GLuint targets[2][2] = {{open_out[r], open_in[other]}, {open_in[r], open_out[other]}};
+            for (const auto& target : targets)
+                if (target[0] != NONE && target[1] != NONE && kinds[representative[target[0]]] == SEAM &&
+                    representative[target[0]] == representative[target[1]])
+                    consider(r, target[0], other, target[1]);
+        }
+        best[r] = collapse;
+    };
+
+    for (unsigned pass = 0; pass < MAX_PASSES && result.size() > target_index_count; ++pass)
+    {
+        // The triangles around every position.
+        std::fill(triangle_offsets.begin(), triangle_offsets.end(), 0);
+        for (GLuint index : result)
+            ++triangle_offsets[representative[index] + 1];
+        std::partial_sum(triangle_offsets.begin(), triangle_offsets.end(), triangle_offsets.begin());
+        triangles.resize(result.size());
+        {
+            std::vector<unsigned> fill(triangle_offsets.begin(), triangle_offsets.end() - 1);
+            for (std::size_t i = 0; i < result.size(); ++i)
+                triangles[fill[representative[result[i]]]++] = static_cast<unsigned>(i / 3);
+        }
+
+        sources.clear();
+        for (std::size_t v = 0; v < vertex_count; ++v)
+            if (representative[v] == v && kinds[v] != LOCKED && triangle_offsets[v + 1] > triangle_offsets[v])
+                sources.push_back(static_cast<GLuint>(v));
+
+        const unsigned chunks = static_cast<unsigned>((sources.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        ParallelFor(chunks, ThreadsFor(chunks, 2), [&](unsigned chunk)
+        {
+            const std::size_t end = std::min(sources.size(), std::size_t(chunk + 1) * CHUNK_SIZE);
+            for (std::size_t i = std::size_t(chunk) * CHUNK_SIZE; i < end; ++i)
+                rank(sources[i]);
+        });
+
+        sources.erase(std::remove_if(sources.begin(), sources.end(), [&](GLuint r) { return !(best[r].cost <= error_limit); }), sources.end());
+        std::sort(sources.begin(), sources.end(), [&](GLuint a, GLuint b) { return best[a].cost < best[b].cost; });
+
+        // A manifold collapse removes two triangles. The ends of every collapse are locked for the rest of the pass, so
+        // the ranking of later ones is still accurate enough.
+        const std::size_t goal = std::max<std::size_t>(1, (result.size() - target_index_count) / 6);
+        std::iota(collapse_remap.begin(), collapse_remap.end(), GLuint(0));
+        std::fill(locked.begin(), locked.end(), 0);
+        std::size_t collapses = 0;
+        for (GLuint r : sources)
+        {
+            if (collapses >= goal)
+                break;
+            const Collapse& collapse = best[r];
+            const GLuint target = representative[collapse.target];
+            if (locked[r] || locked[target])
+                continue;
+
+            collapse_remap[collapse.source] = collapse.target;
+            if (collapse.sibling_source != NONE)
+                collapse_remap[collapse.sibling_source] = collapse.sibling_target;
+            Add(quadrics[target], quadrics[r]);
+            locked[r] = locked[target] = 1;
+            result_error = std::max(result_error, collapse.cost);
+            ++collapses;
+        }
+        if (collapses == 0)
+            break;
+
+        // Borders and seams continue past the vertices collapsed onto their neighbors.
+        for (std::size_t v = 0; v < vertex_count; ++v)
+        {
+            const GLuint out = open_out[v], in = open_in[v];
+            next_out[v] = out == NONE ? NONE : (collapse_remap[out] == v ? (open_out[out] == NONE ? NONE : collapse_remap[open_out[out]]) : collapse_remap[out]);
+            next_in[v]  = in  == NONE ? NONE : (collapse_remap[in]  == v ? (open_in[in]   == NONE ? NONE : collapse_remap[open_in[in]])   : collapse_remap[in]);
+        }
+        open_out.swap(next_out);
+        open_in.swap(next_in);
+
+        std::size_t write = 0;
+        for (std::size_t t = 0; t < result.size(); t += 3)
+        {
+            const GLuint a = collapse_remap[result[t]], b = collapse_remap[result[t + 1]], c = collapse_remap[result[t + 2]];
+            const GLuint ra = representative[a], rb = representative[b], rc = representative[c];
+            if (ra == rb || rb == rc || rc == ra)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (error)
+        *error = std::sqrt(result_error);
+    return result;
+}
+
+
+std::vector<MeshLod> GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float max_error)
+{
+    std::vector<MeshLod> lods;
+    lods.push_back({0, static_cast<GLuint>(indices.size()), 0.0f});
+    if (indices.empty() || indices.size() % 3 != 0 || vertices.empty())
+        return lods;
+
+    glm::vec3 min;
+    const float extent = Extent(vertices.data(), vertices.size(), min);
+
+    // Every level is simplified from the previous one, so their errors add up.
+    float error = 0.0f;
+    std::vector<GLuint> previous(indices);
+    while (lods.size() < MAX_LODS && previous.size() > MIN_LOD_INDICES && error < max_error)
+    {
+        float level_error = 0.0f;
+        std::vector<GLuint> next = Simplify(vertices.data(), vertices.size(), previous.data(), previous.size(), previous.size() / 6 * 3, max_error - error, &level_error);
+        if (next.size() > previous.size() * 4 / 5)
+            break;
+
+        error += level_error;
+        std::vector<GLuint> optimized(next.size());
+        OptimizeVertexCache(optimized.data(), next.data(), next.size(), vertices.size());
+        lods.push_back({static_cast<GLuint>(indices.size()), static_cast<GLuint>(optimized.size()), error * extent});
+        indices.insert(indices.end(), optimized.begin(), optimized.end());
+        previous.swap(optimized);
+    }
+
+    return lods;
+}
+
+
+static Quadric PlaneQuadric(const glm::vec3& normal, float distance, float weight)
+{
+    Quadric quadric;
+    quadric.a00 = weight * normal.x * normal.x;
+    quadric.a11 = weight * normal.y * normal.y;
+    quadric.a22 = weight * normal.z * normal.z;
+    quadric.a01 = weight * normal.x * normal.y;
+    quadric.a02 = weight * normal.x * normal.z;
+    quadric.a12 = weight * normal.y * normal.z;
+    quadric.b0  = weight * normal.x * distance;
+    quadric.b1  = weight * normal.y * distance;
+    quadric.b2  = weight * normal.z * distance;
+    quadric.c   = weight * distance * distance;
+    quadric.weight = weight;
+    return quadric;
+}
+
+static void Add(Quadric& quadric, const Quadric& other)
+{
+    quadric.a00 += other.a00;
+    quadric.a11 += other.a11;
+    quadric.a22 += other.a22;
+    quadric.a01 += other.a01;
+    quadric.a02 += other.a02;
+    quadric.a12 += other.a12;
+    quadric.b0  += other.b0;
+    quadric.b1  += other.b1;
+    quadric.b2  += other.b2;
+    quadric.c   += other.c;
+    quadric.weight += other.weight;
+}
+
+// The weighted average of the squared distances to the planes.
+static float Error(const Quadric& quadric, const glm::vec3& p)
+{
+    const float sum =
+        quadric.a00 * p.x * p.x + quadric.a11 * p.y * p.y + quadric.a22 * p.z * p.z +
+        2.0f * (quadric.a01 * p.x * p.y + quadric.a02 * p.x * p.z + quadric.a12 * p.y * p.z) +
+        2.0f * (quadric.b0 * p.x + quadric.b1 * p.y + quadric.b2 * p.z) +
+        quadric.c;
+    return std::abs(sum) / (quadric.weight > 0.0f ? quadric.weight : 1.0f);
+}
+
+// The largest side of the bounds of the vertices, whose minimum is written to 'min'.
+static float Extent(const Vertex* vertices, std::size_t vertex_count, glm::vec3& min)
+{
+    min = vertices[0].position;
+    glm::vec3 max = min;
+    for (std::size_t v = 1; v < vertex_count; ++v)
+    {
+        min = glm::min(min, vertices[v].position);
+        max = glm::max(max, vertices[v].position);
+    }
+    const glm::vec3 size = max - min;
+    return std::max(size.x, std::max(size.y, size.z));
+}
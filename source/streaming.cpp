@@ -0,0 +1,218 @@
+#include "streaming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "loader.h"
+
+
+// Forward declaration of internal functions.
+static bool Ready(const TextureStreamer::Upload& upload);
+static void Begin(TextureStreamer::Upload& upload);
+
+
+void Create(TextureStreamer& streamer, unsigned buffer_count, std::size_t buffer_size)
+{
+    streamer.buffers.resize(buffer_count);
+    streamer.buffer_size = buffer_size;
+    streamer.next_buffer = 0;
+
+    for (TextureStreamer::Buffer& buffer : streamer.buffers)
+    {
+        GLCALL(glGenBuffers(1, &buffer.id));
+        GLCALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id));
+        GLCALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW));
+        buffer.fence = nullptr;
+    }
+    GLCALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
+void Destroy(TextureStreamer& streamer)
+{
+    for (TextureStreamer::Buffer& buffer : streamer.buffers)
+    {
+        if (buffer.fence)
+        {
+            GLCALL(glDeleteSync(buffer.fence));
+        }
+        GLCALL(glDeleteBuffers(1, &buffer.id));
+    }
+    streamer.buffers.clear();
+    streamer.uploads.clear();
+}
+
+
+GLuint StreamTexture(TextureStreamer& streamer, std::shared_ptr<ImageRequest> image)
+{
+    GLuint texture;
+    GLCALL(glGenTextures(1, &texture));
+    streamer.uploads.push_back({std::move(image), texture, false, 0, 0});
+    return texture;
+}
+
+
+void Cancel(TextureStreamer& streamer, GLuint texture)
+{
+    streamer.uploads.erase(
+        std::remove_if(streamer.uploads.begin(), streamer.uploads.end(), [texture](const TextureStreamer::Upload& upload)
+        {
+            return upload.texture == texture;
+        }),
+        streamer.uploads.end()
+    );
+}
+
+
+void Update(TextureStreamer& streamer)
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    auto elapsed = [start]() { return std::chrono::duration<float, std::milli>(Clock::now() - start).count(); };
+
+    std::size_t bytes = 0;
+    bool out_of_budget = false;
+
+    GLCALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));  // Rows of the levels are tightly packed.
+
+    for (auto it = streamer.uploads.begin(); it != streamer.uploads.end() && !out_of_budget;)
+    {
+        TextureStreamer::Upload& upload = *it;
+
+        // Images are uploaded as they're decoded, not necessarily in the order they were queued.
+        if (!Ready(upload))
+        {
+            ++it;
+            continue;
+        }
+
+        const CookedImage& image = upload.image->cooked;
+        if (image.levels.empty() || image.format != UNCOMPRESSED)
+        {
+            it = streamer.uploads.erase(it);
+            continue;
+        }
+
+        const GLenum format = ImageFormat(image.components);
+
+        if (!upload.started)
+            Begin(upload);
+
+        bool done = false;
+        while (!done)
+        {
+            const MipLevel&   level     = image.levels[upload.level];
+            const std::size_t row_bytes = std::size_t(level.width) * image.components;
+            const unsigned    height    = static_cast<unsigned>(level.height);
+
+            if (upload.row == height)
+            {
+                // The level is in, so it can be sampled from.
+                GLCALL(glBindTexture(GL_TEXTURE_2D, upload.texture));
+                GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(upload.level)));
+                if (upload.level == 0)
+                {
+                    done = true;
+                }
+                else
+                {
+                    --upload.level;
+                    upload.row = 0;
+                }
+                continue;
+            }
+
+            // Past the first band, a row that doesn't fit in what's left of the budget waits for the next frame.
+            if (bytes > 0 && (bytes + row_bytes > streamer.bytes_per_frame || elapsed() >= streamer.milliseconds_per_frame))
+            {
+                out_of_budget = true;
+                break;
+            }
+
+            TextureStreamer::Buffer& buffer = streamer.buffers[streamer.next_buffer];
+            if (buffer.fence)
+            {
+                // The GPU hasn't consumed the previous upload from this buffer yet, so the ring is full.
+                GLCALL(GLenum status = glClientWaitSync(buffer.fence, 0, 0));
+                if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+                {
+                    out_of_budget = true;
+                    break;
+                }
+                GLCALL(glDeleteSync(buffer.fence));
+                buffer.fence = nullptr;
+            }
+
+            // As many rows as fit in the buffer and what's left of the budget, but always at least one.
+            std::size_t budget = streamer.bytes_per_frame > bytes ? streamer.bytes_per_frame - bytes : 0;
+            std::size_t rows   = std::min<std::size_t>(height - upload.row, std::min(streamer.buffer_size, std::max(budget, row_bytes)) / row_bytes);
+            const unsigned char* source = image.data.data() + level.offset + upload.row * row_bytes;
+            const GLint mip = static_cast<GLint>(upload.level);
+
+            GLCALL(glBindTexture(GL_TEXTURE_2D, upload.texture));
+            if (rows == 0)
+            {
+                // A single row is larger than a buffer. Rare enough to not be worth streaming.
+                rows = 1;
+                GLCALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+                GLCALL(glTexSubImage2D(GL_TEXTURE_2D, mip, 0, upload.row, level.width, 1, format, GL_UNSIGNED_BYTE, source));
+            }
+            else
+            {
+                // The previous content isn't needed, so let the driver give us fresh memory if it's still in use.
+                GLCALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id));
+                GLCALL(void* memory = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, rows * row_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+                std::memcpy(memory, source, rows * row_bytes);
+                GLCALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+                GLCALL(glTexSubImage2D(GL_TEXTURE_2D, mip, 0, upload.row, level.width, static_cast<GLsizei>(rows), format, GL_UNSIGNED_BYTE, nullptr));
+                GLCALL(buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+                streamer.next_buffer = (streamer.next_buffer + 1) % streamer.buffers.size();
+            }
+
+            upload.row += static_cast<unsigned>(rows);
+            bytes += rows * row_bytes;
+        }
+
+        if (!done)
+            break;
+
+        it = streamer.uploads.erase(it);  // Releases the pixels, unless someone else is holding on to them.
+    }
+
+    GLCALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    GLCALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    streamer.bytes_last_frame = bytes;
+    streamer.milliseconds_last_frame = elapsed();
+}
+
+
+static bool Ready(const TextureStreamer::Upload& upload)
+{
+    return upload.image->decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// Allocates every level and starts at the smallest one. The texture samples as black until that's in.
+static void Begin(TextureStreamer::Upload& upload)
+{
+    const CookedImage& image  = upload.image->cooked;
+    const GLenum       format = ImageFormat(image.components);
+    const GLint        last   = static_cast<GLint>(image.levels.size() - 1);
+
+    GLCALL(glBindTexture(GL_TEXTURE_2D, upload.texture));
+    for (std::size_t i = 0; i < image.levels.size(); ++i)
+    {
+        GLCALL(glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), format, image.levels[i].width, image.levels[i].height, 0, format, GL_UNSIGNED_BYTE, nullptr));
+    }
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, last));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, last));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+    GLCALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+
+    upload.started = true;
+    upload.level   = static_cast<unsigned>(last);
+    upload.row     = 0;
+}
@@ -0,0 +1,87 @@
+#include "textures.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "debug.h"
+#include "streaming.h"
+
+TextureCache texture_cache;
+
+
+GLuint Acquire(TextureCache& cache, unsigned long long key)
+{
+    auto it = cache.entries.find(key);
+    if (it == cache.entries.end())
+    {
+        ++cache.misses;
+        return 0;
+    }
+
+    ++cache.hits;
+    ++it->second.references;
+    it->second.last_used = ++cache.tick;
+    return it->second.id;
+}
+
+void Insert(TextureCache& cache, unsigned long long key, GLuint id, std::size_t bytes, const std::string& path)
+{
+    Assert(cache.entries.find(key) == cache.entries.end(), "Texture '%s' is already in the cache.", path.c_str());
+
+    cache.entries[key] = {id, bytes, 1, ++cache.tick, path};
+    cache.resident += bytes;
+}
+
+void Release(TextureCache& cache, unsigned long long key)
+{
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end() && it->second.references > 0)
+        --it->second.references;
+}
+
+void Release(TextureCache& cache, const TexturedModel& model)
+{
+    for (const TexturedMesh& mesh : model.meshes)
+        for (const Texture& texture : mesh.textures)
+            Release(cache, texture.key);
+}
+
+void Evict(TextureCache& cache, TextureStreamer* streamer)
+{
+    if (cache.resident <= cache.budget)
+        return;
+
+    std::vector<std::unordered_map<unsigned long long, TextureCache::Entry>::iterator> unused;
+    for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it)
+        if (it->second.references == 0)
+            unused.push_back(it);
+
+    std::sort(unused.begin(), unused.end(), [](const decltype(unused)::value_type& a, const decltype(unused)::value_type& b)
+    {
+        return a->second.last_used < b->second.last_used;
+    });
+
+    for (auto it : unused)
+    {
+        if (cache.resident <= cache.budget)
+            break;
+
+        GLuint id = it->second.id;
+        if (streamer)
+            Cancel(*streamer, id);
+        GLCALL(glDeleteTextures(1, &id));
+
+        cache.resident -= it->second.bytes;
+        ++cache.evictions;
+        cache.entries.erase(it);
+    }
+}
+
+
+std::size_t TextureBytes(int width, int height, int components)
+{
+    // A full mipmap chain adds a third.
+    std::size_t base = std::size_t(width) * height * components;
+    return base + base / 3;
+}
@@ -0,0 +1,183 @@
+#include "threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Set on the threads of pools, and on those of ParallelFor while they run its calls, the calling one included.
+static thread_local bool on_worker_thread = false;
+
+
+unsigned HardwareThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+void ParallelFor(unsigned count, unsigned thread_count, const std::function<void(unsigned)>& function)
+{
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+    thread_count = std::min(thread_count, count);
+
+    if (thread_count <= 1)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    // Indices are handed out one at a time so uneven work is balanced between the threads.
+    std::atomic<unsigned> next {0};
+    auto worker = [&]()
+    {
+        const bool was_on_worker_thread = on_worker_thread;
+        on_worker_thread = true;
+        for (unsigned i = next++; i < count; i = next++)
+            function(i);
+        on_worker_thread = was_on_worker_thread;
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (unsigned i = 1; i < thread_count; ++i)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+bool OnWorkerThread()
+{
+    return on_worker_thread;
+}
+
+unsigned ThreadsFor(std::size_t size, std::size_t threshold)
+{
+    return (size >= threshold && !on_worker_thread) ? 0 : 1;
+}
+
+
+void Start(WorkerPool& pool, unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+
+    pool.stopping = false;
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+        pool.threads.emplace_back([&pool]()
+        {
+            on_worker_thread = true;
+            while (true)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(pool.mutex);
+                    pool.condition.wait(lock, [&pool]() { return pool.stopping || !pool.jobs.empty(); });
+                    if (pool.jobs.empty())
+                        return;
+                    job = std::move(pool.jobs.front());
+                    pool.jobs.pop_front();
+                }
+                job();
+            }
+        });
+    }
+}
+
+void Submit(WorkerPool& pool, std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.jobs.push_back(std::move(job));
+    }
+    pool.condition.notify_one();
+}
+
+void Stop(WorkerPool& pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.condition.notify_all();
+
+    for (std::thread& thread : pool.threads)
+        thread.join();
+    pool.threads.clear();
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop(*this);
+}
+
+
+void ParallelFor(WorkerPool& pool, unsigned count, unsigned thread_count, const std::function<void(unsigned)>& function)
+{
+    if (thread_count == 0)
+        thread_count = HardwareThreads();
+    thread_count = std::min(thread_count, count);
+
+    if (thread_count <= 1)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            function(i);
+        return;
+    }
+
+    // Jobs the pool only gets to once every index is taken return without calling 'function', so they may run after
+    // this returns, and only share state that they keep alive.
+    struct State
+    {
+        std::atomic<unsigned> next {0};
+        unsigned done = 0;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+    auto state = std::make_shared<State>();
+    const std::function<void(unsigned)>* body = &function;
+    auto worker = [state, body, count]()
+    {
+        const bool was_on_worker_thread = on_worker_thread;
+        on_worker_thread = true;
+        unsigned finished = 0;
+        for (unsigned i = state->next++; i < count; i = state->next++, ++finished)
+            (*body)(i);
+        on_worker_thread = was_on_worker_thread;
+        if (finished == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done += finished;
+        if (state->done == count)
+            state->condition.notify_all();
+    };
+
+    for (unsigned i = 1; i < thread_count; ++i)
+        Submit(pool, worker);
+
+    worker();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&state, count]() { return state->done == count; });
+}
+
+WorkerPool& FramePool()
+{
+    static WorkerPool pool;
+    static std::once_flag started;
+    std::call_once(started, []() { Start(pool, std::max(1u, HardwareThreads() - 1)); });
+    return pool;
+}
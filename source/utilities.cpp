@@ -4,6 +4,21 @@
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#if _WIN32 || _WIN64
+	#include <windows.h>
+	#include <direct.h>
+	#include <stdlib.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <limits.h>
+#endif
 
 #include "errors.h"
 
@@ -23,4 +38,160 @@ Return<std::string> Read(const std::string& path)
     std::stringstream buffer;
     buffer << file.rdbuf();
     return buffer.str();
-}
\ No newline at end of file
+}
+
+
+#if _WIN32 || _WIN64
+
+Return<MappedFile> Map(const std::string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return CreateError("Couldn't open file '%s'.", path.c_str());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return CreateError("Couldn't get the size of file '%s'.", path.c_str());
+    }
+
+    // Mapping an empty file is an error on Windows, so we just return an empty view.
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return MappedFile{nullptr, 0};
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return CreateError("Couldn't map file '%s'.", path.c_str());
+
+    // The view keeps the mapping alive, so the handle can be closed right away.
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data)
+        return CreateError("Couldn't map file '%s'.", path.c_str());
+
+    return MappedFile{static_cast<const char*>(data), static_cast<std::size_t>(size.QuadPart)};
+}
+
+void Unmap(MappedFile file)
+{
+    if (file.data)
+        UnmapViewOfFile(file.data);
+}
+
+#else
+
+Return<MappedFile> Map(const std::string& path)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return CreateError("Couldn't open file '%s'.", path.c_str());
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        close(file);
+        return CreateError("Couldn't get the size of file '%s'.", path.c_str());
+    }
+
+    // mmap doesn't accept a length of 0, so we just return an empty view.
+    if (info.st_size == 0)
+    {
+        close(file);
+        return MappedFile{nullptr, 0};
+    }
+
+    // The mapping keeps the file alive, so the descriptor can be closed right away.
+    void* data = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        return CreateError("Couldn't map file '%s'.", path.c_str());
+
+    madvise(data, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+
+    return MappedFile{static_cast<const char*>(data), static_cast<std::size_t>(info.st_size)};
+}
+
+void Unmap(MappedFile file)
+{
+    if (file.data)
+        munmap(const_cast<char*>(file.data), file.size);
+}
+
+#endif
+
+
+static unsigned long long Mix(unsigned long long x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+unsigned long long ContentHash(const void* data, std::size_t size, unsigned long long seed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    // Four independent lanes of 8 bytes so the multiplications can overlap.
+    unsigned long long lanes[4] = {seed ^ 0x9E3779B97F4A7C15ull, seed ^ 0xC2B2AE3D27D4EB4Full, seed ^ 0x165667B19E3779F9ull, seed ^ size};
+
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (unsigned lane = 0; lane < 4; ++lane)
+        {
+            unsigned long long word;
+            std::memcpy(&word, bytes + i + lane * 8, 8);
+            lanes[lane] = (lanes[lane] ^ word) * 0x9FB21C651E98DF25ull;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    unsigned long long hash = Mix(lanes[0]) ^ Mix(lanes[1] + 1) ^ Mix(lanes[2] + 2) ^ Mix(lanes[3] + 3);
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+
+    return Mix(hash ^ size);
+}
+
+
+bool MakeDirectory(const std::string& path)
+{
+#if _WIN32 || _WIN64
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool RemoveEmptyDirectory(const std::string& path)
+{
+#if _WIN32 || _WIN64
+    return _rmdir(path.c_str()) == 0;
+#else
+    return rmdir(path.c_str()) == 0;
+#endif
+}
+
+
+std::string ResolvePath(const std::string& path)
+{
+#if _WIN32 || _WIN64
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, path.c_str(), sizeof(resolved)) == nullptr)
+        return path;
+    return resolved;
+#else
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == nullptr)
+        return path;
+    return resolved;
+#endif
+}
@@ -1,11 +1,25 @@
 #include "vao.h"
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "opengl.h"
+#include "geometry.h"
+
+
+VertexFormat vertex_format = COMPACT;
+
+
+// Forward declaration of internal functions.
+static std::uint32_t PackTangent(const Vertex& vertex);
 
 
 Mesh Cube()
@@ -26,36 +40,174 @@ Mesh Cube()
 }
 
 
-Mesh IndexedModel(std::vector<Vertex> vertices, std::vector<GLuint> indices)
+Mesh IndexedModel(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
 {
-    GLuint vao, vbo, ebo;
+    return IndexedModel(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
 
-    GLCALL(glGenVertexArrays(1, &vao));
-    GLCALL(glGenBuffers(1, &vbo));
-    GLCALL(glGenBuffers(1, &ebo));
+std::size_t VertexSize(VertexFormat format)
+{
+    switch (format)
+    {
+        case FULL:      return sizeof(Vertex);
+        case COMPACT:   return sizeof(CompactVertex);
+        case QUANTIZED: return sizeof(QuantizedVertex);
+    }
+    return sizeof(Vertex);
+}
 
-    GLCALL(glBindVertexArray(vao));
 
-    GLCALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-    GLCALL(glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW));
+std::vector<unsigned char> EncodeVertices(const Vertex* vertices, std::size_t count, VertexFormat format, glm::vec3& scale, glm::vec3& offset)
+{
+    scale  = glm::vec3(1.0f);
+    offset = glm::vec3(0.0f);
+
+    std::vector<unsigned char> encoded(count * VertexSize(format));
+    if (format == FULL)
+    {
+        if (count > 0)
+            std::memcpy(encoded.data(), vertices, encoded.size());
+        return encoded;
+    }
+
+    if (format == QUANTIZED && count > 0)
+    {
+        glm::vec3 min = vertices[0].position, max = vertices[0].position;
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            min = glm::min(min, vertices[i].position);
+            max = glm::max(max, vertices[i].position);
+        }
+        offset = min;
+        scale  = max - min;
+    }
+    // Flat axes have nothing to quantize, they're all at 'offset'.
+    const glm::vec3 inverse_scale = glm::vec3(
+            scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+            scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+            scale.z > 0.0f ? 1.0f / scale.z : 0.0f
+    );
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Vertex& vertex = vertices[i];
+        const std::uint32_t texture_coordinate = glm::packHalf2x16(vertex.texture_coordinate);
+        const std::uint32_t normal  = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+        const std::uint32_t tangent = PackTangent(vertex);
+
+        if (format == COMPACT)
+        {
+            CompactVertex out;
+            out.position = vertex.position;
+            std::memcpy(out.texture_coordinate, &texture_coordinate, sizeof(out.texture_coordinate));
+            out.normal  = normal;
+            out.tangent = tangent;
+            std::memcpy(&encoded[i * sizeof(CompactVertex)], &out, sizeof(out));
+        }
+        else
+        {
+            QuantizedVertex out;
+            const glm::uint64 position = glm::packUnorm4x16(glm::vec4((vertex.position - offset) * inverse_scale, 0.0f));
+            std::memcpy(out.position, &position, sizeof(out.position));
+            std::memcpy(out.texture_coordinate, &texture_coordinate, sizeof(out.texture_coordinate));
+            out.normal  = normal;
+            out.tangent = tangent;
+            std::memcpy(&encoded[i * sizeof(QuantizedVertex)], &out, sizeof(out));
+        }
+    }
+
+    return encoded;
+}
 
-    GLCALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo));
-    GLCALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW));
 
-    // Set the vertex attribute pointers
-    // Positions
-    GLCALL(glEnableVertexAttribArray(0));
-    GLCALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0));
+GLenum IndexType(std::size_t vertex_count)
+{
+    return vertex_count <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
 
-    // Texture coordinates
-    GLCALL(glEnableVertexAttribArray(1));
-    GLCALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texture_coordinate)));
 
-    // Normals
-    GLCALL(glEnableVertexAttribArray(2));
-    GLCALL(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal)));
+std::size_t IndexSize(GLenum index_type)
+{
+    switch (index_type)
+    {
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        default:                return 4;
+    }
+}
 
-    GLCALL(glBindVertexArray(0));
 
-    return {vao, ebo, static_cast<GLuint>(indices.size()), vertices};
+Mesh IndexedModel(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count)
+{
+    return IndexedModel(vertices, vertex_count, indices, index_count, vertex_format);
+}
+
+
+Mesh IndexedModel(const Vertex* vertices, std::size_t vertex_count, const GLuint* indices, std::size_t index_count, VertexFormat format)
+{
+    Mesh mesh;
+    mesh.format = format;
+    mesh.index_type = IndexType(vertex_count);
+    const std::vector<unsigned char> encoded = EncodeVertices(vertices, vertex_count, format, mesh.position_scale, mesh.position_offset);
+
+    if (mesh.index_type == GL_UNSIGNED_SHORT)
+    {
+        std::vector<std::uint16_t> narrow(indices, indices + index_count);
+        mesh.allocation = Allocate(geometry_arena, format, encoded.data(), vertex_count, narrow.data(), narrow.size() * sizeof(std::uint16_t));
+    }
+    else
+    {
+        mesh.allocation = Allocate(geometry_arena, format, encoded.data(), vertex_count, indices, index_count * sizeof(GLuint));
+    }
+
+    mesh.count = static_cast<GLuint>(index_count);
+    if (vertex_count > 0)
+    {
+        mesh.bounds = {vertices[0].position, vertices[0].position};
+        for (std::size_t i = 1; i < vertex_count; ++i)
+        {
+            mesh.bounds.min = glm::min(mesh.bounds.min, vertices[i].position);
+            mesh.bounds.max = glm::max(mesh.bounds.max, vertices[i].position);
+        }
+
+        // Around the center of the box, to the farthest vertex rather than the farthest corner.
+        mesh.sphere.center = (mesh.bounds.min + mesh.bounds.max) * 0.5f;
+        float farthest = 0.0f;
+        for (std::size_t i = 0; i < vertex_count; ++i)
+        {
+            const glm::vec3 offset = vertices[i].position - mesh.sphere.center;
+            farthest = std::max(farthest, glm::dot(offset, offset));
+        }
+        mesh.sphere.radius = std::sqrt(farthest);
+    }
+    return mesh;
+}
+
+
+unsigned SelectLod(const Mesh& mesh, const glm::mat4& model, const glm::vec3& camera, float projection_scale, float threshold)
+{
+    if (mesh.lod_count <= 1)
+        return 0;
+
+    // The errors scale with the largest axis of the model matrix. The distance is to the sphere around the bounds, so
+    // the mesh is never coarser than it should be at any of its points.
+    const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    const glm::vec3 center = glm::vec3(model * glm::vec4((mesh.bounds.min + mesh.bounds.max) * 0.5f, 1.0f));
+    const float radius = glm::length(mesh.bounds.max - mesh.bounds.min) * 0.5f * scale;
+    const float distance = std::max(glm::length(center - camera) - radius, 1e-3f);
+
+    unsigned lod = 0;
+    for (unsigned i = 1; i < mesh.lod_count; ++i)
+        if (mesh.lods[i].error * scale / distance * projection_scale <= threshold)
+            lod = i;
+    return lod;
+}
+
+
+// The tangent with whether the bitangent is cross(normal, tangent) or its opposite in w, as -1 or 1.
+static std::uint32_t PackTangent(const Vertex& vertex)
+{
+    const float handedness = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+    return glm::packSnorm3x10_1x2(glm::vec4(vertex.tangent, handedness));
 }
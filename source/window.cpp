@@ -26,10 +26,12 @@ static void OnMouseMovement(GLFWwindow* window, double x, double y)
 
 void OnMouseClick(GLFWwindow* window, int button, int action, int mods)
 {
+    double x = 0.0, y = 0.0;
+    glfwGetCursorPos(window, &x, &y);
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
-        AddEvent(event_queue, new MouseClick(MouseClick::Button::LEFT, MouseClick::Event::CLICKED));
+        AddEvent(event_queue, new MouseClick(MouseClick::Button::LEFT, MouseClick::Event::CLICKED, static_cast<float>(x), static_cast<float>(y)));
     else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE)
-        AddEvent(event_queue, new MouseClick(MouseClick::Button::LEFT, MouseClick::Event::RELEASED));
+        AddEvent(event_queue, new MouseClick(MouseClick::Button::LEFT, MouseClick::Event::RELEASED, static_cast<float>(x), static_cast<float>(y)));
 }
 
 Window CreateWindow(unsigned width, unsigned height, std::string title)
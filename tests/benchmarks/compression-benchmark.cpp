@@ -0,0 +1,65 @@
+#include "compression.h"
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+
+// Noisy gradients, so the blocks aren't trivially flat.
+static std::vector<unsigned char> Image(int size)
+{
+    std::vector<unsigned char> pixels(std::size_t(size) * size * 4);
+    unsigned seed = 1;
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const std::size_t x = (i / 4) % size, y = (i / 4) / size;
+        pixels[i] = static_cast<unsigned char>((x * 255 / size + y * (i % 4) * 64 / size + (seed >> 16) % 16) & 0xFF);
+    }
+    return pixels;
+}
+
+
+static void BM_EncodeBlocks(benchmark::State& state)
+{
+    const BlockFormat format = static_cast<BlockFormat>(state.range(0));
+    const int size = static_cast<int>(state.range(1));
+    std::vector<unsigned char> pixels = Image(size);
+    std::vector<unsigned char> blocks(std::size_t(size / 4) * (size / 4) * BlockSize(format));
+
+    for (auto _ : state)
+    {
+        EncodeBlocks(format, pixels.data(), size, size, blocks.data());
+        benchmark::DoNotOptimize(blocks.data());
+    }
+    state.SetLabel(FormatName(format));
+    state.SetBytesProcessed(state.iterations() * static_cast<long long>(pixels.size()));
+}
+BENCHMARK(BM_EncodeBlocks)
+    ->Args({BC1, 1024})->Args({BC3, 1024})->Args({BC4, 1024})->Args({BC5, 1024})->Args({BC7, 1024})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Including the mip chain, like a texture cooked on load.
+static void BM_Cook(benchmark::State& state)
+{
+    const BlockFormat format = static_cast<BlockFormat>(state.range(0));
+    const int size = static_cast<int>(state.range(1));
+    std::vector<unsigned char> pixels = Image(size);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Cook(pixels.data(), size, size, 4, format, true));
+    state.SetLabel(FormatName(format));
+}
+BENCHMARK(BM_Cook)->Args({UNCOMPRESSED, 2048})->Args({BC1, 2048})->Args({BC7, 2048})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_GenerateMipChain(benchmark::State& state)
+{
+    const MipFilter filter = static_cast<MipFilter>(state.range(0));
+    const int size = static_cast<int>(state.range(1));
+    std::vector<unsigned char> pixels = Image(size);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(GenerateMipChain(pixels.data(), size, size, 4, true, filter));
+    state.SetLabel(filter == BOX ? "box" : "kaiser");
+}
+BENCHMARK(BM_GenerateMipChain)->Args({BOX, 2048})->Args({KAISER, 2048})->Unit(benchmark::kMillisecond)->UseRealTime();
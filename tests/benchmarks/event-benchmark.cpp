@@ -0,0 +1,33 @@
+#include "event.h"
+
+#include <benchmark/benchmark.h>
+
+
+// A frame worth of input: fill the queue, read it and clear it.
+static void BM_EventQueue_Frame(benchmark::State& state)
+{
+    const unsigned count = static_cast<unsigned>(state.range(0));
+    EventQueue queue {};
+    for (auto _ : state)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            AddEvent(queue, new MouseMovement(1.0f, -1.0f));
+        for (Event* event : GetAll(queue))
+            benchmark::DoNotOptimize(event->type);
+        Clear(queue);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_EventQueue_Frame)->Arg(1)->Arg(16)->Arg(MAX_EVENTS);
+
+static void BM_EventQueue_GetAll(benchmark::State& state)
+{
+    EventQueue queue {};
+    for (unsigned i = 0; i < MAX_EVENTS; ++i)
+        AddEvent(queue, new Resize(1280, 720));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(GetAll(queue));
+    state.SetItemsProcessed(state.iterations() * MAX_EVENTS);
+    Clear(queue);
+}
+BENCHMARK(BM_EventQueue_GetAll);
@@ -0,0 +1,121 @@
+#include "generator.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+
+
+// Forward declaration of internal functions.
+static unsigned Next(unsigned long long& state);
+static float NextFloat(unsigned long long& state);
+
+
+std::string GenerateOBJ(const OBJOptions& options)
+{
+    // Corners are generated first, as the attributes must be declared before the faces.
+    const unsigned WINDOW = 64;
+    const unsigned threshold = static_cast<unsigned>(options.reuse * 0xFFFFFF);
+
+    unsigned long long state = options.seed * 0x9E3779B97F4A7C15ull + 1;
+    unsigned vertex_count = 0;
+
+    std::vector<unsigned> corners;
+    corners.reserve(3ull * options.triangle_count);
+    for (unsigned i = 0; i < 3 * options.triangle_count; ++i)
+    {
+        if (vertex_count > 0 && (Next(state) & 0xFFFFFF) < threshold)
+        {
+            unsigned window = vertex_count < WINDOW ? vertex_count : WINDOW;
+            corners.push_back(vertex_count - 1 - Next(state) % window);
+        }
+        else
+        {
+            corners.push_back(vertex_count++);
+        }
+    }
+
+    std::string source;
+    source.reserve(vertex_count * 80ull + corners.size() * 24ull);
+
+    char line[128];
+    for (unsigned i = 0; i < vertex_count; ++i)
+    {
+        std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", NextFloat(state) * 2 - 1, NextFloat(state) * 2 - 1, NextFloat(state) * 2 - 1);
+        source += line;
+    }
+    if (options.attributes & OBJOptions::TEXTURE_COORDINATES)
+    {
+        for (unsigned i = 0; i < vertex_count; ++i)
+        {
+            std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", NextFloat(state), NextFloat(state));
+            source += line;
+        }
+    }
+    if (options.attributes & OBJOptions::NORMALS)
+    {
+        for (unsigned i = 0; i < vertex_count; ++i)
+        {
+            std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", NextFloat(state) * 2 - 1, NextFloat(state) * 2 - 1, NextFloat(state) * 2 - 1);
+            source += line;
+        }
+    }
+
+    for (std::size_t i = 0; i < corners.size(); i += 3)
+    {
+        source += 'f';
+        for (std::size_t j = i; j < i + 3; ++j)
+        {
+            unsigned index = corners[j] + 1;  // OBJ-files are 1-indexed.
+            switch (options.attributes & (OBJOptions::TEXTURE_COORDINATES | OBJOptions::NORMALS))
+            {
+                case OBJOptions::POSITIONS:
+                    std::snprintf(line, sizeof(line), " %u", index);
+                    break;
+                case OBJOptions::TEXTURE_COORDINATES:
+                    std::snprintf(line, sizeof(line), " %u/%u", index, index);
+                    break;
+                case OBJOptions::NORMALS:
+                    std::snprintf(line, sizeof(line), " %u//%u", index, index);
+                    break;
+                default:
+                    std::snprintf(line, sizeof(line), " %u/%u/%u", index, index, index);
+                    break;
+            }
+            source += line;
+        }
+        source += '\n';
+    }
+
+    return source;
+}
+
+
+std::string GenerateOBJFile(const OBJOptions& options)
+{
+    char path[128];
+    std::snprintf(
+        path, sizeof(path), "nax-bench-%u-%u-%u-%u.obj",
+        options.triangle_count, options.attributes, static_cast<unsigned>(options.reuse * 100), options.seed
+    );
+
+    std::ifstream exists(path);
+    if (!exists.is_open())
+        std::ofstream(path, std::ios::binary) << GenerateOBJ(options);
+    return path;
+}
+
+
+// xorshift64*. Used instead of <random>, whose distributions differ between standard libraries.
+static unsigned Next(unsigned long long& state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<unsigned>((state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+static float NextFloat(unsigned long long& state)
+{
+    return (Next(state) >> 8) * (1.0f / 16777216.0f);
+}
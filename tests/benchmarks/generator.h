@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+
+// Options for GenerateOBJ.
+struct OBJOptions
+{
+    enum Attributes { POSITIONS = 0, TEXTURE_COORDINATES = 1 << 0, NORMALS = 1 << 1 };
+
+    unsigned triangle_count = 1024;
+    unsigned attributes = TEXTURE_COORDINATES | NORMALS;  // Positions are always generated.
+
+    // Probability (0 to 1) that a face corner refers to an earlier vertex instead of a new one. 0 means no vertex is
+    // shared between triangles, while a closed mesh typically reuses around 5/6 of its corners.
+    float reuse = 0.5f;
+
+    unsigned seed = 1;
+};
+
+// Generates an OBJ source of triangles. The output only depends on the options, so runs on different machines and
+// commits parse the same input. Attributes are declared before the faces, and earlier vertices are picked from a small
+// window of the most recent ones, like in meshes exported by modelling tools.
+std::string GenerateOBJ(const OBJOptions& options);
+
+// Name of the generated file in the working directory, written by GenerateOBJ if it doesn't exist.
+std::string GenerateOBJFile(const OBJOptions& options);
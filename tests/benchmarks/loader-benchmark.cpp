@@ -0,0 +1,632 @@
+#include "loader.h"
+#include "obj.h"
+#include "utilities.h"
+#include "generator.h"
+#include "optimizer.h"
+#include "simplifier.h"
+#include "meshlets.h"
+#include "scene.h"
+#include "instancing.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+#include <assimp/mesh.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <benchmark/benchmark.h>
+
+
+// Same inputs as the ParsingOBJ tests.
+static const std::string QUAD =
+    "v -0.5, -0.5, 0.0\n"
+    "v 0.5, 0.5, 0.0\n"
+    "v -0.5, 0.5, 0.0\n"
+    "v 0.5, -0.5, 0.0\n"
+    "vn 0.0, 0.0, 0.0\n"
+    "vn 0.0, 0.0, 0.0\n"
+    "vn 0.0, 0.0, 0.0\n"
+    "vn 0.0, 0.0, 0.0\n"
+    "f 1//1 2//2 3//3\n"
+    "f 1//1 4//4 2//2\n";
+
+static const std::string CUBE = Check(Read(
+    std::string(__FILE__).substr(0, std::string(__FILE__).find_last_of("/\\")) + "/../../resources/models/cube.obj"
+));
+
+
+// A grid of 'size' x 'size' vertices, triangulated, with texture coordinates and normals.
+static std::string Grid(unsigned size)
+{
+    std::ostringstream stream;
+    stream.precision(6);
+    stream << std::fixed;
+
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+            stream << "v " << x * 0.01f << ' ' << y * 0.01f << ' ' << (x ^ y) * 0.001f << '\n';
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+            stream << "vt " << x / float(size) << ' ' << y / float(size) << '\n';
+    stream << "vn 0.000000 0.000000 1.000000\n";
+
+    for (unsigned y = 0; y + 1 < size; ++y)
+    {
+        for (unsigned x = 0; x + 1 < size; ++x)
+        {
+            unsigned a = y * size + x + 1;
+            unsigned b = a + 1;
+            unsigned c = a + size;
+            unsigned d = c + 1;
+            stream << "f " << a << '/' << a << "/1 " << b << '/' << b << "/1 " << d << '/' << d << "/1\n";
+            stream << "f " << a << '/' << a << "/1 " << d << '/' << d << "/1 " << c << '/' << c << "/1\n";
+        }
+    }
+
+    return stream.str();
+}
+
+static const std::string& CachedGrid(unsigned size)
+{
+    static std::map<unsigned, std::string> grids;
+    auto it = grids.find(size);
+    if (it == grids.end())
+        it = grids.emplace(size, Grid(size)).first;
+    return it->second;
+}
+
+static std::string GridFile(unsigned size)
+{
+    std::string path = "nax-bench-grid-" + std::to_string(size) + ".obj";
+    std::ifstream exists(path);
+    if (!exists.is_open())
+        std::ofstream(path) << CachedGrid(size);
+    return path;
+}
+
+
+static void BM_Parse_Quad(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Parse(QUAD));
+}
+BENCHMARK(BM_Parse_Quad);
+
+static void BM_ParseOBJ_Quad(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ParseOBJ(QUAD.data(), QUAD.data() + QUAD.size()));
+}
+BENCHMARK(BM_ParseOBJ_Quad);
+
+static void BM_Parse_Cube(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Parse(CUBE));
+}
+BENCHMARK(BM_Parse_Cube);
+
+static void BM_ParseOBJ_Cube(benchmark::State& state)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ParseOBJ(CUBE.data(), CUBE.data() + CUBE.size()));
+}
+BENCHMARK(BM_ParseOBJ_Cube);
+
+
+static void BM_Parse_Grid(benchmark::State& state)
+{
+    const std::string& source = CachedGrid(static_cast<unsigned>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Parse(source));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Parse_Grid)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseOBJ_Grid(benchmark::State& state)
+{
+    const std::string& source = CachedGrid(static_cast<unsigned>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ParseOBJ(source.data(), source.data() + source.size()));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_ParseOBJ_Grid)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+// Grid size, thread count.
+static void BM_ParseOBJ_Grid_Parallel(benchmark::State& state)
+{
+    const std::string& source = CachedGrid(static_cast<unsigned>(state.range(0)));
+    unsigned thread_count = static_cast<unsigned>(state.range(1));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ParseOBJ(source.data(), source.data() + source.size(), thread_count));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_ParseOBJ_Grid_Parallel)
+    ->ArgsProduct({{1024}, {1, 2, 4, 8, 16, 32}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+
+// From disk, i.e. including the cost of reading or mapping the file.
+static void BM_ReadAndParse_GridFile(benchmark::State& state)
+{
+    std::string path = GridFile(static_cast<unsigned>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Parse(Check(Read(path))));
+}
+BENCHMARK(BM_ReadAndParse_GridFile)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+static void BM_LoadOBJ_GridFile(benchmark::State& state)
+{
+    std::string path = GridFile(static_cast<unsigned>(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(LoadOBJ(path));
+}
+BENCHMARK(BM_LoadOBJ_GridFile)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+
+// The corners (position, texture coordinate, normal) of a triangulated grid of 'size' x 'size' vertices, in the order
+// they would be deduplicated.
+static const std::vector<std::array<unsigned, 3>>& GridCorners(unsigned size)
+{
+    static std::map<unsigned, std::vector<std::array<unsigned, 3>>> grids;
+    auto it = grids.find(size);
+    if (it != grids.end())
+        return it->second;
+
+    std::vector<std::array<unsigned, 3>> corners;
+    corners.reserve(6ull * size * size);
+    for (unsigned y = 0; y + 1 < size; ++y)
+    {
+        for (unsigned x = 0; x + 1 < size; ++x)
+        {
+            unsigned a = y * size + x;
+            unsigned b = a + 1;
+            unsigned c = a + size;
+            unsigned d = c + 1;
+            for (unsigned i : {a, b, d, a, d, c})
+                corners.push_back({i, i, i % 6});
+        }
+    }
+    return grids.emplace(size, std::move(corners)).first->second;
+}
+
+static void BM_Deduplicate_UnorderedMap(benchmark::State& state)
+{
+    const auto& corners = GridCorners(static_cast<unsigned>(state.range(0)));
+    for (auto _ : state)
+    {
+        // The key packing Parse used before VertexTable.
+        std::unordered_map<unsigned long long, unsigned> vertex;
+        std::vector<GLuint> indices;
+        indices.reserve(corners.size());
+        for (const auto& corner : corners)
+        {
+            unsigned long long key = (static_cast<unsigned long long>(corner[0]) << 32) + (static_cast<unsigned long long>(corner[1]) << 16) + corner[2];
+            indices.push_back(vertex.emplace(key, static_cast<unsigned>(vertex.size())).first->second);
+        }
+        benchmark::DoNotOptimize(indices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * corners.size());
+}
+BENCHMARK(BM_Deduplicate_UnorderedMap)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond);
+
+static void BM_Deduplicate_VertexTable(benchmark::State& state)
+{
+    const auto& corners = GridCorners(static_cast<unsigned>(state.range(0)));
+    VertexTable table;
+    for (auto _ : state)
+    {
+        Reserve(table, corners.size() / 3);
+        std::vector<GLuint> indices;
+        indices.reserve(corners.size());
+        for (const auto& corner : corners)
+            indices.push_back(FindOrInsert(table, corner[0], corner[1], corner[2], static_cast<unsigned>(table.count)));
+        benchmark::DoNotOptimize(indices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * corners.size());
+}
+BENCHMARK(BM_Deduplicate_VertexTable)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond);
+
+
+// ---- GENERATED ----
+// Arguments are triangle count, attributes (see OBJOptions) and reuse in percent.
+static OBJOptions Options(const benchmark::State& state)
+{
+    OBJOptions options;
+    options.triangle_count = static_cast<unsigned>(state.range(0));
+    options.attributes     = static_cast<unsigned>(state.range(1));
+    options.reuse          = state.range(2) / 100.0f;
+    return options;
+}
+
+static const std::string& CachedOBJ(const OBJOptions& options)
+{
+    static std::map<std::array<unsigned, 4>, std::string> sources;
+    const std::array<unsigned, 4> key = {options.triangle_count, options.attributes, static_cast<unsigned>(options.reuse * 100), options.seed};
+    auto it = sources.find(key);
+    if (it == sources.end())
+        it = sources.emplace(key, GenerateOBJ(options)).first;
+    return it->second;
+}
+
+static void GeneratedArguments(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"triangles", "attributes", "reuse"});
+    const long long mixes[] = {OBJOptions::POSITIONS, OBJOptions::NORMALS, OBJOptions::TEXTURE_COORDINATES | OBJOptions::NORMALS};
+    for (long long attributes : mixes)
+        for (long long reuse : {0ll, 50ll, 83ll})
+            benchmark->Args({1 << 18, attributes, reuse});
+    benchmark->Unit(benchmark::kMillisecond);
+}
+
+
+static void BM_Split_Lines(benchmark::State& state)
+{
+    const std::string& source = CachedOBJ(Options(state));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Split(source, '\n'));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Split_Lines)->Apply(GeneratedArguments);
+
+// How Parse splits every face.
+static void BM_Split_Face(benchmark::State& state)
+{
+    const std::string face = "f 12345/12345/12345 12346/12346/12346 12347/12347/12347";
+    for (auto _ : state)
+        for (const std::string& corner : Split(face, ' '))
+            benchmark::DoNotOptimize(Split(corner, '/'));
+}
+BENCHMARK(BM_Split_Face);
+
+
+static void BM_Parse_Generated(benchmark::State& state)
+{
+    const std::string& source = CachedOBJ(Options(state));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Parse(source));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Parse_Generated)->Apply(GeneratedArguments);
+
+static void BM_ParseOBJ_Generated(benchmark::State& state)
+{
+    const std::string& source = CachedOBJ(Options(state));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ParseOBJ(source.data(), source.data() + source.size()));
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_ParseOBJ_Generated)->Apply(GeneratedArguments);
+
+
+static void BM_Read(benchmark::State& state)
+{
+    OBJOptions options;
+    options.triangle_count = static_cast<unsigned>(state.range(0));
+    const std::string path = GenerateOBJFile(options);
+
+    std::size_t size = 0;
+    for (auto _ : state)
+    {
+        std::string source = Check(Read(path));
+        size = source.size();
+        benchmark::DoNotOptimize(source.data());
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Read)->Arg(1 << 12)->Arg(1 << 16)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+// Mapping and touching every page, for comparison with Read.
+static void BM_Map(benchmark::State& state)
+{
+    OBJOptions options;
+    options.triangle_count = static_cast<unsigned>(state.range(0));
+    const std::string path = GenerateOBJFile(options);
+
+    std::size_t size = 0;
+    for (auto _ : state)
+    {
+        MappedFile file = Check(Map(path));
+        unsigned sum = 0;
+        for (std::size_t i = 0; i < file.size; i += 4096)
+            sum += static_cast<unsigned char>(file.data[i]);
+        benchmark::DoNotOptimize(sum);
+        size = file.size;
+        Unmap(file);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Map)->Arg(1 << 12)->Arg(1 << 16)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+
+// The CPU part of importing a model; an Assimp mesh of 'vertex_count' vertices with all attributes, as produced by
+// aiProcess_Triangulate | aiProcess_CalcTangentSpace.
+static void BM_ProcessMesh(benchmark::State& state)
+{
+    const unsigned vertex_count = static_cast<unsigned>(state.range(0));
+
+    aiMesh mesh;
+    mesh.mNumVertices      = vertex_count;
+    mesh.mVertices         = new aiVector3D[vertex_count];
+    mesh.mNormals          = new aiVector3D[vertex_count];
+    mesh.mTangents         = new aiVector3D[vertex_count];
+    mesh.mBitangents       = new aiVector3D[vertex_count];
+    mesh.mTextureCoords[0] = new aiVector3D[vertex_count];
+    mesh.mNumUVComponents[0] = 2;
+    for (unsigned i = 0; i < vertex_count; ++i)
+    {
+        float x = static_cast<float>(i);
+        mesh.mVertices[i]         = aiVector3D(x, -x, x * 0.5f);
+        mesh.mNormals[i]          = aiVector3D(0.0f, 0.0f, 1.0f);
+        mesh.mTangents[i]         = aiVector3D(1.0f, 0.0f, 0.0f);
+        mesh.mBitangents[i]       = aiVector3D(0.0f, 1.0f, 0.0f);
+        mesh.mTextureCoords[0][i] = aiVector3D(x / vertex_count, 1.0f - x / vertex_count, 0.0f);
+    }
+
+    // Roughly two triangles per vertex, as in a closed mesh.
+    mesh.mNumFaces = 2 * vertex_count;
+    mesh.mFaces    = new aiFace[mesh.mNumFaces];
+    for (unsigned i = 0; i < mesh.mNumFaces; ++i)
+    {
+        mesh.mFaces[i].mNumIndices = 3;
+        mesh.mFaces[i].mIndices    = new unsigned[3] {(i / 2) % vertex_count, (i / 2 + 1) % vertex_count, (i / 2 + 2) % vertex_count};
+    }
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(ProcessMesh(&mesh));
+    state.SetItemsProcessed(state.iterations() * vertex_count);
+}
+BENCHMARK(BM_ProcessMesh)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+
+// The optimization pass of an import, on a grid in scanline order.
+static void BM_OptimizeMesh(benchmark::State& state)
+{
+    const auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::vector<Vertex> vertices = grid.first;
+        std::vector<GLuint> indices  = grid.second;
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(OptimizeMesh(vertices, indices));
+    }
+    state.SetItemsProcessed(state.iterations() * grid.second.size() / 3);
+}
+BENCHMARK(BM_OptimizeMesh)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+
+// Generating the LOD chain of a grid, which simplifies all the way down.
+static void BM_GenerateLods(benchmark::State& state)
+{
+    const auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::vector<GLuint> indices = grid.second;
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(GenerateLods(grid.first, indices));
+    }
+    state.SetItemsProcessed(state.iterations() * grid.second.size() / 3);
+}
+BENCHMARK(BM_GenerateLods)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+
+// Clustering an optimized grid into meshlets.
+static void BM_BuildMeshlets(benchmark::State& state)
+{
+    auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    OptimizeMesh(grid.first, grid.second);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::vector<GLuint> indices = grid.second;
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(BuildMeshlets(grid.first.data(), grid.first.size(), indices.data(), indices.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * grid.second.size() / 3);
+}
+BENCHMARK(BM_BuildMeshlets)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+
+// A hierarchy of 'range(0)' nodes, four children per node, where every node is animated every frame.
+static void BM_UpdateTransforms(benchmark::State& state)
+{
+    const std::uint32_t count = static_cast<std::uint32_t>(state.range(0));
+    Scene scene;
+    AddNode(scene, NO_PARENT);
+    for (std::uint32_t i = 1; i < count; ++i)
+        AddNode(scene, (i - 1) / 4, glm::vec3(1.0f, 0.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.9f));
+
+    float angle = 0.0f;
+    for (auto _ : state)
+    {
+        angle += 0.01f;
+        for (std::uint32_t i = 0; i < count; ++i)
+            SetRotation(scene, i, glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+        benchmark::DoNotOptimize(UpdateTransforms(scene));
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_UpdateTransforms)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+
+// A square grid of 'range(0)' instances seen from one side, about half of which are in view.
+static void BM_CullInstances(benchmark::State& state)
+{
+    const unsigned count = static_cast<unsigned>(state.range(0));
+    const unsigned side  = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<float>(count))));
+    std::vector<Instance> instances;
+    for (unsigned i = 0; i < count; ++i)
+        instances.push_back({glm::translate(glm::mat4(1.0f), glm::vec3(float(i % side) * 3.0f - side * 1.5f, 0.0f, float(i / side) * 3.0f - side * 1.5f)), glm::vec4(1.0f)});
+
+    const glm::mat4 view_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10000.0f) * glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    InstanceBatch batch;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(CullInstances(instances.data(), instances.size(), Bounds {glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 2.0f, 1.0f)}, 1.0f, view_projection, glm::vec3(0.0f, 2.0f, 0.0f), batch));
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CullInstances)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+
+// 'range(0)' objects scattered in a cube around the camera, about a sixth of which are in view, culled by 'range(1)'
+// threads.
+static void BM_CullBounds(benchmark::State& state)
+{
+    const std::size_t count = static_cast<std::size_t>(state.range(0));
+    BoundsTable table;
+    Reset(table, count);
+    std::uint32_t seed = 1;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f * 200.0f - 100.0f; };
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 center(random(), random(), random());
+        Set(table, i, {center - 0.5f, center + 0.5f}, 0.8f);
+    }
+
+    const Frustum frustum = ExtractFrustum(glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f));
+    std::vector<std::uint8_t> visible;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(CullBounds(table, frustum, visible, static_cast<unsigned>(state.range(1))));
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CullBounds)->Args({10000, 1})->Args({100000, 1})->Args({100000, 4})->Args({1000000, 1})->Args({1000000, 0})->Args({1000000, 4})->Unit(benchmark::kMicrosecond);
+
+
+// Building the triangle tree of a grid, as the loader does for every mesh.
+static void BM_BuildMeshBvh(benchmark::State& state)
+{
+    const auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(BuildMeshBvh(grid.first.data(), grid.first.size(), grid.second.data(), grid.second.size()));
+    state.SetItemsProcessed(state.iterations() * grid.second.size() / 3);
+}
+BENCHMARK(BM_BuildMeshBvh)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+// Rays from above the grid towards random points on it.
+static void BM_RaycastMeshBvh(benchmark::State& state)
+{
+    const auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    const std::shared_ptr<MeshBvh> mesh = BuildMeshBvh(grid.first.data(), grid.first.size(), grid.second.data(), grid.second.size());
+    const Bounds bounds = mesh->bvh.nodes[0].bounds;
+    const glm::vec3 origin = bounds.max + (bounds.max - bounds.min);
+
+    std::uint32_t seed = 1;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f; };
+    std::vector<Ray> rays(1024);
+    for (Ray& ray : rays)
+        ray = {origin, bounds.min + (bounds.max - bounds.min) * glm::vec3(random(), random(), random()) - origin};
+
+    std::size_t r = 0;
+    for (auto _ : state)
+    {
+        RayHit hit;
+        benchmark::DoNotOptimize(Raycast(*mesh, rays[r++ % rays.size()], hit));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RaycastMeshBvh)->Arg(256)->Arg(1024)->Unit(benchmark::kNanosecond);
+
+// Building a tree over scattered boxes and querying it.
+static void BM_BvhQueries(benchmark::State& state)
+{
+    const std::size_t count = static_cast<std::size_t>(state.range(0));
+    std::uint32_t seed = 1;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f * 200.0f - 100.0f; };
+    std::vector<Bounds> boxes(count);
+    for (Bounds& box : boxes)
+    {
+        const glm::vec3 center(random(), random(), random());
+        box = {center - 0.5f, center + 0.5f};
+    }
+
+    Bvh bvh;
+    const Frustum frustum = ExtractFrustum(glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 50.0f));
+    std::vector<std::uint32_t> items;
+    for (auto _ : state)
+    {
+        Build(bvh, boxes.data(), boxes.size());
+        items.clear();
+        Query(bvh, boxes.data(), frustum, items);
+        Nearest(bvh, boxes.data(), glm::vec3(random(), random(), random()), 16, items);
+        benchmark::DoNotOptimize(items.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_BvhQueries)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+
+// Rasterizing a grid seen at an angle as the occluder, with the given number of threads, and testing boxes behind it.
+static void BM_RasterizeOccluders(benchmark::State& state)
+{
+    const auto grid = Parse(CachedGrid(static_cast<unsigned>(state.range(0))));
+    std::vector<glm::vec3> positions(grid.first.size());
+    for (std::size_t i = 0; i < positions.size(); ++i)
+        positions[i] = grid.first[i].position;
+
+    Bounds bounds {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+    for (const glm::vec3& position : positions)
+    {
+        bounds.min = glm::min(bounds.min, position);
+        bounds.max = glm::max(bounds.max, position);
+    }
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const float size = glm::length(bounds.max - bounds.min);
+    const glm::mat4 view_projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, size * 0.01f, size * 4.0f) * glm::lookAt(center + glm::vec3(0.3f, 0.2f, 1.0f) * size * 0.8f, center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    DepthBuffer buffer;
+    for (auto _ : state)
+    {
+        Reset(buffer, 256, 144);
+        AddOccluder(buffer, {positions.data(), positions.size(), grid.second.data(), grid.second.size() / 3, view_projection});
+        benchmark::DoNotOptimize(Rasterize(buffer, static_cast<unsigned>(state.range(1))));
+    }
+    state.SetItemsProcessed(state.iterations() * grid.second.size() / 3);
+}
+BENCHMARK(BM_RasterizeOccluders)->Args({64, 1})->Args({64, 4})->Args({256, 1})->Args({256, 0})->Args({256, 4})->Unit(benchmark::kMicrosecond);
+
+static void BM_CullOccluded(benchmark::State& state)
+{
+    const std::size_t count = static_cast<std::size_t>(state.range(0));
+    const glm::mat4 view_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 1000.0f);
+
+    // A wall across the left half of the view, and boxes scattered in front of the camera.
+    const std::vector<glm::vec3> wall {{-100.0f, -100.0f, -20.0f}, {0.0f, -100.0f, -20.0f}, {0.0f, 100.0f, -20.0f}, {-100.0f, 100.0f, -20.0f}};
+    const std::vector<GLuint> indices {0, 1, 2, 0, 2, 3};
+    DepthBuffer buffer;
+    Reset(buffer, 256, 256);
+    AddOccluder(buffer, {wall.data(), wall.size(), indices.data(), 2, view_projection});
+    Rasterize(buffer, 1);
+
+    BoundsTable table;
+    Reset(table, count);
+    std::uint32_t seed = 1;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f; };
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 center((random() - 0.5f) * 100.0f, (random() - 0.5f) * 100.0f, -5.0f - random() * 100.0f);
+        Set(table, i, {center - 0.5f, center + 0.5f}, 0.8f);
+    }
+
+    std::vector<std::uint8_t> visible;
+    for (auto _ : state)
+    {
+        visible.assign(count, 1);
+        benchmark::DoNotOptimize(CullOccluded(buffer, table, view_projection, visible));
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CullOccluded)->Arg(10000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,35 @@
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+
+
+// Same as BENCHMARK_MAIN, except that the results are also written as JSON to 'nax-bench.json' unless
+// --benchmark_out is given. Two runs can then be compared with tools/compare.py of google benchmark, e.g.
+//     compare.py benchmarks before.json after.json
+int main(int argc, char** argv)
+{
+    std::vector<char*> arguments(argv, argv + argc);
+
+    bool has_out = false;
+    for (int i = 1; i < argc; ++i)
+        if (std::strncmp(argv[i], "--benchmark_out=", std::strlen("--benchmark_out=")) == 0)
+            has_out = true;
+
+    char out[]    = "--benchmark_out=nax-bench.json";
+    char format[] = "--benchmark_out_format=json";
+    if (!has_out)
+    {
+        arguments.push_back(out);
+        arguments.push_back(format);
+    }
+
+    int count = static_cast<int>(arguments.size());
+    benchmark::Initialize(&count, arguments.data());
+    if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "bvh.h"
+#include "scene.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+static float Random(std::uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / 16777216.0f;
+}
+
+// Boxes of up to 'size' scattered in a cube of side 100 around the origin.
+static std::vector<Bounds> RandomBoxes(std::size_t count, float size, std::uint32_t seed)
+{
+    std::vector<Bounds> boxes(count);
+    for (Bounds& box : boxes)
+    {
+        const glm::vec3 min = glm::vec3(Random(seed), Random(seed), Random(seed)) * 100.0f - 50.0f;
+        box = {min, min + glm::vec3(Random(seed), Random(seed), Random(seed)) * size};
+    }
+    return boxes;
+}
+
+static bool Contains(const Bounds& outer, const Bounds& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+// Every item is in exactly one leaf, and every node contains what's under it.
+static void ExpectValid(const Bvh& bvh, const std::vector<Bounds>& boxes, unsigned max_leaf_items)
+{
+    std::vector<int> seen(boxes.size(), 0);
+    for (std::size_t i = 0; i < bvh.nodes.size(); ++i)
+    {
+        const BvhNode& node = bvh.nodes[i];
+        if (node.count > 0)
+        {
+            EXPECT_LE(node.count, max_leaf_items);
+            for (std::uint32_t j = node.first; j < node.first + node.count; ++j)
+            {
+                ++seen[bvh.items[j]];
+                EXPECT_TRUE(Contains(node.bounds, boxes[bvh.items[j]]));
+            }
+        }
+        else
+        {
+            ASSERT_LT(node.first, bvh.nodes.size());
+            EXPECT_TRUE(Contains(node.bounds, bvh.nodes[i + 1].bounds));
+            EXPECT_TRUE(Contains(node.bounds, bvh.nodes[node.first].bounds));
+        }
+    }
+    for (int count : seen)
+        EXPECT_EQ(count, 1);
+}
+
+// Small triangles scattered like the boxes.
+static void RandomTriangles(std::size_t count, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    std::uint32_t seed = 3;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 corner = glm::vec3(Random(seed), Random(seed), Random(seed)) * 100.0f - 50.0f;
+        for (int c = 0; c < 3; ++c)
+        {
+            Vertex vertex {};
+            vertex.position = corner + (glm::vec3(Random(seed), Random(seed), Random(seed)) - 0.5f) * 6.0f;
+            vertices.push_back(vertex);
+            indices.push_back(static_cast<GLuint>(indices.size()));
+        }
+    }
+}
+
+
+TEST(Bvh, BuildAndRefit)
+{
+    std::vector<Bounds> boxes = RandomBoxes(1000, 3.0f, 1);
+    Bvh bvh;
+    Build(bvh, boxes.data(), boxes.size());
+    ExpectValid(bvh, boxes, 4);
+
+    // Moved, but with the same tree.
+    const std::size_t nodes = bvh.nodes.size();
+    std::uint32_t seed = 2;
+    for (Bounds& box : boxes)
+    {
+        const glm::vec3 offset = glm::vec3(Random(seed), Random(seed), Random(seed)) * 10.0f;
+        box = {box.min + offset, box.max + offset};
+    }
+    Refit(bvh, boxes.data());
+    EXPECT_EQ(bvh.nodes.size(), nodes);
+    ExpectValid(bvh, boxes, 4);
+
+    // Items in one place still end up in small leaves.
+    const std::vector<Bounds> same(37, Bounds {glm::vec3(1.0f), glm::vec3(2.0f)});
+    Build(bvh, same.data(), same.size(), 2);
+    ExpectValid(bvh, same, 2);
+
+    Build(bvh, nullptr, 0);
+    EXPECT_TRUE(bvh.nodes.empty());
+}
+
+
+TEST(Bvh, RaycastFindsTheClosestTriangle)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    RandomTriangles(5000, vertices, indices);
+    const std::shared_ptr<MeshBvh> mesh = BuildMeshBvh(vertices.data(), vertices.size(), indices.data(), indices.size());
+
+    // The same triangles in a single leaf, so every one of them is tested.
+    std::vector<Bounds> bounds;
+    for (std::size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3& a = vertices[indices[i]].position, & b = vertices[indices[i + 1]].position, & c = vertices[indices[i + 2]].position;
+        bounds.push_back({glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c))});
+    }
+    MeshBvh brute = *mesh;
+    Build(brute.bvh, bounds.data(), bounds.size(), static_cast<unsigned>(bounds.size()));
+    ASSERT_EQ(brute.bvh.nodes.size(), 1u);
+
+    std::uint32_t seed = 4;
+    unsigned hits = 0;
+    for (int r = 0; r < 200; ++r)
+    {
+        const glm::vec3 target = glm::vec3(Random(seed), Random(seed), Random(seed)) * 100.0f - 50.0f;
+        const Ray ray {glm::vec3(0.0f, 0.0f, 120.0f), glm::normalize(target - glm::vec3(0.0f, 0.0f, 120.0f))};
+
+        RayHit hit, expected;
+        const bool found = Raycast(*mesh, ray, hit);
+        EXPECT_EQ(found, Raycast(brute, ray, expected));
+        if (found)
+        {
+            ++hits;
+            EXPECT_EQ(hit.triangle, expected.triangle);
+            EXPECT_FLOAT_EQ(hit.distance, expected.distance);
+        }
+    }
+    EXPECT_GT(hits, 20u);
+}
+
+
+TEST(Bvh, Queries)
+{
+    const std::vector<Bounds> boxes = RandomBoxes(3000, 4.0f, 5);
+    Bvh bvh;
+    Build(bvh, boxes.data(), boxes.size());
+
+    const Frustum frustum = ExtractFrustum(glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 40.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    std::vector<std::uint32_t> items;
+    const std::size_t count = Query(bvh, boxes.data(), frustum, items);
+    EXPECT_EQ(count, items.size());
+    std::sort(items.begin(), items.end());
+
+    std::vector<std::uint32_t> expected;
+    for (std::uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        bool inside = true;
+        const glm::vec3 center = (boxes[i].min + boxes[i].max) * 0.5f, extent = (boxes[i].max - boxes[i].min) * 0.5f;
+        for (const glm::vec4& plane : frustum.planes)
+            inside = inside && glm::dot(glm::vec3(plane), center) + plane.w >= -glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if (inside)
+            expected.push_back(i);
+    }
+    EXPECT_EQ(items, expected);
+    EXPECT_GT(expected.size(), 10u);
+
+    // A sphere, appended to what's there.
+    const glm::vec3 center(5.0f, -3.0f, 2.0f);
+    const std::size_t before = items.size();
+    Query(bvh, boxes.data(), center, 15.0f, items);
+    std::vector<std::uint32_t> in_sphere(items.begin() + before, items.end());
+    std::sort(in_sphere.begin(), in_sphere.end());
+    expected.clear();
+    for (std::uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        const glm::vec3 closest = glm::clamp(center, boxes[i].min, boxes[i].max);
+        if (glm::dot(closest - center, closest - center) <= 15.0f * 15.0f)
+            expected.push_back(i);
+    }
+    EXPECT_EQ(in_sphere, expected);
+
+    // The nearest, in order.
+    auto distance = [&](std::uint32_t i)
+    {
+        const glm::vec3 closest = glm::clamp(center, boxes[i].min, boxes[i].max);
+        return glm::dot(closest - center, closest - center);
+    };
+    Nearest(bvh, boxes.data(), center, 10, items);
+    ASSERT_EQ(items.size(), 10u);
+    std::vector<float> distances;
+    for (std::uint32_t i = 0; i < boxes.size(); ++i)
+        distances.push_back(distance(i));
+    std::sort(distances.begin(), distances.end());
+    for (std::size_t i = 0; i < items.size(); ++i)
+        EXPECT_FLOAT_EQ(distance(items[i]), distances[i]);
+}
+
+
+TEST(Bvh, PickModel)
+{
+    // Two copies of a quad facing +z, one at z = -5 and one, smaller, in front of it at z = -3 but off to the side.
+    std::vector<Vertex> vertices(4);
+    vertices[0].position = {-1.0f, -1.0f, 0.0f};
+    vertices[1].position = { 1.0f, -1.0f, 0.0f};
+    vertices[2].position = { 1.0f,  1.0f, 0.0f};
+    vertices[3].position = {-1.0f,  1.0f, 0.0f};
+    const std::vector<GLuint> indices = {0, 1, 2, 0, 2, 3};
+
+    TexturedModel model;
+    model.nodes = {
+        {NO_PARENT, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+        {0, glm::vec3(0.0f, 0.0f, -5.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+        {0, glm::vec3(0.5f, 0.0f, -3.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.25f)},
+    };
+    for (std::uint32_t node : {1u, 2u})
+    {
+        TexturedMesh mesh;
+        mesh.mesh.bounds = {glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f)};
+        mesh.mesh.bvh = BuildMeshBvh(vertices.data(), vertices.size(), indices.data(), indices.size());
+        mesh.node = node;
+        model.meshes.push_back(mesh);
+    }
+
+    Scene scene;
+    const std::uint32_t first = AddModel(scene, model, NO_PARENT);
+    UpdateTransforms(scene);
+
+    std::vector<Bounds> bounds;
+    MeshBounds(model, scene, first, bounds);
+    Bvh bvh;
+    Build(bvh, bounds.data(), bounds.size());
+
+    const glm::mat4 view_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+
+    // Straight ahead only the far quad is hit, on its lower right triangle.
+    RayHit hit;
+    ASSERT_TRUE(Raycast(bvh, model, scene, first, RayThrough(view_projection, glm::vec2(0.05f, -0.01f)), hit));
+    EXPECT_EQ(hit.mesh, 0u);
+    EXPECT_EQ(hit.triangle, 0u);
+    EXPECT_NEAR(hit.distance, 5.0f, 0.1f);
+
+    // Towards the near quad, which covers the far one.
+    hit = {};
+    ASSERT_TRUE(Raycast(bvh, model, scene, first, RayThrough(view_projection, glm::vec2(0.5f / 3.0f, 0.02f)), hit));
+    EXPECT_EQ(hit.mesh, 1u);
+    EXPECT_EQ(hit.triangle, 1u);
+    EXPECT_NEAR(hit.distance, 3.0f, 0.1f);
+
+    // Moving the far quad out of the way and refitting.
+    SetPosition(scene, first + 1, glm::vec3(10.0f, 0.0f, -5.0f));
+    UpdateTransforms(scene);
+    MeshBounds(model, scene, first, bounds);
+    Refit(bvh, bounds.data());
+    hit = {};
+    EXPECT_FALSE(Raycast(bvh, model, scene, first, RayThrough(view_projection, glm::vec2(0.05f, -0.01f)), hit));
+}
@@ -0,0 +1,203 @@
+#include "compression.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+#include "loader.h"
+#include "utilities.h"
+
+
+// A smooth RGBA image with some noise, so blocks aren't on a single line.
+static std::vector<unsigned char> TestImage(int width, int height)
+{
+    std::vector<unsigned char> pixels(std::size_t(width) * height * 4);
+    unsigned seed = 1;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            seed = seed * 1103515245u + 12345u;
+            const int noise = int((seed >> 16) % 9) - 4;
+            unsigned char* pixel = &pixels[(std::size_t(y) * width + x) * 4];
+            pixel[0] = static_cast<unsigned char>(std::min(255, std::max(0, x * 255 / width + noise)));
+            pixel[1] = static_cast<unsigned char>(std::min(255, std::max(0, y * 255 / height + noise)));
+            pixel[2] = static_cast<unsigned char>((x + y) * 255 / (width + height));
+            pixel[3] = static_cast<unsigned char>(255 - x * 255 / width);
+        }
+    }
+    return pixels;
+}
+
+// Root mean square error over the first 'channels' channels.
+static double RoundTripError(BlockFormat format, const std::vector<unsigned char>& pixels, int width, int height, int channels)
+{
+    std::vector<unsigned char> blocks(std::size_t((width + 3) / 4) * ((height + 3) / 4) * BlockSize(format));
+    std::vector<unsigned char> decoded(pixels.size());
+    EncodeBlocks(format, pixels.data(), width, height, blocks.data());
+    DecodeBlocks(format, blocks.data(), width, height, decoded.data());
+
+    double sum = 0.0;
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        if (int(i % 4) >= channels)
+            continue;
+        const double difference = double(pixels[i]) - double(decoded[i]);
+        sum += difference * difference;
+    }
+    return std::sqrt(sum / (pixels.size() / 4 * channels));
+}
+
+
+TEST(Compression, RoundTripErrorIsSmall)
+{
+    const int width = 64, height = 48;
+    std::vector<unsigned char> pixels = TestImage(width, height);
+
+    EXPECT_LT(RoundTripError(BC1, pixels, width, height, 3), 6.0);
+    EXPECT_LT(RoundTripError(BC3, pixels, width, height, 4), 6.0);
+    EXPECT_LT(RoundTripError(BC4, pixels, width, height, 1), 3.0);
+    EXPECT_LT(RoundTripError(BC5, pixels, width, height, 2), 3.0);
+    EXPECT_LT(RoundTripError(BC7, pixels, width, height, 4), 4.0);
+}
+
+TEST(Compression, SolidBlocksAreExact)
+{
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < 16; ++i)
+        pixels.insert(pixels.end(), {200, 100, 50, 128});
+
+    EXPECT_EQ(RoundTripError(BC4, pixels, 4, 4, 1), 0.0);
+    EXPECT_EQ(RoundTripError(BC5, pixels, 4, 4, 2), 0.0);
+    EXPECT_EQ(RoundTripError(BC7, pixels, 4, 4, 4), 0.0);
+}
+
+TEST(Compression, PartialBlocks)
+{
+    // Blocks on the edge repeat the last row/column, so they encode like an image padded that way.
+    const int width = 7, height = 3;
+    std::vector<unsigned char> pixels = TestImage(width, height);
+    std::vector<unsigned char> padded;
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 8; ++x)
+            for (int c = 0; c < 4; ++c)
+                padded.push_back(pixels[(std::size_t(std::min(y, height - 1)) * width + std::min(x, width - 1)) * 4 + c]);
+
+    for (BlockFormat format : {BC1, BC3, BC4, BC5, BC7})
+    {
+        std::vector<unsigned char> blocks(2 * BlockSize(format)), padded_blocks(2 * BlockSize(format));
+        EncodeBlocks(format, pixels.data(), width, height, blocks.data());
+        EncodeBlocks(format, padded.data(), 8, 4, padded_blocks.data());
+        EXPECT_EQ(blocks, padded_blocks) << FormatName(format);
+    }
+}
+
+TEST(Compression, MipChain)
+{
+    std::vector<unsigned char> pixels = TestImage(64, 32);
+    CookedImage image = Cook(pixels.data(), 64, 32, 4, BC1, false);
+
+    ASSERT_EQ(image.levels.size(), 7);
+    EXPECT_EQ(image.levels[0].size, 16 * 8 * 8);
+    EXPECT_EQ(image.levels[6].width, 1);
+    EXPECT_EQ(image.levels[6].height, 1);
+    EXPECT_EQ(image.levels[6].size, 8);
+    EXPECT_EQ(image.data.size(), image.levels[6].offset + image.levels[6].size);
+}
+
+TEST(Compression, FormatForRole)
+{
+    const unsigned all = (1u << BC1) | (1u << BC3) | (1u << BC4) | (1u << BC5) | (1u << BC7);
+    const unsigned core = (1u << BC4) | (1u << BC5);
+    const unsigned char opaque[4] = {10, 20, 30, 255};
+    const unsigned char transparent[4] = {10, 20, 30, 100};
+
+    EXPECT_EQ(FormatFor("texture_diffuse",  opaque, 1, 1, 4, all), BC1);
+    EXPECT_EQ(FormatFor("texture_diffuse",  transparent, 1, 1, 4, all), BC7);
+    EXPECT_EQ(FormatFor("texture_diffuse",  transparent, 1, 1, 4, all & ~(1u << BC7)), BC3);
+    EXPECT_EQ(FormatFor("texture_specular", opaque, 1, 1, 3, all), BC1);
+    EXPECT_EQ(FormatFor("texture_normal",   opaque, 1, 1, 3, all), BC5);
+    EXPECT_EQ(FormatFor("texture_height",   opaque, 1, 1, 1, all), BC4);
+    EXPECT_EQ(FormatFor("texture_diffuse",  opaque, 1, 1, 3, core), UNCOMPRESSED);
+    EXPECT_EQ(FormatFor("",                 opaque, 1, 1, 3, all), UNCOMPRESSED);
+}
+
+TEST(Compression, DDSRoundTrip)
+{
+    texture_cache_directory = "compression-test-cache";
+    std::vector<unsigned char> pixels = TestImage(20, 12);
+
+    for (BlockFormat format : {UNCOMPRESSED, BC1, BC3, BC4, BC5, BC7})
+    {
+        const std::string path = texture_cache_directory + DIRECTORY_SEPERATOR + FormatName(format) + ".dds";
+        CookedImage image = Cook(pixels.data(), 20, 12, 4, format, true);
+        ASSERT_FALSE(WriteDDS(path, image).error);
+
+        Return<CookedImage> read = ReadDDS(path);
+        ASSERT_FALSE(read.error);
+        EXPECT_EQ(read.value.format, format);
+        EXPECT_EQ(read.value.components, image.components);
+        EXPECT_EQ(read.value.levels.size(), image.levels.size());
+        EXPECT_EQ(read.value.data, image.data);
+        std::remove(path.c_str());
+    }
+
+    // Uncompressed images keep their components.
+    for (int components = 1; components <= 3; ++components)
+    {
+        const std::string path = texture_cache_directory + DIRECTORY_SEPERATOR + "gray.dds";
+        CookedImage image = Cook(pixels.data(), 20, 12 / components, components, UNCOMPRESSED, false);
+        ASSERT_FALSE(WriteDDS(path, image).error);
+
+        Return<CookedImage> read = ReadDDS(path);
+        ASSERT_FALSE(read.error);
+        EXPECT_EQ(read.value.components, components);
+        EXPECT_EQ(read.value.data, image.data);
+        std::remove(path.c_str());
+    }
+
+    EXPECT_TRUE(RemoveEmptyDirectory(texture_cache_directory));
+    texture_cache_directory = ".naxcache";
+}
+
+TEST(Compression, RequestImageCooksOnce)
+{
+    texture_cache_directory = "compression-test-cache";
+    const unsigned supported = supported_block_formats;
+    supported_block_formats = (1u << UNCOMPRESSED) | (1u << BC1);
+
+    const std::string path = "compression-test.ppm";
+    const std::string content = "P6\n4 4\n255\n" + std::string(48, '\x80');
+    std::ofstream(path, std::ios::binary) << content;
+    const std::string cooked_path = CookedTexturePath(ContentHash(content.data(), content.size()), "texture_diffuse");
+
+    unsigned long long key;
+    {
+        std::shared_ptr<ImageRequest> request = RequestImage(path, "texture_diffuse");
+        request->decoded.wait();
+        EXPECT_EQ(request->cooked.format, BC1);
+        EXPECT_EQ(request->image.pixels, nullptr);
+        key = request->key;
+    }
+    EXPECT_FALSE(ReadDDS(cooked_path).error);
+
+    // Read back from the cache, and keyed apart from the uncompressed image.
+    std::shared_ptr<ImageRequest> cached = RequestImage(path, "texture_diffuse");
+    std::shared_ptr<ImageRequest> uncompressed = RequestImage(path);
+    cached->decoded.wait();
+    uncompressed->decoded.wait();
+    EXPECT_EQ(cached->cooked.format, BC1);
+    EXPECT_EQ(cached->key, key);
+    EXPECT_NE(uncompressed->key, key);
+    EXPECT_NE(uncompressed->image.pixels, nullptr);
+
+    std::remove(cooked_path.c_str());
+    std::remove(path.c_str());
+    EXPECT_TRUE(RemoveEmptyDirectory(texture_cache_directory));
+    supported_block_formats = supported;
+    texture_cache_directory = ".naxcache";
+}
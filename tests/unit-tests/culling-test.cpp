@@ -0,0 +1,107 @@
+#include "culling.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+// Objects scattered in a cube of side 200 around the origin, with boxes and spheres of varying sizes.
+static BoundsTable Scatter(std::size_t count)
+{
+    BoundsTable table;
+    Reset(table, count);
+    std::uint32_t seed = 7;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f; };
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 center = glm::vec3(random(), random(), random()) * 200.0f - 100.0f;
+        const glm::vec3 extent = glm::vec3(random(), random(), random()) * 5.0f;
+        Set(table, i, {center - extent, center + extent}, random() * 8.0f);
+    }
+    return table;
+}
+
+
+TEST(Culling, BoxAndSphere)
+{
+    const Frustum frustum = ExtractFrustum(glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f));
+
+    BoundsTable table;
+    Reset(table, 3);
+    // A thin box behind the near plane, with a sphere that reaches in.
+    Set(table, 0, {glm::vec3(-20.0f, -0.1f, 0.5f), glm::vec3(20.0f, 0.1f, 1.0f)}, 20.0f);
+    // A long box that reaches in past the left plane, with a sphere that doesn't.
+    Set(table, 1, {glm::vec3(-40.0f, -1.0f, -11.0f), glm::vec3(-8.0f, 1.0f, -9.0f)}, 1.0f);
+    // Both reach in.
+    Set(table, 2, {glm::vec3(-12.0f, -1.0f, -11.0f), glm::vec3(-8.0f, 1.0f, -9.0f)}, 3.0f);
+
+    std::vector<std::uint8_t> visible;
+    EXPECT_EQ(CullBounds(table, frustum, visible), 1u);
+    EXPECT_EQ(visible, (std::vector<std::uint8_t> {0, 0, 1}));
+}
+
+
+TEST(Culling, MatchesSpheresAndBoxesOneByOne)
+{
+    const glm::mat4 view_projection = glm::perspective(glm::radians(60.0f), 1.5f, 0.1f, 80.0f) * glm::lookAt(glm::vec3(5.0f, 3.0f, 0.0f), glm::vec3(-1.0f, 0.0f, -4.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = ExtractFrustum(view_projection);
+
+    // Not a multiple of the SIMD width, so there's a tail, and enough to be split between threads.
+    const std::size_t count = CULL_THREADING_THRESHOLD * 2 + 3;
+    const BoundsTable table = Scatter(count);
+
+    std::vector<std::uint8_t> visible, threaded;
+    const std::size_t kept = CullBounds(table, frustum, visible, 1);
+    EXPECT_EQ(CullBounds(table, frustum, threaded, 4), kept);
+    EXPECT_EQ(threaded, visible);
+    EXPECT_GT(kept, 0u);
+    EXPECT_LT(kept, count);
+
+    // The smallest margin by which the box or the sphere is inside any plane.
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 center(table.center_x[i], table.center_y[i], table.center_z[i]);
+        const glm::vec3 extent(table.extent_x[i], table.extent_y[i], table.extent_z[i]);
+        float margin = INFINITY;
+        for (const glm::vec4& plane : frustum.planes)
+            margin = std::min(margin, glm::dot(glm::vec3(plane), center) + plane.w + std::min(table.radius[i], glm::dot(glm::abs(glm::vec3(plane)), extent)));
+
+        // The kernel adds in another order, which can only matter for objects right on a plane.
+        if ((margin >= 0.0f) != (visible[i] != 0))
+        {
+            EXPECT_LT(std::abs(margin), 1e-4f) << i;
+        }
+    }
+
+    // With everything in view, every chunk and the tail of the last one are kept.
+    BoundsTable in_view;
+    Reset(in_view, count);
+    for (std::size_t i = 0; i < count; ++i)
+        Set(in_view, i, {glm::vec3(-1.5f, -0.5f, -4.5f), glm::vec3(-0.5f, 0.5f, -3.5f)}, 1.0f);
+    EXPECT_EQ(CullBounds(in_view, frustum, visible, 1), count);
+    EXPECT_EQ(CullBounds(in_view, frustum, threaded, 4), count);
+    EXPECT_EQ(threaded, visible);
+}
+
+
+TEST(Culling, TransformBoundsAndSphere)
+{
+    const glm::mat4 matrix = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f)), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(2.0f, 1.0f, 1.0f));
+
+    const Bounds bounds = TransformBounds({glm::vec3(0.0f), glm::vec3(1.0f, 2.0f, 3.0f)}, matrix);
+    // x is scaled by 2 and turned onto y, y turned onto -x.
+    EXPECT_NEAR(bounds.min.x, -1.0f, 1e-5f);
+    EXPECT_NEAR(bounds.max.x,  1.0f, 1e-5f);
+    EXPECT_NEAR(bounds.min.y,  2.0f, 1e-5f);
+    EXPECT_NEAR(bounds.max.y,  4.0f, 1e-5f);
+    EXPECT_NEAR(bounds.min.z,  3.0f, 1e-5f);
+    EXPECT_NEAR(bounds.max.z,  6.0f, 1e-5f);
+
+    const Sphere sphere = TransformSphere({glm::vec3(1.0f, 0.0f, 0.0f), 1.0f}, matrix);
+    EXPECT_NEAR(glm::length(sphere.center - glm::vec3(1.0f, 4.0f, 3.0f)), 0.0f, 1e-5f);
+    EXPECT_FLOAT_EQ(sphere.radius, 2.0f);
+}
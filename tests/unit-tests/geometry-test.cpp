@@ -0,0 +1,163 @@
+#include "geometry.h"
+
+#include <vector>
+#include <map>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "opengl-stubs.h"
+
+
+// The buffers, simulated in memory.
+static std::map<GLuint, std::vector<unsigned char>> buffers;
+static std::map<GLenum, GLuint> bound;
+static GLuint next_name;
+
+static void SimulateBuffers()
+{
+    buffers.clear();
+    bound.clear();
+    next_name = 1;
+
+    StubOpenGL();
+    glad_glGenBuffers = [](GLsizei count, GLuint* names) { for (GLsizei i = 0; i < count; ++i) buffers[names[i] = next_name++]; };
+    glad_glDeleteBuffers = [](GLsizei count, const GLuint* names) { for (GLsizei i = 0; i < count; ++i) buffers.erase(names[i]); };
+    glad_glBindBuffer = [](GLenum target, GLuint name) { bound[target] = name; };
+    glad_glBufferData = [](GLenum target, GLsizeiptr size, const void*, GLenum) { buffers[bound[target]].assign(size, 0); };
+    glad_glBufferSubData = [](GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        std::vector<unsigned char>& buffer = buffers[bound[target]];
+        ASSERT_LE(std::size_t(offset + size), buffer.size());
+        std::memcpy(buffer.data() + offset, data, size);
+    };
+    glad_glCopyBufferSubData = [](GLenum read, GLenum write, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size)
+    {
+        std::memcpy(buffers[bound[write]].data() + write_offset, buffers[bound[read]].data() + read_offset, size);
+    };
+}
+
+// The vertices and indices of an allocation, as they are in its block.
+static std::vector<unsigned char> Contents(const GeometryArena& arena, unsigned id)
+{
+    const GeometryAllocation& allocation = arena.allocations[id];
+    const GeometryBlock& block = arena.blocks[allocation.format][allocation.block];
+    const std::size_t vertex_size = VertexSize(allocation.format);
+    const std::vector<unsigned char>& vertices = buffers[block.vbo];
+    const std::vector<unsigned char>& indices  = buffers[block.ebo];
+
+    std::vector<unsigned char> contents(vertices.begin() + allocation.vertex_offset * vertex_size, vertices.begin() + (allocation.vertex_offset + allocation.vertex_count) * vertex_size);
+    contents.insert(contents.end(), indices.begin() + allocation.index_offset, indices.begin() + allocation.index_offset + allocation.index_bytes);
+    return contents;
+}
+
+
+TEST(FreeList, BestFitAndMerging)
+{
+    FreeList list;
+    Create(list, 100);
+
+    std::size_t a, b, c, d;
+    ASSERT_TRUE(Allocate(list, 10, a));
+    ASSERT_TRUE(Allocate(list, 20, b));
+    ASSERT_TRUE(Allocate(list, 30, c));
+    EXPECT_EQ(a, 0u);
+    EXPECT_EQ(b, 10u);
+    EXPECT_EQ(c, 30u);
+    EXPECT_EQ(list.used, 60u);
+    EXPECT_FALSE(Allocate(list, 41, d));
+
+    // The 10 freed at the start is the best fit for 8, not the 40 at the end.
+    Free(list, a, 10);
+    EXPECT_GT(Fragmentation(list), 0.0f);
+    ASSERT_TRUE(Allocate(list, 8, d));
+    EXPECT_EQ(d, 0u);
+
+    // Freeing everything merges it back into one range.
+    Free(list, b, 20);
+    Free(list, d, 8);
+    Free(list, c, 30);
+    EXPECT_EQ(list.used, 0u);
+    ASSERT_EQ(list.by_offset.size(), 1u);
+    EXPECT_EQ(list.by_offset.begin()->second, 100u);
+    EXPECT_EQ(list.by_size.size(), 1u);
+    EXPECT_EQ(Fragmentation(list), 0.0f);
+}
+
+
+TEST(GeometryArena, SharesBlocksAndReusesFreedRanges)
+{
+    SimulateBuffers();
+    GeometryArena arena;
+    arena.block_vertex_bytes = 1024;
+    arena.block_index_bytes  = 256;
+
+    const std::vector<unsigned char> vertices(10 * sizeof(CompactVertex), 7);
+    const std::vector<std::uint16_t> indices(15, 3);  // An odd size, which is padded.
+    const unsigned a = Allocate(arena, COMPACT, vertices.data(), 10, indices.data(), 30);
+    const unsigned b = Allocate(arena, COMPACT, vertices.data(), 10, indices.data(), 30);
+    ASSERT_EQ(arena.blocks[COMPACT].size(), 1u);
+    EXPECT_EQ(arena.allocations[b].vertex_offset, 10u);
+    EXPECT_EQ(arena.allocations[b].index_offset, 32u);
+
+    // Too large for the block: it gets one of its own size.
+    const std::vector<unsigned char> large(100 * sizeof(CompactVertex), 1);
+    const unsigned c = Allocate(arena, COMPACT, large.data(), 100, indices.data(), 30);
+    ASSERT_EQ(arena.blocks[COMPACT].size(), 2u);
+    EXPECT_EQ(arena.allocations[c].block, 1u);
+    EXPECT_EQ(arena.blocks[COMPACT][1].vertices.capacity, 100u);
+
+    Free(arena, a);
+    EXPECT_FALSE(arena.allocations[a].live);
+    const unsigned d = Allocate(arena, COMPACT, vertices.data(), 10, indices.data(), 30);
+    EXPECT_EQ(d, a);  // The id is reused too.
+    EXPECT_EQ(arena.allocations[d].vertex_offset, 0u);
+
+    Destroy(arena);
+    EXPECT_TRUE(buffers.empty());
+}
+
+
+TEST(GeometryArena, DefragmentKeepsContents)
+{
+    SimulateBuffers();
+    GeometryArena arena;
+    arena.block_vertex_bytes = 64 * sizeof(Vertex);
+    arena.block_index_bytes  = 1024;
+
+    // Every other allocation is freed, which leaves the free space in pieces.
+    std::vector<unsigned> ids;
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        const std::vector<unsigned char> vertices(4 * sizeof(Vertex), static_cast<unsigned char>(i + 1));
+        const std::vector<GLuint> indices(6, i);
+        ids.push_back(Allocate(arena, FULL, vertices.data(), 4, indices.data(), indices.size() * sizeof(GLuint)));
+    }
+    std::vector<std::vector<unsigned char>> contents;
+    for (unsigned i = 0; i < ids.size(); i += 2)
+        Free(arena, ids[i]);
+    for (unsigned i = 1; i < ids.size(); i += 2)
+        contents.push_back(Contents(arena, ids[i]));
+
+    const GeometryBlock& block = arena.blocks[FULL][0];
+    EXPECT_GT(Fragmentation(block.vertices), 0.25f);
+    const GLuint old_vbo = block.vbo;
+
+    EXPECT_EQ(Defragment(arena), 1u);
+    EXPECT_NE(block.vbo, old_vbo);
+    EXPECT_EQ(buffers.count(old_vbo), 0u);
+    EXPECT_EQ(Fragmentation(block.vertices), 0.0f);
+    EXPECT_EQ(Fragmentation(block.indices), 0.0f);
+
+    // Packed at the start, in the same order, with the same contents.
+    for (unsigned i = 1, n = 0; i < ids.size(); i += 2, ++n)
+    {
+        EXPECT_EQ(arena.allocations[ids[i]].vertex_offset, n * 4);
+        EXPECT_EQ(arena.allocations[ids[i]].index_offset, n * 24);
+        EXPECT_EQ(Contents(arena, ids[i]), contents[n]);
+    }
+
+    // Nothing left to pack.
+    EXPECT_EQ(Defragment(arena), 0u);
+    Destroy(arena);
+}
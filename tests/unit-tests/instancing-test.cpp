@@ -0,0 +1,149 @@
+#include "instancing.h"
+
+#include <vector>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+#include "opengl-stubs.h"
+
+
+// The draws issued, and how the instance attributes are specified.
+struct DrawCall
+{
+    GLsizei count;
+    std::size_t pointer;
+    GLsizei instances;
+    GLint base_vertex;
+};
+
+static std::vector<DrawCall> draws;
+static std::vector<std::size_t> instance_offsets;  // Of the first column of the instance matrix, for every respecification.
+
+static void RecordDraws()
+{
+    draws.clear();
+    instance_offsets.clear();
+
+    StubOpenGL();
+    glad_glVertexAttribPointer = [](GLuint index, GLint, GLenum, GLboolean, GLsizei, const void* pointer)
+    {
+        if (index == INSTANCE_MODEL_LOCATION)
+            instance_offsets.push_back(reinterpret_cast<std::size_t>(pointer));
+    };
+    glad_glDrawElementsInstancedBaseVertex = [](GLenum, GLsizei count, GLenum, const void* pointer, GLsizei instances, GLint base_vertex)
+    {
+        draws.push_back({count, reinterpret_cast<std::size_t>(pointer), instances, base_vertex});
+    };
+}
+
+// Of a unit cube around the origin, with the sphere that touches its faces.
+static const Bounds CUBE = {glm::vec3(-0.5f), glm::vec3(0.5f)};
+
+static std::vector<Instance> Row(unsigned count)
+{
+    std::vector<Instance> instances;
+    for (unsigned i = 0; i < count; ++i)
+        instances.push_back({glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -2.0f - 3.0f * i)), glm::vec4(1.0f)});
+    return instances;
+}
+
+
+TEST(Instancing, CullAndSortByDistance)
+{
+    const glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 1000.0f);
+    std::vector<Instance> instances = Row(100);
+    // Behind the camera.
+    instances.push_back({glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 10.0f)), glm::vec4(1.0f)});
+    // Reversed, so they're not already sorted.
+    std::reverse(instances.begin(), instances.end());
+
+    InstanceBatch batch;
+    EXPECT_EQ(CullInstances(instances.data(), instances.size(), CUBE, 0.5f, view_projection, glm::vec3(0.0f), batch), 100u);
+    ASSERT_EQ(batch.visible.size(), 100u);
+    EXPECT_EQ(batch.starts[0], 0u);
+    EXPECT_EQ(batch.starts[INSTANCE_BUCKETS], 100u);
+
+    // Every bucket is at least as far as its distance, and farther than the buckets before it.
+    float previous = 0.0f;
+    for (unsigned b = 0; b < INSTANCE_BUCKETS; ++b)
+    {
+        for (std::uint32_t i = batch.starts[b]; i < batch.starts[b + 1]; ++i)
+        {
+            const float distance = -batch.visible[i].model[3].z - 0.5f;
+            EXPECT_GE(distance, batch.distances[b] * 0.9999f);
+            EXPECT_GE(distance, previous);
+        }
+        if (batch.starts[b] < batch.starts[b + 1])
+            previous = batch.distances[b];
+    }
+
+    // A scaled copy counts as nearer, as its errors are larger too.
+    const Instance copy = {glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f)), glm::vec4(1.0f)};
+    Instance scaled = copy;
+    scaled.model = glm::scale(scaled.model, glm::vec3(4.0f));
+    InstanceBatch scaled_batch;
+    CullInstances(&copy, 1, CUBE, 0.5f, view_projection, glm::vec3(0.0f), batch);
+    CullInstances(&scaled, 1, CUBE, 0.5f, view_projection, glm::vec3(0.0f), scaled_batch);
+    unsigned bucket = 0, scaled_bucket = 0;
+    while (batch.starts[bucket + 1] == 0)
+        ++bucket;
+    while (scaled_batch.starts[scaled_bucket + 1] == 0)
+        ++scaled_bucket;
+    EXPECT_LT(scaled_bucket, bucket);
+}
+
+
+TEST(Instancing, SelectLod)
+{
+    Mesh mesh;
+    mesh.lod_count = 3;
+    mesh.lods[0] = {0, 300, 0.0f};
+    mesh.lods[1] = {300, 150, 0.01f};
+    mesh.lods[2] = {450, 30, 0.1f};
+
+    EXPECT_EQ(SelectLod(mesh, glm::mat4(1.0f), 1.0f, 100.0f, 1.0f), 1u);
+    EXPECT_EQ(SelectLod(mesh, glm::mat4(1.0f), 0.5f, 100.0f, 1.0f), 0u);
+    EXPECT_EQ(SelectLod(mesh, glm::mat4(1.0f), 20.0f, 100.0f, 1.0f), 2u);
+    // The matrix of the mesh within the model scales its errors.
+    EXPECT_EQ(SelectLod(mesh, glm::scale(glm::mat4(1.0f), glm::vec3(4.0f)), 20.0f, 100.0f, 1.0f), 1u);
+}
+
+
+TEST(Instancing, DrawRangesOfInstances)
+{
+    RecordDraws();
+
+    GeometryArena arena;
+    arena.blocks[FULL].push_back({1, 2, 3, {}, {}});
+    arena.allocations.push_back({FULL, 0, 100, 10, 64, 60, true});
+
+    Mesh mesh;
+    mesh.allocation = 0;
+    mesh.index_type = GL_UNSIGNED_SHORT;
+
+    InstanceBuffer buffer;
+    buffer.id = 4;
+    DrawList list;
+    list.counts  = {6, 3};
+    list.offsets = {0, 12};
+
+    DrawInstanced(arena, mesh, list, buffer, 5, 7);
+    ASSERT_EQ(draws.size(), 2u);
+    EXPECT_EQ(draws[0].count, 6);
+    EXPECT_EQ(draws[0].pointer, 64u);
+    EXPECT_EQ(draws[1].pointer, 64u + 12 * 2);
+    EXPECT_EQ(draws[1].instances, 7);
+    EXPECT_EQ(draws[1].base_vertex, 100);
+    ASSERT_EQ(instance_offsets.size(), 1u);
+    EXPECT_EQ(instance_offsets[0], 5 * sizeof(Instance));
+
+    // The same block and first instance don't respecify the attributes, another first instance does.
+    DrawInstanced(arena, mesh, list, buffer, 5, 7);
+    EXPECT_EQ(instance_offsets.size(), 1u);
+    DrawInstanced(arena, mesh, list, buffer, 0, 5);
+    ASSERT_EQ(instance_offsets.size(), 2u);
+    EXPECT_EQ(instance_offsets[1], 0u);
+}
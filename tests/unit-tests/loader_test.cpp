@@ -1,4 +1,13 @@
 #include "loader.h"
+#include "obj.h"
+#include "threading.h"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#include <glm/vector_relational.hpp>
+#include <assimp/mesh.h>
 
 #include <gtest/gtest.h>
 
@@ -157,4 +166,326 @@ TEST(ParsingOBJ, Cube)
     // Correct amount of vertices.
     EXPECT_EQ(result.first.size(), 24);
 
-}
\ No newline at end of file
+}
+
+TEST(ParsingOBJ, SameAsParse)
+{
+    std::string source =
+        "# Two quads sharing an edge.\n"
+        "v -1.0 0.0 0.0\n"
+        "v 0.0 0.0 0.0\n"
+        "v 1.0 0.0 0.0\n"
+        "v -1.0 1.0 0.0\n"
+        "v 0.0 1.0 0.0\n"
+        "v 1.0 1.0 0.0\n"
+        "vt 0.0 0.0\n"
+        "vt 1.0 1.0\n"
+        "vn 0.0 0.0 1.0\n"
+        "f 1/1/1 2/2/1 5/2/1\n"
+        "f 1/1/1 5/2/1 4/1/1\n"
+        "f 2/2/1 3/1/1 6/1/1\n"
+        "f 2/2/1 6/1/1 5/2/1\n";
+
+    auto expected = Parse(source);
+    auto result   = Check(ParseOBJ(source.data(), source.data() + source.size()));
+
+    ASSERT_EQ(result.second, expected.second);
+    ASSERT_EQ(result.first.size(), expected.first.size());
+    for (unsigned i = 0; i < result.first.size(); ++i)
+    {
+        EXPECT_EQ(result.first[i].position, expected.first[i].position);
+        EXPECT_EQ(result.first[i].texture_coordinate, expected.first[i].texture_coordinate);
+        EXPECT_EQ(result.first[i].normal, expected.first[i].normal);
+    }
+}
+
+
+TEST(ParsingOBJ, Numbers)
+{
+    std::string source =
+        "v 1.5e2 -2.5E-1 +3\r\n"
+        "v .25, 1000000, -0.000001\r\n"
+        "v 3.14159265358979 0 0\r\n"
+        "f 1 2 3";
+    auto result = Check(ParseOBJ(source.data(), source.data() + source.size()));
+
+    ASSERT_EQ(result.first.size(), 3);
+    EXPECT_FLOAT_EQ(result.first[0].position.x,  150.0f);
+    EXPECT_FLOAT_EQ(result.first[0].position.y, -0.25f);
+    EXPECT_FLOAT_EQ(result.first[0].position.z,  3.0f);
+    EXPECT_FLOAT_EQ(result.first[1].position.x,  0.25f);
+    EXPECT_FLOAT_EQ(result.first[1].position.y,  1000000.0f);
+    EXPECT_FLOAT_EQ(result.first[1].position.z, -0.000001f);
+    EXPECT_FLOAT_EQ(result.first[2].position.x,  3.14159265358979f);
+}
+
+
+TEST(ParsingOBJ, PolygonsAndRelativeIndices)
+{
+    std::string source =
+        "v 0.0 0.0 0.0\n"
+        "v 1.0 0.0 0.0\n"
+        "v 1.0 1.0 0.0\n"
+        "v 0.0 1.0 0.0\n"
+        "f -4 -3 -2 -1\n";
+    auto result = Check(ParseOBJ(source.data(), source.data() + source.size()));
+
+    // The quad is triangulated as a fan.
+    ASSERT_EQ(result.second.size(), 6);
+    EXPECT_EQ(result.second, (std::vector<GLuint>{0, 1, 2, 0, 2, 3}));
+    EXPECT_EQ(result.first.size(), 4);
+    EXPECT_FLOAT_EQ(result.first[3].position.y, 1.0f);
+}
+
+
+TEST(ParsingOBJ, InvalidIndex)
+{
+    std::string source =
+        "v 0.0 0.0 0.0\n"
+        "f 1 2 3\n";
+    auto result = ParseOBJ(source.data(), source.data() + source.size());
+
+    EXPECT_NE(result.error, nullptr);
+}
+
+
+TEST(ParsingOBJ, ParallelSameAsSerial)
+{
+    // A 256 x 256 grid of quads, big enough to be split in several chunks. Every other row uses relative indices and
+    // the texture coordinates are shared, so vertices are deduplicated across chunk boundaries.
+    const unsigned size = 256;
+    std::string source;
+    for (unsigned y = 0; y < size; ++y)
+    {
+        for (unsigned x = 0; x < size; ++x)
+            source += "v " + std::to_string(x) + " " + std::to_string(y) + " 0.5\n";
+        source += "vt " + std::to_string(y % 7) + " 0.25\n";
+        source += "vn 0 0 1\n";
+
+        if (y == 0)
+            continue;
+
+        for (unsigned x = 0; x + 1 < size; ++x)
+        {
+            unsigned a = (y - 1) * size + x + 1;
+            unsigned b = a + size;
+            std::string t = std::to_string(y % 3 + 1);
+            if (y % 2)
+                source += "f " + std::to_string(a) + "/" + t + "/1 " + std::to_string(a + 1) + "/" + t + "/1 " +
+                          std::to_string(b + 1) + "/" + t + "/1 " + std::to_string(b) + "/" + t + "/1\n";
+            else
+                source += "f " + std::to_string(int(a) - int((y + 1) * size) - 1) + "//-1 " + std::to_string(int(a) - int((y + 1) * size)) +
+                          "//-1 " + std::to_string(int(b) - int((y + 1) * size)) + "//-1\n";
+        }
+    }
+
+    auto expected = Check(ParseOBJ(source.data(), source.data() + source.size(), 1));
+    ASSERT_GT(expected.first.size(), size);
+
+    for (unsigned thread_count : {2u, 3u, 8u})
+    {
+        auto result = Check(ParseOBJ(source.data(), source.data() + source.size(), thread_count));
+
+        ASSERT_EQ(result.second, expected.second);
+        ASSERT_EQ(result.first.size(), expected.first.size());
+        EXPECT_EQ(std::memcmp(result.first.data(), expected.first.data(), result.first.size() * sizeof(Vertex)), 0);
+    }
+}
+
+
+TEST(ParsingOBJ, MoreThan65536Normals)
+{
+    // Packing the indices into 16 bit fields would make the corners 1/2/1 and 1/1/65537 the same vertex.
+    const unsigned normal_count = 70000;
+    std::string source =
+        "v 0.0 0.0 0.0\n"
+        "v 1.0 0.0 0.0\n"
+        "v 0.0 1.0 0.0\n"
+        "vt 0.0 0.0\n"
+        "vt 1.0 1.0\n";
+    for (unsigned i = 0; i < normal_count; ++i)
+        source += "vn " + std::to_string(i) + " 0 0\n";
+    source += "f 1/2/1 2/2/1 3/2/1\n";
+    source += "f 1/1/65537 2/1/65537 3/1/65537\n";
+    source += "f 1/1/70000 2/1/70000 3/1/70000\n";
+
+    auto expected = Parse(source);
+    auto result   = Check(ParseOBJ(source.data(), source.data() + source.size()));
+
+    for (const auto& mesh : {expected, result})
+    {
+        ASSERT_EQ(mesh.first.size(), 9);
+        EXPECT_EQ(mesh.second, (std::vector<GLuint>{0, 1, 2, 3, 4, 5, 6, 7, 8}));
+        EXPECT_FLOAT_EQ(mesh.first[0].normal.x, 0.0f);
+        EXPECT_FLOAT_EQ(mesh.first[0].texture_coordinate.x, 1.0f);
+        EXPECT_FLOAT_EQ(mesh.first[3].normal.x, 65536.0f);
+        EXPECT_FLOAT_EQ(mesh.first[3].texture_coordinate.x, 0.0f);
+        EXPECT_FLOAT_EQ(mesh.first[8].normal.x, 69999.0f);
+    }
+}
+
+
+TEST(StreamingOBJ, SameTrianglesAsParseOBJ)
+{
+    // Big enough to need several windows and chunks with the smallest budget.
+    const unsigned size = 120;
+    std::string source;
+    for (unsigned y = 0; y < size; ++y)
+    {
+        for (unsigned x = 0; x < size; ++x)
+            source += "v " + std::to_string(x) + " " + std::to_string(y) + " " + std::to_string(x * y % 5) + "\n";
+        source += "vn 0 " + std::to_string(y) + " 1\n";
+
+        for (unsigned x = 0; y > 0 && x + 1 < size; ++x)
+        {
+            unsigned a = (y - 1) * size + x + 1;
+            unsigned b = a + size;
+            source += "f " + std::to_string(a) + "//-1 " + std::to_string(a + 1) + "//-1 " + std::to_string(b + 1) + "//-1 " + std::to_string(b) + "//-1\n";
+        }
+    }
+
+    const std::string path = "streaming-test.obj";
+    std::ofstream(path, std::ios::binary) << source;
+
+    auto expected = Check(ParseOBJ(source.data(), source.data() + source.size()));
+
+    std::vector<Vertex> triangles;
+    unsigned calls = 0;
+    auto chunks = Check(StreamOBJ(path, 1 << 20, [&](const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+    {
+        for (GLuint index : indices)
+            triangles.push_back(vertices[index]);
+        ++calls;
+    }));
+    std::remove(path.c_str());
+
+    EXPECT_GT(chunks, 1);
+    EXPECT_EQ(chunks, calls);
+    ASSERT_EQ(triangles.size(), expected.second.size());
+    for (std::size_t i = 0; i < triangles.size(); ++i)
+    {
+        const Vertex& vertex = expected.first[expected.second[i]];
+        ASSERT_EQ(triangles[i].position, vertex.position);
+        ASSERT_EQ(triangles[i].normal,   vertex.normal);
+    }
+}
+
+
+TEST(ProcessMesh, MissingAttributesAreZero)
+{
+    aiMesh mesh;
+    mesh.mNumVertices = 3;
+    mesh.mVertices    = new aiVector3D[3] {{1.0f, -2.0f, 3.0f}, {-1.0f, 2.0f, 0.0f}, {0.0f, 0.0f, -3.0f}};
+    mesh.mNormals     = new aiVector3D[3] {{0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+    mesh.mNumFaces    = 2;
+    mesh.mFaces       = new aiFace[2];
+    mesh.mFaces[0].mNumIndices = 3;
+    mesh.mFaces[0].mIndices    = new unsigned[3] {0, 1, 2};
+    mesh.mFaces[1].mNumIndices = 2;  // A line.
+    mesh.mFaces[1].mIndices    = new unsigned[2] {2, 0};
+
+    MeshData data = ProcessMesh(&mesh);
+
+    ASSERT_EQ(data.vertices.size(), 3);
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(data.vertices[i].position,  glm::vec3(mesh.mVertices[i].x, mesh.mVertices[i].y, mesh.mVertices[i].z));
+        EXPECT_EQ(data.vertices[i].normal,    glm::vec3(mesh.mNormals[i].x, mesh.mNormals[i].y, mesh.mNormals[i].z));
+        EXPECT_EQ(data.vertices[i].texture_coordinate, glm::vec2(0.0f));
+        EXPECT_EQ(data.vertices[i].tangent,   glm::vec3(0.0f));
+        EXPECT_EQ(data.vertices[i].bitangent, glm::vec3(0.0f));
+    }
+    EXPECT_EQ(data.indices, std::vector<GLuint>({0, 1, 2, 2, 0}));
+    EXPECT_EQ(data.bounds.min, glm::vec3(-1.0f, -2.0f, -3.0f));
+    EXPECT_EQ(data.bounds.max, glm::vec3( 1.0f,  2.0f,  3.0f));
+}
+
+
+TEST(SplitMesh, PartsFitAndKeepTheTriangles)
+{
+    // A strip of 'size' x 2 vertices.
+    const unsigned size = 100;
+    MeshData mesh;
+    for (unsigned i = 0; i < size * 2; ++i)
+        mesh.vertices.push_back({glm::vec3(float(i / 2), float(i % 2), 0.0f), glm::vec2(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)});
+    for (unsigned i = 0; i + 1 < size; ++i)
+        mesh.indices.insert(mesh.indices.end(), {i * 2, i * 2 + 1, i * 2 + 2, i * 2 + 2, i * 2 + 1, i * 2 + 3});
+    mesh.textures.push_back({"diffuse.png", "texture_diffuse"});
+    mesh.node = 3;
+
+    std::vector<MeshData> parts = SplitMesh(mesh, 16);
+    EXPECT_GT(parts.size(), 1);
+
+    std::vector<glm::vec3> triangles;
+    for (const MeshData& part : parts)
+    {
+        EXPECT_LE(part.vertices.size(), 16);
+        EXPECT_EQ(part.textures.size(), 1);
+        EXPECT_EQ(part.node, 3u);
+        for (GLuint index : part.indices)
+        {
+            triangles.push_back(part.vertices[index].position);
+            EXPECT_TRUE(glm::all(glm::greaterThanEqual(part.vertices[index].position, part.bounds.min)));
+            EXPECT_TRUE(glm::all(glm::lessThanEqual(part.vertices[index].position, part.bounds.max)));
+        }
+    }
+
+    ASSERT_EQ(triangles.size(), mesh.indices.size());
+    for (std::size_t i = 0; i < mesh.indices.size(); ++i)
+        EXPECT_EQ(triangles[i], mesh.vertices[mesh.indices[i]].position);
+
+    EXPECT_EQ(SplitMesh(mesh).size(), 1);
+}
+
+
+TEST(RequestImage, DecodesSamePathOnce)
+{
+    const std::string path = "request-image-test.pgm";
+    std::ofstream(path, std::ios::binary) << "P5\n2 2\n255\n" << std::string("\x10\x20\x30\x40", 4);
+
+    // Requested concurrently, while the first request is kept alive.
+    std::shared_ptr<ImageRequest> first = RequestImage(path);
+    std::vector<std::shared_ptr<ImageRequest>> requests(16);
+    ParallelFor(static_cast<unsigned>(requests.size()), 4, [&](unsigned i) { requests[i] = RequestImage(path); });
+
+    for (const auto& request : requests)
+        EXPECT_EQ(request, first);
+
+    first->decoded.wait();
+    ASSERT_NE(first->image.pixels, nullptr);
+    EXPECT_EQ(first->image.width,  2);
+    EXPECT_EQ(first->image.height, 2);
+    EXPECT_EQ(first->image.components, 1);
+    EXPECT_EQ(first->image.pixels[3], 0x40);
+
+    std::remove(path.c_str());
+}
+
+
+TEST(RequestImage, ConcurrentFirstRequestsCanWait)
+{
+    const std::string path = "request-image-race-test.pgm";
+    std::ofstream(path, std::ios::binary) << "P5\n1 1\n255\n" << std::string("\x7f", 1);
+
+    // Nobody holds on to the image between rounds, so every round races to create the request and waits on whichever
+    // one won, which must be ready to wait on as soon as it can be found.
+    for (int round = 0; round < 50; ++round)
+    {
+        std::vector<std::shared_ptr<ImageRequest>> requests(8);
+        ParallelFor(static_cast<unsigned>(requests.size()), 8, [&](unsigned i)
+        {
+            requests[i] = RequestImage(path);
+            ASSERT_TRUE(requests[i]->decoded.valid());
+            requests[i]->decoded.wait();
+        });
+
+        for (const auto& request : requests)
+        {
+            EXPECT_EQ(request, requests[0]);
+            ASSERT_NE(request->image.pixels, nullptr);
+            EXPECT_EQ(request->image.pixels[0], 0x7f);
+        }
+    }
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,136 @@
+#include "meshlets.h"
+#include "optimizer.h"
+
+#include <vector>
+#include <set>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+// A unit sphere of 'rings' x 'segments' quads, wound counter clockwise seen from outside.
+static void SphereMesh(unsigned rings, unsigned segments, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    vertices.clear();
+    indices.clear();
+    for (unsigned r = 0; r <= rings; ++r)
+    {
+        for (unsigned s = 0; s <= segments; ++s)
+        {
+            const float theta = 3.14159265f * r / rings, phi = 2.0f * 3.14159265f * s / segments;
+            const glm::vec3 position(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            vertices.push_back({position, glm::vec2(float(s) / segments, float(r) / rings), position, glm::vec3(0.0f), glm::vec3(0.0f)});
+        }
+    }
+    for (unsigned r = 0; r < rings; ++r)
+    {
+        for (unsigned s = 0; s < segments; ++s)
+        {
+            const GLuint a = r * (segments + 1) + s, b = a + 1, c = a + segments + 1, d = c + 1;
+            if (r > 0)
+                indices.insert(indices.end(), {a, b, c});
+            if (r + 1 < rings)
+                indices.insert(indices.end(), {b, d, c});
+        }
+    }
+}
+
+
+TEST(Meshlets, Limits)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    SphereMesh(64, 128, vertices, indices);
+    OptimizeMesh(vertices, indices);
+
+    const std::vector<Meshlet> meshlets = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size());
+    ASSERT_FALSE(meshlets.empty());
+
+    // Consecutive ranges covering all the triangles, within the limits, with spheres around their vertices.
+    GLuint end = 0;
+    for (const Meshlet& meshlet : meshlets)
+    {
+        EXPECT_EQ(meshlet.offset, end);
+        EXPECT_EQ(meshlet.count % 3, 0u);
+        EXPECT_LE(meshlet.count / 3, MAX_MESHLET_TRIANGLES);
+        end = meshlet.offset + meshlet.count;
+
+        const std::set<GLuint> used(indices.begin() + meshlet.offset, indices.begin() + end);
+        EXPECT_LE(used.size(), MAX_MESHLET_VERTICES);
+        for (GLuint v : used)
+            EXPECT_LE(glm::length(vertices[v].position - meshlet.center), meshlet.radius * 1.0001f);
+    }
+    EXPECT_EQ(end, indices.size());
+
+    // Growing them from their neighbors keeps the clusters nearly full.
+    EXPECT_LT(meshlets.size(), indices.size() / 3 / 80);
+}
+
+TEST(Meshlets, Frustum)
+{
+    const glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Frustum frustum = ExtractFrustum(view_projection);
+
+    EXPECT_TRUE(Intersects(frustum, glm::vec3(0.0f, 0.0f, -10.0f), 0.0f));
+    EXPECT_FALSE(Intersects(frustum, glm::vec3(0.0f, 0.0f, 10.0f), 1.0f));
+    EXPECT_FALSE(Intersects(frustum, glm::vec3(0.0f, 0.0f, -200.0f), 1.0f));
+    EXPECT_FALSE(Intersects(frustum, glm::vec3(20.0f, 0.0f, -10.0f), 1.0f));
+    // Touching the frustum is enough.
+    EXPECT_TRUE(Intersects(frustum, glm::vec3(0.0f, 0.0f, 1.0f), 1.5f));
+}
+
+TEST(Meshlets, CullsBackFacingClusters)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    SphereMesh(64, 128, vertices, indices);
+    OptimizeMesh(vertices, indices);
+
+    Mesh mesh {};
+    mesh.index_type = GL_UNSIGNED_INT;
+    mesh.meshlets = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size());
+
+    const glm::vec3 camera(0.0f, 0.0f, 10.0f);
+    const glm::mat4 view_projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f) * glm::lookAt(camera, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    for (const glm::mat4& model : {glm::mat4(1.0f), glm::rotate(glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)), 1.0f, glm::vec3(0.0f, 1.0f, 0.0f))})
+    {
+        DrawList list;
+        const std::size_t kept = CullMeshlets(mesh, model, view_projection, camera, list);
+        ASSERT_EQ(list.counts.size(), list.offsets.size());
+
+        // About half the sphere faces away.
+        EXPECT_GT(kept, mesh.meshlets.size() / 3);
+        EXPECT_LT(kept, mesh.meshlets.size() * 3 / 4);
+
+        // Every triangle facing the camera is still drawn.
+        std::vector<bool> drawn(indices.size() / 3, false);
+        std::size_t drawn_indices = 0;
+        for (std::size_t i = 0; i < list.counts.size(); ++i)
+        {
+            const std::size_t offset = list.offsets[i];
+            for (std::size_t t = offset / 3; t < (offset + list.counts[i]) / 3; ++t)
+                drawn[t] = true;
+            drawn_indices += list.counts[i];
+        }
+        for (std::size_t t = 0; t < indices.size() / 3; ++t)
+        {
+            const glm::vec3 p0 = glm::vec3(model * glm::vec4(vertices[indices[t * 3]].position, 1.0f));
+            const glm::vec3 p1 = glm::vec3(model * glm::vec4(vertices[indices[t * 3 + 1]].position, 1.0f));
+            const glm::vec3 p2 = glm::vec3(model * glm::vec4(vertices[indices[t * 3 + 2]].position, 1.0f));
+            if (glm::dot(glm::cross(p1 - p0, p2 - p0), camera - p0) > 0.0f)
+            {
+                EXPECT_TRUE(drawn[t]);
+            }
+        }
+        EXPECT_LT(drawn_indices, indices.size() * 3 / 4);
+    }
+
+    // A non-uniform scale only culls by the frustum, which here keeps everything.
+    DrawList list;
+    EXPECT_EQ(CullMeshlets(mesh, glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 1.0f)), view_projection, camera, list), mesh.meshlets.size());
+    EXPECT_EQ(list.counts.size(), 1u);
+}
@@ -0,0 +1,73 @@
+#include "mipmaps.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+TEST(MipChain, LevelSizes)
+{
+    std::vector<unsigned char> pixels(5 * 3 * 3);
+    MipChain chain = GenerateMipChain(pixels.data(), 5, 3, 3, false);
+
+    ASSERT_EQ(chain.levels.size(), 3);
+    EXPECT_EQ(chain.levels[1].width, 2);
+    EXPECT_EQ(chain.levels[1].height, 1);
+    EXPECT_EQ(chain.levels[2].width, 1);
+    EXPECT_EQ(chain.levels[2].height, 1);
+    EXPECT_EQ(chain.levels[2].offset, (5 * 3 + 2 * 1) * 3);
+    EXPECT_EQ(chain.data.size(), (5 * 3 + 2 * 1 + 1) * 3);
+}
+
+TEST(MipChain, ConstantStaysConstant)
+{
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < 16 * 8; ++i)
+        pixels.insert(pixels.end(), {37, 140, 220, 99});
+
+    for (MipFilter filter : {BOX, KAISER})
+    {
+        for (bool srgb : {false, true})
+        {
+            MipChain chain = GenerateMipChain(pixels.data(), 16, 8, 4, srgb, filter);
+            for (std::size_t i = chain.levels[0].size; i < chain.data.size(); ++i)
+                EXPECT_EQ(chain.data[i], pixels[i % 4]);
+        }
+    }
+}
+
+// Black and white average to middle gray in linear space, which is 188 in sRGB rather than 128.
+TEST(MipChain, SRGBIsFilteredInLinearSpace)
+{
+    const unsigned char pixels[2] = {0, 255};
+
+    MipChain linear = GenerateMipChain(pixels, 2, 1, 1, false, BOX);
+    MipChain srgb   = GenerateMipChain(pixels, 2, 1, 1, true,  BOX);
+    EXPECT_EQ(linear.data[2], 128);
+    EXPECT_EQ(srgb.data[2],   188);
+
+    // Alpha is linear either way.
+    const unsigned char gray_alpha[4] = {0, 0, 255, 255};
+    MipChain chain = GenerateMipChain(gray_alpha, 2, 1, 2, true, BOX);
+    EXPECT_EQ(chain.data[4], 188);
+    EXPECT_EQ(chain.data[5], 128);
+}
+
+TEST(MipChain, OddSizesCoverEveryPixel)
+{
+    const unsigned char pixels[3] = {0, 255, 0};
+    MipChain chain = GenerateMipChain(pixels, 3, 1, 1, false, BOX);
+    EXPECT_EQ(chain.data[3], 85);
+}
+
+TEST(MipChain, KaiserFiltersCheckerboardToGray)
+{
+    std::vector<unsigned char> pixels(32 * 32);
+    for (int y = 0; y < 32; ++y)
+        for (int x = 0; x < 32; ++x)
+            pixels[y * 32 + x] = ((x + y) % 2) ? 255 : 0;
+
+    MipChain chain = GenerateMipChain(pixels.data(), 32, 32, 1, false, KAISER);
+    for (std::size_t i = chain.levels[1].offset; i < chain.levels[1].offset + chain.levels[1].size; ++i)
+        EXPECT_NEAR(chain.data[i], 128, 2);
+}
@@ -0,0 +1,84 @@
+#include "models.h"
+#include "textures.h"
+#include "geometry.h"
+
+#include <gtest/gtest.h>
+
+
+// A model with one mesh using the texture 'key'. It has no geometry, so nothing is freed from the arena.
+static TexturedModel TexturedWith(TextureCache& cache, unsigned long long key)
+{
+    if (!Acquire(cache, key))
+        Insert(cache, key, static_cast<GLuint>(key), 100, "texture.png");
+
+    TexturedModel model;
+    model.meshes.push_back({Mesh {}, {{static_cast<GLuint>(key), "texture_diffuse", key}}});
+    return model;
+}
+
+
+TEST(ModelManager, OldHandlesAreDetected)
+{
+    TextureCache cache;
+    GeometryArena arena;
+    ModelManager manager;
+    Create(manager, cache, arena);
+
+    EXPECT_EQ(Get(manager, ModelHandle {}), nullptr);
+
+    const ModelHandle a = Add(manager, TexturedWith(cache, 1));
+    ASSERT_NE(Get(manager, a), nullptr);
+    EXPECT_EQ(Get(manager, a)->meshes.size(), 1u);
+
+    Release(manager, a);
+    EXPECT_EQ(Get(manager, a), nullptr);
+    EXPECT_FALSE(Acquire(manager, a));
+
+    // The slot is reused, but not by the old handle.
+    const ModelHandle b = Add(manager, TexturedWith(cache, 2));
+    EXPECT_EQ(b.index, a.index);
+    EXPECT_NE(b.generation, a.generation);
+    EXPECT_EQ(Get(manager, a), nullptr);
+    EXPECT_NE(Get(manager, b), nullptr);
+
+    // Releasing an old handle doesn't release the new model.
+    Release(manager, a);
+    EXPECT_NE(Get(manager, b), nullptr);
+
+    Destroy(manager);
+}
+
+
+TEST(ModelManager, ResourcesAreReleasedFramesLater)
+{
+    TextureCache cache;
+    GeometryArena arena;
+    ModelManager manager;
+    Create(manager, cache, arena);
+    manager.frames_in_flight = 2;
+
+    const ModelHandle model = Add(manager, TexturedWith(cache, 1));
+    EXPECT_TRUE(Acquire(manager, model));
+
+    // Still referenced once.
+    Release(manager, model);
+    EXPECT_NE(Get(manager, model), nullptr);
+    EXPECT_EQ(EndFrame(manager), 0u);
+
+    Release(manager, model);
+    EXPECT_EQ(Get(manager, model), nullptr);
+    EXPECT_EQ(cache.entries[1].references, 1u);
+
+    // It may have been drawn in this frame and the one before it is still in flight.
+    EXPECT_EQ(EndFrame(manager), 0u);
+    EXPECT_EQ(cache.entries[1].references, 1u);
+    EXPECT_EQ(EndFrame(manager), 1u);
+    EXPECT_EQ(cache.entries[1].references, 0u);
+    EXPECT_EQ(EndFrame(manager), 0u);
+
+    // Destroy releases what's still live.
+    Add(manager, TexturedWith(cache, 1));
+    EXPECT_EQ(cache.entries[1].references, 1u);
+    Destroy(manager);
+    EXPECT_EQ(cache.entries[1].references, 0u);
+}
@@ -0,0 +1,174 @@
+#include "naxmesh.h"
+#include "threading.h"
+#include "utilities.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+
+static ModelData TestModel()
+{
+    ModelData model;
+
+    MeshData quad;
+    quad.vertices = {
+        {{-0.5f, -0.5f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}},
+        {{ 0.5f,  0.5f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}},
+        {{-0.5f,  0.5f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}},
+        {{ 0.5f, -0.5f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}},
+    };
+    quad.indices  = {0, 1, 2, 0, 3, 1, 0, 3, 2};
+    quad.lods     = {{0, 6, 0.0f}, {6, 3, 0.25f}};
+    quad.meshlets = {{0, 3, glm::vec3(0.0f), 1.0f, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 0.0f}, {3, 3, glm::vec3(0.5f), 0.5f, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 2.0f}};
+    quad.textures = {{"textures/Body.png", "texture_diffuse"}, {"textures/Body_normal.png", "texture_normal"}};
+    quad.bounds   = {{-0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}};
+    model.meshes.push_back(quad);
+
+    MeshData triangle;
+    triangle.vertices = {quad.vertices[0], quad.vertices[1], quad.vertices[2]};
+    triangle.indices  = {2, 1, 0};
+    triangle.bounds   = {{-0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}};
+    triangle.node     = 1;
+    model.meshes.push_back(triangle);
+
+    model.nodes = {
+        {NO_PARENT, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+        {0, glm::vec3(1.0f, 2.0f, 3.0f), glm::quat(0.5f, 0.5f, 0.5f, 0.5f), glm::vec3(2.0f)},
+    };
+
+    return model;
+}
+
+
+TEST(MeshCache, RoundTrip)
+{
+    mesh_cache_directory = "naxmesh-test-cache";
+    ModelData model = TestModel();
+
+    const unsigned long long key = MeshCacheKey("source", 6, 0);
+    const std::string path = MeshCachePath(key);
+    ASSERT_EQ(Check(WriteMeshCache(path, key, model)), true);
+
+    MeshCache cache = Check(OpenMeshCache(path, key));
+    ASSERT_EQ(cache.meshes.size(), 2);
+
+    for (std::size_t i = 0; i < model.meshes.size(); ++i)
+    {
+        const MeshData& expected = model.meshes[i];
+        const MeshView& mesh     = cache.meshes[i];
+
+        ASSERT_EQ(mesh.vertex_count, expected.vertices.size());
+        ASSERT_EQ(mesh.index_count,  expected.indices.size());
+        EXPECT_EQ(std::memcmp(mesh.vertices, expected.vertices.data(), mesh.vertex_count * sizeof(Vertex)), 0);
+        EXPECT_EQ(std::vector<GLuint>(mesh.indices, mesh.indices + mesh.index_count), expected.indices);
+        EXPECT_EQ(mesh.bounds.min, expected.bounds.min);
+        EXPECT_EQ(mesh.bounds.max, expected.bounds.max);
+        EXPECT_EQ(mesh.node, expected.node);
+
+        ASSERT_EQ(mesh.meshlet_count, expected.meshlets.size());
+        EXPECT_EQ(std::memcmp(mesh.meshlets, expected.meshlets.data(), mesh.meshlet_count * sizeof(Meshlet)), 0);
+
+        ASSERT_EQ(mesh.lods.size(), expected.lods.size());
+        for (std::size_t j = 0; j < mesh.lods.size(); ++j)
+        {
+            EXPECT_EQ(mesh.lods[j].offset, expected.lods[j].offset);
+            EXPECT_EQ(mesh.lods[j].count,  expected.lods[j].count);
+            EXPECT_EQ(mesh.lods[j].error,  expected.lods[j].error);
+        }
+
+        ASSERT_EQ(mesh.textures.size(), expected.textures.size());
+        for (std::size_t j = 0; j < mesh.textures.size(); ++j)
+        {
+            EXPECT_EQ(mesh.textures[j].path, expected.textures[j].path);
+            EXPECT_EQ(mesh.textures[j].type, expected.textures[j].type);
+        }
+    }
+
+    ASSERT_EQ(cache.nodes.size(), model.nodes.size());
+    for (std::size_t i = 0; i < model.nodes.size(); ++i)
+    {
+        EXPECT_EQ(cache.nodes[i].parent,   model.nodes[i].parent);
+        EXPECT_EQ(cache.nodes[i].position, model.nodes[i].position);
+        EXPECT_EQ(cache.nodes[i].rotation, model.nodes[i].rotation);
+        EXPECT_EQ(cache.nodes[i].scale,    model.nodes[i].scale);
+    }
+
+    Close(cache);
+    std::remove(path.c_str());
+    EXPECT_TRUE(RemoveEmptyDirectory(mesh_cache_directory));
+}
+
+
+TEST(MeshCache, Invalid)
+{
+    mesh_cache_directory = "naxmesh-test-cache";
+
+    const unsigned long long key = MeshCacheKey("source", 6, 0);
+    const std::string path = MeshCachePath(key);
+    ASSERT_EQ(Check(WriteMeshCache(path, key, TestModel())), true);
+
+    // Another key, i.e. the source or import flags have changed.
+    EXPECT_NE(OpenMeshCache(path, MeshCacheKey("source", 6, 1)).error, nullptr);
+
+    // Truncated.
+    std::string content = Check(Read(path));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << content.substr(0, content.size() - 4);
+    EXPECT_NE(OpenMeshCache(path, key).error, nullptr);
+
+    // Missing.
+    std::remove(path.c_str());
+    EXPECT_NE(OpenMeshCache(path, key).error, nullptr);
+    EXPECT_TRUE(RemoveEmptyDirectory(mesh_cache_directory));
+}
+
+
+// A cached model is read by LoadModelAsync without going through Assimp.
+TEST(MeshCache, LoadModelAsync)
+{
+    mesh_cache_directory = "naxmesh-test-cache";
+
+    const std::string source = "# Not a model, only used for the key.\n";
+    const std::string path   = "naxmesh-test-source.obj";
+    std::ofstream(path, std::ios::binary) << source;
+
+    const unsigned long long key = MeshCacheKey(source.data(), source.size(), IMPORT_FLAGS, ImportOptions());
+    const std::string cache_path = MeshCachePath(key);
+    ModelData model = TestModel();
+    model.meshes[0].textures.clear();  // Doesn't exist.
+    ASSERT_EQ(Check(WriteMeshCache(cache_path, key, model)), true);
+
+    WorkerPool pool;
+    Start(pool, 1);
+    std::unique_ptr<ModelLoad> load = LoadModelAsync(pool, path);
+    while (!Done(*load))
+        std::this_thread::yield();
+    Stop(pool);
+
+    ASSERT_EQ(load->state, ModelLoad::LOADED);
+    EXPECT_EQ(load->progress, 1.0f);
+    ASSERT_EQ(load->data.meshes.size(), 2);
+    EXPECT_EQ(load->data.meshes[0].indices, model.meshes[0].indices);
+    EXPECT_EQ(load->data.meshes[1].vertices.size(), model.meshes[1].vertices.size());
+    EXPECT_EQ(load->data.meshes[1].node, 1u);
+    EXPECT_EQ(load->data.nodes.size(), 2u);
+
+    std::remove(cache_path.c_str());
+    std::remove(path.c_str());
+    EXPECT_TRUE(RemoveEmptyDirectory(mesh_cache_directory));
+}
+
+
+TEST(MeshCache, CancelledLoad)
+{
+    WorkerPool pool;
+    std::unique_ptr<ModelLoad> load = LoadModelAsync(pool, "doesn't-exist.obj");
+    Cancel(*load);
+
+    Start(pool, 1);
+    Stop(pool);
+    EXPECT_EQ(load->state, ModelLoad::CANCELLED);
+}
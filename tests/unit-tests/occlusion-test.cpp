@@ -0,0 +1,188 @@
+#include "occlusion.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+// A square of side 2 * 'size' facing the camera at depth 'z', centered on (x, 0).
+struct Square
+{
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices {0, 1, 2, 0, 2, 3};
+
+    Square(float x, float z, float size)
+        : positions {{x - size, -size, z}, {x + size, -size, z}, {x + size, size, z}, {x - size, size, z}}
+    {
+    }
+};
+
+static const glm::mat4 PROJECTION = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+
+static Occluder Occluding(const Square& square, const glm::mat4& matrix = PROJECTION)
+{
+    return {square.positions.data(), square.positions.size(), square.indices.data(), square.indices.size() / 3, matrix};
+}
+
+static Bounds Box(glm::vec3 center, float size)
+{
+    return {center - size, center + size};
+}
+
+
+TEST(Occlusion, OccludedBehindOccluders)
+{
+    // A wall filling the left half of the view at z = -5.
+    const Square wall(-5.0f, -5.0f, 5.0f);
+    DepthBuffer buffer;
+    Reset(buffer, 100, 100);
+    EXPECT_EQ(buffer.width, 128u);
+    EXPECT_EQ(buffer.height, 128u);
+    AddOccluder(buffer, Occluding(wall));
+    EXPECT_EQ(Rasterize(buffer), 2u);
+
+    EXPECT_TRUE(Occluded(buffer, Box({-2.0f, 0.0f, -10.0f}, 1.0f), PROJECTION));
+    EXPECT_TRUE(Occluded(buffer, Box({-25.0f, 2.0f, -50.0f}, 10.0f), PROJECTION));
+    // In front of it, reaching past it to the right, or behind the camera.
+    EXPECT_FALSE(Occluded(buffer, Box({-2.0f, 0.0f, -3.0f}, 1.0f), PROJECTION));
+    EXPECT_FALSE(Occluded(buffer, Box({0.5f, 0.0f, -10.0f}, 1.0f), PROJECTION));
+    EXPECT_FALSE(Occluded(buffer, Box({-2.0f, 0.0f, 0.0f}, 1.0f), PROJECTION));
+    EXPECT_FALSE(Occluded(buffer, Box({-2.0f, 0.0f, 10.0f}, 1.0f), PROJECTION));
+
+    // A box reaching into the wall isn't hidden by it.
+    EXPECT_FALSE(Occluded(buffer, Box({-2.0f, 0.0f, -6.0f}, 1.5f), PROJECTION));
+
+    // Nothing is occluded by an empty buffer.
+    Reset(buffer, 100, 100);
+    Rasterize(buffer);
+    EXPECT_FALSE(Occluded(buffer, Box({-2.0f, 0.0f, -10.0f}, 1.0f), PROJECTION));
+}
+
+
+TEST(Occlusion, ClipsToTheNearPlane)
+{
+    // A floor from behind the camera to far in front of it, seen from above. Without clipping the part behind the
+    // camera would project to the wrong side of the screen.
+    const std::vector<glm::vec3> positions {{-50.0f, -1.0f, 20.0f}, {50.0f, -1.0f, 20.0f}, {50.0f, -1.0f, -80.0f}, {-50.0f, -1.0f, -80.0f}};
+    const std::vector<GLuint> indices {0, 1, 2, 0, 2, 3};
+
+    DepthBuffer buffer;
+    Reset(buffer, 64, 64);
+    AddOccluder(buffer, {positions.data(), positions.size(), indices.data(), 2, PROJECTION});
+    EXPECT_GT(Rasterize(buffer), 2u);
+
+    // Below the floor, but not above it.
+    EXPECT_TRUE(Occluded(buffer, Box({0.0f, -3.0f, -10.0f}, 0.5f), PROJECTION));
+    EXPECT_FALSE(Occluded(buffer, Box({0.0f, 1.0f, -10.0f}, 0.5f), PROJECTION));
+
+    // The top half of the screen is clear.
+    const std::vector<float>& depths = buffer.levels[0];
+    EXPECT_EQ(depths[(buffer.height - 1) * buffer.width + buffer.width / 2], 1.0f);
+    EXPECT_LT(depths[buffer.width / 2], 1.0f);
+}
+
+
+TEST(Occlusion, DepthsAndPyramid)
+{
+    // Squares at random places and depths, many more than a chunk of triangles, in both windings.
+    std::uint32_t seed = 9;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return static_cast<float>(seed >> 8) / 16777216.0f; };
+    std::vector<Square> squares;
+    for (int i = 0; i < 1500; ++i)
+    {
+        squares.emplace_back(random() * 40.0f - 20.0f, -5.0f - random() * 40.0f, 0.2f + random() * 2.0f);
+        if (i % 2)
+            std::swap(squares.back().indices[1], squares.back().indices[2]);
+    }
+
+    DepthBuffer threaded, single;
+    Reset(threaded, 96, 64);
+    Reset(single, 96, 64);
+    for (const Square& square : squares)
+    {
+        AddOccluder(threaded, Occluding(square));
+        AddOccluder(single, Occluding(square));
+    }
+    EXPECT_EQ(Rasterize(threaded, 4), Rasterize(single, 1));
+    for (std::size_t level = 0; level < single.levels.size(); ++level)
+        EXPECT_EQ(threaded.levels[level], single.levels[level]);
+
+    // Every pixel is the depth of the nearest square whose inside covers its center, well away from the edges.
+    const std::vector<float>& depths = single.levels[0];
+    unsigned checked = 0;
+    for (unsigned y = 0; y < single.height; ++y)
+    {
+        for (unsigned x = 0; x < single.width; ++x)
+        {
+            const float ndc_x = (x + 0.5f) / single.width * 2.0f - 1.0f, ndc_y = (y + 0.5f) / single.height * 2.0f - 1.0f;
+            float expected = 1.0f;
+            bool near_edge = false;
+            for (const Square& square : squares)
+            {
+                // The square's corners in normalized device coordinates, and its depth.
+                const glm::vec4 min = PROJECTION * glm::vec4(square.positions[0], 1.0f), max = PROJECTION * glm::vec4(square.positions[2], 1.0f);
+                const float x_0 = min.x / min.w, y_0 = min.y / min.w, x_1 = max.x / max.w, y_1 = max.y / max.w;
+                const float margin = 0.05f;
+                if (ndc_x > x_0 - margin && ndc_x < x_1 + margin && ndc_y > y_0 - margin && ndc_y < y_1 + margin)
+                {
+                    if (ndc_x > x_0 + margin && ndc_x < x_1 - margin && ndc_y > y_0 + margin && ndc_y < y_1 - margin)
+                        expected = std::min(expected, min.z / min.w * 0.5f + 0.5f);
+                    else
+                        near_edge = true;
+                }
+            }
+            if (near_edge)
+                continue;
+            EXPECT_NEAR(depths[y * single.width + x], expected, 1e-5f);
+            ++checked;
+        }
+    }
+    EXPECT_GT(checked, single.width * single.height / 4);
+
+    // Every texel above is the farthest of the ones below it.
+    unsigned width = single.width, height = single.height;
+    for (std::size_t level = 1; level < single.levels.size(); ++level)
+    {
+        const unsigned below_width = width, below_height = height;
+        width  = (width  + 1) / 2;
+        height = (height + 1) / 2;
+        ASSERT_EQ(single.levels[level].size(), width * height);
+        for (unsigned y = 0; y < height; ++y)
+        {
+            for (unsigned x = 0; x < width; ++x)
+            {
+                float farthest = 0.0f;
+                for (unsigned v = 2 * y; v < std::min(2 * y + 2, below_height); ++v)
+                    for (unsigned u = 2 * x; u < std::min(2 * x + 2, below_width); ++u)
+                        farthest = std::max(farthest, single.levels[level - 1][v * below_width + u]);
+                EXPECT_EQ(single.levels[level][y * width + x], farthest);
+            }
+        }
+    }
+    EXPECT_EQ(single.levels.back().size(), 1u);
+}
+
+
+TEST(Occlusion, CullsTheTable)
+{
+    const glm::mat4 view_projection = PROJECTION * glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const Square wall(0.0f, 0.0f, 3.0f);
+    DepthBuffer buffer;
+    Reset(buffer, 64, 64);
+    AddOccluder(buffer, Occluding(wall, view_projection));
+    Rasterize(buffer);
+
+    BoundsTable table;
+    Reset(table, 4);
+    Set(table, 0, Box({0.0f, 0.0f, -5.0f}, 1.0f), 2.0f);   // Behind the wall.
+    Set(table, 1, Box({0.0f, 0.0f,  5.0f}, 1.0f), 2.0f);   // In front of it.
+    Set(table, 2, Box({20.0f, 0.0f, -5.0f}, 1.0f), 2.0f);  // Behind it but beside it, and out of view.
+    Set(table, 3, Box({1.0f, 1.0f, -2.0f}, 0.5f), 1.0f);   // Behind it, but already culled.
+    std::vector<std::uint8_t> visible {1, 1, 1, 0};
+    EXPECT_EQ(CullOccluded(buffer, table, view_projection, visible), 1u);
+    EXPECT_EQ(visible, (std::vector<std::uint8_t> {0, 1, 1, 0}));
+}
@@ -0,0 +1,45 @@
+#include "opengl-stubs.h"
+
+
+static GLuint next_name;
+static int fence;  // Every fence is the address of this.
+
+
+void StubOpenGL()
+{
+    next_name = 1;
+
+    glad_glGetError = []() -> GLenum { return GL_NO_ERROR; };
+
+    // Buffers and vertex arrays.
+    glad_glGenBuffers = [](GLsizei count, GLuint* names) { for (GLsizei i = 0; i < count; ++i) names[i] = next_name++; };
+    glad_glGenVertexArrays = [](GLsizei count, GLuint* names) { for (GLsizei i = 0; i < count; ++i) names[i] = next_name++; };
+    glad_glDeleteBuffers = [](GLsizei, const GLuint*) {};
+    glad_glDeleteVertexArrays = [](GLsizei, const GLuint*) {};
+    glad_glBindBuffer = [](GLenum, GLuint) {};
+    glad_glBindVertexArray = [](GLuint) {};
+    glad_glBufferData = [](GLenum, GLsizeiptr, const void*, GLenum) {};
+    glad_glBufferSubData = [](GLenum, GLintptr, GLsizeiptr, const void*) {};
+    glad_glCopyBufferSubData = [](GLenum, GLenum, GLintptr, GLintptr, GLsizeiptr) {};
+    glad_glEnableVertexAttribArray = [](GLuint) {};
+    glad_glVertexAttribPointer = [](GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {};
+    glad_glVertexAttribDivisor = [](GLuint, GLuint) {};
+
+    // Synchronization. Fences are signaled as soon as they're made.
+    glad_glFenceSync = [](GLenum, GLbitfield) -> GLsync { return reinterpret_cast<GLsync>(&fence); };
+    glad_glClientWaitSync = [](GLsync, GLbitfield, GLuint64) -> GLenum { return GL_ALREADY_SIGNALED; };
+    glad_glDeleteSync = [](GLsync) {};
+
+    // Drawing.
+    glad_glDrawElementsInstancedBaseVertex = [](GLenum, GLsizei, GLenum, const void*, GLsizei, GLint) {};
+
+    // Textures.
+    glad_glGenTextures = [](GLsizei count, GLuint* names) { for (GLsizei i = 0; i < count; ++i) names[i] = next_name++; };
+    glad_glDeleteTextures = [](GLsizei, const GLuint*) {};
+    glad_glBindTexture = [](GLenum, GLuint) {};
+    glad_glTexParameteri = [](GLenum, GLenum, GLint) {};
+    glad_glPixelStorei = [](GLenum, GLint) {};
+    glad_glTexImage2D = [](GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {};
+    glad_glTexSubImage2D = [](GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*) {};
+    glad_glCompressedTexImage2D = [](GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void*) {};
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "opengl.h"
+
+
+// There's no OpenGL context in the tests, so the functions called by the code under test are replaced by ones that do
+// nothing and report no errors. Names are handed out counting up from 1. Tests that check the calls replace the
+// functions they're interested in after calling this.
+void StubOpenGL();
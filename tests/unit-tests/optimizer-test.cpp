@@ -0,0 +1,143 @@
+#include "optimizer.h"
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+
+// A grid of 'size' x 'size' vertices on a sphere-like bump, with its triangles shuffled.
+static void ShuffledGrid(unsigned size, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    vertices.clear();
+    indices.clear();
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+            vertices.push_back({glm::vec3(float(x), float(y), float(x * (size - x) + y * (size - y)) * 0.01f), glm::vec2(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)});
+
+    std::vector<std::array<GLuint, 3>> triangles;
+    for (unsigned y = 0; y + 1 < size; ++y)
+    {
+        for (unsigned x = 0; x + 1 < size; ++x)
+        {
+            const GLuint a = y * size + x, b = a + 1, c = a + size, d = c + 1;
+            triangles.push_back({a, b, d});
+            triangles.push_back({a, d, c});
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+    for (const auto& triangle : triangles)
+        indices.insert(indices.end(), triangle.begin(), triangle.end());
+}
+
+// The triangles as positions, with their first corner rotated to the front, so they compare across vertex orders.
+static std::vector<std::array<float, 9>> Triangles(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+    std::vector<std::array<float, 9>> triangles;
+    for (std::size_t i = 0; i < indices.size(); i += 3)
+    {
+        std::array<float, 9> triangle;
+        for (int c = 0; c < 3; ++c)
+            for (int k = 0; k < 3; ++k)
+                triangle[c * 3 + k] = vertices[indices[i + c]].position[k];
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+
+TEST(MeshOptimizer, AnalyzeVertexCache)
+{
+    // Two triangles sharing an edge: 4 vertices transformed for 2 triangles.
+    const GLuint quad[] = {0, 1, 2, 2, 1, 3};
+    VertexCacheStatistics statistics = AnalyzeVertexCache(quad, 6, 4);
+    EXPECT_EQ(statistics.acmr, 2.0f);
+    EXPECT_EQ(statistics.atvr, 1.0f);
+
+    // With a cache of 3, vertex 0 is evicted before it's used again.
+    const GLuint fan[] = {0, 1, 2, 3, 4, 5, 0, 1, 2};
+    EXPECT_EQ(AnalyzeVertexCache(fan, 9, 6, 3).acmr, 3.0f);
+}
+
+TEST(MeshOptimizer, ImprovesShuffledGrid)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    ShuffledGrid(64, vertices, indices);
+    const std::vector<std::array<float, 9>> before = Triangles(vertices, indices);
+
+    std::pair<VertexCacheStatistics, VertexCacheStatistics> statistics = OptimizeMesh(vertices, indices);
+
+    EXPECT_GT(statistics.first.acmr, 2.0f);
+    EXPECT_LT(statistics.second.acmr, 0.8f);
+    EXPECT_LT(statistics.second.atvr, 1.5f);
+    EXPECT_EQ(statistics.second.acmr, AnalyzeVertexCache(indices.data(), indices.size(), vertices.size()).acmr);
+
+    // The same triangles, with the same winding.
+    EXPECT_EQ(Triangles(vertices, indices), before);
+}
+
+TEST(MeshOptimizer, OverdrawStaysWithinThreshold)
+{
+    // A sphere, where the cluster order matters.
+    const unsigned size = 64;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    for (unsigned y = 0; y <= size; ++y)
+    {
+        for (unsigned x = 0; x <= size; ++x)
+        {
+            const float theta = 3.14159265f * y / size, phi = 6.28318531f * x / size;
+            vertices.push_back({glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)), glm::vec2(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)});
+        }
+    }
+    for (unsigned y = 0; y < size; ++y)
+    {
+        for (unsigned x = 0; x < size; ++x)
+        {
+            const GLuint a = y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            indices.insert(indices.end(), {a, d, b, a, c, d});
+        }
+    }
+
+    std::vector<GLuint> cache_order(indices.size());
+    OptimizeVertexCache(cache_order.data(), indices.data(), indices.size(), vertices.size());
+    std::vector<GLuint> overdraw_order = cache_order;
+    OptimizeOverdraw(overdraw_order.data(), overdraw_order.size(), vertices.data(), vertices.size(), 1.05f);
+
+    EXPECT_NE(overdraw_order, cache_order);
+    EXPECT_LE(AnalyzeVertexCache(overdraw_order.data(), overdraw_order.size(), vertices.size()).acmr,
+              AnalyzeVertexCache(cache_order.data(), cache_order.size(), vertices.size()).acmr * 1.05f);
+    EXPECT_EQ(Triangles(vertices, overdraw_order), Triangles(vertices, cache_order));
+}
+
+TEST(MeshOptimizer, VertexFetchFollowsFirstUse)
+{
+    std::vector<Vertex> vertices(5);
+    for (unsigned i = 0; i < 5; ++i)
+        vertices[i].position = glm::vec3(float(i));
+    std::vector<GLuint> indices = {3, 1, 4, 4, 1, 3};  // Vertices 0 and 2 are unused.
+
+    vertices.resize(OptimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertices.size()));
+
+    ASSERT_EQ(vertices.size(), 3);
+    EXPECT_EQ(indices, std::vector<GLuint>({0, 1, 2, 2, 1, 0}));
+    EXPECT_EQ(vertices[0].position, glm::vec3(3.0f));
+    EXPECT_EQ(vertices[1].position, glm::vec3(1.0f));
+    EXPECT_EQ(vertices[2].position, glm::vec3(4.0f));
+}
+
+TEST(MeshOptimizer, LeavesOtherPrimitivesAlone)
+{
+    std::vector<Vertex> vertices(3);
+    std::vector<GLuint> indices = {0, 1, 2, 2, 0};  // Ends with a line.
+
+    OptimizeMesh(vertices, indices);
+
+    EXPECT_EQ(indices, std::vector<GLuint>({0, 1, 2, 2, 0}));
+    EXPECT_EQ(vertices.size(), 3);
+}
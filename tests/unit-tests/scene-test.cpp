@@ -0,0 +1,80 @@
+#include "scene.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+static void ExpectNear(const glm::mat4& a, const glm::mat4& b)
+{
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row)
+            EXPECT_NEAR(a[column][row], b[column][row], 1e-5f);
+}
+
+
+TEST(Scene, TransformMatrix)
+{
+    const glm::vec3 position(1.0f, 2.0f, 3.0f), scale(2.0f, 3.0f, 4.0f);
+    const glm::quat rotation = glm::angleAxis(0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f)));
+
+    const glm::mat4 expected = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    ExpectNear(TransformMatrix(position, rotation, scale), expected);
+}
+
+
+TEST(Scene, OnlyDirtySubtreesAreUpdated)
+{
+    // root -> a -> b, and root -> c.
+    Scene scene;
+    const std::uint32_t root = AddNode(scene, NO_PARENT, glm::vec3(0.0f, 0.0f, -2.0f));
+    const std::uint32_t a = AddNode(scene, root, glm::vec3(1.0f, 0.0f, 0.0f), glm::angleAxis(1.0f, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const std::uint32_t b = AddNode(scene, a, glm::vec3(0.0f, 1.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(2.0f));
+    const std::uint32_t c = AddNode(scene, root, glm::vec3(0.0f, 0.0f, 5.0f));
+
+    EXPECT_EQ(UpdateTransforms(scene), 4u);
+    EXPECT_EQ(UpdateTransforms(scene), 0u);
+
+    auto local = [&](std::uint32_t node) { return TransformMatrix(scene.positions[node], scene.rotations[node], scene.scales[node]); };
+    ExpectNear(scene.worlds[b], local(root) * local(a) * local(b));
+    ExpectNear(scene.worlds[c], local(root) * local(c));
+
+    // Moving a only touches its subtree.
+    const glm::mat4 before = scene.worlds[c];
+    SetPosition(scene, a, glm::vec3(3.0f, 0.0f, 0.0f));
+    EXPECT_EQ(UpdateTransforms(scene), 2u);
+    ExpectNear(scene.worlds[b], local(root) * local(a) * local(b));
+    EXPECT_EQ(scene.worlds[c], before);
+
+    // Rotating the root moves everything.
+    SetRotation(scene, root, glm::angleAxis(0.5f, glm::vec3(0.0f, 0.0f, 1.0f)));
+    SetScale(scene, root, glm::vec3(0.5f));
+    EXPECT_EQ(UpdateTransforms(scene), 4u);
+    ExpectNear(scene.worlds[b], local(root) * local(a) * local(b));
+    ExpectNear(scene.worlds[c], local(root) * local(c));
+}
+
+
+TEST(Scene, AddModel)
+{
+    TexturedModel model;
+    model.nodes = {
+        {NO_PARENT, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+        {0, glm::vec3(1.0f, 0.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+        {1, glm::vec3(0.0f, 1.0f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)},
+    };
+
+    Scene scene;
+    const std::uint32_t root  = AddNode(scene, NO_PARENT, glm::vec3(0.0f, 0.0f, 1.0f));
+    const std::uint32_t first = AddModel(scene, model, root);
+    EXPECT_EQ(first, 1u);
+    EXPECT_EQ(scene.parents[first], root);
+    EXPECT_EQ(scene.parents[first + 2], first + 1);
+
+    UpdateTransforms(scene);
+    EXPECT_EQ(glm::vec3(scene.worlds[first + 2][3]), glm::vec3(1.0f, 1.0f, 1.0f));
+
+    // A model without nodes gets one, for all its meshes.
+    EXPECT_EQ(AddModel(scene, TexturedModel {}, root), 4u);
+    EXPECT_EQ(scene.parents.size(), 5u);
+}
@@ -0,0 +1,156 @@
+#include "simplifier.h"
+
+#include <vector>
+#include <set>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+
+// A flat grid of 'size' x 'size' vertices in [0, 1], split down the middle (x = 0.5) by a texture seam when 'seam' is
+// set: the vertices on it are duplicated with different texture coordinates.
+static void Grid(unsigned size, bool seam, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    vertices.clear();
+    indices.clear();
+    const unsigned middle = size / 2;
+    std::vector<GLuint> left(size * size), right(size * size);
+    for (unsigned y = 0; y < size; ++y)
+    {
+        for (unsigned x = 0; x < size; ++x)
+        {
+            const glm::vec3 position(float(x) / (size - 1), float(y) / (size - 1), 0.0f);
+            left[y * size + x] = right[y * size + x] = static_cast<GLuint>(vertices.size());
+            vertices.push_back({position, glm::vec2(position), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f), glm::vec3(0.0f)});
+            if (seam && x == middle)
+            {
+                right[y * size + x] = static_cast<GLuint>(vertices.size());
+                vertices.push_back({position, glm::vec2(position) + glm::vec2(1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f), glm::vec3(0.0f)});
+            }
+        }
+    }
+    for (unsigned y = 0; y + 1 < size; ++y)
+    {
+        for (unsigned x = 0; x + 1 < size; ++x)
+        {
+            const std::vector<GLuint>& side = x < middle ? left : right;
+            const GLuint a = side[y * size + x], b = side[y * size + x + 1], c = side[(y + 1) * size + x], d = side[(y + 1) * size + x + 1];
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+        }
+    }
+}
+
+static float Area(const std::vector<Vertex>& vertices, const GLuint* indices, std::size_t index_count)
+{
+    float area = 0.0f;
+    for (std::size_t i = 0; i < index_count; i += 3)
+    {
+        const glm::vec3 a = vertices[indices[i]].position, b = vertices[indices[i + 1]].position, c = vertices[indices[i + 2]].position;
+        area += glm::cross(b - a, c - a).z * 0.5f;  // Signed, so flipped triangles would show.
+    }
+    return area;
+}
+
+
+TEST(Simplifier, FlatGridKeepsItsShape)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    Grid(33, false, vertices, indices);
+
+    float error = -1.0f;
+    const std::vector<GLuint> simplified = Simplify(vertices.data(), vertices.size(), indices.data(), indices.size(), indices.size() / 8, 0.01f, &error);
+
+    // A plane simplifies without error, so it reaches the target.
+    EXPECT_LE(simplified.size(), indices.size() / 8);
+    EXPECT_GT(simplified.size(), 0u);
+    EXPECT_NEAR(error, 0.0f, 1e-4f);
+    EXPECT_NEAR(Area(vertices, simplified.data(), simplified.size()), 1.0f, 1e-4f);
+
+    // The corners are still used.
+    const std::set<GLuint> used(simplified.begin(), simplified.end());
+    for (GLuint corner : {0u, 32u, 33u * 32u, 33u * 33u - 1u})
+        EXPECT_EQ(used.count(corner), 1u);
+}
+
+TEST(Simplifier, SeamsStayClosed)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    Grid(17, true, vertices, indices);
+
+    const std::vector<GLuint> simplified = Simplify(vertices.data(), vertices.size(), indices.data(), indices.size(), 0, 0.01f);
+    EXPECT_LT(simplified.size(), indices.size() / 4);
+    EXPECT_NEAR(Area(vertices, simplified.data(), simplified.size()), 1.0f, 1e-4f);
+
+    // Every triangle stays on its side of the seam, and uses that side's vertices on it.
+    for (std::size_t i = 0; i < simplified.size(); i += 3)
+    {
+        float x = 0.0f;
+        for (int c = 0; c < 3; ++c)
+            x += vertices[simplified[i + c]].position.x;
+        const bool right = x > 1.5f;
+        for (int c = 0; c < 3; ++c)
+        {
+            const Vertex& vertex = vertices[simplified[i + c]];
+            EXPECT_TRUE(right ? vertex.position.x >= 0.5f : vertex.position.x <= 0.5f);
+            if (vertex.position.x == 0.5f)
+            {
+                EXPECT_EQ(vertex.texture_coordinate.x, right ? 1.5f : 0.5f);
+            }
+        }
+    }
+}
+
+TEST(Simplifier, GenerateLods)
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    Grid(65, true, vertices, indices);
+    // Bend the grid, so the LODs have some error.
+    for (Vertex& vertex : vertices)
+        vertex.position.z = 0.25f * std::sin(vertex.position.x * 6.0f) * std::cos(vertex.position.y * 5.0f);
+    const std::size_t full = indices.size();
+
+    const std::vector<MeshLod> lods = GenerateLods(vertices, indices);
+    ASSERT_GT(lods.size(), 2u);
+    ASSERT_LE(lods.size(), MAX_LODS);
+    EXPECT_EQ(lods[0].offset, 0u);
+    EXPECT_EQ(lods[0].count, full);
+    EXPECT_EQ(lods[0].error, 0.0f);
+
+    for (std::size_t i = 1; i < lods.size(); ++i)
+    {
+        EXPECT_EQ(lods[i].offset, lods[i - 1].offset + lods[i - 1].count);
+        EXPECT_LT(lods[i].count, lods[i - 1].count);
+        EXPECT_EQ(lods[i].count % 3, 0u);
+        EXPECT_GE(lods[i].error, lods[i - 1].error);
+    }
+    EXPECT_EQ(indices.size(), lods.back().offset + lods.back().count);
+    for (GLuint index : indices)
+        EXPECT_LT(index, vertices.size());
+}
+
+TEST(Simplifier, SelectLod)
+{
+    Mesh mesh {};
+    mesh.bounds = {glm::vec3(-1.0f), glm::vec3(1.0f)};
+    mesh.lod_count = 3;
+    mesh.lods[0] = {0, 300, 0.0f};
+    mesh.lods[1] = {300, 150, 0.01f};
+    mesh.lods[2] = {450, 75, 0.1f};
+
+    const glm::mat4 model(1.0f);
+    const float scale = 700.0f;
+
+    // Inside the bounds, or close, only the full mesh is good enough.
+    EXPECT_EQ(SelectLod(mesh, model, glm::vec3(0.0f), scale, 1.0f), 0u);
+    EXPECT_EQ(SelectLod(mesh, model, glm::vec3(0.0f, 0.0f, 5.0f), scale, 1.0f), 0u);
+    // Further away the coarser levels are.
+    EXPECT_EQ(SelectLod(mesh, model, glm::vec3(0.0f, 0.0f, 20.0f), scale, 1.0f), 1u);
+    EXPECT_EQ(SelectLod(mesh, model, glm::vec3(0.0f, 0.0f, 200.0f), scale, 1.0f), 2u);
+    // Scaling the model up brings the errors closer.
+    EXPECT_EQ(SelectLod(mesh, glm::scale(model, glm::vec3(4.0f)), glm::vec3(0.0f, 0.0f, 200.0f), scale, 1.0f), 1u);
+}
@@ -0,0 +1,213 @@
+#include "streaming.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "loader.h"
+#include "opengl-stubs.h"
+
+
+// The textures are simulated in memory, with the uploads to them and their base level recorded.
+struct TextureUpload
+{
+    GLuint texture;
+    GLint level;
+    GLint row;
+    GLsizei rows;
+    bool from_buffer;
+};
+
+static std::map<GLuint, std::vector<std::vector<unsigned char>>> textures;  // RGBA levels of every texture.
+static std::map<GLuint, std::vector<GLint>> base_levels;                    // Every base level set, in order.
+static std::vector<TextureUpload> uploads;
+static std::map<GLuint, std::vector<unsigned char>> buffer_memory;
+static GLuint bound_texture, bound_unpack_buffer;
+
+static void SimulateTextures()
+{
+    textures.clear();
+    base_levels.clear();
+    uploads.clear();
+    buffer_memory.clear();
+    bound_texture = bound_unpack_buffer = 0;
+
+    StubOpenGL();
+    glad_glBindTexture = [](GLenum, GLuint texture) { bound_texture = texture; };
+    glad_glBindBuffer = [](GLenum target, GLuint buffer)
+    {
+        if (target == GL_PIXEL_UNPACK_BUFFER)
+            bound_unpack_buffer = buffer;
+    };
+    glad_glMapBufferRange = [](GLenum, GLintptr, GLsizeiptr length, GLbitfield) -> void*
+    {
+        std::vector<unsigned char>& memory = buffer_memory[bound_unpack_buffer];
+        memory.assign(length, 0);
+        return memory.data();
+    };
+    glad_glUnmapBuffer = [](GLenum) -> GLboolean { return GL_TRUE; };
+    glad_glTexImage2D = [](GLenum, GLint level, GLint, GLsizei width, GLsizei height, GLint, GLenum, GLenum, const void*)
+    {
+        std::vector<std::vector<unsigned char>>& levels = textures[bound_texture];
+        levels.resize(std::max<std::size_t>(levels.size(), level + 1));
+        levels[level].assign(std::size_t(width) * height * 4, 0);
+    };
+    glad_glTexSubImage2D = [](GLenum, GLint level, GLint, GLint y, GLsizei width, GLsizei height, GLenum, GLenum, const void* pixels)
+    {
+        // From the start of the bound buffer, which is what the streamer passes, or from client memory.
+        const unsigned char* source = bound_unpack_buffer ? buffer_memory[bound_unpack_buffer].data() : static_cast<const unsigned char*>(pixels);
+        std::vector<unsigned char>& destination = textures[bound_texture][level];
+        const std::size_t row_bytes = std::size_t(width) * 4;
+        ASSERT_LE((y + height) * row_bytes, destination.size());
+        std::memcpy(destination.data() + y * row_bytes, source, height * row_bytes);
+        uploads.push_back({bound_texture, level, y, height, bound_unpack_buffer != 0});
+    };
+    glad_glTexParameteri = [](GLenum, GLenum name, GLint value)
+    {
+        if (name == GL_TEXTURE_BASE_LEVEL)
+            base_levels[bound_texture].push_back(value);
+    };
+}
+
+// An RGBA image of 'width' by 'height' pixels with its mip chain, every byte different from its neighbors.
+static std::shared_ptr<ImageRequest> CookedRequest(int width, int height, std::promise<void>& decoded)
+{
+    auto request = std::make_shared<ImageRequest>();
+    request->decoded = decoded.get_future().share();
+
+    CookedImage& image = request->cooked;
+    image.components = 4;
+    while (true)
+    {
+        const std::size_t size = std::size_t(width) * height * 4;
+        image.levels.push_back({width, height, image.data.size(), size});
+        for (std::size_t i = 0; i < size; ++i)
+            image.data.push_back(static_cast<unsigned char>(image.data.size() * 7 + 3));
+        if (width == 1 && height == 1)
+            break;
+        width  = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return request;
+}
+
+static std::vector<unsigned char> Level(const CookedImage& image, std::size_t level)
+{
+    const unsigned char* begin = image.data.data() + image.levels[level].offset;
+    return std::vector<unsigned char>(begin, begin + image.levels[level].size);
+}
+
+
+TEST(TextureStreamer, UploadsFromTheSmallestLevelWithinTheBudget)
+{
+    SimulateTextures();
+
+    TextureStreamer streamer;
+    Create(streamer, 2, 1024);
+    streamer.bytes_per_frame = 1024;
+    streamer.milliseconds_per_frame = 1e6f;  // Only the bytes count.
+
+    std::promise<void> decoded;
+    std::shared_ptr<ImageRequest> request = CookedRequest(64, 32, decoded);
+    decoded.set_value();
+    const CookedImage& image = request->cooked;
+    const GLuint texture = StreamTexture(streamer, request);
+
+    // Every frame uploads something, but no more than the budget, until the texture is done.
+    unsigned frames = 0;
+    std::size_t total = 0;
+    while (!streamer.uploads.empty())
+    {
+        Update(streamer);
+        EXPECT_GT(streamer.bytes_last_frame, 0u);
+        EXPECT_LE(streamer.bytes_last_frame, streamer.bytes_per_frame);
+        total += streamer.bytes_last_frame;
+        ASSERT_LT(++frames, 100u);
+    }
+    EXPECT_EQ(total, image.data.size());
+    EXPECT_GE(frames, (image.data.size() + 1023) / 1024);
+
+    // The levels are uploaded from the smallest up, every one from its first row to its last.
+    GLint level = static_cast<GLint>(image.levels.size() - 1);
+    GLint row = 0;
+    for (const TextureUpload& upload : uploads)
+    {
+        EXPECT_EQ(upload.texture, texture);
+        EXPECT_TRUE(upload.from_buffer);
+        if (upload.level != level)
+        {
+            EXPECT_EQ(row, image.levels[level].height);
+            EXPECT_EQ(upload.level, level - 1);
+            level = upload.level;
+            row = 0;
+        }
+        EXPECT_EQ(upload.row, row);
+        row += upload.rows;
+    }
+    EXPECT_EQ(level, 0);
+    EXPECT_EQ(row, image.levels[0].height);
+
+    // It's sampled from every level as soon as that's in, and ends up with the whole image.
+    std::vector<GLint> expected_base_levels;
+    for (GLint l = static_cast<GLint>(image.levels.size() - 1); l >= 0; --l)
+        expected_base_levels.push_back(l);
+    expected_base_levels.insert(expected_base_levels.begin(), expected_base_levels.front());  // Set when allocated.
+    EXPECT_EQ(base_levels[texture], expected_base_levels);
+    ASSERT_EQ(textures[texture].size(), image.levels.size());
+    for (std::size_t l = 0; l < image.levels.size(); ++l)
+        EXPECT_EQ(textures[texture][l], Level(image, l)) << l;
+
+    Destroy(streamer);
+}
+
+
+TEST(TextureStreamer, SkipsImagesStillDecodingAndWaitsForFullRings)
+{
+    SimulateTextures();
+
+    TextureStreamer streamer;
+    Create(streamer, 2, 256);
+    streamer.bytes_per_frame = 1 << 20;
+    streamer.milliseconds_per_frame = 1e6f;
+
+    std::promise<void> first_decoded, second_decoded;
+    std::shared_ptr<ImageRequest> first  = CookedRequest(8, 8, first_decoded);
+    std::shared_ptr<ImageRequest> second = CookedRequest(8, 8, second_decoded);
+    const GLuint first_texture  = StreamTexture(streamer, first);
+    const GLuint second_texture = StreamTexture(streamer, second);
+
+    // Nothing is decoded yet.
+    Update(streamer);
+    EXPECT_EQ(streamer.bytes_last_frame, 0u);
+    EXPECT_TRUE(uploads.empty());
+
+    // The second image is decoded first, so it's uploaded past the first.
+    second_decoded.set_value();
+    Update(streamer);
+    EXPECT_EQ(streamer.bytes_last_frame, second->cooked.data.size());
+    ASSERT_EQ(streamer.uploads.size(), 1u);
+    EXPECT_EQ(streamer.uploads.front().texture, first_texture);
+    for (const TextureUpload& upload : uploads)
+        EXPECT_EQ(upload.texture, second_texture);
+
+    // While the GPU hasn't consumed the buffers, no more than the ring is written.
+    glad_glClientWaitSync = [](GLsync, GLbitfield, GLuint64) -> GLenum { return GL_TIMEOUT_EXPIRED; };
+    first_decoded.set_value();
+    uploads.clear();
+    Update(streamer);
+    EXPECT_EQ(uploads.size(), 0u);
+    EXPECT_EQ(streamer.uploads.size(), 1u);
+
+    glad_glClientWaitSync = [](GLsync, GLbitfield, GLuint64) -> GLenum { return GL_ALREADY_SIGNALED; };
+    Update(streamer);
+    EXPECT_TRUE(streamer.uploads.empty());
+    for (std::size_t l = 0; l < first->cooked.levels.size(); ++l)
+        EXPECT_EQ(textures[first_texture][l], Level(first->cooked, l)) << l;
+
+    Destroy(streamer);
+}
@@ -0,0 +1,120 @@
+#include "textures.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+#include "loader.h"
+#include "compression.h"
+#include "utilities.h"
+#include "opengl-stubs.h"
+
+
+// The textures the cache deletes.
+static std::vector<GLuint> deleted;
+
+static void RecordDeletes()
+{
+    StubOpenGL();
+    glad_glDeleteTextures = [](GLsizei count, const GLuint* textures) { deleted.insert(deleted.end(), textures, textures + count); };
+    deleted.clear();
+}
+
+
+TEST(TextureCache, SameContentIsShared)
+{
+    TextureCache cache;
+    EXPECT_EQ(Acquire(cache, 42), 0);
+    Insert(cache, 42, 7, 100, "textures/Body.png");
+
+    EXPECT_EQ(Acquire(cache, 42), 7);
+    EXPECT_EQ(cache.entries[42].references, 2);
+    EXPECT_EQ(cache.hits, 1);
+    EXPECT_EQ(cache.misses, 1);
+    EXPECT_EQ(cache.resident, 100);
+}
+
+
+TEST(TextureCache, EvictsLeastRecentlyUsedUnreferenced)
+{
+    RecordDeletes();
+
+    TextureCache cache;
+    cache.budget = 150;
+    Insert(cache, 1, 11, 100, "a.png");
+    Insert(cache, 2, 12, 100, "b.png");
+    Insert(cache, 3, 13, 100, "c.png");
+    Acquire(cache, 1);  // Now used more recently than 2.
+
+    // Everything is referenced, so nothing can be evicted.
+    Evict(cache);
+    EXPECT_TRUE(deleted.empty());
+
+    Release(cache, 1);
+    Release(cache, 1);
+    Release(cache, 2);
+    Release(cache, 3);
+    Evict(cache);
+
+    EXPECT_EQ(deleted, std::vector<GLuint>({12, 13}));
+    EXPECT_EQ(cache.resident, 100);
+    EXPECT_EQ(cache.evictions, 2);
+    EXPECT_EQ(Acquire(cache, 1), 11);
+}
+
+
+TEST(TextureCache, ReleaseModel)
+{
+    TextureCache cache;
+    Insert(cache, 1, 11, 100, "a.png");
+    Acquire(cache, 1);
+
+    TexturedModel model;
+    model.meshes.push_back({Mesh {}, {{11, "texture_diffuse", 1}}});
+    model.meshes.push_back({Mesh {}, {{11, "texture_normal", 1}, {0, "texture_height", 0}}});
+    Release(cache, model);
+
+    EXPECT_EQ(cache.entries[1].references, 0);
+}
+
+
+TEST(TextureCache, SameFileInColorAndDataRolesIsNotShared)
+{
+    texture_cache_directory = "textures-test-cache";
+    const unsigned supported = supported_block_formats;
+    supported_block_formats = (1u << UNCOMPRESSED) | (1u << BC1);
+
+    // Opaque, so both roles are BC1, but with mips filtered in sRGB for the diffuse map and linearly for the specular.
+    const std::string path = "textures-test.ppm";
+    std::string content = "P6\n8 8\n255\n";
+    for (int i = 0; i < 8 * 8 * 3; ++i)
+        content += static_cast<char>((i * 37) & 0xFF);
+    std::ofstream(path, std::ios::binary) << content;
+    const unsigned long long content_key = ContentHash(content.data(), content.size());
+
+    // Looked up in the cache like LoadTextures does.
+    TextureCache cache;
+    std::vector<unsigned long long> keys;
+    for (const char* type : {"texture_diffuse", "texture_specular"})
+    {
+        std::shared_ptr<ImageRequest> request = RequestImage(path, type);
+        request->decoded.wait();
+        EXPECT_EQ(request->cooked.format, BC1);
+        if (Acquire(cache, request->key) == 0)
+            Insert(cache, request->key, static_cast<GLuint>(keys.size() + 1), request->cooked.data.size(), path);
+        keys.push_back(request->key);
+        std::remove(CookedTexturePath(content_key, type).c_str());
+    }
+
+    EXPECT_NE(keys[0], keys[1]);
+    EXPECT_EQ(cache.entries.size(), 2u);
+    EXPECT_EQ(cache.hits, 0u);
+
+    std::remove(path.c_str());
+    EXPECT_TRUE(RemoveEmptyDirectory(texture_cache_directory));
+    supported_block_formats = supported;
+    texture_cache_directory = ".naxcache";
+}
@@ -0,0 +1,86 @@
+#include "threading.h"
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+
+TEST(ParallelFor, CallsEveryIndexOnce)
+{
+    std::vector<std::atomic<unsigned>> calls(1000);
+    for (auto& count : calls)
+        count = 0;
+
+    ParallelFor(static_cast<unsigned>(calls.size()), 4, [&](unsigned i) { ++calls[i]; });
+
+    for (const auto& count : calls)
+        EXPECT_EQ(count, 1);
+}
+
+
+TEST(WorkerPool, RunsAllJobsBeforeStopping)
+{
+    WorkerPool pool;
+    Start(pool, 3);
+
+    std::atomic<unsigned> sum {0};
+    for (unsigned i = 1; i <= 100; ++i)
+        Submit(pool, [&sum, i]() { sum += i; });
+
+    Stop(pool);
+    EXPECT_EQ(sum, 5050);
+    EXPECT_TRUE(pool.threads.empty());
+}
+
+
+TEST(ParallelFor, OnPoolFromItsOwnThread)
+{
+    WorkerPool pool;
+    Start(pool, 1);
+
+    std::vector<std::atomic<unsigned>> calls(1000);
+    for (auto& count : calls)
+        count = 0;
+    ParallelFor(pool, static_cast<unsigned>(calls.size()), 4, [&](unsigned i) { ++calls[i]; });
+    for (const auto& count : calls)
+        EXPECT_EQ(count, 1);
+
+    // From the pool's only thread its other jobs can't start until it's done, so it does everything itself.
+    std::atomic<unsigned> sum {0};
+    Submit(pool, [&]() { ParallelFor(pool, 100, 4, [&sum](unsigned i) { sum += i; }); });
+    Stop(pool);
+    EXPECT_EQ(sum, 4950);
+}
+
+
+TEST(ParallelFor, KnowsWhenOnWorkerThreads)
+{
+    EXPECT_FALSE(OnWorkerThread());
+
+    std::atomic<unsigned> on_workers {0};
+    ParallelFor(100, 4, [&](unsigned) { on_workers += OnWorkerThread(); });
+    EXPECT_EQ(on_workers, 100);
+    EXPECT_FALSE(OnWorkerThread());
+
+    // Run on the calling thread alone it's not spread over threads.
+    ParallelFor(10, 1, [](unsigned) { EXPECT_FALSE(OnWorkerThread()); });
+
+    WorkerPool pool;
+    Start(pool, 2);
+    Submit(pool, [&]() { on_workers += OnWorkerThread(); });
+    Stop(pool);
+    EXPECT_EQ(on_workers, 101);
+}
+
+
+TEST(ParallelFor, ThreadsForSizeAndWorkerThreads)
+{
+    EXPECT_EQ(ThreadsFor(100, 1000), 1u);
+    EXPECT_EQ(ThreadsFor(1000, 1000), 0u);
+
+    // Work nested on a worker thread stays on it.
+    std::atomic<unsigned> nested {0};
+    ParallelFor(8, 4, [&](unsigned) { nested += ThreadsFor(1000, 1000); });
+    EXPECT_EQ(nested, 8);
+}
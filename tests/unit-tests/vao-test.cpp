@@ -0,0 +1,91 @@
+#include "vao.h"
+
+#include <vector>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <gtest/gtest.h>
+
+
+static std::vector<Vertex> TestVertices()
+{
+    std::vector<Vertex> vertices;
+    for (int i = 0; i < 64; ++i)
+    {
+        const float angle = i * 0.1f;
+        Vertex vertex;
+        vertex.position = glm::vec3(-3.0f + i * 0.25f, std::sin(angle) * 2.0f, 5.0f);
+        vertex.texture_coordinate = glm::vec2(i / 64.0f, 1.0f - i / 128.0f);
+        vertex.normal    = glm::normalize(glm::vec3(std::cos(angle), std::sin(angle), 0.5f));
+        vertex.tangent   = glm::normalize(glm::cross(vertex.normal, glm::vec3(0.0f, 0.0f, 1.0f)));
+        vertex.bitangent = glm::cross(vertex.normal, vertex.tangent) * (i % 2 ? -1.0f : 1.0f);
+        vertices.push_back(vertex);
+    }
+    return vertices;
+}
+
+
+TEST(VertexFormat, Sizes)
+{
+    EXPECT_EQ(VertexSize(FULL), 56);
+    EXPECT_EQ(VertexSize(COMPACT), 24);
+    EXPECT_EQ(VertexSize(QUANTIZED), 20);
+
+    glm::vec3 scale, offset;
+    EXPECT_EQ(EncodeVertices(TestVertices().data(), 64, QUANTIZED, scale, offset).size(), 64 * 20);
+}
+
+TEST(VertexFormat, CompactRoundTrip)
+{
+    std::vector<Vertex> vertices = TestVertices();
+    glm::vec3 scale, offset;
+    std::vector<unsigned char> encoded = EncodeVertices(vertices.data(), vertices.size(), COMPACT, scale, offset);
+    EXPECT_EQ(scale, glm::vec3(1.0f));
+    EXPECT_EQ(offset, glm::vec3(0.0f));
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        CompactVertex vertex;
+        std::memcpy(&vertex, &encoded[i * sizeof(CompactVertex)], sizeof(vertex));
+        std::uint32_t texture_coordinate;
+        std::memcpy(&texture_coordinate, vertex.texture_coordinate, sizeof(texture_coordinate));
+
+        EXPECT_EQ(vertex.position, vertices[i].position);
+        EXPECT_LT(glm::length(glm::unpackHalf2x16(texture_coordinate) - vertices[i].texture_coordinate), 1e-3f);
+
+        const glm::vec4 normal  = glm::unpackSnorm3x10_1x2(vertex.normal);
+        const glm::vec4 tangent = glm::unpackSnorm3x10_1x2(vertex.tangent);
+        EXPECT_LT(glm::length(glm::vec3(normal) - vertices[i].normal), 4e-3f);
+        EXPECT_LT(glm::length(glm::vec3(tangent) - vertices[i].tangent), 4e-3f);
+
+        // The bitangent is reconstructed from the sign.
+        const glm::vec3 bitangent = glm::cross(glm::vec3(normal), glm::vec3(tangent)) * tangent.w;
+        EXPECT_LT(glm::length(bitangent - vertices[i].bitangent), 1e-2f) << i;
+    }
+}
+
+TEST(VertexFormat, QuantizedPositions)
+{
+    std::vector<Vertex> vertices = TestVertices();
+    glm::vec3 scale, offset;
+    std::vector<unsigned char> encoded = EncodeVertices(vertices.data(), vertices.size(), QUANTIZED, scale, offset);
+
+    // The z axis is flat, so it's all in the offset.
+    EXPECT_EQ(offset.x, -3.0f);
+    EXPECT_EQ(scale.z, 0.0f);
+    EXPECT_EQ(offset.z, 5.0f);
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        QuantizedVertex vertex;
+        std::memcpy(&vertex, &encoded[i * sizeof(QuantizedVertex)], sizeof(vertex));
+        glm::uint64 packed;
+        std::memcpy(&packed, vertex.position, sizeof(packed));
+
+        const glm::vec3 position = glm::vec3(glm::unpackUnorm4x16(packed)) * scale + offset;
+        // Within half a step of 16 bits on every axis.
+        EXPECT_LE(glm::length(position - vertices[i].position), glm::length(scale) / 65535.0f * 0.5f + 1e-6f);
+    }
+}